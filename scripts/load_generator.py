@@ -11,6 +11,7 @@ import ipdb
 import itertools
 import json
 import logging
+import multiprocessing
 import os
 import random
 import re
@@ -148,6 +149,9 @@ SENSOR_IP      = '192.168.1.7'
 SENSOR_PORT    = 514
 SENSOR_ADDRESS = (SENSOR_IP, SENSOR_PORT)
 
+SENSOR_TCP_PORT    = 601
+SENSOR_TCP_ADDRESS = (SENSOR_IP, SENSOR_TCP_PORT)
+
 def send_combined_logs():
     udp_socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
     udp_socket.connect(SENSOR_ADDRESS)
@@ -166,6 +170,51 @@ def send_combined_logs():
     rate    = float(counter) / elapsed
     print '%09d logs in %09.3d secs. or %010.3d logs / sec.' % (counter, elapsed, rate)
 
+# one short-lived syslog-over-TCP connection per iteration,
+# with each source port landing on whichever lcore RSS picks
+def tcp_churn_worker(seconds, messages_per_connection, results):
+    connections = 0
+    failures    = 0
+    deadline    = time.time() + seconds
+    logs        = itertools.cycle(combined_logs)
+
+    while time.time() < deadline:
+        try:
+            tcp_socket = socket.create_connection(SENSOR_TCP_ADDRESS, timeout=1.0)
+            for i in xrange(0, messages_per_connection):
+                message = '<13>' + next(logs)
+                tcp_socket.sendall('%d %s' % (len(message), message))
+            tcp_socket.close()
+            connections += 1
+        except socket.error as e:
+            failures += 1
+
+    results.put((connections, failures))
+
+# run the sensor with increasing lcore masks and compare connections / sec.
+def send_tcp_churn(workers, seconds, messages_per_connection):
+    results   = multiprocessing.Queue()
+    processes = [
+        multiprocessing.Process(target=tcp_churn_worker, args=(seconds, messages_per_connection, results))
+        for i in xrange(0, workers)
+    ]
+
+    for process in processes:
+        process.start()
+    for process in processes:
+        process.join()
+
+    connections = 0
+    failures    = 0
+    for process in processes:
+        worker_connections, worker_failures = results.get()
+        connections += worker_connections
+        failures    += worker_failures
+
+    rate = float(connections) / seconds
+    print '%09d connections %06d failures in %03d secs. or %010.3f connections / sec.' % \
+        (connections, failures, seconds, rate)
+
 def main(argv=None):
     if argv is None:
         argv = sys.argv
@@ -173,7 +222,13 @@ def main(argv=None):
     load_matching_rows()
     load_filler_rows()
     load_combined_logs()
-    send_combined_logs()
+    if len(argv) > 1 and argv[1] == 'tcp_churn':
+        workers  = int(argv[2]) if len(argv) > 2 else multiprocessing.cpu_count()
+        seconds  = int(argv[3]) if len(argv) > 3 else 30
+        messages = int(argv[4]) if len(argv) > 4 else 4
+        send_tcp_churn(workers, seconds, messages)
+    else:
+        send_combined_logs()
 
 if __name__ == "__main__":
     sys.exit(main())
@@ -1,33 +1,82 @@
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
+
+#include <emmintrin.h>
 
 #include "checksum.h"
 
-uint16_t ss_in_cksum(uint16_t* data, size_t len) {
-    register int sum      = 0;
-    uint16_t answer       = 0;
-    register uint16_t* w  = data;
-    register size_t nleft = len;
-
-    /*
-     * Our algorithm is simple, using a 32 bit accumulator (sum), we add
-     * sequential 16 bit words to it, and at the end, fold back all the
-     * carry bits from the top 16 bits into the lower 16 bits.
-     */
-    while (nleft > 1) {
-        sum += *w++;
-        nleft -= 2;
+/*
+ * SSE2 body: widen each 32-bit lane to 64 bits and accumulate, so nothing
+ * can carry out until 2^32 blocks have been added. Returns the bytes used.
+ */
+static size_t ss_cksum_add_sse2(uint64_t* sum, const uint8_t* data, size_t len) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    __m128i block0, block1;
+    uint64_t lanes[2];
+    size_t i = 0;
+
+    for (; i + 2 * sizeof(__m128i) <= len; i += 2 * sizeof(__m128i)) {
+        block0 = _mm_loadu_si128((const __m128i*) (data + i));
+        block1 = _mm_loadu_si128((const __m128i*) (data + i + sizeof(__m128i)));
+        acc0   = _mm_add_epi64(acc0, _mm_unpacklo_epi32(block0, zero));
+        acc1   = _mm_add_epi64(acc1, _mm_unpackhi_epi32(block0, zero));
+        acc0   = _mm_add_epi64(acc0, _mm_unpacklo_epi32(block1, zero));
+        acc1   = _mm_add_epi64(acc1, _mm_unpackhi_epi32(block1, zero));
     }
 
-    /* mop up an odd byte, if necessary */
-    if (nleft == 1) {
-        *(uint8_t*)(&answer) = *(uint8_t*) w;
-        sum += answer;
+    _mm_storeu_si128((__m128i*) lanes, _mm_add_epi64(acc0, acc1));
+    *sum = ss_cksum_add64(*sum, lanes[0]);
+    *sum = ss_cksum_add64(*sum, lanes[1]);
+
+    return i;
+}
+
+/*
+ * Add len bytes to an unfolded one's complement sum, see checksum.h.
+ * Short buffers (headers, bare ACKs) stay on the 64-bit scalar path.
+ */
+uint64_t ss_cksum_add(uint64_t sum, const void* data, size_t len) {
+    const uint8_t* ptr = (const uint8_t*) data;
+    uint64_t word;
+    uint32_t half;
+    uint16_t quarter;
+    size_t used;
+
+    if (len >= 256) {
+        used = ss_cksum_add_sse2(&sum, ptr, len);
+        ptr += used;
+        len -= used;
     }
 
-    /* add back carry outs from top 16 bits to low 16 bits */
-    sum = (sum >> 16) + (sum & 0xffff); /* add hi 16 to low 16 */
-    sum += (sum >> 16);                 /* add carry */
-    answer = (uint16_t) ~sum;           /* truncate to 16 bits */
-    return answer;
+    for (; len >= sizeof(word); ptr += sizeof(word), len -= sizeof(word)) {
+        memcpy(&word, ptr, sizeof(word));
+        sum = ss_cksum_add64(sum, word);
+    }
+    if (len >= sizeof(half)) {
+        memcpy(&half, ptr, sizeof(half));
+        sum = ss_cksum_add64(sum, half);
+        ptr += sizeof(half);
+        len -= sizeof(half);
+    }
+    if (len >= sizeof(quarter)) {
+        memcpy(&quarter, ptr, sizeof(quarter));
+        sum = ss_cksum_add64(sum, quarter);
+        ptr += sizeof(quarter);
+        len -= sizeof(quarter);
+    }
+    if (len) {
+        // mop up an odd byte as the first byte of a zero-padded word
+        quarter = 0;
+        *(uint8_t*) &quarter = *ptr;
+        sum = ss_cksum_add64(sum, quarter);
+    }
+
+    return sum;
+}
+
+uint16_t ss_in_cksum(uint16_t* data, size_t len) {
+    return (uint16_t) ~ss_cksum_fold(ss_cksum_add(0, data, len));
 }
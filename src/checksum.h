@@ -3,8 +3,68 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <rte_byteorder.h>
+
+/*
+ * Internet checksum helpers (RFC 1071, RFC 1624).
+ *
+ * Sums are kept unfolded in a 64-bit accumulator in memory byte order, so
+ * the partial sum of a pseudo-header, a header and a payload can be chained
+ * with ss_cksum_add as long as every piece after the first starts at an even
+ * offset in the checksummed data. Fold once at the end.
+ */
+
+/* add two unfolded sums with end-around carry */
+static inline uint64_t ss_cksum_add64(uint64_t sum, uint64_t value) {
+    sum += value;
+    return sum + (sum < value);
+}
+
+/* fold an unfolded sum to 16 bits, NOT inverted */
+static inline uint16_t ss_cksum_fold(uint64_t sum) {
+    sum = (sum >> 32) + (sum & 0xffffffff);
+    sum = (sum >> 32) + (sum & 0xffffffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    return (uint16_t) sum;
+}
+
+/*
+ * RFC 1624 eqn. 3: HC' = ~(~HC + ~m + m') for a 16-bit field rewritten from
+ * m to m' under the existing checksum HC. All values in network order.
+ */
+static inline uint16_t ss_cksum_update16(uint16_t check, uint16_t old_value, uint16_t new_value) {
+    uint64_t sum = (uint16_t) ~check;
+    sum += (uint16_t) ~old_value;
+    sum += new_value;
+    return (uint16_t) ~ss_cksum_fold(sum);
+}
+
+static inline uint16_t ss_cksum_update32(uint16_t check, uint32_t old_value, uint32_t new_value) {
+    uint64_t sum = (uint16_t) ~check;
+    sum += (uint32_t) ~old_value;
+    sum += new_value;
+    return (uint16_t) ~ss_cksum_fold(sum);
+}
+
 /* BEGIN PROTOTYPES */
 
+uint64_t ss_cksum_add(uint64_t sum, const void* data, size_t len);
 uint16_t ss_in_cksum(uint16_t* data, size_t len);
 
 /* END PROTOTYPES */
+
+/*
+ * Unfolded sum of the TCP / UDP / ICMPv6 pseudo-header, computed in place
+ * from the addresses in the IP header. addr_length is IPV4_ALEN or IPV6_ALEN;
+ * the IPv4 and IPv6 layouts sum to the same value for the length and
+ * protocol fields so one helper covers both.
+ */
+static inline uint64_t ss_cksum_phdr(const void* saddr, const void* daddr, size_t addr_length, uint8_t protocol, uint32_t l4_length) {
+    uint64_t sum = ss_cksum_add(0, saddr, addr_length);
+    sum = ss_cksum_add(sum, daddr, addr_length);
+    return ss_cksum_add64(sum, (uint64_t) rte_cpu_to_be_16((uint16_t) protocol)
+        + rte_cpu_to_be_16((uint16_t) (l4_length >> 16))
+        + rte_cpu_to_be_16((uint16_t) (l4_length & 0xffff)));
+}
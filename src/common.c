@@ -1,7 +1,10 @@
+#include <pthread.h>
+#include <signal.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include <bsd/string.h>
 #include <bsd/sys/queue.h>
@@ -14,17 +17,58 @@
 #include <pcap/pcap.h>
 
 #include <rte_byteorder.h>
+#include <rte_cycles.h>
 #include <rte_log.h>
 #include <rte_lpm.h>
 #include <rte_lpm6.h>
+#include <rte_mbuf.h>
 
 #include "common.h"
 #include "json.h"
+#include "log.h"
 #include "sdn_sensor.h"
 #include "sensor_conf.h"
 
 /* COMMON */
 
+// wall clock at a known TSC, to put real times on records and packets
+static uint64_t clock_epoch_tsc;
+static uint64_t clock_epoch_nsec;
+
+/* needs the EAL, for the TSC frequency */
+int ss_clock_init(void) {
+    struct timespec now;
+    
+    clock_gettime(CLOCK_REALTIME, &now);
+    clock_epoch_tsc  = rte_rdtsc();
+    clock_epoch_nsec = (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+    return 0;
+}
+
+/*
+ * Helper threads run with every signal blocked, so a fatal signal lands
+ * on an lcore or main, never on a thread the shutdown is about to join.
+ */
+int ss_thread_create(pthread_t* thread, void* (*start)(void*), void* arg) {
+    sigset_t all;
+    sigset_t saved;
+    int rv;
+    
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    rv = pthread_create(thread, NULL, start, arg);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    return rv;
+}
+
+/* nanoseconds since the Unix epoch; whole seconds first, so the multiply cannot overflow */
+uint64_t ss_tsc_to_nsec(uint64_t tsc) {
+    uint64_t hz    = rte_get_tsc_hz();
+    uint64_t delta = tsc - clock_epoch_tsc;
+    
+    return clock_epoch_nsec + delta / hz * 1000000000 + delta % hz * 1000000000 / hz;
+}
+
 int ss_metadata_prepare(ss_frame_t* fbuf) {
     ss_metadata_t* m = &fbuf->data;
     
@@ -73,6 +117,9 @@ int ss_tcp_key_dump(const char* message, ss_tcp_key_t* key) {
     uint16_t sport = rte_bswap16(key->sport);
     uint16_t dport = rte_bswap16(key->dport);
 
+    // called per segment from the socket lookup, skip the formatting unless it prints
+    if (!SS_LOG_ENABLED(DEBUG)) return 0;
+
     memset(sip, 0, sizeof(sip));
     memset(dip, 0, sizeof(dip));
 
@@ -93,7 +140,7 @@ int ss_tcp_key_dump(const char* message, ss_tcp_key_t* key) {
     ss_inet_ntop_raw(family, key->sip, sip, sizeof(sip));
     ss_inet_ntop_raw(family, key->dip, dip, sizeof(dip));
 
-    RTE_LOG(INFO, L3L4, "%s: tcp key: %s: %s:%hu --> %s:%hu\n",
+    SS_LOG(DEBUG, L3L4, "%s: tcp key: %s: %s:%hu --> %s:%hu\n",
         message, protocol, sip, sport, dip, dport);
 
     return 0;
@@ -104,6 +151,9 @@ int sflow_key_dump(const char* message, sflow_key_t* key) {
     const char* protocol;
     char agent_ip[SS_ADDR_STR_MAX];
 
+    // called per datagram from the socket lookup, as ss_tcp_key_dump
+    if (!SS_LOG_ENABLED(DEBUG)) return 0;
+
     if (key->protocol == L4_SFLOW4) {
         family = SS_AF_INET4;
         protocol = "L4_SFLOW4";
@@ -119,7 +169,7 @@ int sflow_key_dump(const char* message, sflow_key_t* key) {
     memset(agent_ip, 0, sizeof(agent_ip));
     ss_inet_ntop_raw(family, key->agent_ip, agent_ip, sizeof(agent_ip));
 
-    RTE_LOG(INFO, L3L4, "%s: sflow key: %s: %s:%u --> sflow_collector\n",
+    SS_LOG(DEBUG, L3L4, "%s: sflow key: %s: %s:%u --> sflow_collector\n",
         message, protocol, agent_ip, key->agent_sub_id);
 
     return 0;
@@ -261,13 +311,15 @@ int ss_pcap_chain_remove_name(char* name) {
     return -1;
 }
 
-int ss_pcap_match_prepare(ss_pcap_match_t* pcap_match, uint8_t* packet, uint16_t length) {
-    // XXX: set to useless values for speed
-    pcap_match->header.ts.tv_sec  = 0;
-    pcap_match->header.ts.tv_usec = 0;
-    pcap_match->header.caplen     = length;
-    pcap_match->header.len        = length;
-    pcap_match->packet            = packet;
+/* the rx time of the burst, converted once per frame, for filters and sinks alike */
+int ss_pcap_match_prepare(ss_pcap_match_t* pcap_match, ss_frame_t* fbuf) {
+    uint64_t nsec = ss_tsc_to_nsec(fbuf->rx_tsc);
+    
+    pcap_match->header.ts.tv_sec  = (time_t) (nsec / 1000000000);
+    pcap_match->header.ts.tv_usec = (suseconds_t) (nsec % 1000000000 / 1000);
+    pcap_match->header.caplen     = rte_pktmbuf_data_len(fbuf->mbuf);
+    pcap_match->header.len        = rte_pktmbuf_pkt_len(fbuf->mbuf);
+    pcap_match->packet            = rte_pktmbuf_mtod(fbuf->mbuf, uint8_t*);
     return 0;
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <pthread.h>
 #include <stdint.h>
 
 #include <bsd/sys/queue.h>
@@ -29,6 +30,7 @@
 
 #include "ip_utils.h"
 #include "nn_queue.h"
+#include "timer_wheel.h"
 
 /* MACROS */
 
@@ -87,16 +89,46 @@
 #define L4_PORT_NETFLOW_1       2055
 #define L4_PORT_NETFLOW_2       9995
 #define L4_PORT_NETFLOW_3       9996
+#define L4_PORT_IPFIX           4739
 
 #define L4_TCP_HASH_SIZE            2048
 #define L4_TCP_BUCKET_SIZE             4
-#define L4_TCP_WINDOW_SHIFT           10 // 1 << 10 == 1024; i.e. 1KB scale multiplier
-#define L4_TCP_WINDOW_SIZE          8192 // 8192KB; allows 20 msec of data at 10 gbps
 #define L4_TCP_HEADER_OFFSET           5
 #define L4_TCP_MSS                  1460
-#define L4_TCP_BUFFER_SIZE          4096
-//#define L4_TCP_BUFFER_SIZE ((L4_TCP_WINDOW_SIZE << L4_TCP_WINDOW_SHIFT) * 2)
-#define L4_TCP_EXPIRED_SECONDS       600
+#define L4_TCP_MSS_MIN               536 // RFC 879 default MSS, first guess at a full-sized segment
+#define L4_TCP_SOCKET_MAX          65536 // default connection capacity across all lcores
+#define L4_TCP_SOCKET_MIN            256 // smallest per-lcore socket table
+#define L4_TCP_BUFFER_CLASSES          4 // reassembly buffer size classes, see tcp.c
+#define L4_TCP_BUFFER_MIN             16 // smallest per-lcore count of each buffer class
+#define L4_TCP_MESSAGE_MAX         65535 // cap on one reassembled message, extractors take uint16_t
+#define L4_TCP_FRAME_DIGITS_MAX        9 // RFC 6587 MSG-LEN digits accepted
+#define L4_TCP_EXPIRED_SECONDS       600 // default idle timeout
+#define L4_TCP_SYN_SECONDS            30 // default handshake timeout
+#define L4_TCP_TIME_WAIT_SECONDS       2 // default TIME_WAIT linger
+#define L4_TCP_TIMER_TICK_MSEC       100
+#define L4_TCP_TIMEOUTS_MAX           16 // listening ports with their own timeouts
+#define L4_TCP_TIMEOUT_MAX         86400 // longest tcp_timeouts value, in seconds
+#define L4_TCP_ACK_DELAY_MSEC         40 // default delayed ACK timer
+#define L4_TCP_ACK_SEGMENTS            2 // full-sized segments which force an ACK, RFC 5681 4.2
+#define L4_TCP_SYN_BACKLOG          1024 // default half-open sockets across all lcores before SYN cookies
+#define L4_TCP_SYN_SOURCE_MAX         16 // default half-open sockets per source address and lcore
+#define L4_TCP_SYN_SOURCE_BUCKETS   4096 // per-lcore half-open counters, indexed by source hash
+#define L4_TCP_COOKIE_SHIFT            6 // cookie clock ticks every 64 seconds
+#define L4_TCP_OOO_SEGMENTS            8 // out-of-order ranges held per socket
+#define L4_TCP_OOO_MBUFS              64 // mbufs held per socket across those ranges
+#define L4_TCP_OOO_POOL_SIZE        1024 // default out-of-order mbuf clones across all lcores
+#define L4_TCP_OOO_MBUF_SHARE          4 // clones may pin at most 1 / share of the rx mbufs
+#define L4_TCP_FOREIGN_RETRIES         4 // tries at a foreign socket locked by its owner before the segment is dropped
+#define L4_DNS_TCP_STREAM_MAX      16384 // default passive DNS-over-TCP streams across all lcores
+#define L4_NETFLOW_TCP_PORTS_MAX       8 // ports taking IPFIX over TCP
+#define L4_IPFIX_HEADER_SIZE          16 // RFC 7011 3.1, the length word sits at offset 2
+#define L4_FLOW_MAX               131072 // default flow cache entries across all lcores
+#define L4_FLOW_IDLE_SECONDS          60 // default idle timeout before a flow is reported
+#define L4_FLOW_ACTIVE_SECONDS       300 // default interval between reports of a long flow
+
+// sequence number comparison modulo 2^32, RFC 793 3.3
+#define SS_TCP_SEQ_LT(a, b)  ((int32_t) ((uint32_t) (a) - (uint32_t) (b)) <  0)
+#define SS_TCP_SEQ_LEQ(a, b) ((int32_t) ((uint32_t) (a) - (uint32_t) (b)) <= 0)
 
 #define L4_TCP4 4
 #define L4_TCP6 6
@@ -229,6 +261,8 @@ struct ss_ioc_file_s {
 
 typedef struct ss_ioc_file_s ss_ioc_file_t;
 
+struct ss_flow_s; // flow.h
+
 struct ss_frame_s {
     unsigned int   active;
     //unsigned int   port_id;
@@ -248,6 +282,8 @@ struct ss_frame_s {
     tcp_hdr_t*     tcp;
     udp_hdr_t*     udp;
     uint8_t*       l4_offset;
+    struct ss_flow_s* flow; // NULL when the flow cache is not tracking it
+    uint64_t       rx_tsc;  // read once per rx burst, see ss_tsc_to_nsec
     
     ss_metadata_t  data;
 } __rte_cache_aligned;
@@ -272,26 +308,110 @@ enum ss_tcp_state_e {
     SS_TCP_SYN_TX   = 2,
     SS_TCP_SYN_RX   = 3,
     SS_TCP_OPEN     = 4,
+    SS_TCP_TIME_WAIT = 5,
     SS_TCP_UNKNOWN  = -1,
 };
 
 typedef enum ss_tcp_state_e ss_tcp_state_t;
 
+// RFC 6587 section 3.4
+enum ss_tcp_framing_e {
+    SS_TCP_FRAMING_EMPTY           = 0, // auto-detect from the first byte
+    SS_TCP_FRAMING_OCTET_COUNTED   = 1,
+    SS_TCP_FRAMING_NON_TRANSPARENT = 2,
+    SS_TCP_FRAMING_MAX,
+};
+
+typedef enum ss_tcp_framing_e ss_tcp_framing_t;
+
+// per listening port, in seconds; port 0 holds the defaults
+struct ss_tcp_timeouts_s {
+    uint16_t port;
+    uint32_t syn_timeout;
+    uint32_t idle_timeout;
+    uint32_t time_wait_timeout;
+};
+
+typedef struct ss_tcp_timeouts_s ss_tcp_timeouts_t;
+
+// a contiguous range received ahead of a hole, as a chain of payload clones
+struct ss_tcp_ooo_s {
+    uint32_t    seq;
+    uint32_t    length;
+    rte_mbuf_t* chain;
+};
+
+typedef struct ss_tcp_ooo_s ss_tcp_ooo_t;
+
+struct peer_state; // netflow_peer.h
+
+// a DNS-over-TCP message in progress, see ss_dns_tcp_consume
+struct ss_dns_tcp_reasm_s {
+    uint16_t length;        // from the two-byte prefix
+    uint16_t have;          // bytes of the message seen so far
+    uint8_t  prefix_length; // prefix bytes read, the message follows at 2
+    uint8_t* data;          // only for messages split across segments
+};
+
+typedef struct ss_dns_tcp_reasm_s ss_dns_tcp_reasm_t;
+
 // RFC 793, RFC 1122
 struct ss_tcp_socket_s {
     ss_tcp_key_t key;
     uint64_t id;
+    uint16_t lcore_id; // owning shard
     
     rte_spinlock_recursive_t lock;
     ss_tcp_state_t state;
 
+    // armed on the owner's wheel, see ss_tcp_socket_deadline
+    ss_timer_wheel_entry_t timer;
+    ss_tcp_timeouts_t* timeouts;
+
     uint64_t rx_ticks;
     uint64_t tx_ticks;
     uint32_t last_seq;
     uint32_t last_ack_seq;
+
+    // where ACKs built without an rx frame go, refreshed on every rx
+    uint8_t    port_id;
+    eth_addr_t peer_addr;
+
+    // delayed ACK state, host order; see ss_tcp_ack_schedule
+    uint32_t rx_next_seq;  // next byte expected from the peer
+    uint32_t tx_next_seq;  // next byte of ours, as last acknowledged by the peer
+    uint16_t rx_mss;       // largest segment seen, i.e. a full-sized segment
+    uint16_t rx_window;    // window advertised in the last ACK, in bytes
+    uint8_t  ack_segments; // full-sized segments not yet acknowledged
+    uint8_t  ack_now;      // send at the end of the rx burst
+    uint8_t  ack_queued;   // on the owner's ack_list
+    uint8_t  half_open;    // counted in the owner's SYN backlog
+    uint64_t ack_deadline;
+    TAILQ_ENTRY(ss_tcp_socket_s) ack_entry;
+
+    // out-of-order queue sorted by seq, see ss_tcp_ooo_insert
+    uint8_t      rx_ooo_count;
+    uint8_t      rx_ooo_mbufs;
+    ss_tcp_ooo_t rx_ooo[L4_TCP_OOO_SEGMENTS];
     
-    uint16_t rx_length;
-    uint8_t  rx_data[L4_TCP_BUFFER_SIZE];
+    // message reassembly, rx_data grows up to ss_conf->tcp_message_max
+    ss_tcp_framing_t rx_framing;
+    uint32_t rx_frame_length;   // MSG-LEN digits read so far
+    uint32_t rx_frame_digits;
+    uint32_t rx_frame_remaining; // body bytes left in the current frame
+    uint8_t  rx_in_frame;
+    uint8_t  rx_truncated;
+    uint8_t  rx_class;
+    uint32_t rx_length;
+    uint32_t rx_size;
+    uint8_t* rx_data;
+
+    uint8_t  rx_desync; // framing lost, the rest of the stream is ignored
+
+    // port 53 carries length-prefixed DNS messages instead
+    ss_dns_tcp_reasm_t rx_dns;
+    // IPFIX templates are scoped to the session, RFC 7011 8.1
+    struct peer_state* rx_netflow_peer;
 } __rte_cache_aligned;
 
 typedef struct ss_tcp_socket_s ss_tcp_socket_t;
@@ -401,6 +521,9 @@ typedef struct ss_cidr_table_s ss_cidr_table_t;
 
 /* BEGIN PROTOTYPES */
 
+int ss_clock_init(void);
+int ss_thread_create(pthread_t* thread, void* (*start)(void*), void* arg);
+uint64_t ss_tsc_to_nsec(uint64_t tsc);
 int ss_metadata_prepare(ss_frame_t* fbuf);
 ss_direction_t ss_direction_load(const char* direction);
 const char* ss_direction_dump(ss_direction_t direction);
@@ -414,7 +537,7 @@ int ss_pcap_entry_destroy(ss_pcap_entry_t* pcap_entry);
 int ss_pcap_chain_add(ss_pcap_entry_t* pcap_entry);
 int ss_pcap_chain_remove_index(int index);
 int ss_pcap_chain_remove_name(char* name);
-int ss_pcap_match_prepare(ss_pcap_match_t* pcap_match, uint8_t* packet, uint16_t length);
+int ss_pcap_match_prepare(ss_pcap_match_t* pcap_match, ss_frame_t* fbuf);
 int ss_pcap_match(ss_pcap_entry_t* pcap_entry, ss_pcap_match_t* pcap_match);
 int ss_dns_chain_destroy(void);
 ss_dns_entry_t* ss_dns_entry_create(json_object* dns_json);
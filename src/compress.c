@@ -0,0 +1,176 @@
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+
+#include "compress.h"
+
+const char* ss_compress_type_dump(ss_compress_type_t type) {
+    switch (type) {
+        case SS_COMPRESS_NONE: return "none";
+        case SS_COMPRESS_LZ4:  return "lz4";
+        case SS_COMPRESS_ZSTD: return "zstd";
+        default:               return "unknown";
+    }
+}
+
+/* SS_COMPRESS_MAX when the name is unknown */
+ss_compress_type_t ss_compress_type_parse(const char* name) {
+    if      (!strcasecmp(name, "none")) return SS_COMPRESS_NONE;
+    else if (!strcasecmp(name, "lz4"))  return SS_COMPRESS_LZ4;
+    else if (!strcasecmp(name, "zstd")) return SS_COMPRESS_ZSTD;
+    return SS_COMPRESS_MAX;
+}
+
+/* trained zstd dictionaries carry an id, raw content ones get a hash */
+static uint32_t ss_compress_dict_id(const uint8_t* dict, size_t length) {
+    uint32_t id = ZSTD_getDictID_fromDict(dict, length);
+
+    if (id) return id;
+    id = 2166136261U; // FNV-1a
+    for (size_t i = 0; i < length; ++i) {
+        id = (id ^ dict[i]) * 16777619U;
+    }
+    return id ? id : 1;
+}
+
+static int ss_compress_dict_load(ss_compress_conf_t* conf, const char* path) {
+    FILE* file;
+    long length;
+
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "could not open compression dictionary %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fseek(file, 0, SEEK_END) || (length = ftell(file)) <= 0 || length > SS_COMPRESS_DICT_MAX || fseek(file, 0, SEEK_SET)) {
+        fprintf(stderr, "compression dictionary %s is empty, unreadable, or over %d bytes\n", path, SS_COMPRESS_DICT_MAX);
+        fclose(file);
+        return -1;
+    }
+    conf->dict = malloc((size_t) length);
+    if (conf->dict == NULL || fread(conf->dict, 1, (size_t) length, file) != (size_t) length) {
+        fprintf(stderr, "could not read compression dictionary %s\n", path);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    conf->dict_length = (size_t) length;
+    conf->dict_id     = ss_compress_dict_id(conf->dict, conf->dict_length);
+    return 0;
+}
+
+/*
+ * Digests the dictionary once, so every batch starts from it without
+ * paying for it again. dict_path is optional.
+ */
+int ss_compress_conf_init(ss_compress_conf_t* conf, ss_compress_type_t type, int level, const char* dict_path) {
+    memset(conf, 0, sizeof(*conf));
+    conf->type  = type;
+    conf->level = level;
+    if (type == SS_COMPRESS_NONE || dict_path == NULL) return 0;
+
+    if (ss_compress_dict_load(conf, dict_path)) goto error_out;
+    if (type == SS_COMPRESS_LZ4) {
+        conf->lz4_cdict = LZ4F_createCDict(conf->dict, conf->dict_length);
+        if (conf->lz4_cdict == NULL) goto error_out;
+    }
+    else {
+        conf->zstd_cdict = ZSTD_createCDict(conf->dict, conf->dict_length, level ? level : ZSTD_CLEVEL_DEFAULT);
+        conf->zstd_ddict = ZSTD_createDDict(conf->dict, conf->dict_length);
+        if (conf->zstd_cdict == NULL || conf->zstd_ddict == NULL) goto error_out;
+    }
+    return 0;
+
+    error_out:
+    fprintf(stderr, "could not load %s dictionary %s\n", ss_compress_type_dump(type), dict_path);
+    ss_compress_conf_destroy(conf);
+    return -1;
+}
+
+void ss_compress_conf_destroy(ss_compress_conf_t* conf) {
+    if (conf->lz4_cdict)  LZ4F_freeCDict(conf->lz4_cdict);
+    if (conf->zstd_cdict) ZSTD_freeCDict(conf->zstd_cdict);
+    if (conf->zstd_ddict) ZSTD_freeDDict(conf->zstd_ddict);
+    free(conf->dict);
+    memset(conf, 0, sizeof(*conf));
+}
+
+static void ss_compress_lz4_prefs(ss_compress_conf_t* conf, size_t length, LZ4F_preferences_t* prefs) {
+    memset(prefs, 0, sizeof(*prefs));
+    prefs->compressionLevel      = conf->level;
+    prefs->frameInfo.contentSize = length;
+    prefs->frameInfo.dictID      = conf->dict_id;
+}
+
+/* room the frame of length bytes can take */
+size_t ss_compress_bound(ss_compress_conf_t* conf, size_t length) {
+    LZ4F_preferences_t prefs;
+
+    switch (conf->type) {
+        case SS_COMPRESS_LZ4: {
+            ss_compress_lz4_prefs(conf, length, &prefs);
+            return LZ4F_compressFrameBound(length, &prefs);
+        }
+        case SS_COMPRESS_ZSTD: return ZSTD_compressBound(length);
+        default:               return length;
+    }
+}
+
+/* returns the frame length, or -1 when it did not fit or failed */
+ssize_t ss_compress(ss_compress_conf_t* conf, ss_compress_ctx_t* ctx, const uint8_t* src, size_t length, uint8_t* dst, size_t size) {
+    LZ4F_preferences_t prefs;
+    size_t rv;
+
+    switch (conf->type) {
+        case SS_COMPRESS_LZ4: {
+            if (ctx->lz4_cctx == NULL && LZ4F_isError(LZ4F_createCompressionContext(&ctx->lz4_cctx, LZ4F_VERSION))) return -1;
+            ss_compress_lz4_prefs(conf, length, &prefs);
+            rv = LZ4F_compressFrame_usingCDict(ctx->lz4_cctx, dst, size, src, length, conf->lz4_cdict, &prefs);
+            return LZ4F_isError(rv) ? -1 : (ssize_t) rv;
+        }
+        case SS_COMPRESS_ZSTD: {
+            if (ctx->zstd_cctx == NULL && (ctx->zstd_cctx = ZSTD_createCCtx()) == NULL) return -1;
+            if (conf->zstd_cdict) rv = ZSTD_compress_usingCDict(ctx->zstd_cctx, dst, size, src, length, conf->zstd_cdict);
+            else                  rv = ZSTD_compressCCtx(ctx->zstd_cctx, dst, size, src, length, conf->level);
+            return ZSTD_isError(rv) ? -1 : (ssize_t) rv;
+        }
+        default: return -1;
+    }
+}
+
+/* returns the decompressed length, or -1 when the frame is bad or too big */
+ssize_t ss_decompress(ss_compress_conf_t* conf, ss_compress_ctx_t* ctx, const uint8_t* src, size_t length, uint8_t* dst, size_t size) {
+    size_t src_length = length;
+    size_t dst_length = size;
+    size_t rv;
+
+    switch (conf->type) {
+        case SS_COMPRESS_LZ4: {
+            if (ctx->lz4_dctx == NULL && LZ4F_isError(LZ4F_createDecompressionContext(&ctx->lz4_dctx, LZ4F_VERSION))) return -1;
+            LZ4F_resetDecompressionContext(ctx->lz4_dctx);
+            rv = LZ4F_decompress_usingDict(ctx->lz4_dctx, dst, &dst_length, src, &src_length, conf->dict, conf->dict_length, NULL);
+            // 0 is the end of the frame, anything else wants more input or room
+            return rv != 0 || src_length != length ? -1 : (ssize_t) dst_length;
+        }
+        case SS_COMPRESS_ZSTD: {
+            if (ctx->zstd_dctx == NULL && (ctx->zstd_dctx = ZSTD_createDCtx()) == NULL) return -1;
+            if (conf->zstd_ddict) rv = ZSTD_decompress_usingDDict(ctx->zstd_dctx, dst, size, src, length, conf->zstd_ddict);
+            else                  rv = ZSTD_decompressDCtx(ctx->zstd_dctx, dst, size, src, length);
+            return ZSTD_isError(rv) ? -1 : (ssize_t) rv;
+        }
+        default: return -1;
+    }
+}
+
+void ss_compress_ctx_destroy(ss_compress_ctx_t* ctx) {
+    if (ctx->lz4_cctx)  LZ4F_freeCompressionContext(ctx->lz4_cctx);
+    if (ctx->lz4_dctx)  LZ4F_freeDecompressionContext(ctx->lz4_dctx);
+    if (ctx->zstd_cctx) ZSTD_freeCCtx(ctx->zstd_cctx);
+    if (ctx->zstd_dctx) ZSTD_freeDCtx(ctx->zstd_dctx);
+    memset(ctx, 0, sizeof(*ctx));
+}
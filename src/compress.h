@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define LZ4F_STATIC_LINKING_ONLY /* LZ4F_CDict */
+#include <lz4frame.h>
+#include <zstd.h>
+
+/*
+ * nm_compress: one LZ4 or zstd frame per nanomsg batch. Shared by the
+ * sensor and by the standalone tools, so it must not pull in DPDK.
+ * Contexts are per thread and reused across batches; the settings and
+ * the digested dictionary are per queue and read-only once loaded.
+ */
+
+/* CONSTANTS */
+
+#define SS_COMPRESS_DICT_MAX    (1 << 20) // largest nm_compress_dict accepted
+#define SS_COMPRESS_DICT_SIZE     112640 // dictionaries trained by the tools
+
+enum ss_compress_type_e {
+    SS_COMPRESS_NONE = 0,
+    SS_COMPRESS_LZ4  = 1,
+    SS_COMPRESS_ZSTD = 2,
+    SS_COMPRESS_MAX,
+};
+
+typedef enum ss_compress_type_e ss_compress_type_t;
+
+/* DATA TYPES */
+
+struct ss_compress_conf_s {
+    ss_compress_type_t type;
+    int                level;       // 0 is the library default
+    uint32_t           dict_id;     // 0 without a dictionary
+    uint8_t*           dict;
+    size_t             dict_length;
+    LZ4F_CDict*        lz4_cdict;
+    ZSTD_CDict*        zstd_cdict;
+    ZSTD_DDict*        zstd_ddict;
+};
+
+typedef struct ss_compress_conf_s ss_compress_conf_t;
+
+/* created on first use, by the thread owning them */
+struct ss_compress_ctx_s {
+    LZ4F_cctx*  lz4_cctx;
+    LZ4F_dctx*  lz4_dctx;
+    ZSTD_CCtx*  zstd_cctx;
+    ZSTD_DCtx*  zstd_dctx;
+};
+
+typedef struct ss_compress_ctx_s ss_compress_ctx_t;
+
+/* BEGIN PROTOTYPES */
+
+const char* ss_compress_type_dump(ss_compress_type_t type);
+ss_compress_type_t ss_compress_type_parse(const char* name);
+int ss_compress_conf_init(ss_compress_conf_t* conf, ss_compress_type_t type, int level, const char* dict_path);
+void ss_compress_conf_destroy(ss_compress_conf_t* conf);
+size_t ss_compress_bound(ss_compress_conf_t* conf, size_t length);
+ssize_t ss_compress(ss_compress_conf_t* conf, ss_compress_ctx_t* ctx, const uint8_t* src, size_t length, uint8_t* dst, size_t size);
+ssize_t ss_decompress(ss_compress_conf_t* conf, ss_compress_ctx_t* ctx, const uint8_t* src, size_t length, uint8_t* dst, size_t size);
+void ss_compress_ctx_destroy(ss_compress_ctx_t* ctx);
+
+/* END PROTOTYPES */
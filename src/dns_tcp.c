@@ -0,0 +1,315 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <netinet/tcp.h>
+
+#include <rte_branch_prediction.h>
+#include <rte_byteorder.h>
+#include <rte_cycles.h>
+#include <rte_hash.h>
+#include <rte_hash_crc.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_mempool.h>
+#include <rte_memcpy.h>
+
+#include <jemalloc/jemalloc.h>
+
+#include "common.h"
+#include "dns_tcp.h"
+#include "extractor.h"
+#include "sensor_conf.h"
+#include "timer_wheel.h"
+
+/*
+ * Passive streams never leave the lcore which saw their SYN. Each
+ * direction is a stream of its own, so even asymmetric RSS keeps every
+ * stream on a single lcore and the shards need no locking at all.
+ */
+struct ss_dns_tcp_shard_s {
+    rte_hash_t* hash;
+    ss_dns_tcp_stream_t** streams;
+    rte_mempool_t* stream_pool;
+    ss_timer_wheel_t wheel;
+} __rte_cache_aligned;
+
+typedef struct ss_dns_tcp_shard_s ss_dns_tcp_shard_t;
+
+static ss_dns_tcp_shard_t dns_tcp_shards[RTE_MAX_LCORE];
+static ss_dns_tcp_stats_t dns_tcp_stats[RTE_MAX_LCORE];
+
+int ss_dns_tcp_init() {
+    char name[RTE_MEMPOOL_NAMESIZE];
+    unsigned int lcore_id;
+    int socket_id;
+    ss_dns_tcp_shard_t* shard;
+    uint32_t shard_size = SS_MAX(ss_conf->dns_tcp_stream_max / rte_lcore_count(), SS_DNS_TCP_STREAM_MIN);
+    struct rte_hash_parameters hash_params = {
+        .name               = name,
+        .entries            = shard_size,
+        .key_len            = sizeof(ss_tcp_key_t),
+        .hash_func          = rte_hash_crc,
+        .hash_func_init_val = 0,
+    };
+
+    RTE_LOG(NOTICE, L3L4, "dns tcp streams per lcore: %u\n", shard_size);
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        shard     = &dns_tcp_shards[lcore_id];
+        socket_id = (int) rte_lcore_to_socket_id(lcore_id);
+        ss_timer_wheel_init(&shard->wheel, rte_get_tsc_hz() * L4_TCP_TIMER_TICK_MSEC / 1000, rte_rdtsc());
+
+        snprintf(name, sizeof(name), "dns_tcp_hash_lcore_%u", lcore_id);
+        hash_params.socket_id = socket_id;
+        shard->hash = rte_hash_create(&hash_params);
+        if (shard->hash == NULL) {
+            RTE_LOG(ERR, L3L4, "could not initialize dns tcp stream hash for lcore %u\n", lcore_id);
+            return -1;
+        }
+
+        shard->streams = je_calloc(shard_size, sizeof(ss_dns_tcp_stream_t*));
+        if (shard->streams == NULL) {
+            RTE_LOG(ERR, L3L4, "could not allocate dns tcp stream table for lcore %u\n", lcore_id);
+            return -1;
+        }
+
+        snprintf(name, sizeof(name), "dns_tcp_stream_lcore_%u", lcore_id);
+        shard->stream_pool = rte_mempool_create(name, shard_size, sizeof(ss_dns_tcp_stream_t), 0, 0,
+            NULL, NULL, NULL, NULL, socket_id, MEMPOOL_F_SP_PUT | MEMPOOL_F_SC_GET);
+        if (shard->stream_pool == NULL) {
+            RTE_LOG(ERR, L3L4, "could not create dns tcp stream pool for lcore %u\n", lcore_id);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Run one complete message through the UDP DNS path. The extractor reads
+ * the message from l4_offset, so point the frame at it for the call.
+ */
+static void ss_dns_tcp_deliver(ss_frame_t* rx_buf, const uint8_t* message, uint16_t length) {
+    ss_dns_tcp_stats_t* stats = &dns_tcp_stats[rte_lcore_id()];
+    uint8_t* l4_offset        = rx_buf->l4_offset;
+    uint16_t l4_length        = rx_buf->data.l4_length;
+
+    ++stats->messages;
+    // answers of an earlier message in the same segment must not leak into this one
+    memset(rx_buf->data.dns_name, 0, sizeof(rx_buf->data.dns_name));
+    memset(rx_buf->data.dns_answers, 0, sizeof(rx_buf->data.dns_answers));
+
+    rx_buf->l4_offset      = (uint8_t*) message;
+    rx_buf->data.l4_length = length;
+    if (ss_extract_dns(rx_buf)) ++stats->decode_errors;
+    rx_buf->l4_offset      = l4_offset;
+    rx_buf->data.l4_length = l4_length;
+}
+
+void ss_dns_tcp_reasm_reset(ss_dns_tcp_reasm_t* reasm) {
+    if (reasm->data) je_free(reasm->data);
+    memset(reasm, 0, sizeof(*reasm));
+}
+
+/*
+ * RFC 1035 4.2.2, RFC 7766 8: each message is preceded by its length as
+ * two bytes in network order, and a stream may carry any number of them.
+ * A message inside a single segment is decoded straight from the mbuf;
+ * only messages split across segments are copied, into a buffer of
+ * exactly the announced length.
+ */
+int ss_dns_tcp_consume(ss_dns_tcp_reasm_t* reasm, ss_frame_t* rx_buf, const uint8_t* data, uint32_t length) {
+    ss_dns_tcp_stats_t* stats = &dns_tcp_stats[rte_lcore_id()];
+    const uint8_t* p          = data;
+    const uint8_t* end        = data + length;
+    uint32_t count;
+
+    while (p < end) {
+        if (reasm->prefix_length < sizeof(uint16_t)) {
+            reasm->length = (uint16_t) (reasm->length << 8 | *p++);
+            ++reasm->prefix_length;
+            // a zero length carries no message, wait for the next prefix
+            if (reasm->prefix_length == sizeof(uint16_t) && reasm->length == 0) reasm->prefix_length = 0;
+            continue;
+        }
+
+        count = (uint32_t) SS_MIN((size_t) (end - p), (size_t) (reasm->length - reasm->have));
+        if (reasm->have == 0 && count == reasm->length) {
+            ss_dns_tcp_deliver(rx_buf, p, reasm->length);
+            ss_dns_tcp_reasm_reset(reasm);
+            p += count;
+            continue;
+        }
+
+        // data stays NULL while skipping a message nothing could be allocated for
+        if (reasm->have == 0) reasm->data = je_malloc(reasm->length);
+        if (reasm->data) rte_memcpy(reasm->data + reasm->have, p, count);
+        reasm->have = (uint16_t) (reasm->have + count);
+        p += count;
+
+        if (reasm->have < reasm->length) continue;
+        if (reasm->data) {
+            ++stats->messages_split;
+            ss_dns_tcp_deliver(rx_buf, reasm->data, reasm->length);
+        }
+        else {
+            ++stats->messages_dropped;
+        }
+        ss_dns_tcp_reasm_reset(reasm);
+    }
+
+    return 0;
+}
+
+static ss_dns_tcp_stream_t* ss_dns_tcp_stream_lookup(ss_dns_tcp_shard_t* shard, ss_tcp_key_t* key) {
+    int32_t stream_id = rte_hash_lookup(shard->hash, key);
+    return stream_id < 0 ? NULL : shard->streams[stream_id];
+}
+
+static void ss_dns_tcp_stream_delete(ss_dns_tcp_shard_t* shard, ss_dns_tcp_stream_t* stream) {
+    int32_t stream_id = rte_hash_del_key(shard->hash, &stream->key);
+    if (stream_id >= 0) shard->streams[stream_id] = NULL;
+
+    ss_timer_wheel_remove(&shard->wheel, &stream->timer);
+    ss_dns_tcp_reasm_reset(&stream->reasm);
+    rte_mempool_put(shard->stream_pool, stream);
+    --dns_tcp_stats[rte_lcore_id()].streams_active;
+}
+
+static ss_dns_tcp_stream_t* ss_dns_tcp_stream_create(ss_dns_tcp_shard_t* shard, ss_tcp_key_t* key, uint32_t next_seq) {
+    ss_dns_tcp_stats_t* stats   = &dns_tcp_stats[rte_lcore_id()];
+    ss_dns_tcp_stream_t* stream = NULL;
+    int32_t stream_id;
+
+    if (rte_mempool_get(shard->stream_pool, (void**) &stream)) {
+        ++stats->streams_rejected;
+        return NULL;
+    }
+
+    stream_id = rte_hash_add_key(shard->hash, key);
+    if (stream_id < 0) {
+        rte_mempool_put(shard->stream_pool, stream);
+        ++stats->streams_rejected;
+        return NULL;
+    }
+
+    memset(stream, 0, sizeof(*stream));
+    rte_memcpy(&stream->key, key, sizeof(ss_tcp_key_t));
+    stream->next_seq  = next_seq;
+    stream->rx_ticks  = rte_rdtsc();
+    shard->streams[stream_id] = stream;
+    ss_timer_wheel_add(&shard->wheel, &stream->timer, stream->rx_ticks + rte_get_tsc_hz() * SS_DNS_TCP_IDLE_SECONDS);
+    ++stats->streams_active;
+
+    return stream;
+}
+
+/*
+ * Follow one direction of a DNS-over-TCP connection between two other
+ * hosts. Nothing is ever sent. A hole in the stream loses the length
+ * prefixes, so the stream is dropped rather than resynchronized.
+ */
+int ss_frame_handle_dns_tcp(ss_frame_t* rx_buf, ss_tcp_key_t* key) {
+    ss_dns_tcp_shard_t* shard = &dns_tcp_shards[rte_lcore_id()];
+    ss_dns_tcp_stats_t* stats = &dns_tcp_stats[rte_lcore_id()];
+    uint8_t tcp_flags         = rx_buf->tcp->th_flags;
+    uint32_t seq              = rte_bswap32(rx_buf->tcp->seq);
+    uint32_t length           = rx_buf->data.l4_length;
+    uint32_t overlap;
+    ss_dns_tcp_stream_t* stream;
+
+    if (unlikely(shard->streams == NULL)) return 0;
+
+    stream = ss_dns_tcp_stream_lookup(shard, key);
+    if (tcp_flags & TH_SYN) {
+        // the tuple is being reused, whatever was in progress is gone
+        if (stream) ss_dns_tcp_stream_delete(shard, stream);
+        stream = ss_dns_tcp_stream_create(shard, key, seq + 1);
+        ++seq;
+    }
+    if (stream == NULL) return 0;
+
+    stream->rx_ticks = rte_rdtsc();
+    if (length && SS_TCP_SEQ_LEQ(seq + length, stream->next_seq)) {
+        ++stats->segments_retransmitted;
+    }
+    else if (length && SS_TCP_SEQ_LT(stream->next_seq, seq)) {
+        ++stats->stream_gaps;
+        ss_tcp_key_dump("dns_tcp: hole in stream, dropping it", key);
+        ss_dns_tcp_stream_delete(shard, stream);
+        return 0;
+    }
+    else if (length) {
+        overlap = stream->next_seq - seq;
+        if (overlap) ++stats->segments_retransmitted;
+        stream->next_seq = seq + length;
+        ss_dns_tcp_consume(&stream->reasm, rx_buf, rx_buf->l4_offset + overlap, length - overlap);
+    }
+
+    if (tcp_flags & (TH_FIN | TH_RST)) ss_dns_tcp_stream_delete(shard, stream);
+
+    return 0;
+}
+
+static void ss_dns_tcp_stream_expire(ss_timer_wheel_entry_t* entry, void* arg) {
+    ss_dns_tcp_stream_t* stream = (ss_dns_tcp_stream_t*) ((uint8_t*) entry - offsetof(ss_dns_tcp_stream_t, timer));
+    ss_dns_tcp_shard_t* shard   = arg;
+    uint64_t deadline           = stream->rx_ticks + rte_get_tsc_hz() * SS_DNS_TCP_IDLE_SECONDS;
+
+    if (deadline > rte_rdtsc()) {
+        ss_timer_wheel_add(&shard->wheel, &stream->timer, deadline);
+        return;
+    }
+
+    ++dns_tcp_stats[rte_lcore_id()].streams_expired;
+    ss_dns_tcp_stream_delete(shard, stream);
+}
+
+/* run the calling lcore's stream deadlines, called every drain tick */
+int ss_dns_tcp_timer_callback(unsigned int lcore_id) {
+    ss_dns_tcp_shard_t* shard = &dns_tcp_shards[lcore_id];
+
+    if (shard->streams == NULL) return 0;
+
+    ss_timer_wheel_advance(&shard->wheel, rte_rdtsc(), ss_dns_tcp_stream_expire, shard);
+    return 0;
+}
+
+int ss_dns_tcp_stats_dump() {
+    ss_dns_tcp_stats_t total;
+
+    if (rte_get_log_level() < RTE_LOG_NOTICE) return 0;
+
+    memset(&total, 0, sizeof(total));
+    for (unsigned int lcore_id = 0; lcore_id < RTE_MAX_LCORE; ++lcore_id) {
+        total.streams_active         += dns_tcp_stats[lcore_id].streams_active;
+        total.streams_rejected       += dns_tcp_stats[lcore_id].streams_rejected;
+        total.streams_expired        += dns_tcp_stats[lcore_id].streams_expired;
+        total.stream_gaps            += dns_tcp_stats[lcore_id].stream_gaps;
+        total.segments_retransmitted += dns_tcp_stats[lcore_id].segments_retransmitted;
+        total.messages               += dns_tcp_stats[lcore_id].messages;
+        total.messages_split         += dns_tcp_stats[lcore_id].messages_split;
+        total.messages_dropped       += dns_tcp_stats[lcore_id].messages_dropped;
+        total.decode_errors          += dns_tcp_stats[lcore_id].decode_errors;
+    }
+
+    printf("DNS over TCP statistics ============================\n"
+           "Streams active: %22lu\n"
+           "Streams rejected: %20lu\n"
+           "Streams expired: %21lu\n"
+           "Streams with holes: %18lu\n"
+           "Segments retransmitted: %14lu\n"
+           "Messages: %28lu\n"
+           "Messages split: %22lu\n"
+           "Messages dropped: %20lu\n"
+           "Decode errors: %23lu\n"
+           "====================================================\n",
+           total.streams_active, total.streams_rejected, total.streams_expired,
+           total.stream_gaps, total.segments_retransmitted,
+           total.messages, total.messages_split, total.messages_dropped,
+           total.decode_errors);
+
+    return 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "common.h"
+#include "timer_wheel.h"
+
+/* CONSTANTS */
+
+#define SS_DNS_TCP_STREAM_MIN      64 // smallest per-lcore stream table
+#define SS_DNS_TCP_IDLE_SECONDS    30 // RFC 7766 6.2.3 suggests servers wait seconds, not minutes
+
+/* DATA TYPES */
+
+/*
+ * One direction of a DNS-over-TCP connection seen on mirrored traffic.
+ * Streams are only created from a SYN, since message boundaries cannot
+ * be recovered from the middle of a stream.
+ */
+struct ss_dns_tcp_stream_s {
+    ss_tcp_key_t key;
+    uint32_t next_seq; // host order
+    uint64_t rx_ticks;
+    ss_timer_wheel_entry_t timer;
+    ss_dns_tcp_reasm_t reasm;
+};
+
+typedef struct ss_dns_tcp_stream_s ss_dns_tcp_stream_t;
+
+// indexed by the lcore doing the work, so no atomics
+struct ss_dns_tcp_stats_s {
+    uint64_t streams_active;
+    uint64_t streams_rejected;
+    uint64_t streams_expired;
+    uint64_t stream_gaps;
+    uint64_t segments_retransmitted;
+    uint64_t messages;
+    uint64_t messages_split;
+    uint64_t messages_dropped;
+    uint64_t decode_errors;
+} __rte_cache_aligned;
+
+typedef struct ss_dns_tcp_stats_s ss_dns_tcp_stats_t;
+
+/* BEGIN PROTOTYPES */
+
+int ss_dns_tcp_init(void);
+int ss_dns_tcp_consume(ss_dns_tcp_reasm_t* reasm, ss_frame_t* rx_buf, const uint8_t* data, uint32_t length);
+void ss_dns_tcp_reasm_reset(ss_dns_tcp_reasm_t* reasm);
+int ss_frame_handle_dns_tcp(ss_frame_t* rx_buf, ss_tcp_key_t* key);
+int ss_dns_tcp_timer_callback(unsigned int lcore_id);
+int ss_dns_tcp_stats_dump(void);
+
+/* END PROTOTYPES */
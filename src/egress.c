@@ -0,0 +1,292 @@
+#define _GNU_SOURCE /* pthread_setname_np */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rte_branch_prediction.h>
+#include <rte_common.h>
+#include <rte_errno.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_mempool.h>
+#include <rte_ring.h>
+
+#include "common.h"
+#include "egress.h"
+#include "sdn_sensor.h"
+#include "sensor_conf.h"
+
+/*
+ * nn_send runs on egress threads instead of the packet lcores, so a slow
+ * or stalled nanomsg transport costs queued events, never rx time. Each
+ * lcore owns a ring of finished messages, bounded in events and bytes;
+ * each ring is drained by one egress thread, which also owns the nm_batch
+ * buffers of its lcores. Events live in slots preallocated per lcore in
+ * size classes, each class getting an equal share of ring_bytes, so the
+ * lcore never enters malloc and the egress thread never frees into
+ * another thread's arena.
+ */
+
+static const uint32_t egress_slot_sizes[SS_EGRESS_SLOT_CLASSES] = { 512, 2048, 8192, 65536 };
+
+static ss_egress_ring_t   egress_rings[RTE_MAX_LCORE];
+static ss_egress_thread_t egress_threads[SS_EGRESS_THREADS_MAX];
+static volatile int       egress_stopping;
+
+static void ss_egress_event_free(ss_egress_ring_t* ring, ss_egress_event_t* event) {
+    __sync_sub_and_fetch(&ring->bytes, event->length);
+    rte_mempool_put(ring->slot_pools[event->slot_class], event);
+}
+
+/* the smallest free slot class holding length bytes, larger ones when it is exhausted */
+static ss_egress_event_t* ss_egress_slot_get(ss_egress_ring_t* ring, uint32_t length) {
+    void* event;
+
+    for (int i = 0; i < SS_EGRESS_SLOT_CLASSES; ++i) {
+        if (egress_slot_sizes[i] < length) continue;
+        if (rte_mempool_get(ring->slot_pools[i], &event) == 0) {
+            ((ss_egress_event_t*) event)->slot_class = (uint8_t) i;
+            return event;
+        }
+    }
+    return NULL;
+}
+
+static void* ss_egress_thread(void* arg) {
+    ss_egress_thread_t* thread = arg;
+    ss_egress_ring_t* ring;
+    ss_egress_event_t* events[SS_EGRESS_BURST];
+    unsigned int count;
+    unsigned int total;
+    int stopping;
+
+    for (;;) {
+        // read ahead of the pass, so an empty pass after the stop saw everything
+        stopping = egress_stopping;
+        __sync_synchronize();
+        total = 0;
+        for (unsigned int i = 0; i < thread->ring_count; ++i) {
+            ring  = thread->rings[i];
+            count = rte_ring_dequeue_burst(ring->ring, (void**) events, SS_EGRESS_BURST);
+            for (unsigned int j = 0; j < count; ++j) {
+                ss_nn_queue_transmit(events[j]->nn_queue, events[j]->data, events[j]->length, ring->lcore_id);
+                ss_egress_event_free(ring, events[j]);
+            }
+            ring->stats.sent += count;
+            // the batches of this lcore are only touched from here
+            ss_nn_queue_timer_callback((uint16_t) ring->lcore_id);
+            total += count;
+        }
+        if (total == 0) {
+            if (stopping) break;
+            usleep(SS_EGRESS_IDLE_USECS);
+        }
+    }
+
+    return NULL;
+}
+
+int ss_egress_init() {
+    ss_egress_ring_t* ring;
+    ss_egress_thread_t* thread;
+    unsigned int lcore_id;
+    unsigned int index = 0;
+    unsigned int size;
+    uint32_t slot_counts[SS_EGRESS_SLOT_CLASSES];
+    int socket_id;
+    char name[32];
+    int rv;
+
+    if (!ss_conf->egress_enabled) return 0;
+
+    // a ring holds one event less than its size, alloc keeps to ring_size
+    size = rte_align32pow2(ss_conf->egress_ring_size + 1);
+    for (int i = 0; i < SS_EGRESS_SLOT_CLASSES; ++i) {
+        slot_counts[i] = (uint32_t) SS_MAX(SS_MIN(ss_conf->egress_ring_bytes / SS_EGRESS_SLOT_CLASSES / egress_slot_sizes[i], ss_conf->egress_ring_size), 1);
+        RTE_LOG(NOTICE, NM, "egress %u byte slots per lcore: %u\n", egress_slot_sizes[i], slot_counts[i]);
+    }
+    RTE_LCORE_FOREACH(lcore_id) {
+        ring      = &egress_rings[lcore_id];
+        socket_id = (int) rte_lcore_to_socket_id(lcore_id);
+        snprintf(name, sizeof(name), "egress_lcore_%u", lcore_id);
+        ring->ring = rte_ring_create(name, size, socket_id, RING_F_SP_ENQ);
+        if (ring->ring == NULL) {
+            RTE_LOG(ERR, NM, "could not create egress ring for lcore %u: %s\n", lcore_id, rte_strerror(rte_errno));
+            return -1;
+        }
+        ring->lcore_id = lcore_id;
+
+        for (int i = 0; i < SS_EGRESS_SLOT_CLASSES; ++i) {
+            snprintf(name, sizeof(name), "egress_%u_lcore_%u", egress_slot_sizes[i], lcore_id);
+            ring->slot_pools[i] = rte_mempool_create(name, slot_counts[i], sizeof(ss_egress_event_t) + egress_slot_sizes[i], 0, 0,
+                NULL, NULL, NULL, NULL, socket_id, MEMPOOL_F_SC_GET);
+            if (ring->slot_pools[i] == NULL) {
+                RTE_LOG(ERR, NM, "could not create egress %u byte slot pool for lcore %u: %s\n",
+                    egress_slot_sizes[i], lcore_id, rte_strerror(rte_errno));
+                return -1;
+            }
+        }
+
+        thread = &egress_threads[index++ % ss_conf->egress_threads];
+        thread->rings[thread->ring_count++] = ring;
+    }
+
+    for (unsigned int i = 0; i < ss_conf->egress_threads; ++i) {
+        thread     = &egress_threads[i];
+        thread->id = i;
+        if (thread->ring_count == 0) continue;
+        rv = ss_thread_create(&thread->thread, ss_egress_thread, thread);
+        if (rv) {
+            RTE_LOG(ERR, NM, "could not start egress thread %u: %s\n", i, strerror(rv));
+            return -1;
+        }
+        snprintf(name, sizeof(name), "ss_egress_%u", i);
+        pthread_setname_np(thread->thread, name);
+    }
+
+    RTE_LOG(NOTICE, NM, "egress threads %u ring size %u ring bytes %lu policy %s\n",
+        ss_conf->egress_threads, size - 1, ss_conf->egress_ring_bytes,
+        ss_egress_policy_dump(ss_conf->egress_policy));
+    return 0;
+}
+
+/*
+ * Drains every ring and joins the egress threads, so nothing sends on a
+ * queue once ss_conf_destroy tears it down. What the lcores enqueue after
+ * the last pass stays in the rings; the batches still open are flushed
+ * by ss_nn_queue_destroy.
+ */
+void ss_egress_stop() {
+    ss_egress_thread_t* thread;
+    int rv;
+
+    if (!ss_conf->egress_enabled) return;
+
+    egress_stopping = 1;
+    for (unsigned int i = 0; i < ss_conf->egress_threads; ++i) {
+        thread = &egress_threads[i];
+        if (thread->ring_count == 0 || thread->thread == 0) continue;
+        rv = pthread_join(thread->thread, NULL);
+        if (rv) {
+            fprintf(stderr, "could not join egress thread %u: %s\n", i, strerror(rv));
+            continue;
+        }
+        thread->thread = 0;
+    }
+}
+
+const char* ss_egress_policy_dump(ss_egress_policy_t policy) {
+    switch (policy) {
+        case SS_EGRESS_DROP_NEWEST: return "drop_newest";
+        case SS_EGRESS_DROP_OLDEST: return "drop_oldest";
+        default:                    return "unknown";
+    }
+}
+
+/* NULL on threads without a ring: those send inline, as before egress */
+ss_egress_ring_t* ss_egress_ring_get() {
+    unsigned int lcore_id = rte_lcore_id();
+
+    if (unlikely(lcore_id >= RTE_MAX_LCORE)) return NULL;
+    return egress_rings[lcore_id].ring ? &egress_rings[lcore_id] : NULL;
+}
+
+/*
+ * Makes room under the egress policy, then takes a slot for the caller
+ * to fill in. Only this lcore enqueues, so the room found here is still
+ * there in ss_egress_event_enqueue. Under drop_oldest a missing slot is
+ * made room for too. NULL when the event is dropped.
+ */
+ss_egress_event_t* ss_egress_event_alloc(ss_egress_ring_t* ring, nn_queue_t* nn_queue, uint32_t length) {
+    ss_egress_event_t* event;
+
+    while (rte_ring_count(ring->ring) >= ss_conf->egress_ring_size || ring->bytes + length > ss_conf->egress_ring_bytes) {
+        if (ss_conf->egress_policy == SS_EGRESS_DROP_NEWEST || rte_ring_dequeue(ring->ring, (void**) &event)) {
+            ++ring->stats.dropped_newest;
+            return NULL;
+        }
+        ss_egress_event_free(ring, event);
+        ++ring->stats.dropped_oldest;
+    }
+
+    while ((event = ss_egress_slot_get(ring, length)) == NULL) {
+        if (ss_conf->egress_policy == SS_EGRESS_DROP_NEWEST || length > egress_slot_sizes[SS_EGRESS_SLOT_CLASSES - 1]
+            || rte_ring_dequeue(ring->ring, (void**) &event)) {
+            ++ring->stats.dropped_nomem;
+            return NULL;
+        }
+        ss_egress_event_free(ring, event);
+        ++ring->stats.dropped_oldest;
+    }
+    event->nn_queue = nn_queue;
+    event->length   = length;
+    return event;
+}
+
+void ss_egress_event_enqueue(ss_egress_ring_t* ring, ss_egress_event_t* event) {
+    uint64_t depth;
+
+    // ahead of the enqueue, so the egress thread never takes bytes not added yet
+    __sync_add_and_fetch(&ring->bytes, event->length);
+    if (unlikely(rte_ring_sp_enqueue(ring->ring, event) == -ENOBUFS)) {
+        ss_egress_event_free(ring, event);
+        ++ring->stats.dropped_newest;
+        return;
+    }
+
+    ++ring->stats.enqueued;
+    depth = rte_ring_count(ring->ring);
+    if (depth > ring->stats.depth_peak) ring->stats.depth_peak = depth;
+}
+
+int ss_egress_stats_dump() {
+    ss_egress_ring_t* ring;
+    ss_egress_stats_t total;
+    uint64_t depth = 0;
+    uint64_t bytes = 0;
+
+    if (!ss_conf->egress_enabled) return 0;
+    if (rte_get_log_level() < RTE_LOG_NOTICE) return 0;
+
+    memset(&total, 0, sizeof(total));
+    for (unsigned int lcore_id = 0; lcore_id < RTE_MAX_LCORE; ++lcore_id) {
+        ring = &egress_rings[lcore_id];
+        if (ring->ring == NULL) continue;
+        total.enqueued       += ring->stats.enqueued;
+        total.sent           += ring->stats.sent;
+        total.dropped_newest += ring->stats.dropped_newest;
+        total.dropped_oldest += ring->stats.dropped_oldest;
+        total.dropped_nomem  += ring->stats.dropped_nomem;
+        total.depth_peak      = SS_MAX(total.depth_peak, ring->stats.depth_peak);
+        depth                += rte_ring_count(ring->ring);
+        bytes                += ring->bytes;
+    }
+
+    printf("Egress statistics ==================================\n"
+           "Threads: %29u\n"
+           "Events enqueued: %21lu\n"
+           "Events sent: %25lu\n"
+           "Dropped newest: %22lu\n"
+           "Dropped oldest: %22lu\n"
+           "Dropped no memory: %19lu\n"
+           "Depth: %31lu\n"
+           "Depth peak: %26lu\n"
+           "Bytes held: %26lu\n",
+           ss_conf->egress_threads, total.enqueued, total.sent,
+           total.dropped_newest, total.dropped_oldest, total.dropped_nomem,
+           depth, total.depth_peak, bytes);
+    for (unsigned int lcore_id = 0; lcore_id < RTE_MAX_LCORE; ++lcore_id) {
+        ring = &egress_rings[lcore_id];
+        if (ring->ring == NULL || ring->stats.enqueued == 0) continue;
+        printf("Lcore %2u: Depth [%u] Peak [%lu] Bytes [%lu] Drops [%lu]\n",
+            lcore_id, rte_ring_count(ring->ring), ring->stats.depth_peak, ring->bytes,
+            ring->stats.dropped_newest + ring->stats.dropped_oldest + ring->stats.dropped_nomem);
+    }
+    printf("====================================================\n");
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <rte_memory.h>
+#include <rte_ring.h>
+
+#include "common.h"
+
+/* CONSTANTS */
+
+#define SS_EGRESS_THREADS_DEFAULT        1
+#define SS_EGRESS_THREADS_MAX           16
+#define SS_EGRESS_RING_SIZE           4096 // default events held per lcore
+#define SS_EGRESS_RING_SIZE_MAX  (1 << 20)
+#define SS_EGRESS_RING_BYTES     (16 << 20) // default message bytes held per lcore
+#define SS_EGRESS_BURST                 32 // events an egress thread takes from a ring at once
+#define SS_EGRESS_IDLE_USECS           100 // egress thread sleep when every ring was empty
+#define SS_EGRESS_SLOT_CLASSES           4 // event slot size classes, see egress.c
+
+/* what to give up when a ring is out of events or bytes */
+enum ss_egress_policy_e {
+    SS_EGRESS_DROP_NEWEST = 0, // the event being enqueued
+    SS_EGRESS_DROP_OLDEST = 1, // queued events, until the new one fits
+};
+
+typedef enum ss_egress_policy_e ss_egress_policy_t;
+
+/* DATA TYPES */
+
+/* one finished message, sent by an egress thread as if its lcore had */
+struct ss_egress_event_s {
+    nn_queue_t* nn_queue;
+    uint32_t    length;
+    uint8_t     slot_class; // the pool of the ring it goes back to
+    uint8_t     data[];
+};
+
+typedef struct ss_egress_event_s ss_egress_event_t;
+
+// sent is written by the egress thread, everything else by the lcore
+struct ss_egress_stats_s {
+    uint64_t enqueued;
+    uint64_t sent;
+    uint64_t dropped_newest;
+    uint64_t dropped_oldest;
+    uint64_t dropped_nomem;     // no free slot of the message size, or larger
+    uint64_t depth_peak;
+};
+
+typedef struct ss_egress_stats_s ss_egress_stats_t;
+
+/*
+ * Single producer: only its lcore enqueues. Consumers are the egress
+ * thread, and the lcore itself when it drops the oldest event.
+ */
+struct ss_egress_ring_s {
+    struct rte_ring*  ring;
+    uint64_t          bytes;    // held in queued events, updated atomically
+    unsigned int      lcore_id;
+    // event slots; only the lcore gets them, either side puts them back
+    rte_mempool_t*    slot_pools[SS_EGRESS_SLOT_CLASSES];
+    ss_egress_stats_t stats;
+} __rte_cache_aligned;
+
+typedef struct ss_egress_ring_s ss_egress_ring_t;
+
+struct ss_egress_thread_s {
+    pthread_t         thread;
+    unsigned int      id;
+    unsigned int      ring_count;
+    ss_egress_ring_t* rings[RTE_MAX_LCORE];
+};
+
+typedef struct ss_egress_thread_s ss_egress_thread_t;
+
+/* BEGIN PROTOTYPES */
+
+int ss_egress_init(void);
+void ss_egress_stop(void);
+const char* ss_egress_policy_dump(ss_egress_policy_t policy);
+ss_egress_ring_t* ss_egress_ring_get(void);
+ss_egress_event_t* ss_egress_event_alloc(ss_egress_ring_t* ring, nn_queue_t* nn_queue, uint32_t length);
+void ss_egress_event_enqueue(ss_egress_ring_t* ring, ss_egress_event_t* event);
+int ss_egress_stats_dump(void);
+
+/* END PROTOTYPES */
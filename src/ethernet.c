@@ -21,10 +21,11 @@
 #include "icmp.h"
 #include "ip.h"
 #include "ip_utils.h"
+#include "log.h"
 #include "sdn_sensor.h"
 #include "sensor_conf.h"
 
-void ss_frame_handle(rte_mbuf_t* mbuf, uint16_t lcore_id, uint8_t port_id) {
+void ss_frame_handle(rte_mbuf_t* mbuf, struct ss_flow_s* flow, uint64_t rx_tsc, uint16_t lcore_id, uint8_t port_id) {
     int rv;
     ss_frame_t rx_buf;
     ss_frame_t tx_buf;
@@ -34,17 +35,19 @@ void ss_frame_handle(rte_mbuf_t* mbuf, uint16_t lcore_id, uint8_t port_id) {
     ss_metadata_prepare(&tx_buf);
 
     rx_buf.mbuf           = mbuf;
+    rx_buf.flow           = flow;
+    rx_buf.rx_tsc         = rx_tsc;
     rx_buf.data.port_id   = port_id;
     rx_buf.data.direction = SS_FRAME_RX;
     rx_buf.data.length    = (uint16_t) rte_pktmbuf_pkt_len(mbuf);
     
     if (rx_buf.data.length < sizeof(eth_hdr_t)) {
-        RTE_LOG(ERR, L2, "received runt Ethernet frame of length %u:\n", rx_buf.data.length);
-        rte_pktmbuf_dump(stderr, mbuf, rte_pktmbuf_pkt_len(mbuf));
+        SS_LOG(ERR, L2, "received runt Ethernet frame of length %u:\n", rx_buf.data.length);
+        if (SS_LOG_ENABLED(DEBUG)) rte_pktmbuf_dump(stderr, mbuf, rte_pktmbuf_pkt_len(mbuf));
         goto out;
     }
     rx_buf.eth = rte_pktmbuf_mtod(mbuf, eth_hdr_t*);
-    RTE_LOG(DEBUG, L2, "rx eth frame: src: %s, dst: %s, type: 0x%04hx\n",
+    SS_LOG(DEBUG, L2, "rx eth frame: src: %s, dst: %s, type: 0x%04hx\n",
         ss_ether_addr_dump(&rx_buf.eth->s_addr),
         ss_ether_addr_dump(&rx_buf.eth->d_addr),
         rte_bswap16(rx_buf.eth->ether_type));
@@ -54,19 +57,19 @@ void ss_frame_handle(rte_mbuf_t* mbuf, uint16_t lcore_id, uint8_t port_id) {
     uint16_t ether_type = rte_bswap16(rx_buf.eth->ether_type);
     rx_buf.data.eth_type = ether_type;
     if (ether_type == ETHER_TYPE_VLAN) {
-        RTE_LOG(NOTICE, L2, "port %u attempting decode of VLAN frame\n", port_id);
-        if (rte_get_log_level() >= RTE_LOG_DEBUG)
+        SS_LOG(NOTICE, L2, "port %u attempting decode of VLAN frame\n", port_id);
+        if (SS_LOG_ENABLED(DEBUG))
             rte_pktmbuf_dump(stderr, mbuf, rte_pktmbuf_pkt_len(mbuf));
         rx_buf.ethv = rte_pktmbuf_mtod(mbuf, eth_vhdr_t*);
         rx_buf.eth = (eth_hdr_t*) ((uint8_t*) rx_buf.eth + sizeof(eth_vhdr_t));
     }
     
-    RTE_LOG(FINE, L2, "process frame type 0x%04hx size %u\n", ether_type, rte_pktmbuf_pkt_len(mbuf));
+    SS_LOG(FINE, L2, "process frame type 0x%04hx size %u\n", ether_type, rte_pktmbuf_pkt_len(mbuf));
     
     switch (ether_type) {
         case ETHER_TYPE_VLAN: {
-            if (rte_get_log_level() >= RTE_LOG_FINEST) {
-                RTE_LOG(INFO, L2, "port %u received unsupported VLAN frame:\n", port_id);
+            if (SS_LOG_ENABLED(FINEST)) {
+                SS_LOG(INFO, L2, "port %u received unsupported VLAN frame:\n", port_id);
                 rte_pktmbuf_dump(stderr, mbuf, rte_pktmbuf_pkt_len(mbuf));
             }
             break;
@@ -77,8 +80,8 @@ void ss_frame_handle(rte_mbuf_t* mbuf, uint16_t lcore_id, uint8_t port_id) {
         }
         case ETHER_TYPE_IPV4: {
             if (rx_buf.data.length < sizeof(eth_hdr_t) + sizeof(ip4_hdr_t)) {
-                RTE_LOG(ERR, L3L4, "received runt IPv4 frame of length %u:\n", rx_buf.data.length);
-                rte_pktmbuf_dump(stderr, mbuf, rte_pktmbuf_pkt_len(mbuf));
+                SS_LOG(ERR, L3L4, "received runt IPv4 frame of length %u:\n", rx_buf.data.length);
+                if (SS_LOG_ENABLED(DEBUG)) rte_pktmbuf_dump(stderr, mbuf, rte_pktmbuf_pkt_len(mbuf));
                 goto out;
             }
             ss_frame_handle_ip4(&rx_buf, &tx_buf);
@@ -86,16 +89,16 @@ void ss_frame_handle(rte_mbuf_t* mbuf, uint16_t lcore_id, uint8_t port_id) {
         }
         case ETHER_TYPE_IPV6: {
             if (rx_buf.data.length < sizeof(eth_hdr_t) + sizeof(ip6_hdr_t)) {
-                RTE_LOG(ERR, L3L4, "received runt IPv6 frame of length %u:\n", rx_buf.data.length);
-                rte_pktmbuf_dump(stderr, mbuf, rte_pktmbuf_pkt_len(mbuf));
+                SS_LOG(ERR, L3L4, "received runt IPv6 frame of length %u:\n", rx_buf.data.length);
+                if (SS_LOG_ENABLED(DEBUG)) rte_pktmbuf_dump(stderr, mbuf, rte_pktmbuf_pkt_len(mbuf));
                 goto out;
             }
             ss_frame_handle_ip6(&rx_buf, &tx_buf);
             break;
         }
         default: {
-            if (rte_get_log_level() >= RTE_LOG_FINER) {
-                RTE_LOG(FINER, L2, "port %u received unsupported 0x%04hx frame:\n", port_id, ether_type);
+            if (SS_LOG_ENABLED(FINER)) {
+                SS_LOG(FINER, L2, "port %u received unsupported 0x%04hx frame:\n", port_id, ether_type);
                 rte_pktmbuf_dump(stderr, mbuf, rte_pktmbuf_pkt_len(mbuf));
             }
             break;
@@ -106,27 +109,27 @@ void ss_frame_handle(rte_mbuf_t* mbuf, uint16_t lcore_id, uint8_t port_id) {
     
     rv = ss_extract_eth(&rx_buf);
     if (rv) {
-        RTE_LOG(WARNING, L2, "port %u ethernet RX hook failed\n", port_id);
-        rte_pktmbuf_dump(stderr, mbuf, rte_pktmbuf_pkt_len(mbuf));
+        SS_LOG(WARNING, L2, "port %u ethernet RX hook failed\n", port_id);
+        if (SS_LOG_ENABLED(DEBUG)) rte_pktmbuf_dump(stderr, mbuf, rte_pktmbuf_pkt_len(mbuf));
     }
 
     rte_pktmbuf_free(rx_buf.mbuf);
     rx_buf.mbuf = NULL;
 
     if (tx_buf.active && tx_buf.mbuf) {
-        RTE_LOG(DEBUG, L2, "sending tx_buf size %d\n", rte_pktmbuf_pkt_len(tx_buf.mbuf));
+        SS_LOG(DEBUG, L2, "sending tx_buf size %d\n", rte_pktmbuf_pkt_len(tx_buf.mbuf));
         rv = ss_send_packet(tx_buf.mbuf, tx_buf.data.port_id, lcore_id);
         if (rv) {
-            RTE_LOG(ERR, L2, "could not transmit tx_buf, rv: %d\n", rv);
+            SS_LOG(ERR, L2, "could not transmit tx_buf, rv: %d\n", rv);
             // XXX: what would we do here?
             rte_pktmbuf_free(tx_buf.mbuf);
             tx_buf.mbuf = NULL;
         }
     }
     else {
-        RTE_LOG(FINEST, L2, "not sending tx_buf marked inactive\n");
+        SS_LOG(FINEST, L2, "not sending tx_buf marked inactive\n");
         if (tx_buf.mbuf) {
-            rte_pktmbuf_dump(stderr, tx_buf.mbuf, rte_pktmbuf_pkt_len(tx_buf.mbuf));
+            if (SS_LOG_ENABLED(DEBUG)) rte_pktmbuf_dump(stderr, tx_buf.mbuf, rte_pktmbuf_pkt_len(tx_buf.mbuf));
             rte_pktmbuf_free(tx_buf.mbuf);
             tx_buf.mbuf = NULL;
         }
@@ -138,23 +141,23 @@ int ss_frame_prepare_eth(ss_frame_t* tx_buf, uint8_t port_id, eth_addr_t* d_addr
 
     tx_buf->mbuf = rte_pktmbuf_alloc(ss_pool[rte_socket_id()]);
     if (tx_buf->mbuf == NULL) {
-        RTE_LOG(ERR, L2, "could not allocate ethernet mbuf\n");
+        SS_LOG(ERR, L2, "could not allocate ethernet mbuf\n");
         goto error_out;
     }
 
     rte_pktmbuf_reset(tx_buf->mbuf);
     tx_buf->eth = (eth_hdr_t*) rte_pktmbuf_append(tx_buf->mbuf, sizeof(eth_hdr_t));
     if (tx_buf->eth == NULL) {
-        RTE_LOG(ERR, L2, "could not allocate ethernet mbuf\n");
+        SS_LOG(ERR, L2, "could not allocate ethernet mbuf\n");
         goto error_out;
     }
     ether_addr_copy(d_addr, &tx_buf->eth->d_addr);
     ether_addr_copy(&port_eth_addrs[port_id], &tx_buf->eth->s_addr);
     tx_buf->eth->ether_type = rte_bswap16(type);
-    RTE_LOG(FINER, L2, "prepare eth src %02x:%02x:%02x:%02x:%02x:%02x\n",
+    SS_LOG(FINER, L2, "prepare eth src %02x:%02x:%02x:%02x:%02x:%02x\n",
         tx_buf->eth->s_addr.addr_bytes[0], tx_buf->eth->s_addr.addr_bytes[1], tx_buf->eth->s_addr.addr_bytes[2],
         tx_buf->eth->s_addr.addr_bytes[3], tx_buf->eth->s_addr.addr_bytes[4], tx_buf->eth->s_addr.addr_bytes[5]);
-    RTE_LOG(FINER, L2, "prepare eth dst %02x:%02x:%02x:%02x:%02x:%02x\n",
+    SS_LOG(FINER, L2, "prepare eth dst %02x:%02x:%02x:%02x:%02x:%02x\n",
         tx_buf->eth->d_addr.addr_bytes[0], tx_buf->eth->d_addr.addr_bytes[1], tx_buf->eth->d_addr.addr_bytes[2],
         tx_buf->eth->d_addr.addr_bytes[3], tx_buf->eth->d_addr.addr_bytes[4], tx_buf->eth->d_addr.addr_bytes[5]);
     tx_buf->active = 1;
@@ -180,10 +183,10 @@ int ss_frame_handle_arp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
 
     rx_buf->arp = (arp_hdr_t*) ((uint8_t*) rte_pktmbuf_mtod(rx_buf->mbuf, uint8_t*) + sizeof(eth_hdr_t));
     
-    if (rte_get_log_level() >= RTE_LOG_FINE) {
+    if (SS_LOG_ENABLED(FINE)) {
         uint32_t sip = *(uint32_t*) &rx_buf->arp->arp_spa;
         uint32_t dip = *(uint32_t*) &rx_buf->arp->arp_tpa;
-        RTE_LOG(FINE, L2, "arp: eth src: %s, eth dst: %s, ip src: 0x%04x, ip dst: 0x%04x, in dst: 0x%04x, packet:\n",
+        SS_LOG(FINE, L2, "arp: eth src: %s, eth dst: %s, ip src: 0x%04x, ip dst: 0x%04x, in dst: 0x%04x, packet:\n",
             ss_ether_addr_dump((struct ether_addr*) &rx_buf->arp->arp_sha),
             ss_ether_addr_dump((struct ether_addr*) &rx_buf->arp->arp_tha),
             rte_bswap32(sip), rte_bswap32(dip), ss_conf->ip4_address.ip4_addr.addr);
@@ -192,19 +195,19 @@ int ss_frame_handle_arp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
 
     int is_ip_daddr_ok = memcmp(&rx_buf->arp->arp_tpa, &ss_conf->ip4_address.ip4_addr, IPV4_ALEN) == 0;
     if (!is_ip_daddr_ok) {
-        RTE_LOG(FINEST, L2, "arp request is not for this system, ignoring\n");
+        SS_LOG(FINEST, L2, "arp request is not for this system, ignoring\n");
         goto error_out;
     }
 
     rv = ss_frame_prepare_eth(tx_buf, rx_buf->data.port_id, (eth_addr_t*) &rx_buf->eth->s_addr, ETHER_TYPE_ARP);
     if (rv) {
-        RTE_LOG(ERR, L2, "could not prepare ethernet mbuf\n");
+        SS_LOG(ERR, L2, "could not prepare ethernet mbuf\n");
         goto error_out;
     }
 
     tx_buf->arp = (arp_hdr_t*) rte_pktmbuf_append(tx_buf->mbuf, sizeof(arp_hdr_t));
     if (tx_buf->arp == NULL) {
-        RTE_LOG(ERR, L2, "could not allocate mbuf arp header\n");
+        SS_LOG(ERR, L2, "could not allocate mbuf arp header\n");
         goto error_out;
     }
     tx_buf->arp->arp_hrd = rte_bswap16(ARPHRD_ETHER);
@@ -223,7 +226,7 @@ int ss_frame_handle_arp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
 
     error_out:
     if (tx_buf->mbuf) {
-        RTE_LOG(ERR, L2, "could not process arp frame\n");
+        SS_LOG(ERR, L2, "could not process arp frame\n");
         tx_buf->active = 0;
         rte_pktmbuf_free(tx_buf->mbuf);
         tx_buf->mbuf = NULL;
@@ -236,7 +239,7 @@ int ss_frame_handle_ndp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
 
     rx_buf->ndp_rx = (ndp_request_t*) ((uint8_t*) rx_buf->ip6 + sizeof(ip6_hdr_t));
     
-    if (rte_get_log_level() >= RTE_LOG_FINE) {
+    if (SS_LOG_ENABLED(FINE)) {
         rte_memdump(stderr, "ndp dst", &rx_buf->ndp_rx->hdr.nd_ns_target, sizeof(rx_buf->ndp_rx->hdr.nd_ns_target));
         rte_memdump(stderr, "self   ", &ss_conf->ip6_address.ip6_addr, sizeof(ss_conf->ip6_address.ip6_addr));
         rte_pktmbuf_dump(stderr, rx_buf->mbuf, rte_pktmbuf_pkt_len(rx_buf->mbuf));
@@ -244,19 +247,19 @@ int ss_frame_handle_ndp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
 
     int is_ndp_saddr_ok = memcmp(&rx_buf->ndp_rx->hdr.nd_ns_target, &ss_conf->ip6_address.ip6_addr, sizeof(rx_buf->ndp_rx->hdr.nd_ns_target)) == 0;
     if (!is_ndp_saddr_ok) {
-        RTE_LOG(FINEST, L2, "ndp request is not for this system, ignoring\n");
+        SS_LOG(FINEST, L2, "ndp request is not for this system, ignoring\n");
         goto error_out;
     }
 
     rv = ss_frame_prepare_eth(tx_buf, rx_buf->data.port_id, (eth_addr_t*) &rx_buf->eth->s_addr, ETHER_TYPE_IPV6);
     if (rv) {
-        RTE_LOG(ERR, L2, "could not prepare ethernet mbuf\n");
+        SS_LOG(ERR, L2, "could not prepare ethernet mbuf\n");
         goto error_out;
     }
 
     tx_buf->ip6 = (ip6_hdr_t*) rte_pktmbuf_append(tx_buf->mbuf, sizeof(ip6_hdr_t));
     if (tx_buf->ip6 == NULL) {
-        RTE_LOG(ERR, L2, "could not allocate mbuf ipv6 header\n");
+        SS_LOG(ERR, L2, "could not allocate mbuf ipv6 header\n");
         goto error_out;
     }
     tx_buf->ip6->ip6_flow = rte_bswap32(0x60000000);
@@ -269,7 +272,7 @@ int ss_frame_handle_ndp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
     tx_buf->ndp_tx = (ndp_reply_t*) rte_pktmbuf_append(tx_buf->mbuf, sizeof(ndp_reply_t));
     tx_buf->icmp6  = (icmp6_hdr_t*) tx_buf->ndp_tx;
     if (tx_buf->ndp_tx == NULL) {
-        RTE_LOG(ERR, L2, "could not allocate mbuf ndp header\n");
+        SS_LOG(ERR, L2, "could not allocate mbuf ndp header\n");
         goto error_out;
     }
     tx_buf->ndp_tx->hdr.nd_na_type     = ND_NEIGHBOR_ADVERT;
@@ -292,7 +295,7 @@ int ss_frame_handle_ndp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
 
     rv = ss_frame_prepare_icmp6(tx_buf, (uint8_t*) tx_buf->ndp_tx, sizeof(ndp_reply_t));
     if (rv) {
-        RTE_LOG(ERR, L2, "could not prepare ndp frame\n");
+        SS_LOG(ERR, L2, "could not prepare ndp frame\n");
         goto error_out;
     }
 
@@ -300,7 +303,7 @@ int ss_frame_handle_ndp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
 
     error_out:
     if (tx_buf->mbuf) {
-        RTE_LOG(ERR, L2, "could not process ndp frame\n");
+        SS_LOG(ERR, L2, "could not process ndp frame\n");
         tx_buf->active = 0;
         rte_pktmbuf_free(tx_buf->mbuf);
         tx_buf->mbuf = NULL;
@@ -0,0 +1,91 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "event_schema.h"
+
+static const ss_event_field_info_t ss_event_fields[SS_FIELD_MAX] = {
+    [SS_FIELD_SOURCE]           = { "source",           SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_RULE]             = { "rule",             SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_SEQ_NUM]          = { "seq_num",          SS_EVENT_VALUE_INT     },
+    [SS_FIELD_PORT_ID]          = { "port_id",          SS_EVENT_VALUE_INT     },
+    [SS_FIELD_DIRECTION]        = { "direction",        SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_SELF]             = { "self",             SS_EVENT_VALUE_INT     },
+    [SS_FIELD_LENGTH]           = { "length",           SS_EVENT_VALUE_INT     },
+    [SS_FIELD_ETH_TYPE]         = { "eth_type",         SS_EVENT_VALUE_INT     },
+    [SS_FIELD_SMAC]             = { "smac",             SS_EVENT_VALUE_MAC     },
+    [SS_FIELD_DMAC]             = { "dmac",             SS_EVENT_VALUE_MAC     },
+    [SS_FIELD_SIP]              = { "sip",              SS_EVENT_VALUE_ADDRESS },
+    [SS_FIELD_DIP]              = { "dip",              SS_EVENT_VALUE_ADDRESS },
+    [SS_FIELD_IP_PROTOCOL]      = { "ip_protocol",      SS_EVENT_VALUE_INT     },
+    [SS_FIELD_TTL]              = { "ttl",              SS_EVENT_VALUE_INT     },
+    [SS_FIELD_L4_LENGTH]        = { "l4_length",        SS_EVENT_VALUE_INT     },
+    [SS_FIELD_ICMP_TYPE]        = { "icmp_type",        SS_EVENT_VALUE_INT     },
+    [SS_FIELD_ICMP_CODE]        = { "icmp_code",        SS_EVENT_VALUE_INT     },
+    [SS_FIELD_SPORT]            = { "sport",            SS_EVENT_VALUE_INT     },
+    [SS_FIELD_DPORT]            = { "dport",            SS_EVENT_VALUE_INT     },
+    [SS_FIELD_DNS_NAME]         = { "dns_name",         SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_FILE_ID]          = { "file_id",          SS_EVENT_VALUE_INT     },
+    [SS_FIELD_IOC_ID]           = { "ioc_id",           SS_EVENT_VALUE_INT     },
+    [SS_FIELD_TYPE]             = { "type",             SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_THREAT_TYPE]      = { "threat_type",      SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_IP]               = { "ip",               SS_EVENT_VALUE_ADDRESS },
+    [SS_FIELD_VALUE]            = { "value",            SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_DNS]              = { "dns",              SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_SYSLOG_FORMAT]    = { "syslog_format",    SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_SYSLOG_FACILITY]  = { "syslog_facility",  SS_EVENT_VALUE_INT     },
+    [SS_FIELD_SYSLOG_SEVERITY]  = { "syslog_severity",  SS_EVENT_VALUE_INT     },
+    [SS_FIELD_SYSLOG_TIMESTAMP] = { "syslog_timestamp", SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_SYSLOG_HOST]      = { "syslog_host",      SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_SYSLOG_APP_NAME]  = { "syslog_app_name",  SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_SYSLOG_PROCID]    = { "syslog_procid",    SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_SYSLOG_MSGID]     = { "syslog_msgid",     SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_SYSLOG_SD]        = { "syslog_sd",        SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_SYSLOG_MSG]       = { "syslog_msg",       SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_MESSAGE]          = { "message",          SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_REASON]           = { "reason",           SS_EVENT_VALUE_STRING  },
+    [SS_FIELD_FWD_PACKETS]      = { "fwd_packets",      SS_EVENT_VALUE_INT     },
+    [SS_FIELD_FWD_BYTES]        = { "fwd_bytes",        SS_EVENT_VALUE_INT     },
+    [SS_FIELD_FWD_TCP_FLAGS]    = { "fwd_tcp_flags",    SS_EVENT_VALUE_INT     },
+    [SS_FIELD_FWD_FIRST]        = { "fwd_first",        SS_EVENT_VALUE_INT     },
+    [SS_FIELD_FWD_LAST]         = { "fwd_last",         SS_EVENT_VALUE_INT     },
+    [SS_FIELD_REV_PACKETS]      = { "rev_packets",      SS_EVENT_VALUE_INT     },
+    [SS_FIELD_REV_BYTES]        = { "rev_bytes",        SS_EVENT_VALUE_INT     },
+    [SS_FIELD_REV_TCP_FLAGS]    = { "rev_tcp_flags",    SS_EVENT_VALUE_INT     },
+    [SS_FIELD_REV_FIRST]        = { "rev_first",        SS_EVENT_VALUE_INT     },
+    [SS_FIELD_REV_LAST]         = { "rev_last",         SS_EVENT_VALUE_INT     },
+    [SS_FIELD_TAG]              = { "tag",              SS_EVENT_VALUE_STRING  },
+};
+
+/* NULL for ids this version does not know, which readers skip */
+const ss_event_field_info_t* ss_event_field_info(uint32_t field) {
+    if (field >= SS_FIELD_MAX || ss_event_fields[field].name == NULL) return NULL;
+    return &ss_event_fields[field];
+}
+
+const char* ss_event_field_name(ss_event_field_t field) {
+    const ss_event_field_info_t* info = ss_event_field_info(field);
+    return info ? info->name : "unknown";
+}
+
+/* for the config: the field with this name, or 0, which no field uses */
+ss_event_field_t ss_event_field_lookup(const char* name) {
+    for (uint32_t field = 1; field < SS_FIELD_MAX; ++field) {
+        if (ss_event_fields[field].name && !strcmp(ss_event_fields[field].name, name)) return (ss_event_field_t) field;
+    }
+    return (ss_event_field_t) 0;
+}
+
+ss_event_wire_t ss_event_field_wire(ss_event_field_t field) {
+    const ss_event_field_info_t* info = ss_event_field_info(field);
+    return info && info->value == SS_EVENT_VALUE_INT ? SS_EVENT_WIRE_VARINT : SS_EVENT_WIRE_BYTES;
+}
+
+const char* ss_event_type_dump(ss_event_type_t type) {
+    switch (type) {
+        case SS_EVENT_FRAME:  return "frame";
+        case SS_EVENT_SYSLOG: return "syslog";
+        case SS_EVENT_FLOW:   return "flow";
+        default:              return "unknown";
+    }
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Binary event encoding, version 1. Shared by the sensor and by the
+ * standalone decoder in tools/, so it must not pull in DPDK.
+ *
+ * Every message is one event:
+ *
+ *   header   8 bytes: 'S' 'E' version type length[2] fields[2]
+ *            length (whole message, header included) and fields are
+ *            big-endian
+ *   body     fields, each a varint tag (field id << 3 | wire type)
+ *            wire 0: zigzag varint, wire 2: varint length then bytes
+ *
+ * The body is protobuf wire format; doc/sdn_sensor_event.proto
+ * describes it for consumers with a protobuf runtime. Field ids are
+ * shared across event types and are never renumbered or reused: new
+ * fields get new ids, and readers skip ids they do not know.
+ */
+
+/* CONSTANTS */
+
+#define SS_EVENT_MAGIC          "SE"
+#define SS_EVENT_VERSION           1
+#define SS_EVENT_HEADER_SIZE       8
+#define SS_EVENT_SIZE_MAX      65535 // length is 16 bits
+#define SS_EVENT_TAG_SHIFT         3
+
+enum ss_event_type_e {
+    SS_EVENT_FRAME  = 1,
+    SS_EVENT_SYSLOG = 2,
+    SS_EVENT_FLOW   = 3,
+    SS_EVENT_MAX,
+};
+
+typedef enum ss_event_type_e ss_event_type_t;
+
+enum ss_event_wire_e {
+    SS_EVENT_WIRE_VARINT = 0,
+    SS_EVENT_WIRE_BYTES  = 2,
+};
+
+typedef enum ss_event_wire_e ss_event_wire_t;
+
+/* what the bytes of a field mean, for validation and printing */
+enum ss_event_value_e {
+    SS_EVENT_VALUE_INT     = 1, // zigzag varint
+    SS_EVENT_VALUE_STRING  = 2, // text, not NUL-terminated
+    SS_EVENT_VALUE_ADDRESS = 3, // raw IPv4 or IPv6 address, 4 or 16 bytes
+    SS_EVENT_VALUE_MAC     = 4, // raw Ethernet address, 6 bytes
+};
+
+typedef enum ss_event_value_e ss_event_value_t;
+
+enum ss_event_field_e {
+    SS_FIELD_SOURCE           =  1,
+    SS_FIELD_RULE             =  2,
+    SS_FIELD_SEQ_NUM          =  3,
+    SS_FIELD_PORT_ID          =  4,
+    SS_FIELD_DIRECTION        =  5,
+    SS_FIELD_SELF             =  6,
+    SS_FIELD_LENGTH           =  7,
+    SS_FIELD_ETH_TYPE         =  8,
+    SS_FIELD_SMAC             =  9,
+    SS_FIELD_DMAC             = 10,
+    SS_FIELD_SIP              = 11,
+    SS_FIELD_DIP              = 12,
+    SS_FIELD_IP_PROTOCOL      = 13,
+    SS_FIELD_TTL              = 14,
+    SS_FIELD_L4_LENGTH        = 15,
+    SS_FIELD_ICMP_TYPE        = 16,
+    SS_FIELD_ICMP_CODE        = 17,
+    SS_FIELD_SPORT            = 18,
+    SS_FIELD_DPORT            = 19,
+    SS_FIELD_DNS_NAME         = 20,
+    SS_FIELD_FILE_ID          = 21,
+    SS_FIELD_IOC_ID           = 22,
+    SS_FIELD_TYPE             = 23,
+    SS_FIELD_THREAT_TYPE      = 24,
+    SS_FIELD_IP               = 25,
+    SS_FIELD_VALUE            = 26,
+    SS_FIELD_DNS              = 27,
+    SS_FIELD_SYSLOG_FORMAT    = 28,
+    SS_FIELD_SYSLOG_FACILITY  = 29,
+    SS_FIELD_SYSLOG_SEVERITY  = 30,
+    SS_FIELD_SYSLOG_TIMESTAMP = 31,
+    SS_FIELD_SYSLOG_HOST      = 32,
+    SS_FIELD_SYSLOG_APP_NAME  = 33,
+    SS_FIELD_SYSLOG_PROCID    = 34,
+    SS_FIELD_SYSLOG_MSGID     = 35,
+    SS_FIELD_SYSLOG_SD        = 36,
+    SS_FIELD_SYSLOG_MSG       = 37,
+    SS_FIELD_MESSAGE          = 38,
+    SS_FIELD_REASON           = 39,
+    SS_FIELD_FWD_PACKETS      = 40,
+    SS_FIELD_FWD_BYTES        = 41,
+    SS_FIELD_FWD_TCP_FLAGS    = 42,
+    SS_FIELD_FWD_FIRST        = 43,
+    SS_FIELD_FWD_LAST         = 44,
+    SS_FIELD_REV_PACKETS      = 45,
+    SS_FIELD_REV_BYTES        = 46,
+    SS_FIELD_REV_TCP_FLAGS    = 47,
+    SS_FIELD_REV_FIRST        = 48,
+    SS_FIELD_REV_LAST         = 49,
+    SS_FIELD_TAG              = 50, // "key=value", one per nm_tags entry
+    SS_FIELD_MAX,
+};
+
+typedef enum ss_event_field_e ss_event_field_t;
+
+/* DATA TYPES */
+
+struct ss_event_header_s {
+    uint8_t  magic[2];
+    uint8_t  version;
+    uint8_t  type;
+    uint16_t length;
+    uint16_t fields;
+} __attribute__((packed));
+
+typedef struct ss_event_header_s ss_event_header_t;
+
+struct ss_event_field_info_s {
+    const char*      name;  // the JSON key, also used by the decoder
+    ss_event_value_t value;
+};
+
+typedef struct ss_event_field_info_s ss_event_field_info_t;
+
+/* BEGIN PROTOTYPES */
+
+const ss_event_field_info_t* ss_event_field_info(uint32_t field);
+const char* ss_event_field_name(ss_event_field_t field);
+ss_event_field_t ss_event_field_lookup(const char* name);
+ss_event_wire_t ss_event_field_wire(ss_event_field_t field);
+const char* ss_event_type_dump(ss_event_type_t type);
+
+/* END PROTOTYPES */
@@ -0,0 +1,197 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rte_branch_prediction.h>
+#include <rte_byteorder.h>
+#include <rte_log.h>
+
+#include <jemalloc/jemalloc.h>
+
+#include <json-c/json.h>
+#include <json-c/json_object_private.h>
+
+#include "common.h"
+#include "event_schema.h"
+#include "event_writer.h"
+#include "json_writer.h"
+
+void ss_event_writer_init(ss_event_writer_t* writer, nn_queue_t* nn_queue, ss_event_type_t type, uint8_t* data, size_t size) {
+    ss_event_header_t header;
+
+    memset(writer, 0, sizeof(*writer));
+    writer->encoding    = nn_queue->encoding;
+    writer->data        = data;
+    writer->field_mask  = nn_queue->field_mask;
+    writer->field_names = nn_queue->field_names;
+    writer->tags        = nn_queue->tags;
+    writer->tags_length = nn_queue->tags_length;
+    writer->tags_fields = nn_queue->tags_fields;
+    if (writer->encoding != NN_ENCODING_BINARY) {
+        ss_json_writer_init(&writer->json, data, size);
+        ss_json_writer_object_start(&writer->json, NULL);
+        return;
+    }
+
+    writer->size = size < SS_EVENT_SIZE_MAX ? size : SS_EVENT_SIZE_MAX;
+    if (writer->data == NULL || writer->size < SS_EVENT_HEADER_SIZE) {
+        writer->overflow = 1;
+        return;
+    }
+    // length and fields are filled in by finish
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SS_EVENT_MAGIC, sizeof(header.magic));
+    header.version = SS_EVENT_VERSION;
+    header.type    = (uint8_t) type;
+    memcpy(writer->data, &header, sizeof(header));
+    writer->length = sizeof(header);
+}
+
+static inline void ss_event_writer_append(ss_event_writer_t* writer, const void* data, size_t length) {
+    if (unlikely(writer->length + length > writer->size)) {
+        writer->overflow = 1;
+        return;
+    }
+    memcpy(writer->data + writer->length, data, length);
+    writer->length += length;
+}
+
+static inline void ss_event_writer_varint(ss_event_writer_t* writer, uint64_t value) {
+    uint8_t bytes[10];
+    size_t count = 0;
+
+    while (value >= 0x80) {
+        bytes[count++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    bytes[count++] = (uint8_t) value;
+    ss_event_writer_append(writer, bytes, count);
+}
+
+static inline const char* ss_event_writer_key(ss_event_writer_t* writer, ss_event_field_t field) {
+    return writer->field_names ? writer->field_names[field] : ss_event_field_name(field);
+}
+
+static inline void ss_event_writer_tag(ss_event_writer_t* writer, ss_event_field_t field, ss_event_wire_t wire) {
+    ss_event_writer_varint(writer, ((uint64_t) field << SS_EVENT_TAG_SHIFT) | wire);
+    ++writer->fields;
+}
+
+void ss_event_writer_string(ss_event_writer_t* writer, ss_event_field_t field, const char* value) {
+    if (!SS_EVENT_WRITER_WANTS(writer, field)) return;
+    ss_event_writer_string_len(writer, field, value, strlen(value));
+}
+
+void ss_event_writer_string_len(ss_event_writer_t* writer, ss_event_field_t field, const char* value, size_t length) {
+    if (!SS_EVENT_WRITER_WANTS(writer, field)) return;
+    if (writer->encoding != NN_ENCODING_BINARY) {
+        ss_json_writer_string_len(&writer->json, ss_event_writer_key(writer, field), value, length);
+        return;
+    }
+    ss_event_writer_bytes(writer, field, (const uint8_t*) value, length);
+}
+
+void ss_event_writer_int(ss_event_writer_t* writer, ss_event_field_t field, int64_t value) {
+    if (!SS_EVENT_WRITER_WANTS(writer, field)) return;
+    if (writer->encoding != NN_ENCODING_BINARY) {
+        ss_json_writer_int64(&writer->json, ss_event_writer_key(writer, field), value);
+        return;
+    }
+    ss_event_writer_tag(writer, field, SS_EVENT_WIRE_VARINT);
+    // zigzag, so small negative numbers stay short
+    ss_event_writer_varint(writer, ((uint64_t) value << 1) ^ (uint64_t) (value >> 63));
+}
+
+/* binary only: JSON callers format addresses as text and use string */
+void ss_event_writer_bytes(ss_event_writer_t* writer, ss_event_field_t field, const uint8_t* value, size_t length) {
+    if (writer->encoding != NN_ENCODING_BINARY || !SS_EVENT_WRITER_WANTS(writer, field)) return;
+    ss_event_writer_tag(writer, field, SS_EVENT_WIRE_BYTES);
+    ss_event_writer_varint(writer, length);
+    ss_event_writer_append(writer, value, length);
+}
+
+/* returns the message length, or -1 when it did not fit */
+int ss_event_writer_finish(ss_event_writer_t* writer) {
+    ss_event_header_t* header;
+
+    if (writer->encoding != NN_ENCODING_BINARY) {
+        ss_json_writer_members(&writer->json, writer->tags, writer->tags_length);
+        ss_json_writer_object_end(&writer->json);
+        if (ss_json_writer_finish(&writer->json) < 0) {
+            RTE_LOG(ERR, MD, "json writer out of space after %zu bytes\n", writer->json.length);
+            return -1;
+        }
+        return (int) writer->json.length;
+    }
+
+    if (writer->tags_length) {
+        ss_event_writer_append(writer, writer->tags, writer->tags_length);
+        writer->fields = (uint16_t) (writer->fields + writer->tags_fields);
+    }
+    if (writer->overflow || writer->data == NULL) {
+        RTE_LOG(ERR, MD, "event writer out of space after %zu bytes\n", writer->length);
+        return -1;
+    }
+    header = (ss_event_header_t*) writer->data;
+    header->length = rte_cpu_to_be_16((uint16_t) writer->length);
+    header->fields = rte_cpu_to_be_16(writer->fields);
+    return (int) writer->length;
+}
+
+/*
+ * Encodes nm_tags once, in the queue's encoding, for finish to copy into
+ * every event: JSON members, or binary tag fields holding "key=value".
+ * Values are strings or integers.
+ */
+int ss_event_writer_tags_build(nn_queue_t* nn_queue, json_object* tags) {
+    uint8_t data[SS_EVENT_SIZE_MAX];
+    char text[SS_EVENT_SIZE_MAX];
+    ss_event_writer_t writer;
+    const uint8_t* start;
+    int length;
+
+    ss_event_writer_init(&writer, nn_queue, SS_EVENT_FRAME, data, sizeof(data));
+    // the tags themselves are written whatever nm_fields says
+    writer.field_mask  = ~0ULL;
+    writer.tags_length = 0;
+    writer.tags_fields = 0;
+    json_object_object_foreach(tags, key, value) {
+        if (!json_object_is_type(value, json_type_string) && !json_object_is_type(value, json_type_int)) {
+            fprintf(stderr, "nm_tags %s is not string or int\n", key);
+            return -1;
+        }
+        if (writer.encoding != NN_ENCODING_BINARY) {
+            if (json_object_is_type(value, json_type_int)) ss_json_writer_int64(&writer.json, key, json_object_get_int64(value));
+            else                                           ss_json_writer_string(&writer.json, key, json_object_get_string(value));
+            continue;
+        }
+        snprintf(text, sizeof(text), "%s=%s", key, json_object_get_string(value));
+        ss_event_writer_string(&writer, SS_FIELD_TAG, text);
+    }
+    length = ss_event_writer_finish(&writer);
+    if (length < 0) {
+        fprintf(stderr, "nm_tags do not fit in an event\n");
+        return -1;
+    }
+
+    // JSON: the members between "{ " and " }", binary: the fields after the header
+    if (writer.encoding != NN_ENCODING_BINARY) {
+        start  = data + 2;
+        length = SS_MAX(length - 4, 0);
+    }
+    else {
+        start  = data + SS_EVENT_HEADER_SIZE;
+        length = length - SS_EVENT_HEADER_SIZE;
+    }
+    if (length == 0) return 0;
+    nn_queue->tags = je_malloc((size_t) length);
+    if (nn_queue->tags == NULL) {
+        fprintf(stderr, "could not allocate nm_tags\n");
+        return -1;
+    }
+    memcpy(nn_queue->tags, start, (size_t) length);
+    nn_queue->tags_length = (uint32_t) length;
+    nn_queue->tags_fields = writer.fields;
+    return 0;
+}
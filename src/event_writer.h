@@ -0,0 +1,59 @@
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <json-c/json.h>
+
+#include "event_schema.h"
+#include "json_writer.h"
+#include "nn_queue.h"
+
+/* MACROS */
+
+/* whether nm_fields keeps the field, so callers can skip formatting it */
+#define SS_EVENT_WRITER_WANTS(writer, field) ((writer)->field_mask & (1ULL << (field)))
+
+/* DATA TYPES */
+
+/*
+ * Writes one metadata event in the encoding of its nn_queue: JSON text
+ * through ss_json_writer_t, keyed by the schema field names, or the
+ * binary layout from event_schema.h. Running out of space is sticky
+ * and reported by ss_event_writer_finish, like the JSON writer.
+ *
+ * The queue's output template comes along: fields left out of nm_fields
+ * are skipped with one bit test, JSON keys come from nm_rename, and the
+ * nm_tags, encoded once at config time, are appended by finish.
+ */
+struct ss_event_writer_s {
+    nn_queue_encoding_t encoding;
+    ss_json_writer_t    json;
+    uint8_t*            data;
+    size_t              size;
+    size_t              length;
+    int                 overflow;
+    uint16_t            fields;
+    uint64_t            field_mask;
+    const char**        field_names;
+    const uint8_t*      tags;
+    uint32_t            tags_length;
+    uint16_t            tags_fields;
+};
+
+typedef struct ss_event_writer_s ss_event_writer_t;
+
+static_assert(SS_FIELD_MAX <= 64, "field_mask should hold one bit per event field");
+
+/* BEGIN PROTOTYPES */
+
+void ss_event_writer_init(ss_event_writer_t* writer, nn_queue_t* nn_queue, ss_event_type_t type, uint8_t* data, size_t size);
+void ss_event_writer_string(ss_event_writer_t* writer, ss_event_field_t field, const char* value);
+void ss_event_writer_string_len(ss_event_writer_t* writer, ss_event_field_t field, const char* value, size_t length);
+void ss_event_writer_int(ss_event_writer_t* writer, ss_event_field_t field, int64_t value);
+void ss_event_writer_bytes(ss_event_writer_t* writer, ss_event_field_t field, const uint8_t* value, size_t length);
+int ss_event_writer_finish(ss_event_writer_t* writer);
+int ss_event_writer_tags_build(nn_queue_t* nn_queue, json_object* tags);
+
+/* END PROTOTYPES */
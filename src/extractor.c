@@ -14,8 +14,10 @@
 #include "extractor.h"
 
 #include "common.h"
+#include "flow.h"
 #include "ioc.h"
 #include "ip_utils.h"
+#include "log.h"
 #include "metadata.h"
 #include "nn_queue.h"
 #include "re_utils.h"
@@ -25,6 +27,25 @@
 #include "dns.h"
 #include "mappings.h"
 
+/*
+ * Relay a frame match: metadata, or the frame itself on NN_FORMAT_PACKET
+ * queues, where rule_id is the IOC id or else a hash of the rule name.
+ * events holds the nn_event_class_t bits of the match, for nm_events.
+ */
+int ss_extract_frame_send(nn_queue_t* nn_queue, const char* source, const char* rule, ss_frame_t* fbuf, ss_ioc_entry_t* iptr, nn_packet_source_t packet_source, uint32_t events) {
+    uint8_t* metadata;
+    size_t mlength;
+    
+    if (!ss_nn_queue_wants(nn_queue, events)) return 0;
+    if (nn_queue->format == NN_FORMAT_PACKET) {
+        return ss_nn_queue_send_packet(nn_queue, fbuf, packet_source, iptr ? iptr->id : ss_nn_queue_rule_id(rule));
+    }
+    
+    metadata = ss_metadata_prepare_frame(source, rule, nn_queue, fbuf, iptr, &mlength);
+    if (metadata == NULL) return -1;
+    return ss_nn_queue_send(nn_queue, metadata, (uint16_t) mlength);
+}
+
 /*
  * Ethernet frame extractor function
  * Match raw traffic against pcap_chain
@@ -35,57 +56,48 @@ int ss_extract_eth(ss_frame_t* fbuf) {
     ss_pcap_entry_t* pptr;
     ss_pcap_entry_t* ptmp;
     ss_ioc_entry_t* iptr;
-    uint8_t* metadata;
-    uint64_t mlength;
     ss_pcap_match_t match;
     
-    rv = ss_pcap_match_prepare(&match, rte_pktmbuf_mtod(fbuf->mbuf, uint8_t*), (uint16_t) rte_pktmbuf_pkt_len(fbuf->mbuf));
+    rv = ss_pcap_match_prepare(&match, fbuf);
     if (rv) {
-        RTE_LOG(ERR, EXTRACTOR, "pcap match prepare, rv %d\n", rv);
+        SS_LOG(ERR, EXTRACTOR, "pcap match prepare, rv %d\n", rv);
         goto error_out;
     }
     
     TAILQ_FOREACH_SAFE(pptr, &ss_conf->pcap_chain.pcap_list, entry, ptmp) {
-        RTE_LOG(DEBUG, EXTRACTOR, "attempt match port %u frame direction %s against pcap rule %s\n",
+        SS_LOG(DEBUG, EXTRACTOR, "attempt match port %u frame direction %s against pcap rule %s\n",
             fbuf->data.port_id, ss_direction_dump(fbuf->data.direction), pptr->name);
         rv = ss_pcap_match(pptr, &match);
         if (rv > 0) {
             // match
-            RTE_LOG(INFO, EXTRACTOR, "successful match against pcap rule %s\n", pptr->name);
-            metadata = ss_metadata_prepare_frame("pcap", pptr->name, &pptr->nn_queue, fbuf, NULL);
-            // XXX: for now assume the output is C char*
-            mlength = strlen((char*) metadata);
-            //printf("metadata: %s\n", metadata);
-            rv = ss_nn_queue_send(&pptr->nn_queue, metadata, (uint16_t) mlength);
+            SS_LOG(INFO, EXTRACTOR, "successful match against pcap rule %s\n", pptr->name);
+            rv = ss_extract_frame_send(&pptr->nn_queue, "pcap", pptr->name, fbuf, NULL, NN_PACKET_PCAP, NN_EVENT_PCAP);
         }
         else if (rv == 0) {
             // no match
-            RTE_LOG(DEBUG, EXTRACTOR, "failed match against pcap rule %s\n", pptr->name);
+            SS_LOG(DEBUG, EXTRACTOR, "failed match against pcap rule %s\n", pptr->name);
         }
         else {
             // error
-            RTE_LOG(ERR, EXTRACTOR, "pcap match returned error %d\n", rv);
+            SS_LOG(ERR, EXTRACTOR, "pcap match returned error %d\n", rv);
         }
     }
     
-    iptr = ss_ioc_metadata_match(&fbuf->data);
+    // a tracked flow is matched once, on its first frame
+    iptr = fbuf->flow ? ss_flow_ioc_match(fbuf->flow, &fbuf->data) : ss_ioc_metadata_match(&fbuf->data);
     if (iptr) {
         // match
-        RTE_LOG(NOTICE, EXTRACTOR, "successful ioc match from frame\n");
+        SS_LOG(NOTICE, EXTRACTOR, "successful ioc match from frame\n");
         ss_ioc_entry_dump_dpdk(iptr);
         nn_queue_t* nn_queue = &ss_conf->ioc_files[iptr->file_id].nn_queue;
         // XXX: figure out what to put into "rule" field
-        metadata = ss_metadata_prepare_frame("frame_ioc", NULL, nn_queue, fbuf, iptr);
-        // XXX: for now assume the output is C char*
-        mlength = strlen((char*) metadata);
-        //printf("metadata: %s\n", metadata);
-        rv = ss_nn_queue_send(nn_queue, metadata, (uint16_t) mlength);
+        rv = ss_extract_frame_send(nn_queue, "frame_ioc", NULL, fbuf, iptr, NN_PACKET_IOC, NN_EVENT_IOC);
     }
     
     return 0;
     
     error_out:
-    RTE_LOG(ERR, EXTRACTOR, "match error port %u frame direction %s\n", fbuf->data.port_id, ss_direction_dump(fbuf->data.direction));
+    SS_LOG(ERR, EXTRACTOR, "match error port %u frame direction %s\n", fbuf->data.port_id, ss_direction_dump(fbuf->data.direction));
     return -1;
 }
 
@@ -94,8 +106,6 @@ int ss_extract_dns(ss_frame_t* fbuf) {
     ss_dns_entry_t* dtmp;
     ss_ioc_entry_t* iptr;
     int rv;
-    uint8_t* metadata;
-    uint64_t mlength;
     
     dns_decoded_t   dns_info[DNS_DECODEBUF_4K];
     dns_query_t*    dns_query;
@@ -105,21 +115,21 @@ int ss_extract_dns(ss_frame_t* fbuf) {
     enum dns_rcode  dns_rv;
     size_t          dns_info_size = sizeof(dns_info);
     
-    RTE_LOG(INFO, EXTRACTOR, "decode udp dns packet\n");
+    SS_LOG(INFO, EXTRACTOR, "decode dns message\n");
     dns_rv = dns_decode(dns_info, &dns_info_size, (dns_packet_t *) fbuf->l4_offset, fbuf->data.l4_length);
     if (dns_rv != RCODE_OKAY) {
-        RTE_LOG(ERR, EXTRACTOR, "could not decode udp dns packet\n");
-        rte_pktmbuf_dump(stderr, fbuf->mbuf, rte_pktmbuf_pkt_len(fbuf->mbuf));
+        SS_LOG(ERR, EXTRACTOR, "could not decode dns message\n");
+        if (SS_LOG_ENABLED(DEBUG)) rte_pktmbuf_dump(stderr, fbuf->mbuf, rte_pktmbuf_pkt_len(fbuf->mbuf));
         return -1;
     }
     dns_query    = (dns_query_t*) dns_info;
     dns_question = &dns_query->questions[0];
     if (dns_question == NULL) {
-        RTE_LOG(ERR, EXTRACTOR, "dns question missing in query\n");
+        SS_LOG(ERR, EXTRACTOR, "dns question missing in query\n");
         return -1;
     }
     
-    RTE_LOG(INFO, EXTRACTOR, "rx dns query for name [%s] type [%s] class [%s]\n",
+    SS_LOG(INFO, EXTRACTOR, "rx dns query for name [%s] type [%s] class [%s]\n",
         dns_question->name, dns_type_text(dns_question->type), dns_class_text(dns_question->class));
     strlcpy((char*) &fbuf->data.dns_name, dns_question->name, SS_DNS_NAME_MAX);
     size_t ancount = dns_query->ancount;
@@ -128,7 +138,7 @@ int ss_extract_dns(ss_frame_t* fbuf) {
         dns_answer = &dns_query->answers[i];
         rv = ss_extract_dns_atype(&fbuf->data.dns_answers[i], dns_answer);
         if (rv) {
-            RTE_LOG(ERR, EXTRACTOR, "rx dns query decode failure for name [%s] answer index [%zd]\n",
+            SS_LOG(ERR, EXTRACTOR, "rx dns query decode failure for name [%s] answer index [%zd]\n",
                 dns_question->name, i);
         }
     }
@@ -155,32 +165,24 @@ int ss_extract_dns(ss_frame_t* fbuf) {
                 }
                 default: {
                     if (ss_answer->type != SS_TYPE_EMPTY)
-                        RTE_LOG(ERR, EXTRACTOR, "unknown ss_answer type %d\n", ss_answer->type);
+                        SS_LOG(ERR, EXTRACTOR, "unknown ss_answer type %d\n", ss_answer->type);
                     continue;
                 }
             }
         }
         done:
         if (!is_match) continue;
-        RTE_LOG(NOTICE, EXTRACTOR, "successful match against dns rule %s\n", dptr->name);
-        metadata = ss_metadata_prepare_frame("dns_rule", dptr->name, &dptr->nn_queue, fbuf, NULL);
-        // XXX: for now assume the output is C string
-        mlength = strlen((char*) metadata);
-        //printf("metadata: %s\n", metadata);
-        rv = ss_nn_queue_send(&dptr->nn_queue, metadata, (uint16_t) mlength);
+        SS_LOG(NOTICE, EXTRACTOR, "successful match against dns rule %s\n", dptr->name);
+        rv = ss_extract_frame_send(&dptr->nn_queue, "dns_rule", dptr->name, fbuf, NULL, NN_PACKET_DNS, NN_EVENT_DNS);
     }
 
     iptr = ss_ioc_dns_match(&fbuf->data);
     if (iptr) {
         // match
-        RTE_LOG(NOTICE, EXTRACTOR, "successful ioc match from dns frame\n");
+        SS_LOG(NOTICE, EXTRACTOR, "successful ioc match from dns frame\n");
         ss_ioc_entry_dump_dpdk(iptr);
         nn_queue_t* nn_queue = &ss_conf->ioc_files[iptr->file_id].nn_queue;
-        metadata = ss_metadata_prepare_frame("dns_ioc", NULL, nn_queue, fbuf, iptr);
-        // XXX: for now assume the output is C char*
-        mlength = strlen((char*) metadata);
-        //printf("metadata: %s\n", metadata);
-        rv = ss_nn_queue_send(nn_queue, metadata, (uint16_t) mlength);
+        rv = ss_extract_frame_send(nn_queue, "dns_ioc", NULL, fbuf, iptr, NN_PACKET_IOC, NN_EVENT_DNS | NN_EVENT_IOC);
     }
     
     return 0;
@@ -241,40 +243,56 @@ int ss_extract_dns_atype(ss_answer_t* result, dns_answer_t* aptr) {
 int ss_extract_syslog(const char* source, ss_frame_t* fbuf, uint8_t* l4_offset, uint16_t l4_length) {
     int rv;
     uint8_t* metadata = NULL;
-    uint64_t mlength = 0;
+    size_t mlength = 0;
+    uint32_t events;
     ss_re_match_t re_match;
+    ss_syslog_t syslog;
+
+    memset(&re_match, 0, sizeof(re_match));
 
-    RTE_LOG(INFO, EXTRACTOR, "attempt syslog match port %u frame direction %d payload length %hu\n",
+    SS_LOG(INFO, EXTRACTOR, "attempt syslog match port %u frame direction %d payload length %hu\n",
         fbuf->data.port_id, fbuf->data.direction,
         l4_length);
     
-    rv = ss_re_chain_match(&re_match, l4_offset, l4_length);
+    // unparseable messages still run against whole-message rules
+    rv = ss_syslog_parse(&syslog, l4_offset, l4_length);
+    if (rv) {
+        SS_LOG(FINE, EXTRACTOR, "syslog message has no PRI, field rules skipped\n");
+    }
+    
+    rv = ss_re_chain_match(&re_match, &syslog, l4_offset, l4_length);
     if (rv <= 0 || re_match.re_entry == NULL) {
-        RTE_LOG(DEBUG, EXTRACTOR, "no match against syslog rule %s\n", re_match.re_entry->name);
+        SS_LOG(DEBUG, EXTRACTOR, "no match against syslog rules\n");
         return 0;
     }
     
+    events = NN_EVENT_SYSLOG | (re_match.ioc_entry ? NN_EVENT_IOC : 0);
+    if (!ss_nn_queue_wants(&re_match.re_entry->nn_queue, events)) return 0;
+    
+    if (re_match.re_entry->nn_queue.format == NN_FORMAT_PACKET) {
+        return ss_nn_queue_send_packet(&re_match.re_entry->nn_queue, fbuf,
+            NN_PACKET_SYSLOG, ss_nn_queue_rule_id(re_match.re_entry->name));
+    }
+    
     if (re_match.re_entry->type == SS_RE_TYPE_COMPLETE) {
         // include length of null byte
         metadata = ss_metadata_prepare_syslog(
             source, re_match.re_entry->name, &re_match.re_entry->nn_queue,
-            fbuf, l4_offset, l4_length, NULL);
+            fbuf, &syslog, l4_offset, l4_length, NULL, &mlength);
     }
     else if (re_match.re_entry->type == SS_RE_TYPE_SUBSTRING) {
         //ss_ioc_entry_dump_dpdk(re_match.ioc_entry);
         // include length of null byte
         metadata = ss_metadata_prepare_syslog(
             source, re_match.re_entry->name, &re_match.re_entry->nn_queue,
-            fbuf, l4_offset, l4_length, re_match.ioc_entry);
+            fbuf, &syslog, l4_offset, l4_length, re_match.ioc_entry, &mlength);
     }
     
     if (metadata) {
-        // XXX: for now assume the output is C char*
-        mlength = strlen((char*) metadata);
         rv = ss_nn_queue_send(&re_match.re_entry->nn_queue, metadata, (uint16_t) mlength);
     }
     else {
-        RTE_LOG(ERR, EXTRACTOR, "unexpected state matching against syslog rule %s\n", re_match.re_entry->name);
+        SS_LOG(ERR, EXTRACTOR, "unexpected state matching against syslog rule %s\n", re_match.re_entry->name);
         rv = -1;
     }
     
@@ -7,6 +7,7 @@
 
 /* BEGIN PROTOTYPES */
 
+int ss_extract_frame_send(nn_queue_t* nn_queue, const char* source, const char* rule, ss_frame_t* fbuf, ss_ioc_entry_t* iptr, nn_packet_source_t packet_source, uint32_t events);
 int ss_extract_eth(ss_frame_t* fbuf);
 int ss_extract_dns(ss_frame_t* fbuf);
 int ss_extract_dns_atype(ss_answer_t* result, dns_answer_t* aptr);
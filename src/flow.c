@@ -0,0 +1,435 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <rte_branch_prediction.h>
+#include <rte_byteorder.h>
+#include <rte_cycles.h>
+#include <rte_ether.h>
+#include <rte_hash.h>
+#include <rte_hash_crc.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_mbuf.h>
+#include <rte_memcpy.h>
+#include <rte_prefetch.h>
+
+#include <jemalloc/jemalloc.h>
+
+#include "common.h"
+#include "flow.h"
+#include "ioc.h"
+#include "metadata.h"
+#include "nn_queue.h"
+#include "sensor_conf.h"
+#include "timer_wheel.h"
+
+/*
+ * RSS hashes both directions of a conversation to the same queue when
+ * the NIC uses a symmetric key, so each lcore owns its flows outright.
+ * With an asymmetric key the two directions become two flows on two
+ * lcores, which still counts correctly, only less compactly.
+ */
+struct ss_flow_shard_s {
+    rte_hash_t* hash;
+    ss_flow_t* flows; // indexed by hash position
+    ss_flow_list_t lru;
+    ss_timer_wheel_t wheel;
+} __rte_cache_aligned;
+
+typedef struct ss_flow_shard_s ss_flow_shard_t;
+
+static ss_flow_shard_t flow_shards[RTE_MAX_LCORE];
+static ss_flow_stats_t flow_stats[RTE_MAX_LCORE];
+
+int ss_flow_init() {
+    char name[RTE_HASH_NAMESIZE];
+    unsigned int lcore_id;
+    int socket_id;
+    ss_flow_shard_t* shard;
+    uint32_t shard_size = SS_MAX(ss_conf->flow_max / rte_lcore_count(), SS_FLOW_MIN);
+    struct rte_hash_parameters hash_params = {
+        .name               = name,
+        .entries            = shard_size,
+        .key_len            = sizeof(ss_flow_key_t),
+        .hash_func          = rte_hash_crc,
+        .hash_func_init_val = 0,
+    };
+
+    RTE_LOG(NOTICE, L3L4, "flows per lcore: %u\n", shard_size);
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        shard     = &flow_shards[lcore_id];
+        socket_id = (int) rte_lcore_to_socket_id(lcore_id);
+        TAILQ_INIT(&shard->lru);
+        ss_timer_wheel_init(&shard->wheel, rte_get_tsc_hz() * L4_TCP_TIMER_TICK_MSEC / 1000, rte_rdtsc());
+
+        snprintf(name, sizeof(name), "flow_hash_lcore_%u", lcore_id);
+        hash_params.socket_id = socket_id;
+        shard->hash = rte_hash_create(&hash_params);
+        if (shard->hash == NULL) {
+            RTE_LOG(ERR, L3L4, "could not initialize flow hash for lcore %u\n", lcore_id);
+            return -1;
+        }
+
+        shard->flows = je_calloc(shard_size, sizeof(ss_flow_t));
+        if (shard->flows == NULL) {
+            RTE_LOG(ERR, L3L4, "could not allocate flow table for lcore %u\n", lcore_id);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+const char* ss_flow_reason_dump(ss_flow_reason_t reason) {
+    switch (reason) {
+        case SS_FLOW_REASON_IDLE:    return "idle";
+        case SS_FLOW_REASON_ACTIVE:  return "active";
+        case SS_FLOW_REASON_CLOSED:  return "closed";
+        case SS_FLOW_REASON_EVICTED: return "evicted";
+        default:                     return "unknown";
+    }
+}
+
+/*
+ * Build the symmetric key from the raw frame, ahead of the full decode,
+ * so a whole burst can be looked up at once. Non-first fragments carry
+ * no ports and are left untracked rather than counted as another flow.
+ * forward_lo tells whether the sender holds the low side of the key.
+ */
+int ss_flow_key_prepare(rte_mbuf_t* mbuf, ss_flow_key_t* key, int* forward_lo, uint8_t* tcp_flags) {
+    uint8_t* data     = rte_pktmbuf_mtod(mbuf, uint8_t*);
+    uint32_t length   = rte_pktmbuf_data_len(mbuf);
+    uint8_t* sip;
+    uint8_t* dip;
+    uint8_t* l4;
+    uint32_t alen;
+    uint16_t sport    = 0;
+    uint16_t dport    = 0;
+    uint16_t eth_type;
+    uint8_t protocol;
+    int cmp;
+
+    if (length < sizeof(eth_hdr_t)) return -1;
+    eth_type   = rte_bswap16(((eth_hdr_t*) data)->ether_type);
+    *tcp_flags = 0;
+
+    if (eth_type == ETHER_TYPE_IPV4) {
+        ip4_hdr_t* ip4 = (ip4_hdr_t*) (data + sizeof(eth_hdr_t));
+        if (length < sizeof(eth_hdr_t) + sizeof(ip4_hdr_t) || ip4->ihl < 5) return -1;
+        if (rte_bswap16(ip4->frag_off) & IP_OFFMASK) return -1;
+        sip      = (uint8_t*) &ip4->saddr;
+        dip      = (uint8_t*) &ip4->daddr;
+        alen     = IPV4_ALEN;
+        protocol = ip4->protocol;
+        l4       = (uint8_t*) ip4 + ip4->ihl * 4;
+    }
+    else if (eth_type == ETHER_TYPE_IPV6) {
+        ip6_hdr_t* ip6 = (ip6_hdr_t*) (data + sizeof(eth_hdr_t));
+        if (length < sizeof(eth_hdr_t) + sizeof(ip6_hdr_t)) return -1;
+        sip      = (uint8_t*) &ip6->ip6_src;
+        dip      = (uint8_t*) &ip6->ip6_dst;
+        alen     = IPV6_ALEN;
+        protocol = ip6->ip6_nxt;
+        l4       = (uint8_t*) ip6 + sizeof(ip6_hdr_t);
+    }
+    else {
+        return -1;
+    }
+
+    if (protocol == IPPROTO_TCP && l4 + sizeof(tcp_hdr_t) <= data + length) {
+        tcp_hdr_t* tcp = (tcp_hdr_t*) l4;
+        sport      = tcp->source;
+        dport      = tcp->dest;
+        *tcp_flags = tcp->th_flags;
+    }
+    else if (protocol == IPPROTO_UDP && l4 + sizeof(udp_hdr_t) <= data + length) {
+        udp_hdr_t* udp = (udp_hdr_t*) l4;
+        sport      = udp->uh_sport;
+        dport      = udp->uh_dport;
+    }
+
+    memset(key, 0, sizeof(*key));
+    cmp = memcmp(sip, dip, alen);
+    if (cmp == 0) cmp = rte_bswap16(sport) - rte_bswap16(dport);
+    *forward_lo = cmp <= 0;
+    if (*forward_lo) {
+        rte_memcpy(key->addr_lo, sip, alen);
+        rte_memcpy(key->addr_hi, dip, alen);
+        key->port_lo = sport;
+        key->port_hi = dport;
+    }
+    else {
+        rte_memcpy(key->addr_lo, dip, alen);
+        rte_memcpy(key->addr_hi, sip, alen);
+        key->port_lo = dport;
+        key->port_hi = sport;
+    }
+    key->eth_type = eth_type;
+    key->protocol = protocol;
+
+    return 0;
+}
+
+static int ss_flow_record_send(const char* source, nn_queue_t* nn_queue, ss_flow_t* flow, ss_flow_reason_t reason) {
+    uint8_t* metadata;
+    size_t mlength;
+    int rv;
+
+    if (!ss_nn_queue_wants(nn_queue, NN_EVENT_FLOW | (flow->ioc ? NN_EVENT_IOC : 0))) return 0;
+    metadata = ss_metadata_prepare_flow(source, nn_queue, flow, reason, &mlength);
+    if (metadata == NULL) return -1;
+    rv = ss_nn_queue_send(nn_queue, metadata, (uint16_t) mlength);
+    return rv < 0 ? -1 : 0;
+}
+
+/*
+ * One record per flow and reason. Flows which matched an IOC also go to
+ * the queue of that IOC file, since their per-packet reports are
+ * collapsed into the first one.
+ */
+static void ss_flow_record(ss_flow_t* flow, ss_flow_reason_t reason) {
+    ss_flow_stats_t* stats = &flow_stats[rte_lcore_id()];
+
+    if (flow->counters[SS_FLOW_FORWARD].packets == 0 && flow->counters[SS_FLOW_REVERSE].packets == 0) return;
+
+    ++stats->records;
+    if (ss_conf->flow_export_enabled) {
+        if (ss_flow_record_send("flow", &ss_conf->flow_export, flow, reason)) ++stats->record_errors;
+    }
+    // NN_FORMAT_PACKET IOC queues already got the flow's first frame
+    if (flow->ioc && ss_conf->ioc_files[flow->ioc->file_id].nn_queue.format == NN_FORMAT_METADATA) {
+        if (ss_flow_record_send("flow_ioc", &ss_conf->ioc_files[flow->ioc->file_id].nn_queue, flow, reason)) ++stats->record_errors;
+    }
+}
+
+static void ss_flow_delete(ss_flow_shard_t* shard, ss_flow_t* flow) {
+    rte_hash_del_key(shard->hash, &flow->key);
+    ss_timer_wheel_remove(&shard->wheel, &flow->timer);
+    TAILQ_REMOVE(&shard->lru, flow, lru);
+    flow->active = 0;
+    --flow_stats[rte_lcore_id()].flows_active;
+}
+
+static ss_flow_t* ss_flow_create(ss_flow_shard_t* shard, ss_flow_key_t* key, int forward_lo, uint8_t port_id, uint64_t now) {
+    ss_flow_stats_t* stats = &flow_stats[rte_lcore_id()];
+    ss_flow_t* victim;
+    ss_flow_t* flow;
+    int32_t position;
+
+    // a full cuckoo bucket can refuse a key with space left elsewhere,
+    // so give up after a few victims instead of draining the table
+    for (int attempt = 0; (position = rte_hash_add_key(shard->hash, key)) < 0; ++attempt) {
+        victim = TAILQ_FIRST(&shard->lru);
+        if (victim == NULL || attempt == SS_FLOW_EVICT_ATTEMPTS) {
+            ++stats->flows_rejected;
+            return NULL;
+        }
+        ++stats->flows_evicted;
+        ss_flow_record(victim, SS_FLOW_REASON_EVICTED);
+        ss_flow_delete(shard, victim);
+    }
+
+    flow = &shard->flows[position];
+    // the same new flow twice in one lookup batch, both missed
+    if (flow->active) return flow;
+
+    memset(flow, 0, sizeof(*flow));
+    rte_memcpy(&flow->key, key, sizeof(ss_flow_key_t));
+    flow->active     = 1;
+    flow->port_id    = port_id;
+    flow->forward_lo = (uint8_t) forward_lo;
+    flow->start_tsc  = now;
+    flow->last_tsc   = now;
+    TAILQ_INSERT_TAIL(&shard->lru, flow, lru);
+    ss_timer_wheel_add(&shard->wheel, &flow->timer, now + rte_get_tsc_hz() * ss_conf->flow_idle_timeout);
+    ++stats->flows_active;
+    ++stats->flows_created;
+
+    return flow;
+}
+
+/*
+ * The timer is only re-armed on FIN / RST; ordinary packets just bump
+ * last_tsc and the expiry callback works out the real deadline.
+ */
+static void ss_flow_update(ss_flow_shard_t* shard, ss_flow_t* flow, rte_mbuf_t* mbuf, int forward_lo, uint8_t tcp_flags, uint64_t now) {
+    ss_flow_counters_t* counters = &flow->counters[forward_lo == flow->forward_lo ? SS_FLOW_FORWARD : SS_FLOW_REVERSE];
+
+    if (counters->packets == 0) counters->first_tsc = now;
+    ++counters->packets;
+    counters->bytes     += rte_pktmbuf_pkt_len(mbuf);
+    counters->last_tsc   = now;
+    counters->tcp_flags |= tcp_flags;
+    flow->last_tsc       = now;
+
+    if (unlikely(tcp_flags & (TH_FIN | TH_RST)) && !flow->closing) {
+        flow->closing = 1;
+        ss_timer_wheel_add(&shard->wheel, &flow->timer, now + rte_get_tsc_hz() * SS_FLOW_CLOSE_SECONDS);
+    }
+
+    if (flow != TAILQ_LAST(&shard->lru, ss_flow_list_s)) {
+        TAILQ_REMOVE(&shard->lru, flow, lru);
+        TAILQ_INSERT_TAIL(&shard->lru, flow, lru);
+    }
+}
+
+/*
+ * Find or create the flow of every frame in an rx burst, with one bulk
+ * hash lookup per RTE_HASH_LOOKUP_BULK_MAX frames, and count the frames
+ * against them. flows[i] is NULL for frames which are not tracked.
+ */
+void ss_flow_burst(unsigned int lcore_id, uint8_t port_id, rte_mbuf_t** mbufs, ss_flow_t** flows, uint16_t count) {
+    ss_flow_shard_t* shard = &flow_shards[lcore_id];
+    ss_flow_stats_t* stats = &flow_stats[lcore_id];
+    ss_flow_key_t keys[RTE_HASH_LOOKUP_BULK_MAX];
+    const void* key_ptrs[RTE_HASH_LOOKUP_BULK_MAX];
+    int32_t positions[RTE_HASH_LOOKUP_BULK_MAX];
+    int forward_lo[RTE_HASH_LOOKUP_BULK_MAX];
+    uint8_t tcp_flags[RTE_HASH_LOOKUP_BULK_MAX];
+    uint16_t slots[RTE_HASH_LOOKUP_BULK_MAX];
+    uint64_t now = rte_rdtsc();
+    uint16_t chunk;
+    uint32_t valid;
+    ss_flow_t* flow;
+
+    memset(flows, 0, count * sizeof(ss_flow_t*));
+    if (unlikely(shard->flows == NULL)) return;
+
+    stats->packets += count;
+    for (uint16_t base = 0; base < count; base = (uint16_t) (base + chunk)) {
+        chunk = (uint16_t) SS_MIN(count - base, RTE_HASH_LOOKUP_BULK_MAX);
+
+        for (uint16_t i = base; i < base + chunk; ++i) {
+            rte_prefetch0(rte_pktmbuf_mtod(mbufs[i], void*));
+        }
+
+        valid = 0;
+        for (uint16_t i = base; i < base + chunk; ++i) {
+            if (ss_flow_key_prepare(mbufs[i], &keys[valid], &forward_lo[valid], &tcp_flags[valid])) {
+                ++stats->packets_untracked;
+                continue;
+            }
+            key_ptrs[valid] = &keys[valid];
+            slots[valid]    = i;
+            ++valid;
+        }
+        if (valid == 0) continue;
+
+        rte_hash_lookup_bulk(shard->hash, key_ptrs, valid, positions);
+
+        // hits first, so evictions for the misses cannot take a flow
+        // which an earlier frame of this batch already points at
+        for (uint32_t j = 0; j < valid; ++j) {
+            if (positions[j] < 0) continue;
+            flow = &shard->flows[positions[j]];
+            ss_flow_update(shard, flow, mbufs[slots[j]], forward_lo[j], tcp_flags[j], now);
+            flows[slots[j]] = flow;
+        }
+        for (uint32_t j = 0; j < valid; ++j) {
+            if (positions[j] >= 0) continue;
+            flow = ss_flow_create(shard, &keys[j], forward_lo[j], port_id, now);
+            if (flow == NULL) {
+                ++stats->packets_untracked;
+                continue;
+            }
+            ss_flow_update(shard, flow, mbufs[slots[j]], forward_lo[j], tcp_flags[j], now);
+            flows[slots[j]] = flow;
+        }
+    }
+}
+
+/*
+ * Addresses never change within a flow, so the IOC tables are consulted
+ * on its first frame only. The match is returned that one time; the
+ * flow record carries it for the rest of the flow.
+ */
+ss_ioc_entry_t* ss_flow_ioc_match(ss_flow_t* flow, ss_metadata_t* md) {
+    if (flow->ioc_checked) return NULL;
+
+    ++flow_stats[rte_lcore_id()].ioc_lookups;
+    flow->ioc         = ss_ioc_metadata_match(md);
+    flow->ioc_checked = 1;
+    return flow->ioc;
+}
+
+static void ss_flow_expire(ss_timer_wheel_entry_t* entry, void* arg) {
+    ss_flow_t* flow        = (ss_flow_t*) ((uint8_t*) entry - offsetof(ss_flow_t, timer));
+    ss_flow_shard_t* shard = arg;
+    uint64_t hz            = rte_get_tsc_hz();
+    uint64_t now           = rte_rdtsc();
+    uint64_t idle_deadline = flow->last_tsc + hz * (flow->closing ? SS_FLOW_CLOSE_SECONDS : ss_conf->flow_idle_timeout);
+    uint64_t active_deadline;
+
+    if (idle_deadline <= now) {
+        ++flow_stats[rte_lcore_id()].flows_expired;
+        ss_flow_record(flow, flow->closing ? SS_FLOW_REASON_CLOSED : SS_FLOW_REASON_IDLE);
+        ss_flow_delete(shard, flow);
+        return;
+    }
+
+    // long-lived flows report periodically and start a fresh record
+    active_deadline = flow->start_tsc + hz * ss_conf->flow_active_timeout;
+    if (active_deadline <= now) {
+        ss_flow_record(flow, SS_FLOW_REASON_ACTIVE);
+        memset(flow->counters, 0, sizeof(flow->counters));
+        flow->start_tsc = now;
+        active_deadline = now + hz * ss_conf->flow_active_timeout;
+    }
+
+    ss_timer_wheel_add(&shard->wheel, &flow->timer, SS_MIN(idle_deadline, active_deadline));
+}
+
+/* run the calling lcore's flow deadlines, called every drain tick */
+int ss_flow_timer_callback(unsigned int lcore_id) {
+    ss_flow_shard_t* shard = &flow_shards[lcore_id];
+
+    if (shard->flows == NULL) return 0;
+
+    ss_timer_wheel_advance(&shard->wheel, rte_rdtsc(), ss_flow_expire, shard);
+    return 0;
+}
+
+int ss_flow_stats_dump() {
+    ss_flow_stats_t total;
+
+    if (rte_get_log_level() < RTE_LOG_NOTICE) return 0;
+
+    memset(&total, 0, sizeof(total));
+    for (unsigned int lcore_id = 0; lcore_id < RTE_MAX_LCORE; ++lcore_id) {
+        total.flows_active      += flow_stats[lcore_id].flows_active;
+        total.flows_created     += flow_stats[lcore_id].flows_created;
+        total.flows_rejected    += flow_stats[lcore_id].flows_rejected;
+        total.flows_expired     += flow_stats[lcore_id].flows_expired;
+        total.flows_evicted     += flow_stats[lcore_id].flows_evicted;
+        total.records           += flow_stats[lcore_id].records;
+        total.record_errors     += flow_stats[lcore_id].record_errors;
+        total.packets           += flow_stats[lcore_id].packets;
+        total.packets_untracked += flow_stats[lcore_id].packets_untracked;
+        total.ioc_lookups       += flow_stats[lcore_id].ioc_lookups;
+    }
+
+    printf("Flow cache statistics ==============================\n"
+           "Flows active: %24lu\n"
+           "Flows created: %23lu\n"
+           "Flows rejected: %22lu\n"
+           "Flows expired: %23lu\n"
+           "Flows evicted: %23lu\n"
+           "Records: %29lu\n"
+           "Record errors: %23lu\n"
+           "Packets: %29lu\n"
+           "Packets untracked: %19lu\n"
+           "IOC lookups: %25lu\n"
+           "====================================================\n",
+           total.flows_active, total.flows_created, total.flows_rejected,
+           total.flows_expired, total.flows_evicted,
+           total.records, total.record_errors,
+           total.packets, total.packets_untracked, total.ioc_lookups);
+
+    return 0;
+}
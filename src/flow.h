@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <bsd/sys/queue.h>
+
+#include <rte_mbuf.h>
+
+#include "common.h"
+#include "ioc.h"
+#include "timer_wheel.h"
+
+/* CONSTANTS */
+
+#define SS_FLOW_MIN              256 // smallest per-lcore flow table, must exceed a burst
+#define SS_FLOW_EVICT_ATTEMPTS     4 // LRU victims tried when a cuckoo bucket is full
+#define SS_FLOW_CLOSE_SECONDS      2 // linger after FIN or RST, for stray segments
+
+enum ss_flow_direction_e {
+    SS_FLOW_FORWARD = 0, // the side which sent the first packet seen
+    SS_FLOW_REVERSE = 1,
+    SS_FLOW_DIRECTIONS,
+};
+
+typedef enum ss_flow_direction_e ss_flow_direction_t;
+
+enum ss_flow_reason_e {
+    SS_FLOW_REASON_IDLE     = 0,
+    SS_FLOW_REASON_ACTIVE   = 1,
+    SS_FLOW_REASON_CLOSED   = 2,
+    SS_FLOW_REASON_EVICTED  = 3,
+};
+
+typedef enum ss_flow_reason_e ss_flow_reason_t;
+
+/* DATA TYPES */
+
+/*
+ * Symmetric 5-tuple: the lower address / port pair always comes first,
+ * so both directions of a conversation find the same entry.
+ */
+struct ss_flow_key_s {
+    uint8_t  addr_lo[IPV6_ALEN];
+    uint8_t  addr_hi[IPV6_ALEN];
+    uint16_t port_lo;
+    uint16_t port_hi;
+    uint16_t eth_type;
+    uint8_t  protocol;
+    uint8_t  pad;
+} __attribute__((packed));
+
+typedef struct ss_flow_key_s ss_flow_key_t;
+
+struct ss_flow_counters_s {
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t first_tsc;
+    uint64_t last_tsc;
+    uint8_t  tcp_flags; // OR of every segment
+};
+
+typedef struct ss_flow_counters_s ss_flow_counters_t;
+
+/*
+ * Flows live in a flat per-lcore array indexed by their rte_hash
+ * position, so a lookup lands directly on the flow with no pointer
+ * chasing and no pool.
+ */
+struct ss_flow_s {
+    ss_flow_key_t key;
+    uint8_t  active;
+    uint8_t  port_id;
+    uint8_t  forward_lo;  // the forward side holds addr_lo / port_lo
+    uint8_t  closing;     // FIN or RST seen
+    uint8_t  ioc_checked; // ioc below is valid, even when NULL
+    ss_ioc_entry_t* ioc;
+    uint64_t start_tsc;   // start of the record being built
+    uint64_t last_tsc;
+    ss_flow_counters_t counters[SS_FLOW_DIRECTIONS];
+    ss_timer_wheel_entry_t timer;
+    TAILQ_ENTRY(ss_flow_s) lru;
+} __rte_cache_aligned;
+
+typedef struct ss_flow_s ss_flow_t;
+
+TAILQ_HEAD(ss_flow_list_s, ss_flow_s);
+
+typedef struct ss_flow_list_s ss_flow_list_t;
+
+// indexed by the lcore doing the work, so no atomics
+struct ss_flow_stats_s {
+    uint64_t flows_active;
+    uint64_t flows_created;
+    uint64_t flows_rejected;
+    uint64_t flows_expired;
+    uint64_t flows_evicted;
+    uint64_t records;
+    uint64_t record_errors;
+    uint64_t packets;
+    uint64_t packets_untracked;
+    uint64_t ioc_lookups;
+} __rte_cache_aligned;
+
+typedef struct ss_flow_stats_s ss_flow_stats_t;
+
+/* BEGIN PROTOTYPES */
+
+int ss_flow_init(void);
+int ss_flow_key_prepare(rte_mbuf_t* mbuf, ss_flow_key_t* key, int* forward_lo, uint8_t* tcp_flags);
+void ss_flow_burst(unsigned int lcore_id, uint8_t port_id, rte_mbuf_t** mbufs, ss_flow_t** flows, uint16_t count);
+ss_ioc_entry_t* ss_flow_ioc_match(ss_flow_t* flow, ss_metadata_t* md);
+const char* ss_flow_reason_dump(ss_flow_reason_t reason);
+int ss_flow_timer_callback(unsigned int lcore_id);
+int ss_flow_stats_dump(void);
+
+/* END PROTOTYPES */
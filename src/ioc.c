@@ -12,6 +12,7 @@
 #include <bsd/sys/queue.h>
 
 #include <rte_byteorder.h>
+#include <rte_hash_crc.h>
 #include <rte_log.h>
 #include <rte_lpm.h>
 #include <rte_lpm6.h>
@@ -27,12 +28,14 @@
 #include "ip_utils.h"
 #include "je_utils.h"
 #include "json.h"
+#include "log.h"
 #include "netflow_addr.h"
 #include "netflow_format.h"
 #include "nn_queue.h"
 #include "sdn_sensor.h"
 #include "sensor_conf.h"
 #include "sflow.h"
+#include "str_utils.h"
 
 #define SS_IOC_LINE_DELIMITER   '\n'
 #define SS_IOC_FIELD_DELIMITERS ",\n"
@@ -168,32 +171,9 @@ int ss_ioc_tables_dump(uint64_t limit) {
         if (limit && counter > limit) break;
     }
 
-    counter = 1;
-    fprintf(stderr, "dumping %lu entries from domain_table...\n", limit);
-    HASH_ITER(hh, ss_conf->domain_table, iptr, itmp) {
-        fprintf(stderr, "domain_table entry number %lu\n", counter);
-        ss_ioc_entry_dump(iptr);
-        counter++;
-        if (limit && counter > limit) break;
-    }
-
-    counter = 1;
-    fprintf(stderr, "dumping %lu entries from url_table...\n", limit);
-    HASH_ITER(hh_full, ss_conf->url_table, iptr, itmp) {
-        fprintf(stderr, "url_table entry number %lu\n", counter);
-        ss_ioc_entry_dump(iptr);
-        counter++;
-        if (limit && counter > limit) break;
-    }
-
-    counter = 1;
-    fprintf(stderr, "dumping %lu entries from email_table...\n", limit);
-    HASH_ITER(hh_full, ss_conf->email_table, iptr, itmp) {
-        fprintf(stderr, "email_table entry number %lu\n", counter);
-        ss_ioc_entry_dump(iptr);
-        counter++;
-        if (limit && counter > limit) break;
-    }
+    ss_ioc_str_table_dump("domain_table", &ss_conf->domain_table, limit);
+    ss_ioc_str_table_dump("url_table",    &ss_conf->url_table,    limit);
+    ss_ioc_str_table_dump("email_table",  &ss_conf->email_table,  limit);
 
     counter = 1;
     fprintf(stderr, "dumping %lu entries from cidr_table...\n", limit);
@@ -251,7 +231,11 @@ ss_ioc_entry_t* ss_ioc_entry_create(ss_ioc_file_t* ioc_file, char* ioc_str) {
     strlcpy(ioc->dns, field, sizeof(ioc->dns));
 
     field = strsep(&sepptr, SS_IOC_FIELD_DELIMITERS);
-    strlcpy(ioc->value, field, sizeof(ioc->value));
+    ioc->value = je_strdup(field ? field : "");
+    if (ioc->value == NULL) {
+        fprintf(stderr, "ioc id: %lu: could not allocate value\n", ioc->id);
+        goto error_out;
+    }
     if (ioc->type == SS_IOC_TYPE_CIDR) {
         rv = ss_cidr_parse(field, &ioc->ip);
         if (rv != 1) {
@@ -277,7 +261,7 @@ int ss_ioc_entry_destroy(ss_ioc_entry_t* ioc_entry) {
     memset(&ioc_entry->threat_type, 0, sizeof(ioc_entry->threat_type));
     memset(&ioc_entry->ip, 0, sizeof(ioc_entry->ip));
     memset(&ioc_entry->dns, 0, sizeof(ioc_entry->dns));
-    memset(&ioc_entry->value, 0, sizeof(ioc_entry->value));
+    if (ioc_entry->value) { je_free(ioc_entry->value); ioc_entry->value = NULL; }
     je_free(ioc_entry);
     return 0;
 }
@@ -299,7 +283,7 @@ int ss_ioc_entry_dump_dpdk(ss_ioc_entry_t* ioc) {
     char ip_str[SS_ADDR_STR_MAX];
     memset(ip_str, 0, sizeof(ip_str));
     ss_inet_ntop(&ioc->ip, ip_str, sizeof(ip_str));
-    RTE_LOG(NOTICE, IOC, "ioc entry: id: %lu type: %s threat_type: %s ip: %s dns: %s value: %s\n",
+    SS_LOG(NOTICE, IOC, "ioc entry: id: %lu type: %s threat_type: %s ip: %s dns: %s value: %s\n",
         ioc->id, ss_ioc_type_dump(ioc->type), ioc->threat_type, ip_str, ioc->dns, ioc->value);
     return 0;
 }
@@ -363,6 +347,127 @@ int ss_ioc_chain_remove_id(uint64_t id) {
     return -1;
 }
 
+/* STRING TABLES */
+
+/*
+ * CRC32C over the ASCII-lowercased bytes of a (pointer, length) slice,
+ * so "Evil.COM" and "evil.com" land in the same bucket without a copy.
+ */
+static uint32_t ss_ioc_str_hash(const uint8_t* data, size_t length) {
+    uint32_t hash = (uint32_t) length;
+    uint64_t word;
+
+    for (; length >= sizeof(word); data += sizeof(word), length -= sizeof(word)) {
+        memcpy(&word, data, sizeof(word));
+        hash = rte_hash_crc_8byte(ss_ascii_lower64(word), hash);
+    }
+    if (length) {
+        word = 0;
+        memcpy(&word, data, length);
+        hash = rte_hash_crc_8byte(ss_ascii_lower64(word), hash);
+    }
+
+    return hash;
+}
+
+int ss_ioc_str_table_grow(ss_ioc_str_table_t* table) {
+    uint32_t size = table->buckets ? (table->mask + 1) * 2 : SS_IOC_STR_BUCKETS_MIN;
+    ss_ioc_str_node_t** buckets;
+    ss_ioc_str_node_t* nptr;
+    ss_ioc_str_node_t* ntmp;
+
+    buckets = je_calloc(size, sizeof(ss_ioc_str_node_t*));
+    if (buckets == NULL) {
+        fprintf(stderr, "could not allocate ioc string table with %u buckets\n", size);
+        return -1;
+    }
+
+    if (table->buckets) {
+        for (uint32_t i = 0; i <= table->mask; ++i) {
+            for (nptr = table->buckets[i]; nptr; nptr = ntmp) {
+                ntmp = nptr->next;
+                nptr->next = buckets[nptr->hash & (size - 1)];
+                buckets[nptr->hash & (size - 1)] = nptr;
+            }
+        }
+        je_free(table->buckets);
+    }
+
+    table->buckets = buckets;
+    table->mask    = size - 1;
+    return 0;
+}
+
+ss_ioc_entry_t* ss_ioc_str_table_find(ss_ioc_str_table_t* table, const char* key, size_t length) {
+    ss_ioc_str_node_t* nptr;
+    uint32_t hash;
+
+    if (table->buckets == NULL) return NULL;
+
+    hash = ss_ioc_str_hash((const uint8_t*) key, length);
+    for (nptr = table->buckets[hash & table->mask]; nptr; nptr = nptr->next) {
+        if (nptr->hash == hash && nptr->length == length
+            && ss_memcaseeq((const uint8_t*) nptr->key, (const uint8_t*) key, length)) {
+            return nptr->ioc;
+        }
+    }
+
+    return NULL;
+}
+
+/* returns the entry already holding the key, or ioc if it was added */
+ss_ioc_entry_t* ss_ioc_str_table_add(ss_ioc_str_table_t* table, const char* key, size_t length, ss_ioc_entry_t* ioc) {
+    ss_ioc_str_node_t* nptr;
+    ss_ioc_entry_t* hiptr;
+
+    hiptr = ss_ioc_str_table_find(table, key, length);
+    if (hiptr) return hiptr;
+
+    if (table->buckets == NULL || table->count > table->mask) {
+        if (ss_ioc_str_table_grow(table)) return NULL;
+    }
+
+    nptr = je_calloc(1, sizeof(ss_ioc_str_node_t));
+    if (nptr == NULL) {
+        fprintf(stderr, "could not allocate ioc string table node\n");
+        return NULL;
+    }
+    nptr->hash   = ss_ioc_str_hash((const uint8_t*) key, length);
+    nptr->length = (uint32_t) length;
+    nptr->key    = key;
+    nptr->ioc    = ioc;
+    nptr->next   = table->buckets[nptr->hash & table->mask];
+    table->buckets[nptr->hash & table->mask] = nptr;
+    ++table->count;
+
+    return ioc;
+}
+
+int ss_ioc_str_table_dump(const char* label, ss_ioc_str_table_t* table, uint64_t limit) {
+    ss_ioc_str_node_t* nptr;
+    uint64_t counter = 1;
+
+    fprintf(stderr, "dumping %lu entries from %s...\n", limit, label);
+    if (table->buckets == NULL) return 0;
+
+    for (uint32_t i = 0; i <= table->mask; ++i) {
+        for (nptr = table->buckets[i]; nptr; nptr = nptr->next) {
+            fprintf(stderr, "%s entry number %lu\n", label, counter);
+            ss_ioc_entry_dump(nptr->ioc);
+            counter++;
+            if (limit && counter > limit) return 0;
+        }
+    }
+
+    return 0;
+}
+
+// NOTE: domains are stored and matched without the canonical trailing '.'
+static inline size_t ss_ioc_domain_length(const char* name, size_t length) {
+    if (length && name[length - 1] == '.') --length;
+    return length;
+}
+
 int ss_ioc_chain_optimize_ip(ss_ioc_entry_t* iptr) {
     char   tvalue[SS_DNS_NAME_MAX];
     memset(tvalue, 0, sizeof(tvalue));
@@ -448,22 +553,15 @@ int ss_ioc_chain_optimize_cidr(ss_ioc_entry_t* iptr) {
 }
 
 int ss_ioc_chain_optimize_domain(ss_ioc_entry_t* iptr) {
-    char   tvalue[SS_DNS_NAME_MAX];
-    size_t offset;
     ss_ioc_entry_t* hiptr = NULL;
-    // NOTE: convert names to canonical form (trailing '.')
-    offset = strlcpy(tvalue, iptr->value, sizeof(tvalue));
-    if (tvalue[offset] != '.') {
-        tvalue[offset] = '.';
-        tvalue[offset + 1] = '\0';
-    }
-    strlcpy(iptr->value, tvalue, sizeof(iptr->value));
     //fprintf(stderr, "ioc %lu extracted dns domain: %s\n", iptr->id, domain);
-    HASH_FIND_STR(ss_conf->domain_table, iptr->value, hiptr);
+    hiptr = ss_ioc_str_table_add(&ss_conf->domain_table, iptr->value,
+        ss_ioc_domain_length(iptr->value, strlen(iptr->value)), iptr);
     if (hiptr == NULL) {
-        HASH_ADD_STR(ss_conf->domain_table, value, iptr);
+        fprintf(stderr, "ioc id %lu: could not add value: %s\n", iptr->id, iptr->value);
+        return -1;
     }
-    else {
+    else if (hiptr != iptr) {
         fprintf(stderr, "ioc id %lu: skipping duplicate value: %s\n", iptr->id, iptr->value);
     }
     return 0;
@@ -498,18 +596,17 @@ int ss_ioc_chain_optimize_url(ss_ioc_entry_t* iptr) {
     }
     strlcpy(iptr->dns, tvalue, sizeof(iptr->dns));
     //fprintf(stderr, "ioc %lu extracted url domain: %s\n", iptr->id, tvalue);
-    HASH_FIND_STR(ss_conf->domain_table, iptr->dns, hiptr);
-    if (hiptr == NULL) {
-        HASH_ADD_STR(ss_conf->domain_table, dns, iptr);
-    }
-    else {
+    hiptr = ss_ioc_str_table_add(&ss_conf->domain_table, iptr->dns,
+        ss_ioc_domain_length(iptr->dns, strlen(iptr->dns)), iptr);
+    if (hiptr != iptr) {
         fprintf(stderr, "ioc id %lu: skipping duplicate dns: %s\n", iptr->id, iptr->dns);
     }
-    HASH_FIND(hh_full, ss_conf->url_table, &iptr->value, strlen(iptr->value), hiptr);
+    hiptr = ss_ioc_str_table_add(&ss_conf->url_table, iptr->value, strlen(iptr->value), iptr);
     if (hiptr == NULL) {
-        HASH_ADD(hh_full, ss_conf->url_table, value, strlen(iptr->value), iptr);
+        fprintf(stderr, "ioc id %lu: could not add value: %s\n", iptr->id, iptr->value);
+        return -1;
     }
-    else {
+    else if (hiptr != iptr) {
         fprintf(stderr, "ioc id %lu: skipping duplicate value: %s\n", iptr->id, iptr->value);
     }
     return 0;
@@ -536,18 +633,17 @@ int ss_ioc_chain_optimize_email(ss_ioc_entry_t* iptr) {
     }
     strlcpy(iptr->dns, tvalue, sizeof(iptr->dns));
     fprintf(stderr, "ioc %lu extracted email domain: %s\n", iptr->id, tvalue);
-    HASH_FIND_STR(ss_conf->domain_table, iptr->dns, hiptr);
-    if (hiptr == NULL) {
-        HASH_ADD_STR(ss_conf->domain_table, dns, iptr);
-    }
-    else {
+    hiptr = ss_ioc_str_table_add(&ss_conf->domain_table, iptr->dns,
+        ss_ioc_domain_length(iptr->dns, strlen(iptr->dns)), iptr);
+    if (hiptr != iptr) {
         fprintf(stderr, "ioc id %lu: skipping duplicate dns: %s\n", iptr->id, iptr->dns);
     }
-    HASH_FIND(hh_full, ss_conf->email_table, &iptr->value, strlen(iptr->value), hiptr);
+    hiptr = ss_ioc_str_table_add(&ss_conf->email_table, iptr->value, strlen(iptr->value), iptr);
     if (hiptr == NULL) {
-        HASH_ADD(hh_full, ss_conf->email_table, value, strlen(iptr->value), iptr);
+        fprintf(stderr, "ioc id %lu: could not add value: %s\n", iptr->id, iptr->value);
+        return -1;
     }
-    else {
+    else if (hiptr != iptr) {
         fprintf(stderr, "ioc id %lu: skipping duplicate value: %s\n", iptr->id, iptr->value);
     }
     return 0;
@@ -674,14 +770,14 @@ ss_ioc_entry_t* ss_ioc_metadata_match(ss_metadata_t* md) {
 ss_ioc_entry_t* ss_ioc_dns_match(ss_metadata_t* md) {
     ss_ioc_entry_t* iptr = NULL;
 
-    HASH_FIND_STR(ss_conf->domain_table, (char*) md->dns_name, iptr);
+    iptr = ss_ioc_domain_match((char*) md->dns_name, strlen((char*) md->dns_name));
     if (iptr) goto out;
 
     for (int i = 0; i < SS_DNS_RESULT_MAX; ++i) {
         ss_answer_t* dns_answer = &md->dns_answers[i];
         switch (dns_answer->type) {
             case SS_TYPE_NAME: {
-                HASH_FIND_STR(ss_conf->domain_table, (char*) dns_answer->payload, iptr);
+                iptr = ss_ioc_domain_match((char*) dns_answer->payload, strlen((char*) dns_answer->payload));
                 if (iptr) goto out;
                 break;
             }
@@ -701,18 +797,30 @@ ss_ioc_entry_t* ss_ioc_dns_match(ss_metadata_t* md) {
     return iptr;
 }
 
+ss_ioc_entry_t* ss_ioc_domain_match(const char* name, size_t length) {
+    return ss_ioc_str_table_find(&ss_conf->domain_table, name, ss_ioc_domain_length(name, length));
+}
+
+/*
+ * Match a (pointer, length) slice, usually a regex capture pointing into
+ * the payload. It is not NUL terminated and must not be modified.
+ */
 // XXX: for URL and email, this should also try to match the domain
-ss_ioc_entry_t* ss_ioc_syslog_match(const char* ioc, ss_ioc_type_t ioc_type) {
+ss_ioc_entry_t* ss_ioc_syslog_match(const char* ioc, size_t length, ss_ioc_type_t ioc_type) {
     int             rv;
     ss_ioc_entry_t* iptr = NULL;
     ip_addr_t       ip_addr;
-    char            tdns[SS_DNS_NAME_MAX];
+    char            tip[SS_ADDR_STR_MAX];
 
     switch (ioc_type) {
         case SS_IOC_TYPE_IP: {
-            rv = ss_cidr_parse(ioc, &ip_addr);
+            // longer than any address plus prefix, so it cannot parse
+            if (length >= sizeof(tip)) break;
+            memcpy(tip, ioc, length);
+            tip[length] = '\0';
+            rv = ss_cidr_parse(tip, &ip_addr);
             if (rv != 1) {
-                fprintf(stderr, "could not extract ip from ioc %s\n", ioc);
+                RTE_LOG(FINER, IOC, "could not extract ip from ioc %s\n", tip);
             }
             else {
                 iptr = ss_ioc_ip_match(&ip_addr);
@@ -720,38 +828,31 @@ ss_ioc_entry_t* ss_ioc_syslog_match(const char* ioc, ss_ioc_type_t ioc_type) {
             break;
         }
         case SS_IOC_TYPE_DOMAIN: {
-            // NOTE: convert names to canonical form (trailing '.')
-            rv = (int) strlcpy(tdns, ioc, sizeof(tdns) - 2);
-            if (tdns[rv] != '.') {
-                tdns[rv]         = '.';
-                tdns[rv + 1]     = '\0';
-            }
-            HASH_FIND_STR(ss_conf->domain_table, tdns, iptr);
+            iptr = ss_ioc_domain_match(ioc, length);
             break;
         }
         case SS_IOC_TYPE_URL: {
-            HASH_FIND(hh_full, ss_conf->url_table, ioc, strlen(ioc), iptr);
+            iptr = ss_ioc_str_table_find(&ss_conf->url_table, ioc, length);
             break;
         }
         case SS_IOC_TYPE_EMAIL: {
-            HASH_FIND(hh_full, ss_conf->email_table, ioc, strlen(ioc), iptr);
+            iptr = ss_ioc_str_table_find(&ss_conf->email_table, ioc, length);
             break;
         }
         case SS_IOC_TYPE_MD5: {
-            fprintf(stderr, "ioc %s is unsupported md5 type\n", ioc);
+            RTE_LOG(FINER, IOC, "ioc %.*s is unsupported md5 type\n", (int) length, ioc);
             break;
         }
         case SS_IOC_TYPE_SHA256: {
-            fprintf(stderr, "ioc %s is unsupported sha256 type\n", ioc);
+            RTE_LOG(FINER, IOC, "ioc %.*s is unsupported sha256 type\n", (int) length, ioc);
             break;
         }
         default: {
-            fprintf(stderr, "ioc %s is unknown type %d\n", ioc, ioc_type);
+            RTE_LOG(FINER, IOC, "ioc %.*s is unknown type %d\n", (int) length, ioc, ioc_type);
             break;
         }
     }
 
-    out:
     return iptr;
 }
 
@@ -843,9 +944,9 @@ ss_ioc_entry_t* ss_ioc_sflow_match(sflow_sample_t* sample) {
     uint32_t ip;
     int      rv;
     uint32_t next_hop;
-    char     tdns[SS_DNS_NAME_MAX];
     char*    header;
     size_t   offset;
+    size_t   host_length;
 
     if (sample->eth_type == ETHER_TYPE_IPV4) {
         ip = *(uint32_t*) &sample->src_ip.ipv4.addr;
@@ -946,14 +1047,7 @@ ss_ioc_entry_t* ss_ioc_sflow_match(sflow_sample_t* sample) {
     }
 
     if (sample->host[0]) {
-        // NOTE: convert names to canonical form (trailing '.')
-        offset = strlcpy(tdns, sample->host, sizeof(tdns));
-        if (tdns[offset] != '.') {
-            tdns[offset] = '.';
-            tdns[offset + 1] = '\0';
-        }
-        fprintf(stderr, "host %s extracted dns domain: %s\n", sample->host, tdns);
-        HASH_FIND_STR(ss_conf->domain_table, tdns, iptr);
+        iptr = ss_ioc_domain_match(sample->host, strlen(sample->host));
         if (iptr) goto out;
     }
 
@@ -967,23 +1061,15 @@ ss_ioc_entry_t* ss_ioc_sflow_match(sflow_sample_t* sample) {
         }
 
         if (header == NULL || header != sample->url) {
-            fprintf(stderr, "url is corrupt: %s\n", sample->url);
+            SS_LOG(FINER, IOC, "url is corrupt: %s\n", sample->url);
             goto next_check;
         }
-        // NOTE: convert names to canonical form (trailing '.')
-        strlcpy(tdns, sample->url + offset, sizeof(tdns) - 2);
-        for (int i = 0; ; ++i) {
-            if (tdns[i] == '/' || tdns[i] == '\0') {
-                tdns[i] = '.';
-                tdns[i+1] = '\0';
-                break;
-            }
-        }
-        fprintf(stderr, "url %s extracted dns domain: %s\n", sample->url, tdns);
-        HASH_FIND_STR(ss_conf->domain_table, tdns, iptr);
+        // host portion runs up to the first '/' after the scheme
+        host_length = strcspn(sample->url + offset, "/");
+        iptr = ss_ioc_domain_match(sample->url + offset, host_length);
         if (iptr) goto out;
 
-        HASH_FIND(hh_full, ss_conf->url_table, sample->url, strlen(sample->url), iptr);
+        iptr = ss_ioc_str_table_find(&ss_conf->url_table, sample->url, strlen(sample->url));
         if (iptr) goto out;
     }
 
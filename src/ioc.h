@@ -16,8 +16,8 @@
 
 #define SS_IOC_FILE_MAX           8
 #define SS_IOC_THREAT_TYPE_SIZE  24
-#define SS_IOC_VALUE_SIZE        96
 #define SS_IOC_DNS_SIZE          96
+#define SS_IOC_STR_BUCKETS_MIN 1024
 
 enum ss_ioc_type_e {
     SS_IOC_TYPE_EMPTY  = 0,
@@ -41,15 +41,38 @@ struct ss_ioc_entry_s {
     ss_ioc_type_t type;
     char          threat_type[SS_IOC_THREAT_TYPE_SIZE];
     ip_addr_t     ip;
-    char          value[SS_IOC_VALUE_SIZE];
+    char*         value;
     char          dns[SS_IOC_DNS_SIZE];
     UT_hash_handle hh;
-    UT_hash_handle hh_full;
     TAILQ_ENTRY(ss_ioc_entry_s) entry;
 } __rte_cache_aligned;
 
 typedef struct ss_ioc_entry_s ss_ioc_entry_t;
 
+/* STRING TABLES */
+
+/*
+ * Chained hash keyed on case-insensitive (pointer, length) slices, so that
+ * regex captures can be looked up in place inside the payload.
+ */
+struct ss_ioc_str_node_s {
+    uint32_t hash;
+    uint32_t length;
+    const char* key;
+    ss_ioc_entry_t* ioc;
+    struct ss_ioc_str_node_s* next;
+};
+
+typedef struct ss_ioc_str_node_s ss_ioc_str_node_t;
+
+struct ss_ioc_str_table_s {
+    uint32_t mask;
+    uint32_t count;
+    ss_ioc_str_node_t** buckets;
+};
+
+typedef struct ss_ioc_str_table_s ss_ioc_str_table_t;
+
 TAILQ_HEAD(ss_ioc_list_s, ss_ioc_entry_s);
 typedef struct ss_ioc_list_s ss_ioc_list_t;
 
@@ -77,6 +100,10 @@ int ss_ioc_chain_destroy(void);
 int ss_ioc_chain_add(ss_ioc_entry_t* ioc_entry);
 int ss_ioc_chain_remove_index(int index);
 int ss_ioc_chain_remove_id(uint64_t id);
+int ss_ioc_str_table_grow(ss_ioc_str_table_t* table);
+ss_ioc_entry_t* ss_ioc_str_table_find(ss_ioc_str_table_t* table, const char* key, size_t length);
+ss_ioc_entry_t* ss_ioc_str_table_add(ss_ioc_str_table_t* table, const char* key, size_t length, ss_ioc_entry_t* ioc);
+int ss_ioc_str_table_dump(const char* label, ss_ioc_str_table_t* table, uint64_t limit);
 int ss_ioc_chain_optimize_ip(ss_ioc_entry_t* iptr);
 int ss_ioc_chain_optimize_cidr(ss_ioc_entry_t* iptr);
 int ss_ioc_chain_optimize_domain(ss_ioc_entry_t* iptr);
@@ -87,7 +114,8 @@ int ss_ioc_chain_optimize_sha256(ss_ioc_entry_t* iptr);
 int ss_ioc_chain_optimize(void);
 ss_ioc_entry_t* ss_ioc_metadata_match(ss_metadata_t* md);
 ss_ioc_entry_t* ss_ioc_dns_match(ss_metadata_t* md);
-ss_ioc_entry_t* ss_ioc_syslog_match(const char* ioc, ss_ioc_type_t ioc_type);
+ss_ioc_entry_t* ss_ioc_domain_match(const char* name, size_t length);
+ss_ioc_entry_t* ss_ioc_syslog_match(const char* ioc, size_t length, ss_ioc_type_t ioc_type);
 ss_ioc_entry_t* ss_ioc_ip_match(ip_addr_t* ip);
 ss_ioc_entry_t* ss_ioc_xaddr_match(struct xaddr* addr);
 ss_ioc_entry_t* ss_ioc_netflow_match(struct store_flow_complete* flow);
@@ -14,6 +14,7 @@
 #include "ip.h"
 
 #include "common.h"
+#include "log.h"
 #include "sdn_sensor.h"
 #include "icmp.h"
 #include "ip_utils.h"
@@ -31,15 +32,15 @@ int ss_frame_handle_ip4(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
     
     rx_buf->data.self = (memcmp(&rx_buf->ip4->daddr, &ss_conf->ip4_address.ip4_addr, IPV4_ALEN)) == 0;
 
-    RTE_LOG(DEBUG, L3L4, "rx ip4 src %08x, ip4 dst %08x, protocol %hhu, self %hhu\n",
+    SS_LOG(DEBUG, L3L4, "rx ip4 src %08x, ip4 dst %08x, protocol %hhu, self %hhu\n",
         rte_bswap32(rx_buf->ip4->saddr), rte_bswap32(rx_buf->ip4->daddr), rx_buf->ip4->protocol, rx_buf->data.self);
 
     // XXX: walk through extension headers eventually
     rx_buf->data.ip_protocol = rx_buf->ip4->protocol;
     rv = ss_frame_find_l4_header(rx_buf, rx_buf->ip4->protocol);
     if (rv && rx_buf->ip4->protocol != IPPROTO_IGMP) {
-        RTE_LOG(ERR, L3L4, "port %u received damaged ip4 %hhu frame:\n", rx_buf->data.port_id, rx_buf->ip4->protocol);
-        rte_pktmbuf_dump(stderr, rx_buf->mbuf, rte_pktmbuf_pkt_len(rx_buf->mbuf));
+        SS_LOG(ERR, L3L4, "port %u received damaged ip4 %hhu frame:\n", rx_buf->data.port_id, rx_buf->ip4->protocol);
+        if (SS_LOG_ENABLED(DEBUG)) rte_pktmbuf_dump(stderr, rx_buf->mbuf, rte_pktmbuf_pkt_len(rx_buf->mbuf));
     }
     
     switch (rx_buf->ip4->protocol) {
@@ -57,8 +58,8 @@ int ss_frame_handle_ip4(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
         }
         default: {
             if (rx_buf->ip4->protocol != IPPROTO_IGMP) {
-                RTE_LOG(INFO, L3L4, "port %u received unsupported ip4 %hhu frame:\n", rx_buf->data.port_id, rx_buf->ip4->protocol);
-                rte_pktmbuf_dump(stderr, rx_buf->mbuf, rte_pktmbuf_pkt_len(rx_buf->mbuf));
+                SS_LOG(INFO, L3L4, "port %u received unsupported ip4 %hhu frame:\n", rx_buf->data.port_id, rx_buf->ip4->protocol);
+                if (SS_LOG_ENABLED(DEBUG)) rte_pktmbuf_dump(stderr, rx_buf->mbuf, rte_pktmbuf_pkt_len(rx_buf->mbuf));
             }
             rv = -1;
             break;
@@ -72,10 +73,10 @@ int ss_frame_handle_ip6(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
     int rv = 0;
 
     rx_buf->ip6 = (ip6_hdr_t*) ((uint8_t*) rte_pktmbuf_mtod(rx_buf->mbuf, uint8_t*) + sizeof(eth_hdr_t));
-    if (rte_get_log_level() >= RTE_LOG_DEBUG) {
+    if (SS_LOG_ENABLED(DEBUG)) {
         rte_memdump(stderr, "ip6 src", &rx_buf->ip6->ip6_src, sizeof(rx_buf->ip6->ip6_src));
         rte_memdump(stderr, "ip6 dst", &rx_buf->ip6->ip6_dst, sizeof(rx_buf->ip6->ip6_dst));
-        RTE_LOG(DEBUG, L3L4, "ip6 protocol %hhu\n", rx_buf->ip6->ip6_nxt);
+        SS_LOG(DEBUG, L3L4, "ip6 protocol %hhu\n", rx_buf->ip6->ip6_nxt);
     }
     rte_memcpy(&rx_buf->data.sip, &rx_buf->ip6->ip6_src, sizeof(rx_buf->data.sip));
     rte_memcpy(&rx_buf->data.dip, &rx_buf->ip6->ip6_dst, sizeof(rx_buf->data.dip));
@@ -86,9 +87,9 @@ int ss_frame_handle_ip6(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
     rx_buf->data.ip_protocol = rx_buf->ip6->ip6_nxt;
     rv = ss_frame_find_l4_header(rx_buf, rx_buf->ip6->ip6_nxt);
     if (rv) {
-        RTE_LOG(ERR, L3L4, "port %u received damaged ip6 %hhu frame:\n",
+        SS_LOG(ERR, L3L4, "port %u received damaged ip6 %hhu frame:\n",
             rx_buf->data.port_id, rx_buf->ip6->ip6_nxt);
-        rte_pktmbuf_dump(stderr, rx_buf->mbuf, rte_pktmbuf_pkt_len(rx_buf->mbuf));
+        if (SS_LOG_ENABLED(DEBUG)) rte_pktmbuf_dump(stderr, rx_buf->mbuf, rte_pktmbuf_pkt_len(rx_buf->mbuf));
     }
     
     switch (rx_buf->ip6->ip6_nxt) {
@@ -105,9 +106,9 @@ int ss_frame_handle_ip6(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
             break;
         }
         default: {
-            RTE_LOG(INFO, L3L4, "port %u received unsupported ip6 %hhu frame:\n",
+            SS_LOG(INFO, L3L4, "port %u received unsupported ip6 %hhu frame:\n",
                 rx_buf->data.port_id, rx_buf->ip6->ip6_nxt);
-            rte_pktmbuf_dump(stderr, rx_buf->mbuf, rte_pktmbuf_pkt_len(rx_buf->mbuf));
+            if (SS_LOG_ENABLED(DEBUG)) rte_pktmbuf_dump(stderr, rx_buf->mbuf, rte_pktmbuf_pkt_len(rx_buf->mbuf));
             rv = -1;
             break;
         }
@@ -0,0 +1,590 @@
+#define _GNU_SOURCE /* pthread_setname_np */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <bsd/string.h>
+#include <bsd/sys/queue.h>
+
+#include <rte_atomic.h>
+#include <rte_common.h>
+#include <rte_hash_crc.h>
+#include <rte_log.h>
+
+#include <jemalloc/jemalloc.h>
+
+#include <nanomsg/nn.h>
+
+#include "common.h"
+#include "journal.h"
+#include "log.h"
+
+#define SS_JOURNAL_NS_PER_SEC  1000000000ULL
+#define SS_JOURNAL_NS_PER_MSEC    1000000ULL
+
+/*
+ * Every open journal, for the journal thread. Senders never take this
+ * lock, only the thread, and the config load and teardown. The stats
+ * dump walks it unlocked, as it only changes while no lcore runs.
+ */
+static TAILQ_HEAD(ss_journal_list_s, ss_journal_s) journal_list = TAILQ_HEAD_INITIALIZER(journal_list);
+static pthread_mutex_t journal_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t journal_thread;
+static int journal_started;
+static volatile int journal_stopping;
+
+const char* ss_journal_fsync_dump(ss_journal_fsync_t fsync) {
+    switch (fsync) {
+        case SS_JOURNAL_FSYNC_NONE:     return "none";
+        case SS_JOURNAL_FSYNC_INTERVAL: return "interval";
+        case SS_JOURNAL_FSYNC_ALWAYS:   return "always";
+        default:                        return "unknown";
+    }
+}
+
+/* SS_JOURNAL_FSYNC_MAX when the name is unknown */
+ss_journal_fsync_t ss_journal_fsync_parse(const char* name) {
+    if      (!strcasecmp(name, "none"))     return SS_JOURNAL_FSYNC_NONE;
+    else if (!strcasecmp(name, "interval")) return SS_JOURNAL_FSYNC_INTERVAL;
+    else if (!strcasecmp(name, "always"))   return SS_JOURNAL_FSYNC_ALWAYS;
+    return SS_JOURNAL_FSYNC_MAX;
+}
+
+/* wall clock, as the records outlive the process and its TSC */
+static uint64_t ss_journal_now(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t) now.tv_sec * SS_JOURNAL_NS_PER_SEC + (uint64_t) now.tv_nsec;
+}
+
+static uint32_t ss_journal_crc(const ss_journal_record_t* record, const uint8_t* message) {
+    uint32_t crc;
+
+    crc = rte_hash_crc_4byte(record->length, 0);
+    crc = rte_hash_crc_8byte(record->timestamp, crc);
+    return rte_hash_crc(message, record->length, crc);
+}
+
+static void ss_journal_segment_path(ss_journal_t* journal, uint64_t id, char* path, size_t size) {
+    snprintf(path, size, "%s/%016lx.journal", journal->path, id);
+}
+
+/* makes a new or removed segment file survive a crash, not only its data */
+static void ss_journal_dir_sync(ss_journal_t* journal) {
+    int fd;
+
+    if (journal->conf.fsync == SS_JOURNAL_FSYNC_NONE) return;
+    fd = open(journal->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+    fsync(fd);
+    close(fd);
+}
+
+static int ss_journal_buffer_reserve(ss_journal_t* journal, uint32_t length) {
+    uint8_t* buffer;
+
+    if (length <= journal->buffer_size) return 0;
+    buffer = je_realloc(journal->buffer, length);
+    if (buffer == NULL) return -1;
+    journal->buffer      = buffer;
+    journal->buffer_size = length;
+    return 0;
+}
+
+/* the record at offset, its message in journal->buffer; -1 when it is short or bad */
+static int ss_journal_record_read(ss_journal_t* journal, ss_journal_segment_t* segment, uint64_t offset, ss_journal_record_t* record) {
+    ssize_t rv;
+
+    rv = pread(segment->fd, record, sizeof(*record), (off_t) offset);
+    if (rv != (ssize_t) sizeof(*record)) return -1;
+    if (record->magic != SS_JOURNAL_MAGIC || record->length > SS_JOURNAL_RECORD_MAX) return -1;
+    if (offset + sizeof(*record) + record->length > segment->length) return -1;
+    if (ss_journal_buffer_reserve(journal, record->length)) return -1;
+    rv = pread(segment->fd, journal->buffer, record->length, (off_t) (offset + sizeof(*record)));
+    if (rv != (ssize_t) record->length) return -1;
+    if (ss_journal_crc(record, journal->buffer) != record->crc) return -1;
+    return 0;
+}
+
+/* closes and unlinks the segment, with whatever it still held */
+static void ss_journal_segment_remove(ss_journal_t* journal, ss_journal_segment_t* segment) {
+    char path[PATH_MAX];
+
+    TAILQ_REMOVE(&journal->segments, segment, entry);
+    journal->bytes   -= segment->length;
+    journal->records -= segment->records - segment->replayed;
+    if (segment->fd >= 0) close(segment->fd);
+    ss_journal_segment_path(journal, segment->id, path, sizeof(path));
+    unlink(path);
+    ss_journal_dir_sync(journal);
+    je_free(segment);
+}
+
+static ss_journal_segment_t* ss_journal_segment_create(ss_journal_t* journal) {
+    ss_journal_segment_t* segment;
+    char path[PATH_MAX];
+
+    segment = je_calloc(1, sizeof(ss_journal_segment_t));
+    if (segment == NULL) return NULL;
+    segment->id = journal->next_id++;
+    ss_journal_segment_path(journal, segment->id, path, sizeof(path));
+    segment->fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0640);
+    if (segment->fd < 0) {
+        SS_LOG(ERR, NM, "could not create journal segment %s: %s\n", path, strerror(errno));
+        je_free(segment);
+        return NULL;
+    }
+    TAILQ_INSERT_TAIL(&journal->segments, segment, entry);
+    ss_journal_dir_sync(journal);
+    return segment;
+}
+
+/*
+ * Counts the records a segment left by an earlier run holds, and cuts it
+ * at the first one which is torn or fails its crc, so appends carry on
+ * from a clean end.
+ */
+static int ss_journal_segment_recover(ss_journal_t* journal, ss_journal_segment_t* segment) {
+    ss_journal_record_t record;
+    struct stat info;
+    uint64_t offset = 0;
+
+    if (fstat(segment->fd, &info)) return -1;
+    segment->length = (uint64_t) info.st_size;
+    while (offset < segment->length) {
+        if (ss_journal_record_read(journal, segment, offset, &record)) {
+            fprintf(stderr, "journal segment %016lx of %s is corrupt at offset %lu, truncating %lu bytes\n",
+                segment->id, journal->path, offset, segment->length - offset);
+            ++journal->stats.corrupt;
+            if (ftruncate(segment->fd, (off_t) offset)) return -1;
+            segment->length = offset;
+            break;
+        }
+        offset += sizeof(record) + record.length;
+        segment->last_ns = record.timestamp;
+        ++segment->records;
+    }
+    return 0;
+}
+
+static int ss_journal_id_compare(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+/* the segment ids in the directory, oldest first */
+static int ss_journal_scan(ss_journal_t* journal, uint64_t** ids, size_t* count) {
+    DIR* dir;
+    struct dirent* entry;
+    uint64_t* list = NULL;
+    uint64_t* next;
+    size_t size = 0;
+    char* end;
+    uint64_t id;
+
+    *count = 0;
+    dir = opendir(journal->path);
+    if (dir == NULL) return -1;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strlen(entry->d_name) != 16 + strlen(".journal") || strcmp(entry->d_name + 16, ".journal")) continue;
+        id = strtoull(entry->d_name, &end, 16);
+        if (end != entry->d_name + 16) continue;
+        if (*count == size) {
+            size = size ? size * 2 : 64;
+            next = je_realloc(list, size * sizeof(uint64_t));
+            if (next == NULL) {
+                je_free(list);
+                closedir(dir);
+                return -1;
+            }
+            list = next;
+        }
+        list[(*count)++] = id;
+    }
+    closedir(dir);
+    if (*count) qsort(list, *count, sizeof(uint64_t), ss_journal_id_compare);
+    *ids = list;
+    return 0;
+}
+
+static int ss_journal_recover(ss_journal_t* journal) {
+    ss_journal_segment_t* segment;
+    uint64_t* ids = NULL;
+    size_t count;
+    char path[PATH_MAX];
+
+    if (ss_journal_scan(journal, &ids, &count)) {
+        fprintf(stderr, "could not scan journal %s: %s\n", journal->path, strerror(errno));
+        return -1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        segment = je_calloc(1, sizeof(ss_journal_segment_t));
+        if (segment == NULL) goto error_out;
+        segment->id = ids[i];
+        ss_journal_segment_path(journal, segment->id, path, sizeof(path));
+        segment->fd = open(path, O_RDWR | O_CLOEXEC);
+        TAILQ_INSERT_TAIL(&journal->segments, segment, entry);
+        journal->next_id = segment->id + 1;
+        if (segment->fd < 0 || ss_journal_segment_recover(journal, segment)) {
+            fprintf(stderr, "could not recover journal segment %s: %s\n", path, strerror(errno));
+            goto error_out;
+        }
+        journal->bytes   += segment->length;
+        journal->records += segment->records;
+        if (segment->records == 0) ss_journal_segment_remove(journal, segment);
+    }
+    je_free(ids);
+    return 0;
+
+    error_out:
+    je_free(ids);
+    return -1;
+}
+
+/*
+ * Publishes the counters for ss_journal_stats_dump, with the journal
+ * lock held. The pread of the oldest record happens here, on the journal
+ * thread, so the dump on the master lcore never touches the disk.
+ */
+static void ss_journal_snapshot_publish(ss_journal_t* journal, uint64_t now) {
+    ss_journal_snapshot_t snapshot;
+    ss_journal_segment_t* segment;
+    ss_journal_record_t record;
+
+    memset(&snapshot, 0, sizeof(snapshot));
+    snapshot.records = journal->records;
+    snapshot.bytes   = journal->bytes;
+    snapshot.stats   = journal->stats;
+    TAILQ_FOREACH(segment, &journal->segments, entry) ++snapshot.segments;
+    segment = TAILQ_FIRST(&journal->segments);
+    if (segment && segment->offset < segment->length &&
+        pread(segment->fd, &record, sizeof(record), (off_t) segment->offset) == (ssize_t) sizeof(record) &&
+        record.timestamp < now) {
+        snapshot.oldest = (now - record.timestamp) / SS_JOURNAL_NS_PER_SEC;
+    }
+
+    ++journal->snapshot_seq;
+    rte_smp_wmb();
+    journal->snapshot = snapshot;
+    rte_smp_wmb();
+    ++journal->snapshot_seq;
+}
+
+/* a consistent copy of the snapshot, without waiting on the journal thread */
+static void ss_journal_snapshot_read(ss_journal_t* journal, ss_journal_snapshot_t* snapshot) {
+    uint32_t seq;
+
+    do {
+        while ((seq = journal->snapshot_seq) & 1) rte_pause();
+        rte_smp_rmb();
+        *snapshot = journal->snapshot;
+        rte_smp_rmb();
+    } while (journal->snapshot_seq != seq);
+}
+
+/*
+ * Opens the journal in path, creating the directory, and picks up the
+ * records an earlier run could not send. One directory per queue.
+ */
+ss_journal_t* ss_journal_open(const char* path, ss_journal_conf_t* conf, int conn) {
+    ss_journal_t* journal;
+    ss_journal_t* other;
+
+    journal = je_calloc(1, sizeof(ss_journal_t));
+    if (journal == NULL) {
+        fprintf(stderr, "could not allocate journal %s\n", path);
+        return NULL;
+    }
+    pthread_mutex_init(&journal->lock, NULL);
+    TAILQ_INIT(&journal->segments);
+    strlcpy(journal->path, path, sizeof(journal->path));
+    journal->conf     = *conf;
+    journal->conn     = conn;
+    journal->fsync_ns = ss_journal_now();
+
+    if (mkdir(journal->path, 0750) && errno != EEXIST) {
+        fprintf(stderr, "could not create journal %s: %s\n", journal->path, strerror(errno));
+        goto error_out;
+    }
+    pthread_mutex_lock(&journal_list_lock);
+    TAILQ_FOREACH(other, &journal_list, entry) {
+        if (strcmp(other->path, journal->path)) continue;
+        pthread_mutex_unlock(&journal_list_lock);
+        fprintf(stderr, "journal %s is used by another queue\n", journal->path);
+        goto error_out;
+    }
+    pthread_mutex_unlock(&journal_list_lock);
+    if (ss_journal_recover(journal)) goto error_out;
+    ss_journal_snapshot_publish(journal, ss_journal_now());
+
+    pthread_mutex_lock(&journal_list_lock);
+    TAILQ_INSERT_TAIL(&journal_list, journal, entry);
+    pthread_mutex_unlock(&journal_list_lock);
+    fprintf(stderr, "opened journal %s with %lu records, %lu bytes pending\n",
+        journal->path, journal->records, journal->bytes);
+    return journal;
+
+    error_out:
+    ss_journal_close(journal);
+    return NULL;
+}
+
+/* keeps the segments on disk, for the next run to replay */
+void ss_journal_close(ss_journal_t* journal) {
+    ss_journal_segment_t* segment;
+    ss_journal_t* other;
+
+    if (journal == NULL) return;
+    pthread_mutex_lock(&journal_list_lock);
+    TAILQ_FOREACH(other, &journal_list, entry) {
+        if (other != journal) continue;
+        TAILQ_REMOVE(&journal_list, journal, entry);
+        break;
+    }
+    pthread_mutex_unlock(&journal_list_lock);
+
+    while ((segment = TAILQ_FIRST(&journal->segments)) != NULL) {
+        TAILQ_REMOVE(&journal->segments, segment, entry);
+        if (segment->fd >= 0) {
+            if (journal->conf.fsync != SS_JOURNAL_FSYNC_NONE) fdatasync(segment->fd);
+            close(segment->fd);
+        }
+        je_free(segment);
+    }
+    pthread_mutex_destroy(&journal->lock);
+    je_free(journal->buffer);
+    je_free(journal);
+}
+
+/*
+ * Spills one message, from the egress thread, or a thread without an
+ * egress ring, which could not send it. Rolls to a new segment when the last one is full, and drops
+ * the oldest segments to stay under nm_journal_bytes.
+ */
+int ss_journal_append(ss_journal_t* journal, const uint8_t* message, uint32_t length) {
+    ss_journal_segment_t* tail;
+    ss_journal_segment_t* head;
+    ss_journal_record_t record;
+    struct iovec iov[2];
+    uint64_t need = sizeof(record) + length;
+    ssize_t rv;
+
+    record.magic     = SS_JOURNAL_MAGIC;
+    record.length    = length;
+    record.reserved  = 0;
+    record.timestamp = ss_journal_now();
+    record.crc       = ss_journal_crc(&record, message);
+
+    pthread_mutex_lock(&journal->lock);
+    if (length > SS_JOURNAL_RECORD_MAX || need > journal->conf.bytes) goto error_out;
+
+    tail = TAILQ_LAST(&journal->segments, ss_journal_segment_list_s);
+    if (tail == NULL || (tail->length && tail->length + need > journal->conf.segment_bytes)) {
+        if (tail && journal->conf.fsync != SS_JOURNAL_FSYNC_NONE) fdatasync(tail->fd);
+        tail = ss_journal_segment_create(journal);
+        if (tail == NULL) goto error_out;
+    }
+    while (journal->bytes + need > journal->conf.bytes && (head = TAILQ_FIRST(&journal->segments)) != tail) {
+        journal->stats.dropped += head->records - head->replayed;
+        SS_LOG(WARNING, NM, "journal %s over %lu bytes, dropped segment %016lx of %lu records\n",
+            journal->path, journal->conf.bytes, head->id, head->records - head->replayed);
+        ss_journal_segment_remove(journal, head);
+    }
+
+    iov[0].iov_base = &record;
+    iov[0].iov_len  = sizeof(record);
+    iov[1].iov_base = (void*) (uintptr_t) message;
+    iov[1].iov_len  = length;
+    rv = pwritev(tail->fd, iov, 2, (off_t) tail->length);
+    if (rv != (ssize_t) need) {
+        SS_LOG(ERR, NM, "could not write journal %s segment %016lx: %s\n",
+            journal->path, tail->id, rv < 0 ? strerror(errno) : "short write");
+        // the next record overwrites a torn one, and recovery cuts it otherwise
+        goto error_out;
+    }
+    tail->length  += need;
+    tail->last_ns  = record.timestamp;
+    ++tail->records;
+    journal->bytes += need;
+    ++journal->records;
+    ++journal->stats.spilled;
+    journal->dirty = 1;
+    if (journal->conf.fsync == SS_JOURNAL_FSYNC_ALWAYS) {
+        fdatasync(tail->fd);
+        ++journal->stats.fsyncs;
+        journal->dirty = 0;
+    }
+    pthread_mutex_unlock(&journal->lock);
+    return 0;
+
+    error_out:
+    ++journal->stats.write_errors;
+    pthread_mutex_unlock(&journal->lock);
+    return -1;
+}
+
+/*
+ * Sends up to SS_JOURNAL_REPLAY_BURST records, oldest first, until the
+ * socket pushes back again. Expired records and emptied segments go on
+ * the way. Returns the records sent.
+ */
+int ss_journal_replay(ss_journal_t* journal, uint64_t now) {
+    ss_journal_segment_t* segment;
+    ss_journal_record_t record;
+    uint64_t age = journal->conf.age * SS_JOURNAL_NS_PER_SEC;
+    int sent = 0;
+    int rv;
+
+    pthread_mutex_lock(&journal->lock);
+    // whole segments first, without reading them, while the consumer is away
+    while ((segment = TAILQ_FIRST(&journal->segments)) != NULL && segment->last_ns + age < now) {
+        journal->stats.expired += segment->records - segment->replayed;
+        ss_journal_segment_remove(journal, segment);
+    }
+
+    while (sent < SS_JOURNAL_REPLAY_BURST && (segment = TAILQ_FIRST(&journal->segments)) != NULL) {
+        if (segment->offset >= segment->length) {
+            ss_journal_segment_remove(journal, segment);
+            continue;
+        }
+        if (ss_journal_record_read(journal, segment, segment->offset, &record)) {
+            SS_LOG(ERR, NM, "journal %s segment %016lx is corrupt at offset %lu, dropped %lu records\n",
+                journal->path, segment->id, segment->offset, segment->records - segment->replayed);
+            journal->stats.corrupt += segment->records - segment->replayed;
+            ss_journal_segment_remove(journal, segment);
+            continue;
+        }
+        if (record.timestamp + age >= now) {
+            rv = nn_send(journal->conn, journal->buffer, record.length, NN_DONTWAIT);
+            if (rv < 0) break;
+            ++journal->stats.replayed;
+            journal->stats.replayed_bytes += (uint64_t) rv;
+            ++sent;
+        }
+        else {
+            ++journal->stats.expired;
+        }
+        segment->offset += sizeof(record) + record.length;
+        ++segment->replayed;
+        --journal->records;
+    }
+
+    if (journal->conf.fsync == SS_JOURNAL_FSYNC_INTERVAL && journal->dirty &&
+        now - journal->fsync_ns >= journal->conf.fsync_msecs * SS_JOURNAL_NS_PER_MSEC) {
+        segment = TAILQ_LAST(&journal->segments, ss_journal_segment_list_s);
+        if (segment) {
+            fdatasync(segment->fd);
+            ++journal->stats.fsyncs;
+        }
+        journal->dirty    = 0;
+        journal->fsync_ns = now;
+    }
+    ss_journal_snapshot_publish(journal, now);
+    pthread_mutex_unlock(&journal->lock);
+
+    return sent;
+}
+
+static void* ss_journal_thread(void* arg) {
+    ss_journal_t* journal;
+    uint64_t now;
+    int sent;
+
+    while (!journal_stopping) {
+        sent = 0;
+        now  = ss_journal_now();
+        pthread_mutex_lock(&journal_list_lock);
+        TAILQ_FOREACH(journal, &journal_list, entry) {
+            sent += ss_journal_replay(journal, now);
+        }
+        pthread_mutex_unlock(&journal_list_lock);
+        if (sent == 0) usleep(SS_JOURNAL_IDLE_USECS);
+    }
+
+    return NULL;
+}
+
+/* after the queues are created, so records recovered from disk go out too */
+int ss_journal_start() {
+    int rv;
+
+    if (TAILQ_EMPTY(&journal_list)) return 0;
+
+    rv = ss_thread_create(&journal_thread, ss_journal_thread, NULL);
+    if (rv) {
+        RTE_LOG(ERR, SS, "could not start journal thread: %s\n", strerror(rv));
+        return -1;
+    }
+    pthread_setname_np(journal_thread, "ss_journal");
+    journal_started = 1;
+    RTE_LOG(NOTICE, SS, "journal thread started\n");
+    return 0;
+}
+
+/*
+ * Joins the journal thread after its current pass, ahead of the queue
+ * teardown which closes the journals. What is not replayed yet stays in
+ * the segments, for the next run.
+ */
+void ss_journal_stop() {
+    int rv;
+
+    if (!journal_started) return;
+
+    journal_stopping = 1;
+    rv = pthread_join(journal_thread, NULL);
+    if (rv) fprintf(stderr, "could not join journal thread: %s\n", strerror(rv));
+    journal_started = 0;
+}
+
+/*
+ * The depth is what the consumer owes: records, bytes and age of the
+ * oldest. Runs on the master lcore, so it takes no lock and reads only
+ * the snapshots; the list itself changes only at config load and after
+ * the lcores have stopped.
+ */
+int ss_journal_stats_dump() {
+    ss_journal_t* journal;
+    ss_journal_snapshot_t snapshot;
+
+    if (rte_get_log_level() < RTE_LOG_NOTICE) return 0;
+
+    TAILQ_FOREACH(journal, &journal_list, entry) {
+        ss_journal_snapshot_read(journal, &snapshot);
+
+        printf("Journal statistics =================================\n"
+               "Journal: %s\n"
+               "Records pending: %21lu\n"
+               "Bytes on disk: %23lu\n"
+               "Segments: %28lu\n"
+               "Oldest record secs: %18lu\n"
+               "Spilled: %29lu\n"
+               "Replayed: %28lu\n"
+               "Replayed bytes: %22lu\n"
+               "Dropped for size: %20lu\n"
+               "Expired: %29lu\n"
+               "Corrupt: %29lu\n"
+               "Write errors: %24lu\n"
+               "Fsyncs: %30lu\n"
+               "====================================================\n",
+               journal->path, snapshot.records, snapshot.bytes, snapshot.segments, snapshot.oldest,
+               snapshot.stats.spilled, snapshot.stats.replayed, snapshot.stats.replayed_bytes,
+               snapshot.stats.dropped, snapshot.stats.expired, snapshot.stats.corrupt,
+               snapshot.stats.write_errors, snapshot.stats.fsyncs);
+    }
+
+    return 0;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include <bsd/sys/queue.h>
+
+/*
+ * nm_journal: nanomsg messages which would have been discarded on EAGAIN
+ * are appended to segment files in a directory of the queue instead, and
+ * the journal thread sends them again, oldest first, once the consumer
+ * takes them. Delivery is at least once: the replay position is not kept
+ * on disk, so after a restart a partly replayed segment goes out again.
+ */
+
+/* CONSTANTS */
+
+#define SS_JOURNAL_BYTES_DEFAULT         (1ULL << 30) // nm_journal_bytes, all segments
+#define SS_JOURNAL_SEGMENT_BYTES_DEFAULT (16ULL << 20) // nm_journal_segment_bytes
+#define SS_JOURNAL_AGE_DEFAULT           86400 // nm_journal_age, seconds
+#define SS_JOURNAL_FSYNC_MSECS_DEFAULT    1000 // nm_journal_fsync_msecs
+#define SS_JOURNAL_RECORD_MAX       (32 << 20) // larger than any message or batch
+#define SS_JOURNAL_MAGIC            0x534a3031 // "SJ01"
+#define SS_JOURNAL_REPLAY_BURST            256 // records per journal per pass
+#define SS_JOURNAL_IDLE_USECS            10000 // journal thread sleep when nothing was sent
+
+enum ss_journal_fsync_e {
+    SS_JOURNAL_FSYNC_NONE     = 0, // the page cache decides
+    SS_JOURNAL_FSYNC_INTERVAL = 1, // every nm_journal_fsync_msecs, from the journal thread
+    SS_JOURNAL_FSYNC_ALWAYS   = 2, // after every record, on the sending thread
+    SS_JOURNAL_FSYNC_MAX,
+};
+
+typedef enum ss_journal_fsync_e ss_journal_fsync_t;
+
+/* DATA TYPES */
+
+/*
+ * Leads every record in a segment, in host byte order as the journal
+ * never leaves the host. crc is crc32c of length, timestamp and the
+ * message; recovery stops a segment at the first record which fails it.
+ */
+struct ss_journal_record_s {
+    uint32_t magic;
+    uint32_t length;    // message bytes which follow
+    uint32_t crc;
+    uint32_t reserved;
+    uint64_t timestamp; // nanoseconds since the Unix epoch, at spill
+} __attribute__((packed));
+
+typedef struct ss_journal_record_s ss_journal_record_t;
+
+struct ss_journal_conf_s {
+    uint64_t           bytes;
+    uint64_t           segment_bytes;
+    uint64_t           age;         // seconds
+    ss_journal_fsync_t fsync;
+    uint64_t           fsync_msecs;
+};
+
+typedef struct ss_journal_conf_s ss_journal_conf_t;
+
+/* one file, <id in hex>.journal, appended at length and replayed from offset */
+struct ss_journal_segment_s {
+    uint64_t id;
+    int      fd;
+    uint64_t length;
+    uint64_t offset;
+    uint64_t records;
+    uint64_t replayed;
+    uint64_t last_ns;   // timestamp of the newest record
+    TAILQ_ENTRY(ss_journal_segment_s) entry;
+};
+
+typedef struct ss_journal_segment_s ss_journal_segment_t;
+
+struct ss_journal_stats_s {
+    uint64_t spilled;
+    uint64_t replayed;
+    uint64_t replayed_bytes;
+    uint64_t dropped;       // oldest segments removed for nm_journal_bytes
+    uint64_t expired;       // older than nm_journal_age
+    uint64_t corrupt;       // records cut off by recovery or failing the crc
+    uint64_t write_errors;  // could not spill, the message was discarded
+    uint64_t fsyncs;
+};
+
+typedef struct ss_journal_stats_s ss_journal_stats_t;
+
+/* what the stats dump shows, copied out by the journal thread after each pass */
+struct ss_journal_snapshot_s {
+    uint64_t           records;
+    uint64_t           bytes;
+    uint64_t           segments;
+    uint64_t           oldest;     // seconds the oldest pending record waited
+    ss_journal_stats_t stats;
+};
+
+typedef struct ss_journal_snapshot_s ss_journal_snapshot_t;
+
+/*
+ * The lock covers everything but records, which senders read without it
+ * to decide whether a message must queue up behind the journal, and the
+ * snapshot, which the stats dump reads under snapshot_seq instead.
+ */
+struct ss_journal_s {
+    pthread_mutex_t    lock;
+    char               path[PATH_MAX];
+    int                conn;
+    ss_journal_conf_t  conf;
+    uint64_t           next_id;
+    uint64_t           bytes;      // all segments on disk
+    volatile uint64_t  records;    // not replayed yet
+    int                dirty;      // written since the last fsync
+    uint64_t           fsync_ns;
+    ss_journal_stats_t stats;
+    uint8_t*           buffer;     // replay, grown to the largest record
+    uint32_t           buffer_size;
+    // odd while the journal thread rewrites the snapshot, readers retry
+    volatile uint32_t     snapshot_seq;
+    ss_journal_snapshot_t snapshot;
+    TAILQ_HEAD(ss_journal_segment_list_s, ss_journal_segment_s) segments; // oldest first
+    TAILQ_ENTRY(ss_journal_s) entry;
+};
+
+typedef struct ss_journal_s ss_journal_t;
+
+/* BEGIN PROTOTYPES */
+
+const char* ss_journal_fsync_dump(ss_journal_fsync_t fsync);
+ss_journal_fsync_t ss_journal_fsync_parse(const char* name);
+ss_journal_t* ss_journal_open(const char* path, ss_journal_conf_t* conf, int conn);
+void ss_journal_close(ss_journal_t* journal);
+int ss_journal_append(ss_journal_t* journal, const uint8_t* message, uint32_t length);
+int ss_journal_replay(ss_journal_t* journal, uint64_t now);
+int ss_journal_start(void);
+void ss_journal_stop(void);
+int ss_journal_stats_dump(void);
+
+/* END PROTOTYPES */
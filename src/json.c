@@ -1,3 +1,4 @@
+#include <stdint.h>
 #include <stdio.h>
 
 #include <json-c/json.h>
@@ -73,3 +74,22 @@ int ss_json_boolean_get(json_object* items, const char* key, int vdefault) {
     out:
     return rv;
 }
+
+int64_t ss_json_int_get(json_object* items, const char* key, int64_t vdefault) {
+    json_object* item;
+    int64_t rv = vdefault;
+
+    item = ss_json_object_get(items, key);
+    if (item == NULL) {
+        fprintf(stderr, "note: key %s not present, use default %ld\n", key, vdefault);
+        goto out;
+    }
+    if (!json_object_is_type(item, json_type_int)) {
+        fprintf(stderr, "value for %s is not int\n", key);
+        goto out;
+    }
+    rv = json_object_get_int64(item);
+
+    out:
+    return rv;
+}
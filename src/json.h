@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 #include <json-c/json.h>
 #include <json-c/json_object_private.h>
 
@@ -9,5 +11,6 @@ struct json_object* ss_json_object_get(json_object* items, const char* key);
 const char* ss_json_string_view(json_object* items, const char* key);
 char* ss_json_string_get(json_object* items, const char* key);
 int ss_json_boolean_get(json_object* items, const char* key, int vdefault);
+int64_t ss_json_int_get(json_object* items, const char* key, int64_t vdefault);
 
 /* END PROTOTYPES */
@@ -0,0 +1,210 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <rte_branch_prediction.h>
+
+#ifdef SS_JSON_WRITER_VERIFY
+#include <stdio.h>
+
+#include <json-c/json.h>
+#endif
+
+#include "json_writer.h"
+
+/*
+ * Needs no DPDK past likely and unlikely, so tools/ss_json_writer_test
+ * can check it against json-c; the buffers and the logging are up to the
+ * callers.
+ */
+
+/*
+ * json-c's json_escape_str: the short forms below, including "\/",
+ * and \u00xx with lowercase hex for every other control character.
+ * Bytes from 0x7f up are copied as they are.
+ */
+static const uint8_t json_escapes[256] = {
+    ['\b'] = 'b', ['\n'] = 'n', ['\r'] = 'r', ['\t'] = 't', ['\f'] = 'f',
+    ['"']  = '"', ['\\'] = '\\', ['/'] = '/',
+    [0x00] = 'u', [0x01] = 'u', [0x02] = 'u', [0x03] = 'u',
+    [0x04] = 'u', [0x05] = 'u', [0x06] = 'u', [0x07] = 'u',
+    [0x0b] = 'u', [0x0e] = 'u', [0x0f] = 'u',
+    [0x10] = 'u', [0x11] = 'u', [0x12] = 'u', [0x13] = 'u',
+    [0x14] = 'u', [0x15] = 'u', [0x16] = 'u', [0x17] = 'u',
+    [0x18] = 'u', [0x19] = 'u', [0x1a] = 'u', [0x1b] = 'u',
+    [0x1c] = 'u', [0x1d] = 'u', [0x1e] = 'u', [0x1f] = 'u',
+};
+
+static const char json_hex[] = "0123456789abcdef";
+
+void ss_json_writer_init(ss_json_writer_t* writer, uint8_t* data, size_t size) {
+    memset(writer, 0, sizeof(*writer));
+    writer->data = data;
+    // keep room for the NUL written by finish
+    if (size) writer->size = size - 1;
+    else      writer->overflow = 1;
+}
+
+static inline void ss_json_writer_append(ss_json_writer_t* writer, const void* data, size_t length) {
+    if (unlikely(writer->length + length > writer->size)) {
+        writer->overflow = 1;
+        return;
+    }
+    memcpy(writer->data + writer->length, data, length);
+    writer->length += length;
+}
+
+/* first byte in [p, end) which json-c would escape, or end */
+static inline const uint8_t* ss_json_escape_find(const uint8_t* p, const uint8_t* end) {
+#ifdef __SSE2__
+    const __m128i control   = _mm_set1_epi8(0x1f);
+    const __m128i quote     = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i slash     = _mm_set1_epi8('/');
+    __m128i bytes;
+    __m128i hits;
+    int mask;
+
+    while (end - p >= 16) {
+        bytes = _mm_loadu_si128((const __m128i*) p);
+        // unsigned byte <= 0x1f, as max(byte, 0x1f) == 0x1f
+        hits  = _mm_cmpeq_epi8(_mm_max_epu8(bytes, control), control);
+        hits  = _mm_or_si128(hits, _mm_cmpeq_epi8(bytes, quote));
+        hits  = _mm_or_si128(hits, _mm_cmpeq_epi8(bytes, backslash));
+        hits  = _mm_or_si128(hits, _mm_cmpeq_epi8(bytes, slash));
+        mask  = _mm_movemask_epi8(hits);
+        if (mask) return p + __builtin_ctz((unsigned int) mask);
+        p += 16;
+    }
+#endif
+    while (p < end && json_escapes[*p] == 0) ++p;
+    return p;
+}
+
+static void ss_json_writer_escape(ss_json_writer_t* writer, const uint8_t* p, size_t length) {
+    const uint8_t* end = p + length;
+    const uint8_t* next;
+    uint8_t escape[6] = { '\\', 0, '0', '0', 0, 0 };
+
+    while (p < end) {
+        next = ss_json_escape_find(p, end);
+        ss_json_writer_append(writer, p, (size_t) (next - p));
+        if (next == end) break;
+
+        escape[1] = json_escapes[*next];
+        if (escape[1] == 'u') {
+            escape[4] = (uint8_t) json_hex[*next >> 4];
+            escape[5] = (uint8_t) json_hex[*next & 0xf];
+            ss_json_writer_append(writer, escape, 6);
+        }
+        else {
+            ss_json_writer_append(writer, escape, 2);
+        }
+        p = next + 1;
+    }
+}
+
+static void ss_json_writer_key(ss_json_writer_t* writer, const char* key) {
+    uint32_t bit = 1U << writer->depth;
+
+    if (writer->children & bit) ss_json_writer_append(writer, ", \"", 3);
+    else                        ss_json_writer_append(writer, " \"", 2);
+    writer->children |= bit;
+    ss_json_writer_escape(writer, (const uint8_t*) key, strlen(key));
+    ss_json_writer_append(writer, "\": ", 3);
+}
+
+/* key is NULL for the outermost object */
+void ss_json_writer_object_start(ss_json_writer_t* writer, const char* key) {
+    if (key) ss_json_writer_key(writer, key);
+    if (unlikely(writer->depth + 1 >= SS_JSON_WRITER_DEPTH)) {
+        writer->overflow = 1;
+        return;
+    }
+    ++writer->depth;
+    writer->children &= ~(1U << writer->depth);
+    ss_json_writer_append(writer, "{", 1);
+}
+
+void ss_json_writer_object_end(ss_json_writer_t* writer) {
+    // json-c writes an empty object as "{ }" too
+    ss_json_writer_append(writer, " }", 2);
+    if (writer->depth > 0) --writer->depth;
+}
+
+void ss_json_writer_string(ss_json_writer_t* writer, const char* key, const char* value) {
+    ss_json_writer_string_len(writer, key, value, strlen(value));
+}
+
+void ss_json_writer_string_len(ss_json_writer_t* writer, const char* key, const char* value, size_t length) {
+    ss_json_writer_key(writer, key);
+    ss_json_writer_append(writer, "\"", 1);
+    ss_json_writer_escape(writer, (const uint8_t*) value, length);
+    ss_json_writer_append(writer, "\"", 1);
+}
+
+void ss_json_writer_int(ss_json_writer_t* writer, const char* key, int32_t value) {
+    ss_json_writer_int64(writer, key, value);
+}
+
+void ss_json_writer_int64(ss_json_writer_t* writer, const char* key, int64_t value) {
+    char digits[20];
+    char* p = digits + sizeof(digits);
+    // negate in unsigned, INT64_MIN has no positive counterpart
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t) value : (uint64_t) value;
+
+    do {
+        *--p = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+
+    ss_json_writer_key(writer, key);
+    if (value < 0) ss_json_writer_append(writer, "-", 1);
+    ss_json_writer_append(writer, p, (size_t) (digits + sizeof(digits) - p));
+}
+
+/* members rendered by another writer, the text between its "{ " and " }" */
+void ss_json_writer_members(ss_json_writer_t* writer, const uint8_t* members, size_t length) {
+    uint32_t bit = 1U << writer->depth;
+
+    if (length == 0) return;
+    if (writer->children & bit) ss_json_writer_append(writer, ", ", 2);
+    else                        ss_json_writer_append(writer, " ", 1);
+    writer->children |= bit;
+    ss_json_writer_append(writer, members, length);
+}
+
+#ifdef SS_JSON_WRITER_VERIFY
+/*
+ * json-c's parser keeps member order and value types, so printing its
+ * tree again gives what the old json-c code would have produced.
+ */
+static void ss_json_writer_verify(ss_json_writer_t* writer) {
+    json_object* jobject = json_tokener_parse((char*) writer->data);
+    const char* expected;
+
+    if (jobject == NULL) {
+        fprintf(stderr, "json writer produced unparseable output: %s\n", writer->data);
+        return;
+    }
+    expected = json_object_to_json_string_ext(jobject, JSON_C_TO_STRING_SPACED);
+    if (strcmp(expected, (char*) writer->data)) {
+        fprintf(stderr, "json writer mismatch:\n  writer: %s\n  json-c: %s\n", writer->data, expected);
+    }
+    json_object_put(jobject);
+}
+#endif
+
+/* NUL-terminate the message, returns its length or -1 when it did not fit */
+int ss_json_writer_finish(ss_json_writer_t* writer) {
+    if (writer->overflow || writer->data == NULL) return -1;
+    writer->data[writer->length] = '\0';
+#ifdef SS_JSON_WRITER_VERIFY
+    ss_json_writer_verify(writer);
+#endif
+    return (int) writer->length;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* CONSTANTS */
+
+#define SS_JSON_WRITER_SIZE  65536 // largest message nn_queue_send takes, plus the NUL
+#define SS_JSON_WRITER_DEPTH    32 // nested objects, one bit each in children
+
+/* DATA TYPES */
+
+/*
+ * Streams JSON straight into a caller buffer, with no allocations, in
+ * exactly the layout json-c uses for JSON_C_TO_STRING_SPACED:
+ * { "key": value, "key": value }. Running out of space is sticky and
+ * reported once, by ss_json_writer_finish returning -1.
+ *
+ * Build with CPPFLAGS=-DSS_JSON_WRITER_VERIFY to have every message
+ * re-serialized through json-c and compared byte for byte.
+ */
+struct ss_json_writer_s {
+    uint8_t* data;
+    size_t   size;
+    size_t   length;
+    int      overflow;
+    int      depth;
+    uint32_t children; // bit per depth, set once that object has a member
+};
+
+typedef struct ss_json_writer_s ss_json_writer_t;
+
+/* BEGIN PROTOTYPES */
+
+void ss_json_writer_init(ss_json_writer_t* writer, uint8_t* data, size_t size);
+void ss_json_writer_object_start(ss_json_writer_t* writer, const char* key);
+void ss_json_writer_object_end(ss_json_writer_t* writer);
+void ss_json_writer_string(ss_json_writer_t* writer, const char* key, const char* value);
+void ss_json_writer_string_len(ss_json_writer_t* writer, const char* key, const char* value, size_t length);
+void ss_json_writer_int(ss_json_writer_t* writer, const char* key, int32_t value);
+void ss_json_writer_int64(ss_json_writer_t* writer, const char* key, int64_t value);
+void ss_json_writer_members(ss_json_writer_t* writer, const uint8_t* members, size_t length);
+int ss_json_writer_finish(ss_json_writer_t* writer);
+
+/* END PROTOTYPES */
@@ -8,9 +8,11 @@
 #include <rte_mbuf.h>
 #include <rte_memcpy.h>
 
+#include "checksum.h"
 #include "common.h"
 #include "ip_utils.h"
 #include "l4_utils.h"
+#include "log.h"
 #include "sdn_sensor.h"
 #include "sensor_conf.h"
 
@@ -43,7 +45,7 @@ int ss_frame_layer_off_len_get(ss_frame_t* rx_buf,
 
     uint16_t total_length = (uint16_t) ((*layer_offset + *layer_length) - mbuf_start);
     if (total_length > mbuf_length) {
-        RTE_LOG(ERR, UTILS, "received unsafe packet, total_length %u > mbuf_length %u\n",
+        SS_LOG(ERR, UTILS, "received unsafe packet, total_length %u > mbuf_length %u\n",
         total_length, mbuf_length);
         *layer_offset = NULL;
         *layer_length = 0;
@@ -71,7 +73,7 @@ int ss_frame_find_l4_header(ss_frame_t* rx_buf, uint8_t ip_protocol) {
             break;
         }
         default: {
-            RTE_LOG(ERR, UTILS, "could not locate l4 header for ether type 0x%04hx\n", ether_type);
+            SS_LOG(ERR, UTILS, "could not locate l4 header for ether type 0x%04hx\n", ether_type);
             return -1;
         }
     }
@@ -94,7 +96,7 @@ int ss_frame_find_l4_header(ss_frame_t* rx_buf, uint8_t ip_protocol) {
             return 0;
         }
         default: {
-            RTE_LOG(ERR, UTILS, "could not locate l4 header for ip protocol %hhd\n", ip_protocol);
+            SS_LOG(ERR, UTILS, "could not locate l4 header for ip protocol %hhd\n", ip_protocol);
             return -1;
         }
     }
@@ -107,44 +109,76 @@ uint8_t* ss_phdr_append(rte_mbuf_t* pmbuf, void* data, uint16_t length) {
 }
 
 int ss_frame_prepare_ip4(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
+    return ss_frame_prepare_ip4_addr(tx_buf, rx_buf->ip4->protocol, (uint8_t*) &rx_buf->ip4->saddr);
+}
+
+/* build an IPv4 header towards daddr without needing an rx frame */
+int ss_frame_prepare_ip4_addr(ss_frame_t* tx_buf, uint8_t protocol, uint8_t* daddr) {
     tx_buf->ip4 = (ip4_hdr_t*) rte_pktmbuf_append(tx_buf->mbuf, sizeof(ip4_hdr_t));
     if (tx_buf->ip4 == NULL) {
-        RTE_LOG(ERR, L3L4, "could not allocate mbuf ipv4 header\n");
+        SS_LOG(ERR, L3L4, "could not allocate mbuf ipv4 header\n");
         return -1;
     }
     tx_buf->ip4->version   = 0x4;
     tx_buf->ip4->ihl       = 20 / 4;
     tx_buf->ip4->tos       = 0x0;
-    // L4 must set this
-    //tx_buf->ip4->tot_len = ????;
+    // L4 must set this with ss_frame_prepare_ip4_length
+    tx_buf->ip4->tot_len   = rte_bswap16(0x0000);
     tx_buf->ip4->id        = rte_bswap16(0x0000);
     tx_buf->ip4->frag_off  = 0;
     tx_buf->ip4->ttl       = 0xff; // XXX: use constant
-    tx_buf->ip4->protocol  = rx_buf->ip4->protocol;
+    tx_buf->ip4->protocol  = protocol;
     tx_buf->ip4->check     = rte_bswap16(0x0000);
     tx_buf->ip4->saddr     = ss_conf->ip4_address.ip4_addr.addr; // bswap ?????
-    tx_buf->ip4->daddr     = rx_buf->ip4->saddr;
+    rte_memcpy(&tx_buf->ip4->daddr, daddr, sizeof(tx_buf->ip4->daddr));
+    tx_buf->ip4->check     = ss_in_cksum((uint16_t*) tx_buf->ip4, sizeof(ip4_hdr_t));
 
     return 0;
 }
 
+/*
+ * Fill in tot_len once L4 has appended everything, patching the header
+ * checksum from ss_frame_prepare_ip4 per RFC 1624 instead of resumming it.
+ */
+uint16_t ss_frame_prepare_ip4_length(ss_frame_t* tx_buf) {
+    uint16_t ip_len = (uint16_t) (rte_pktmbuf_pkt_len(tx_buf->mbuf) - ((uint8_t*) tx_buf->ip4 - rte_pktmbuf_mtod(tx_buf->mbuf, uint8_t*)));
+    uint16_t tot_len = rte_bswap16(ip_len);
+
+    tx_buf->ip4->check   = ss_cksum_update16(tx_buf->ip4->check, tx_buf->ip4->tot_len, tot_len);
+    tx_buf->ip4->tot_len = tot_len;
+
+    return (uint16_t) (ip_len - sizeof(ip4_hdr_t));
+}
+
 int ss_frame_prepare_ip6(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
+    return ss_frame_prepare_ip6_addr(tx_buf, rx_buf->ip6->ip6_nxt, (uint8_t*) &rx_buf->ip6->ip6_src);
+}
+
+int ss_frame_prepare_ip6_addr(ss_frame_t* tx_buf, uint8_t protocol, uint8_t* daddr) {
     tx_buf->ip6 = (ip6_hdr_t*) rte_pktmbuf_append(tx_buf->mbuf, sizeof(ip6_hdr_t));
     if (tx_buf->ip6 == NULL) {
-        RTE_LOG(ERR, L3L4, "could not allocate mbuf ipv6 header\n");
+        SS_LOG(ERR, L3L4, "could not allocate mbuf ipv6 header\n");
         return -1;
     }
     tx_buf->ip6->ip6_flow   = rte_bswap32(0x60000000);
     tx_buf->ip6->ip6_hlim   = 0x0ff; // XXX: use constant
-    tx_buf->ip6->ip6_nxt    = rx_buf->ip6->ip6_nxt;
-    // L4 must set this
-    //tx_buf->ip6->ip6_plen = ????;
-    rte_memcpy(&tx_buf->ip6->ip6_dst, &rx_buf->ip6->ip6_src, sizeof(tx_buf->ip6->ip6_dst));
+    tx_buf->ip6->ip6_nxt    = protocol;
+    // L4 must set this with ss_frame_prepare_ip6_length
+    tx_buf->ip6->ip6_plen   = rte_bswap16(0x0000);
+    rte_memcpy(&tx_buf->ip6->ip6_dst, daddr, sizeof(tx_buf->ip6->ip6_dst));
     rte_memcpy(&tx_buf->ip6->ip6_src, &ss_conf->ip6_address.ip6_addr, sizeof(tx_buf->ip6->ip6_src));
 
     return 0;
 }
 
+uint16_t ss_frame_prepare_ip6_length(ss_frame_t* tx_buf) {
+    uint16_t plen = (uint16_t) (rte_pktmbuf_pkt_len(tx_buf->mbuf) - ((uint8_t*) tx_buf->ip6 - rte_pktmbuf_mtod(tx_buf->mbuf, uint8_t*)) - sizeof(ip6_hdr_t));
+
+    tx_buf->ip6->ip6_plen = rte_bswap16(plen);
+
+    return plen;
+}
+
 void ss_frame_destroy(ss_frame_t* fbuf) {
     if (!fbuf) return;
     fbuf->active = 0;
@@ -12,7 +12,11 @@ int ss_frame_layer_off_len_get(ss_frame_t* rx_buf, void* layer_start, size_t lay
 int ss_frame_find_l4_header(ss_frame_t* rx_buf, uint8_t ip_protocol);
 uint8_t* ss_phdr_append(rte_mbuf_t* pmbuf, void* data, uint16_t length);
 int ss_frame_prepare_ip4(ss_frame_t* rx_buf, ss_frame_t* tx_buf);
+int ss_frame_prepare_ip4_addr(ss_frame_t* tx_buf, uint8_t protocol, uint8_t* daddr);
+uint16_t ss_frame_prepare_ip4_length(ss_frame_t* tx_buf);
 int ss_frame_prepare_ip6(ss_frame_t* rx_buf, ss_frame_t* tx_buf);
+int ss_frame_prepare_ip6_addr(ss_frame_t* tx_buf, uint8_t protocol, uint8_t* daddr);
+uint16_t ss_frame_prepare_ip6_length(ss_frame_t* tx_buf);
 void ss_frame_destroy(ss_frame_t* fbuf);
 
 /* END PROTOTYPES */
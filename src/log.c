@@ -0,0 +1,245 @@
+#define _GNU_SOURCE /* pthread_setname_np */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rte_atomic.h>
+#include <rte_branch_prediction.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+
+#include <jemalloc/jemalloc.h>
+
+#include "common.h"
+#include "log.h"
+#include "sdn_sensor.h"
+#include "sensor_conf.h"
+
+/*
+ * Packet lcores must not block in stdio, and a hot call site must not
+ * flood the log. SS_LOG lines pass a GCRA limit of their call site, then
+ * go into a ring of the lcore, which the log thread writes out through
+ * rte_log. Threads without a ring, and everything before ss_log_init,
+ * write directly.
+ */
+
+static ss_log_ring_t log_rings[RTE_MAX_LCORE];
+static ss_log_stats_t log_direct;
+static pthread_t log_thread;
+static int log_started;
+static volatile int log_stopping;
+static uint64_t log_interval;
+static uint64_t log_burst;
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wformat-nonliteral"
+
+static void* ss_log_thread(void* arg) {
+    ss_log_ring_t* ring;
+    ss_log_line_t* line;
+    uint32_t head;
+    uint32_t total;
+    int stopping;
+
+    for (;;) {
+        // read ahead of the pass, so an empty pass after the stop saw everything
+        stopping = log_stopping;
+        rte_smp_rmb();
+        total = 0;
+        for (unsigned int lcore_id = 0; lcore_id < RTE_MAX_LCORE; ++lcore_id) {
+            ring = &log_rings[lcore_id];
+            if (ring->lines == NULL) continue;
+            head = ring->head;
+            // read the lines only after the head which covers them
+            rte_smp_rmb();
+            for (; ring->tail != head; ++ring->tail, ++total) {
+                line = &ring->lines[ring->tail & (SS_LOG_RING_SIZE - 1)];
+                rte_log(line->level, line->type, "%s", line->text);
+            }
+        }
+        if (total == 0) {
+            if (stopping) break;
+            usleep(SS_LOG_IDLE_USECS);
+        }
+    }
+
+    return NULL;
+}
+
+int ss_log_init() {
+    unsigned int lcore_id;
+    int rv;
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        log_rings[lcore_id].lines = je_calloc(SS_LOG_RING_SIZE, sizeof(ss_log_line_t));
+        if (log_rings[lcore_id].lines == NULL) {
+            RTE_LOG(ERR, SS, "could not allocate log ring for lcore %u\n", lcore_id);
+            return -1;
+        }
+    }
+
+    // the TSC rate is unknown until the EAL is up, after config parsing
+    log_burst    = ss_conf->log_burst;
+    log_interval = ss_conf->log_rate ? SS_MAX(rte_get_tsc_hz() / ss_conf->log_rate, 1) : 0;
+
+    rv = ss_thread_create(&log_thread, ss_log_thread, NULL);
+    if (rv) {
+        RTE_LOG(ERR, SS, "could not start log thread: %s\n", strerror(rv));
+        return -1;
+    }
+    pthread_setname_np(log_thread, "ss_log");
+
+    // the rings must be visible before any lcore sees log_started
+    rte_smp_wmb();
+    log_started = 1;
+    RTE_LOG(NOTICE, SS, "log rate %u burst %u level max %u\n",
+        ss_conf->log_rate, ss_conf->log_burst, SS_LOG_LEVEL_MAX);
+    return 0;
+}
+
+/*
+ * Sends later lines straight to rte_log, writes out what the rings hold,
+ * and joins the log thread. Called last on the way down, so the other
+ * threads' stop messages still make it out.
+ */
+void ss_log_stop() {
+    int rv;
+
+    if (!log_started) return;
+
+    log_started = 0;
+    rte_smp_wmb();
+    log_stopping = 1;
+    rv = pthread_join(log_thread, NULL);
+    if (rv) fprintf(stderr, "could not join log thread: %s\n", strerror(rv));
+}
+
+static int ss_log_admit(ss_log_site_t* site) {
+    uint64_t now;
+    uint64_t tat;
+    uint64_t next;
+
+    if (log_interval == 0) return 1;
+
+    now = rte_rdtsc();
+    do {
+        tat  = site->tat;
+        next = SS_MAX(tat, now) + log_interval;
+        if (next - now > log_interval * log_burst) return 0;
+    } while (!__sync_bool_compare_and_swap(&site->tat, tat, next));
+
+    return 1;
+}
+
+/* cuts the line to fit, and ends it with a newline like RTE_LOG callers do */
+static void ss_log_line_finish(char* text, int length) {
+    size_t end;
+
+    if (length < 0) length = 0;
+    end = SS_MIN((size_t) length, SS_LOG_LINE_MAX - 2);
+    if (end == 0 || text[end - 1] != '\n') text[end++] = '\n';
+    text[end] = '\0';
+}
+
+static void ss_log_line_write(ss_log_line_t* line, uint32_t level, uint32_t type, const char* fmt, va_list args) {
+    line->level = level;
+    line->type  = type;
+    ss_log_line_finish(line->text, vsnprintf(line->text, sizeof(line->text), fmt, args));
+}
+
+static void ss_log_push(uint32_t level, uint32_t type, const char* fmt, ...) __attribute__ ((__format__ (__printf__, 3, 4)));
+
+static void ss_log_vpush(uint32_t level, uint32_t type, const char* fmt, va_list args) {
+    unsigned int lcore_id = rte_lcore_id();
+    ss_log_ring_t* ring;
+    ss_log_line_t line;
+
+    if (unlikely(!log_started || lcore_id >= RTE_MAX_LCORE || log_rings[lcore_id].lines == NULL)) {
+        ss_log_line_write(&line, level, type, fmt, args);
+        rte_log(level, type, "%s", line.text);
+        __sync_add_and_fetch(&log_direct.written, 1);
+        return;
+    }
+
+    ring = &log_rings[lcore_id];
+    if (unlikely(ring->head - ring->tail >= SS_LOG_RING_SIZE)) {
+        ++ring->stats.dropped;
+        return;
+    }
+    ss_log_line_write(&ring->lines[ring->head & (SS_LOG_RING_SIZE - 1)], level, type, fmt, args);
+    // publish the line before the head which covers it
+    rte_smp_wmb();
+    ++ring->head;
+    ++ring->stats.written;
+}
+
+static void ss_log_push(uint32_t level, uint32_t type, const char* fmt, ...) {
+    va_list args;
+
+    va_start(args, fmt);
+    ss_log_vpush(level, type, fmt, args);
+    va_end(args);
+}
+
+void ss_log_vwrite(ss_log_site_t* site, uint32_t level, uint32_t type, const char* fmt, va_list args) {
+    unsigned int lcore_id = rte_lcore_id();
+    uint64_t suppressed;
+
+    if (!(rte_get_log_type() & type)) return;
+
+    if (log_started && !ss_log_admit(site)) {
+        __sync_add_and_fetch(&site->suppressed, 1);
+        if (lcore_id < RTE_MAX_LCORE) ++log_rings[lcore_id].stats.suppressed;
+        else __sync_add_and_fetch(&log_direct.suppressed, 1);
+        return;
+    }
+
+    suppressed = __sync_lock_test_and_set(&site->suppressed, 0);
+    if (unlikely(suppressed)) {
+        ss_log_push(level, type, "%s:%u: %lu messages suppressed\n", site->file, site->line, suppressed);
+    }
+    ss_log_vpush(level, type, fmt, args);
+}
+
+void ss_log_write(ss_log_site_t* site, uint32_t level, uint32_t type, const char* fmt, ...) {
+    va_list args;
+
+    va_start(args, fmt);
+    ss_log_vwrite(site, level, type, fmt, args);
+    va_end(args);
+}
+
+#pragma clang diagnostic pop
+
+int ss_log_stats_dump() {
+    ss_log_stats_t total;
+    uint64_t pending = 0;
+
+    if (rte_get_log_level() < RTE_LOG_NOTICE) return 0;
+
+    total = log_direct;
+    for (unsigned int lcore_id = 0; lcore_id < RTE_MAX_LCORE; ++lcore_id) {
+        if (log_rings[lcore_id].lines == NULL) continue;
+        total.written    += log_rings[lcore_id].stats.written;
+        total.suppressed += log_rings[lcore_id].stats.suppressed;
+        total.dropped    += log_rings[lcore_id].stats.dropped;
+        pending          += log_rings[lcore_id].head - log_rings[lcore_id].tail;
+    }
+
+    printf("Log statistics =====================================\n"
+           "Lines written: %23lu\n"
+           "Lines direct: %24lu\n"
+           "Lines suppressed: %20lu\n"
+           "Lines dropped: %23lu\n"
+           "Lines pending: %23lu\n"
+           "====================================================\n",
+           total.written, log_direct.written, total.suppressed, total.dropped, pending);
+
+    return 0;
+}
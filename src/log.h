@@ -0,0 +1,98 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#include <rte_log.h>
+#include <rte_memory.h>
+
+#include "common.h"
+
+/* CONSTANTS */
+
+/*
+ * Highest level SS_LOG keeps at compile time. Anything above it costs
+ * nothing at runtime. Rebuild with
+ * CPPFLAGS=-DSS_LOG_LEVEL_MAX=RTE_LOG_FINEST to trace packets.
+ */
+#ifndef SS_LOG_LEVEL_MAX
+#define SS_LOG_LEVEL_MAX      RTE_LOG_INFO
+#endif
+
+#define SS_LOG_RATE_DEFAULT     10 // lines per second per call site, 0 to disable
+#define SS_LOG_BURST_DEFAULT    20 // lines a quiet call site can write at once
+#define SS_LOG_LINE_MAX       1024 // longer lines are cut, keeping the newline
+#define SS_LOG_RING_SIZE       512 // lines buffered per lcore, power of 2
+#define SS_LOG_IDLE_USECS     1000 // log thread sleep when every ring was empty
+
+/* MACROS */
+
+/*
+ * Drop-in for RTE_LOG on packet paths. Each call site carries its own
+ * rate limit, and the lcore hands the line to the log thread instead of
+ * writing it. Levels above SS_LOG_LEVEL_MAX are compiled out.
+ */
+#define SS_LOG(l, t, ...) SS_LOG_LEVEL(RTE_LOG_ ## l, t, #t ": " __VA_ARGS__)
+
+#define SS_LOG_LEVEL(level, t, ...) \
+    do { \
+        if ((level) <= SS_LOG_LEVEL_MAX && (uint32_t) (level) <= rte_get_log_level()) { \
+            static ss_log_site_t ss_log_site = { __FILE__, __LINE__, 0, 0 }; \
+            ss_log_write(&ss_log_site, (uint32_t) (level), RTE_LOGTYPE_ ## t, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define SS_LOG_ENABLED(l) \
+    (RTE_LOG_ ## l <= SS_LOG_LEVEL_MAX && RTE_LOG_ ## l <= rte_get_log_level())
+
+/* DATA TYPES */
+
+/* one per SS_LOG call site, shared by every lcore */
+struct ss_log_site_s {
+    const char* file;
+    uint32_t    line;
+    uint64_t    tat;        // GCRA theoretical arrival time, in TSC cycles
+    uint64_t    suppressed; // since the last line this site wrote
+};
+
+typedef struct ss_log_site_s ss_log_site_t;
+
+struct ss_log_line_s {
+    uint32_t level;
+    uint32_t type;
+    char     text[SS_LOG_LINE_MAX];
+};
+
+typedef struct ss_log_line_s ss_log_line_t;
+
+struct ss_log_stats_s {
+    uint64_t written;
+    uint64_t suppressed;
+    uint64_t dropped;
+};
+
+typedef struct ss_log_stats_s ss_log_stats_t;
+
+/*
+ * Single producer, single consumer: the lcore writes lines at head, the
+ * log thread takes them from tail, so neither side takes a lock.
+ */
+struct ss_log_ring_s {
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    ss_log_stats_t    stats;
+    ss_log_line_t*    lines;
+} __rte_cache_aligned;
+
+typedef struct ss_log_ring_s ss_log_ring_t;
+
+/* BEGIN PROTOTYPES */
+
+int ss_log_init(void);
+void ss_log_stop(void);
+void ss_log_write(ss_log_site_t* site, uint32_t level, uint32_t type, const char* fmt, ...) __attribute__ ((__format__ (__printf__, 4, 5)));
+void ss_log_vwrite(ss_log_site_t* site, uint32_t level, uint32_t type, const char* fmt, va_list args) __attribute__ ((__format__ (__printf__, 4, 0)));
+int ss_log_stats_dump(void);
+
+/* END PROTOTYPES */
@@ -3,152 +3,154 @@
 #include <string.h>
 #include <sys/types.h>
 
-#include <jemalloc/jemalloc.h>
+#include <rte_byteorder.h>
+#include <rte_per_lcore.h>
 
 #include <json-c/json.h>
 #include <json-c/json_object_private.h>
 
 #include "metadata.h"
 #include "common.h"
+#include "event_schema.h"
+#include "event_writer.h"
+#include "flow.h"
 #include "ioc.h"
 #include "ip_utils.h"
-#include "je_utils.h"
 #include "json.h"
+#include "json_writer.h"
 #include "nn_queue.h"
 
-int ss_metadata_prepare_eth(const char* source, const char* rule, nn_queue_t* nn_queue, json_object* jobject, ss_frame_t* fbuf) {
-    char tmp[1024];
-    json_object* item = NULL;
-    
-    item = json_object_new_int(fbuf->data.port_id);
-    if (item == NULL) goto error_out;
-    json_object_object_add(jobject, "port_id", item);
-    item = json_object_new_string(ss_direction_dump(fbuf->data.direction));
-    if (item == NULL) goto error_out;
-    json_object_object_add(jobject, "direction", item);
-    item = json_object_new_int(fbuf->data.self);
-    if (item == NULL) goto error_out;
-    json_object_object_add(jobject, "self", item);
-    item = json_object_new_int(fbuf->data.length);
-    if (item == NULL) goto error_out;
-    json_object_object_add(jobject, "length", item);
-    item = json_object_new_int(fbuf->data.eth_type);
-    if (item == NULL) goto error_out;
-    json_object_object_add(jobject, "eth_type", item);
+/*
+ * Metadata messages are streamed into the calling lcore's writer buffer,
+ * as JSON or as binary events depending on the queue's nm_encoding. The
+ * returned pointer stays valid until the same lcore prepares its next
+ * message, which covers the ss_nn_queue_send right after; callers must
+ * not free it, and must send *length bytes since binary events are not
+ * NUL-terminated.
+ */
+
+/* the calling lcore's message buffer, valid until its next message */
+static RTE_DEFINE_PER_LCORE(uint8_t[SS_JSON_WRITER_SIZE], metadata_buffer);
 
-    snprintf(tmp, sizeof(tmp), "%02hhx:%02hhx:%02hhx:%02hhx:%02hhx:%02hhx",
-        fbuf->data.smac[0], fbuf->data.smac[1], fbuf->data.smac[2],
-        fbuf->data.smac[3], fbuf->data.smac[4], fbuf->data.smac[5]);
-    item = json_object_new_string(tmp);
-    if (item == NULL) goto error_out;
-    json_object_object_add(jobject, "smac", item);
-    
-    snprintf(tmp, sizeof(tmp), "%02hhx:%02hhx:%02hhx:%02hhx:%02hhx:%02hhx",
-        fbuf->data.dmac[0], fbuf->data.dmac[1], fbuf->data.dmac[2],
-        fbuf->data.dmac[3], fbuf->data.dmac[4], fbuf->data.dmac[5]);
-    item = json_object_new_string(tmp);
-    if (item == NULL) goto error_out;
-    json_object_object_add(jobject, "dmac", item);
-    
-    item = NULL;
+int ss_metadata_write_eth(ss_event_writer_t* writer, ss_frame_t* fbuf) {
+    char tmp[1024];
     
-    return 0;
+    ss_event_writer_int(writer, SS_FIELD_PORT_ID, fbuf->data.port_id);
+    ss_event_writer_string(writer, SS_FIELD_DIRECTION, ss_direction_dump(fbuf->data.direction));
+    ss_event_writer_int(writer, SS_FIELD_SELF, fbuf->data.self);
+    ss_event_writer_int(writer, SS_FIELD_LENGTH, fbuf->data.length);
+    ss_event_writer_int(writer, SS_FIELD_ETH_TYPE, fbuf->data.eth_type);
     
-    error_out:
-    fprintf(stderr, "could not serialize ethernet metadata\n");
-    if (item)    { json_object_put(item);    item = NULL;    }
-    if (jobject) { json_object_put(jobject); jobject = NULL; }
+    if (writer->encoding == NN_ENCODING_BINARY) {
+        ss_event_writer_bytes(writer, SS_FIELD_SMAC, fbuf->data.smac, ETHER_ALEN);
+        ss_event_writer_bytes(writer, SS_FIELD_DMAC, fbuf->data.dmac, ETHER_ALEN);
+        return 0;
+    }
     
-    return -1;
+    // skip the formatting of fields nm_fields leaves out
+    if (SS_EVENT_WRITER_WANTS(writer, SS_FIELD_SMAC)) {
+        snprintf(tmp, sizeof(tmp), "%02hhx:%02hhx:%02hhx:%02hhx:%02hhx:%02hhx",
+            fbuf->data.smac[0], fbuf->data.smac[1], fbuf->data.smac[2],
+            fbuf->data.smac[3], fbuf->data.smac[4], fbuf->data.smac[5]);
+        ss_event_writer_string(writer, SS_FIELD_SMAC, tmp);
+    }
+    
+    if (SS_EVENT_WRITER_WANTS(writer, SS_FIELD_DMAC)) {
+        snprintf(tmp, sizeof(tmp), "%02hhx:%02hhx:%02hhx:%02hhx:%02hhx:%02hhx",
+            fbuf->data.dmac[0], fbuf->data.dmac[1], fbuf->data.dmac[2],
+            fbuf->data.dmac[3], fbuf->data.dmac[4], fbuf->data.dmac[5]);
+        ss_event_writer_string(writer, SS_FIELD_DMAC, tmp);
+    }
+    
+    return 0;
 }
 
-int ss_metadata_prepare_ip(const char* source, const char* rule, nn_queue_t* nn_queue, json_object* jobject, ss_frame_t* fbuf) {
-    char tmp[1024];
-    json_object* sip         = NULL;
-    json_object* dip         = NULL;
-    json_object* ip_protocol = NULL;
-    json_object* ttl         = NULL;
-    json_object* l4_length   = NULL;
-    json_object* icmp_type   = NULL;
-    json_object* icmp_code   = NULL;
-    json_object* sport       = NULL;
-    json_object* dport       = NULL;
-    json_object* dns_name    = NULL;
-    
-    if      (fbuf->data.eth_type == ETHER_TYPE_IPV4) {
-        snprintf(tmp, sizeof(tmp), "%hhu.%hhu.%hhu.%hhu",
+int ss_metadata_write_ip(ss_event_writer_t* writer, ss_frame_t* fbuf) {
+    char sip[1024];
+    char dip[1024];
+    
+    if (fbuf->data.eth_type != ETHER_TYPE_IPV4 && fbuf->data.eth_type != ETHER_TYPE_IPV6) {
+        fprintf(stderr, "could not extract IP addresses\n");
+        return -1;
+    }
+    
+    if      (writer->encoding == NN_ENCODING_BINARY) {
+        size_t alen = fbuf->data.eth_type == ETHER_TYPE_IPV4 ? IPV4_ALEN : IPV6_ALEN;
+        ss_event_writer_bytes(writer, SS_FIELD_SIP, fbuf->data.sip, alen);
+        ss_event_writer_bytes(writer, SS_FIELD_DIP, fbuf->data.dip, alen);
+    }
+    else if (!SS_EVENT_WRITER_WANTS(writer, SS_FIELD_SIP) && !SS_EVENT_WRITER_WANTS(writer, SS_FIELD_DIP)) {
+        // neither address kept by nm_fields, skip the formatting
+    }
+    else if (fbuf->data.eth_type == ETHER_TYPE_IPV4) {
+        snprintf(sip, sizeof(sip), "%hhu.%hhu.%hhu.%hhu",
             fbuf->data.sip[0], fbuf->data.sip[1], fbuf->data.sip[2], fbuf->data.sip[3]);
-        sip = json_object_new_string(tmp);
-        snprintf(tmp, sizeof(tmp), "%hhu.%hhu.%hhu.%hhu",
+        snprintf(dip, sizeof(dip), "%hhu.%hhu.%hhu.%hhu",
             fbuf->data.dip[0], fbuf->data.dip[1], fbuf->data.dip[2], fbuf->data.dip[3]);
-        dip = json_object_new_string(tmp);
+        ss_event_writer_string(writer, SS_FIELD_SIP, sip);
+        ss_event_writer_string(writer, SS_FIELD_DIP, dip);
     }
-    else if (fbuf->data.eth_type == ETHER_TYPE_IPV6) {
-        snprintf(tmp, sizeof(tmp), "%hx:%hx:%hx:%hx:%hx:%hx:%hx:%hx",
+    else {
+        snprintf(sip, sizeof(sip), "%hx:%hx:%hx:%hx:%hx:%hx:%hx:%hx",
             *(uint16_t*) &fbuf->data.sip[0],  *(uint16_t*) &fbuf->data.sip[2],
             *(uint16_t*) &fbuf->data.sip[4],  *(uint16_t*) &fbuf->data.sip[6],
             *(uint16_t*) &fbuf->data.sip[8],  *(uint16_t*) &fbuf->data.sip[10],
             *(uint16_t*) &fbuf->data.sip[12], *(uint16_t*) &fbuf->data.sip[14]);
-        sip = json_object_new_string(tmp);
-        snprintf(tmp, sizeof(tmp), "%hx:%hx:%hx:%hx:%hx:%hx:%hx:%hx",
+        snprintf(dip, sizeof(dip), "%hx:%hx:%hx:%hx:%hx:%hx:%hx:%hx",
             *(uint16_t*) &fbuf->data.dip[0],  *(uint16_t*) &fbuf->data.dip[2],
             *(uint16_t*) &fbuf->data.dip[4],  *(uint16_t*) &fbuf->data.dip[6],
             *(uint16_t*) &fbuf->data.dip[8],  *(uint16_t*) &fbuf->data.dip[10],
             *(uint16_t*) &fbuf->data.dip[12], *(uint16_t*) &fbuf->data.dip[14]);
-        dip = json_object_new_string(tmp);
-    }
-    else {
-        fprintf(stderr, "could not extract IP addresses\n");
-        goto error_out;
+        ss_event_writer_string(writer, SS_FIELD_SIP, sip);
+        ss_event_writer_string(writer, SS_FIELD_DIP, dip);
     }
     
-    ip_protocol = json_object_new_int(fbuf->data.ip_protocol);
-    if (ip_protocol == NULL) goto error_out;
-    ttl         = json_object_new_int(fbuf->data.ttl);
-    if (ttl == NULL) goto error_out;
-    l4_length   = json_object_new_int(fbuf->data.l4_length);
-    if (l4_length == NULL) goto error_out;
-    icmp_type   = json_object_new_int(fbuf->data.icmp_type);
-    if (icmp_type == NULL) goto error_out;
-    icmp_code   = json_object_new_int(fbuf->data.icmp_code);
-    if (icmp_code == NULL) goto error_out;
-    sport       = json_object_new_int(fbuf->data.sport);
-    if (sport == NULL) goto error_out;
-    dport       = json_object_new_int(fbuf->data.dport);
-    if (dport == NULL) goto error_out;
-    dns_name    = json_object_new_string((char*)fbuf->data.dns_name);
-    if (dns_name == NULL) goto error_out;    
-
-    json_object_object_add(jobject, "sip",         sip);
-    json_object_object_add(jobject, "dip",         dip);
-    json_object_object_add(jobject, "ip_protocol", ip_protocol);
-    json_object_object_add(jobject, "ttl",         ttl);
-    json_object_object_add(jobject, "l4_length",   l4_length);
-    json_object_object_add(jobject, "icmp_type",   icmp_type);
-    json_object_object_add(jobject, "icmp_code",   icmp_code);
-    json_object_object_add(jobject, "sport",       sport);
-    json_object_object_add(jobject, "dport",       dport);
-    json_object_object_add(jobject, "dns_name",    dns_name);
+    ss_event_writer_int(writer,    SS_FIELD_IP_PROTOCOL, fbuf->data.ip_protocol);
+    ss_event_writer_int(writer,    SS_FIELD_TTL,         fbuf->data.ttl);
+    ss_event_writer_int(writer,    SS_FIELD_L4_LENGTH,   fbuf->data.l4_length);
+    ss_event_writer_int(writer,    SS_FIELD_ICMP_TYPE,   fbuf->data.icmp_type);
+    ss_event_writer_int(writer,    SS_FIELD_ICMP_CODE,   fbuf->data.icmp_code);
+    ss_event_writer_int(writer,    SS_FIELD_SPORT,       fbuf->data.sport);
+    ss_event_writer_int(writer,    SS_FIELD_DPORT,       fbuf->data.dport);
+    ss_event_writer_string(writer, SS_FIELD_DNS_NAME,    (char*) fbuf->data.dns_name);
     // XXX: add support for dns_answers field, dns query type
     
     return 0;
+}
+
+int ss_metadata_write_ioc(ss_event_writer_t* writer, ss_ioc_entry_t* iptr) {
+    char ip_str[SS_ADDR_STR_MAX];
     
-    error_out:
-    fprintf(stderr, "could not serialize ethernet metadata\n");
-    if (sip)         { json_object_put(sip);         sip = NULL;         }
-    if (dip)         { json_object_put(dip);         dip = NULL;         }
-    if (ip_protocol) { json_object_put(ip_protocol); ip_protocol = NULL; }
-    if (ttl)         { json_object_put(ttl);         ttl = NULL;         }
-    if (l4_length)   { json_object_put(l4_length);   l4_length = NULL;   }
-    if (icmp_type)   { json_object_put(icmp_type);   icmp_type = NULL;   }
-    if (icmp_code)   { json_object_put(icmp_code);   icmp_code = NULL;   }
-    if (sport)       { json_object_put(sport);       sport = NULL;       }
-    if (dport)       { json_object_put(dport);       dport = NULL;       }
-    if (dns_name)    { json_object_put(dns_name);    dns_name = NULL;    }
+    memset(ip_str, 0, sizeof(ip_str));
+    if (iptr->ip.family != SS_AF_INET4 && iptr->ip.family != SS_AF_INET6) {
+        fprintf(stderr, "could not serialize ioc id: %lu\n", iptr->id);
+        return -1;
+    }
+    if (writer->encoding != NN_ENCODING_BINARY && SS_EVENT_WRITER_WANTS(writer, SS_FIELD_IP) &&
+        ss_inet_ntop(&iptr->ip, ip_str, sizeof(ip_str)) == NULL) {
+        fprintf(stderr, "could not serialize ioc id: %lu\n", iptr->id);
+        return -1;
+    }
     
-    return -1;
+    ss_event_writer_int(writer,    SS_FIELD_FILE_ID,     (int64_t)iptr->file_id);
+    ss_event_writer_int(writer,    SS_FIELD_IOC_ID,      (int64_t)iptr->id);
+    ss_event_writer_string(writer, SS_FIELD_TYPE,        ss_ioc_type_dump(iptr->type));
+    ss_event_writer_string(writer, SS_FIELD_THREAT_TYPE, iptr->threat_type);
+    if (writer->encoding == NN_ENCODING_BINARY) {
+        ss_event_writer_bytes(writer, SS_FIELD_IP, iptr->ip.family == SS_AF_INET4 ?
+            (uint8_t*) &iptr->ip.ip4_addr : (uint8_t*) &iptr->ip.ip6_addr,
+            iptr->ip.family == SS_AF_INET4 ? IPV4_ALEN : IPV6_ALEN);
+    }
+    else {
+        ss_event_writer_string(writer, SS_FIELD_IP, ip_str);
+    }
+    ss_event_writer_string(writer, SS_FIELD_VALUE,       iptr->value);
+    ss_event_writer_string(writer, SS_FIELD_DNS,         iptr->dns);
+    
+    return 0;
 }
 
+/* json-c flavor, for the sFlow and NetFlow messages which are still built as trees */
 int ss_metadata_prepare_ioc(const char* source, const char* rule, nn_queue_t* nn_queue, ss_ioc_entry_t* iptr, json_object* json) {
     char ip_str[SS_ADDR_STR_MAX];
     const char* result;
@@ -208,124 +210,191 @@ int ss_metadata_prepare_ioc(const char* source, const char* rule, nn_queue_t* nn
     return -1;
 }
 
-uint8_t* ss_metadata_prepare_frame(const char* source, const char* rule, nn_queue_t* nn_queue, ss_frame_t* fbuf, ss_ioc_entry_t* iptr) {
-    int          irv;
-    uint8_t*     rv      = NULL;
-    json_object* jobject = NULL;
-    json_object* item    = NULL;
-    uint8_t*     jstring = NULL;
+uint8_t* ss_metadata_prepare_frame(const char* source, const char* rule, nn_queue_t* nn_queue, ss_frame_t* fbuf, ss_ioc_entry_t* iptr, size_t* length) {
+    int               irv;
+    ss_event_writer_t writer;
     
     if (nn_queue->format != NN_FORMAT_METADATA) {
         fprintf(stderr, "format %d not supported yet\n", nn_queue->format);
         goto error_out;
     }
     
-    jobject = json_object_new_object();
-    if (jobject == NULL) {
-        fprintf(stderr, "could not allocate json object\n");
-        goto error_out;
-    }
-    
-    item = json_object_new_string(source);
-    if (item == NULL) goto error_out;
-    json_object_object_add(jobject, "source", item);
+    ss_event_writer_init(&writer, nn_queue, SS_EVENT_FRAME, RTE_PER_LCORE(metadata_buffer), SS_JSON_WRITER_SIZE);
+    ss_event_writer_string(&writer, SS_FIELD_SOURCE, source);
     if (rule) {
-        item = json_object_new_string(rule);
-        if (item == NULL) goto error_out;
-        json_object_object_add(jobject, "rule", item);
+        ss_event_writer_string(&writer, SS_FIELD_RULE, rule);
     }
-    item = json_object_new_int64((int64_t)__sync_add_and_fetch(&nn_queue->tx_messages, 1));
-    if (item == NULL) goto error_out;
-    json_object_object_add(jobject, "seq_num", item);
+    ss_event_writer_int(&writer, SS_FIELD_SEQ_NUM, (int64_t)__sync_add_and_fetch(&nn_queue->tx_messages, 1));
     
-    irv = ss_metadata_prepare_eth(source, rule, nn_queue, jobject, fbuf);
+    irv = ss_metadata_write_eth(&writer, fbuf);
     if (irv) goto error_out;
     
-    irv = ss_metadata_prepare_ip(source, rule, nn_queue, jobject, fbuf);
+    irv = ss_metadata_write_ip(&writer, fbuf);
     if (irv) goto error_out;
     
     if (iptr) {
-        irv = ss_metadata_prepare_ioc(source, rule, nn_queue, iptr, jobject);
+        irv = ss_metadata_write_ioc(&writer, iptr);
         if (irv) goto error_out;
     }
     
-    // XXX: NOTE: String pointer is internal to JSON object.
-    jstring = (uint8_t*) json_object_to_json_string_ext(jobject, JSON_C_TO_STRING_SPACED);
-    rv = (uint8_t*) je_strdup((char*)jstring);
-    if (!rv) goto error_out;
-    
-    item = NULL;
-    json_object_put(jobject); jobject = NULL;
+    irv = ss_event_writer_finish(&writer);
+    if (irv < 0) goto error_out;
     
-    return rv;
+    *length = (size_t) irv;
+    return writer.data;
     
     error_out:
     fprintf(stderr, "could not serialize packet metadata\n");
-    if (rv)      { je_free(rv); rv = NULL; }
-    if (item)    { json_object_put(jobject); item    = NULL; }
-    if (jobject) { json_object_put(jobject); jobject = NULL; }
     
     return NULL;
 }
 
-uint8_t* ss_metadata_prepare_syslog(
-    const char* source, const char* rule, nn_queue_t* nn_queue,
-    ss_frame_t* fbuf, uint8_t* l4_offset, uint16_t l4_length, ss_ioc_entry_t* iptr) {
-    int          irv;
-    uint8_t*     rv       = NULL;
-    json_object* item     = NULL;
-    json_object* jobject  = NULL;
-    uint8_t*     jstring  = NULL;
+int ss_metadata_write_flow_counters(ss_event_writer_t* writer, ss_flow_direction_t direction, ss_flow_counters_t* counters) {
+    // the reverse fields sit at the same offsets after the forward ones
+    int offset = direction == SS_FLOW_FORWARD ? 0 : SS_FIELD_REV_PACKETS - SS_FIELD_FWD_PACKETS;
+    
+    ss_event_writer_int(writer, (ss_event_field_t) (SS_FIELD_FWD_PACKETS + offset), (int64_t) counters->packets);
+    ss_event_writer_int(writer, (ss_event_field_t) (SS_FIELD_FWD_BYTES + offset), (int64_t) counters->bytes);
+    ss_event_writer_int(writer, (ss_event_field_t) (SS_FIELD_FWD_TCP_FLAGS + offset), counters->tcp_flags);
+    
+    if (counters->packets == 0) return 0;
+    
+    // milliseconds since the epoch
+    ss_event_writer_int(writer, (ss_event_field_t) (SS_FIELD_FWD_FIRST + offset), (int64_t) ss_tsc_to_nsec(counters->first_tsc) / 1000000);
+    ss_event_writer_int(writer, (ss_event_field_t) (SS_FIELD_FWD_LAST + offset), (int64_t) ss_tsc_to_nsec(counters->last_tsc) / 1000000);
+    
+    return 0;
+}
+
+uint8_t* ss_metadata_prepare_flow(const char* source, nn_queue_t* nn_queue, ss_flow_t* flow, ss_flow_reason_t reason, size_t* length) {
+    char tmp[SS_ADDR_STR_MAX];
+    int               irv;
+    ss_event_writer_t writer;
+    uint8_t           family  = flow->key.eth_type == ETHER_TYPE_IPV4 ? SS_AF_INET4 : SS_AF_INET6;
+    size_t            alen    = flow->key.eth_type == ETHER_TYPE_IPV4 ? IPV4_ALEN : IPV6_ALEN;
+    // report the flow the way its first packet went
+    uint8_t*          sip     = flow->forward_lo ? flow->key.addr_lo : flow->key.addr_hi;
+    uint8_t*          dip     = flow->forward_lo ? flow->key.addr_hi : flow->key.addr_lo;
+    uint16_t          sport   = flow->forward_lo ? flow->key.port_lo : flow->key.port_hi;
+    uint16_t          dport   = flow->forward_lo ? flow->key.port_hi : flow->key.port_lo;
     
     if (nn_queue->format != NN_FORMAT_METADATA) {
         fprintf(stderr, "format %d not supported yet\n", nn_queue->format);
         goto error_out;
     }
     
-    jobject = json_object_new_object();
-    if (jobject == NULL) {
-        fprintf(stderr, "could not allocate json object\n");
+    ss_event_writer_init(&writer, nn_queue, SS_EVENT_FLOW, RTE_PER_LCORE(metadata_buffer), SS_JSON_WRITER_SIZE);
+    ss_event_writer_string(&writer, SS_FIELD_SOURCE, source);
+    ss_event_writer_int(&writer, SS_FIELD_SEQ_NUM, (int64_t)__sync_add_and_fetch(&nn_queue->tx_messages, 1));
+    ss_event_writer_string(&writer, SS_FIELD_REASON, ss_flow_reason_dump(reason));
+    ss_event_writer_int(&writer, SS_FIELD_PORT_ID, flow->port_id);
+    ss_event_writer_int(&writer, SS_FIELD_ETH_TYPE, flow->key.eth_type);
+    
+    if (writer.encoding == NN_ENCODING_BINARY) {
+        ss_event_writer_bytes(&writer, SS_FIELD_SIP, sip, alen);
+        ss_event_writer_bytes(&writer, SS_FIELD_DIP, dip, alen);
+    }
+    else if (SS_EVENT_WRITER_WANTS(&writer, SS_FIELD_SIP) || SS_EVENT_WRITER_WANTS(&writer, SS_FIELD_DIP)) {
+        memset(tmp, 0, sizeof(tmp));
+        ss_event_writer_string(&writer, SS_FIELD_SIP, ss_inet_ntop_raw(family, sip, tmp, sizeof(tmp)) ? tmp : "");
+        memset(tmp, 0, sizeof(tmp));
+        ss_event_writer_string(&writer, SS_FIELD_DIP, ss_inet_ntop_raw(family, dip, tmp, sizeof(tmp)) ? tmp : "");
+    }
+    ss_event_writer_int(&writer, SS_FIELD_IP_PROTOCOL, flow->key.protocol);
+    ss_event_writer_int(&writer, SS_FIELD_SPORT, rte_bswap16(sport));
+    ss_event_writer_int(&writer, SS_FIELD_DPORT, rte_bswap16(dport));
+    
+    irv = ss_metadata_write_flow_counters(&writer, SS_FLOW_FORWARD, &flow->counters[SS_FLOW_FORWARD]);
+    if (irv) goto error_out;
+    irv = ss_metadata_write_flow_counters(&writer, SS_FLOW_REVERSE, &flow->counters[SS_FLOW_REVERSE]);
+    if (irv) goto error_out;
+    
+    if (flow->ioc) {
+        irv = ss_metadata_write_ioc(&writer, flow->ioc);
+        if (irv) goto error_out;
+    }
+    
+    irv = ss_event_writer_finish(&writer);
+    if (irv < 0) goto error_out;
+    
+    *length = (size_t) irv;
+    return writer.data;
+    
+    error_out:
+    fprintf(stderr, "could not serialize flow metadata\n");
+    
+    return NULL;
+}
+
+static const ss_event_field_t ss_metadata_syslog_fields[SS_SYSLOG_FIELD_MAX] = {
+    [SS_SYSLOG_FIELD_TIMESTAMP] = SS_FIELD_SYSLOG_TIMESTAMP,
+    [SS_SYSLOG_FIELD_HOST]      = SS_FIELD_SYSLOG_HOST,
+    [SS_SYSLOG_FIELD_APP_NAME]  = SS_FIELD_SYSLOG_APP_NAME,
+    [SS_SYSLOG_FIELD_PROCID]    = SS_FIELD_SYSLOG_PROCID,
+    [SS_SYSLOG_FIELD_MSGID]     = SS_FIELD_SYSLOG_MSGID,
+    [SS_SYSLOG_FIELD_SD]        = SS_FIELD_SYSLOG_SD,
+    [SS_SYSLOG_FIELD_MSG]       = SS_FIELD_SYSLOG_MSG,
+};
+
+int ss_metadata_write_syslog_fields(ss_event_writer_t* writer, ss_syslog_t* syslog) {
+    ss_slice_t* slice;
+    
+    if (syslog->format == SS_SYSLOG_FORMAT_EMPTY) return 0;
+    
+    ss_event_writer_string(writer, SS_FIELD_SYSLOG_FORMAT, ss_syslog_format_dump(syslog->format));
+    ss_event_writer_int(writer, SS_FIELD_SYSLOG_FACILITY, syslog->facility);
+    ss_event_writer_int(writer, SS_FIELD_SYSLOG_SEVERITY, syslog->severity);
+    
+    for (int i = 0; i < SS_SYSLOG_FIELD_MAX; ++i) {
+        slice = &syslog->fields[i];
+        if (ss_metadata_syslog_fields[i] == 0 || slice->data == NULL) continue;
+        ss_event_writer_string_len(writer, ss_metadata_syslog_fields[i], (const char*) slice->data, slice->length);
+    }
+    
+    return 0;
+}
+
+uint8_t* ss_metadata_prepare_syslog(
+    const char* source, const char* rule, nn_queue_t* nn_queue,
+    ss_frame_t* fbuf, ss_syslog_t* syslog, uint8_t* l4_offset, uint16_t l4_length, ss_ioc_entry_t* iptr, size_t* length) {
+    int               irv;
+    ss_event_writer_t writer;
+    
+    if (nn_queue->format != NN_FORMAT_METADATA) {
+        fprintf(stderr, "format %d not supported yet\n", nn_queue->format);
         goto error_out;
     }
     
-    item = json_object_new_string(source);
-    if (item == NULL) goto error_out;
-    json_object_object_add(jobject, "source", item);
-    item = json_object_new_string(rule);
-    if (item == NULL) goto error_out;
-    json_object_object_add(jobject, "rule", item);
-    item = json_object_new_int64((int64_t)__sync_add_and_fetch(&nn_queue->tx_messages, 1));
-    if (item == NULL) goto error_out;
-    json_object_object_add(jobject, "seq_num", item);
+    ss_event_writer_init(&writer, nn_queue, SS_EVENT_SYSLOG, RTE_PER_LCORE(metadata_buffer), SS_JSON_WRITER_SIZE);
+    ss_event_writer_string(&writer, SS_FIELD_SOURCE, source);
+    ss_event_writer_string(&writer, SS_FIELD_RULE, rule);
+    ss_event_writer_int(&writer, SS_FIELD_SEQ_NUM, (int64_t)__sync_add_and_fetch(&nn_queue->tx_messages, 1));
 
-    irv = ss_metadata_prepare_ip(source, rule, nn_queue, jobject, fbuf);
+    irv = ss_metadata_write_ip(&writer, fbuf);
     if (irv) goto error_out;
     
     if (iptr) {
-        irv = ss_metadata_prepare_ioc(source, rule, nn_queue, iptr, jobject);
+        irv = ss_metadata_write_ioc(&writer, iptr);
         if (irv) goto error_out;
     }
     
-    // XXX: for now assume the message is C char*
-    item = json_object_new_string((char*) l4_offset);
-    if (item == NULL) goto error_out;
-    json_object_object_add(jobject, "message", item);
+    if (syslog) {
+        irv = ss_metadata_write_syslog_fields(&writer, syslog);
+        if (irv) goto error_out;
+    }
     
-    // XXX: NOTE: String pointer is internal to JSON object.
-    jstring = (uint8_t*) json_object_to_json_string_ext(jobject, JSON_C_TO_STRING_SPACED);
-    rv = (uint8_t*) je_strdup((char*)jstring);
-    if (!rv) goto error_out;
+    // senders end datagrams with LF, CRLF or NUL, none of which is message
+    while (l4_length && memchr("\0\r\n", l4_offset[l4_length - 1], 3)) --l4_length;
+    ss_event_writer_string_len(&writer, SS_FIELD_MESSAGE, (char*) l4_offset, l4_length);
     
-    item = NULL;
-    json_object_put(jobject); jobject = NULL;
+    irv = ss_event_writer_finish(&writer);
+    if (irv < 0) goto error_out;
     
-    return rv;
+    *length = (size_t) irv;
+    return writer.data;
     
     error_out:
     fprintf(stderr, "could not create syslog metadata\n");
-    if (rv)      { je_free(rv); rv = NULL; }
-    if (item)    { json_object_put(item);    item  = NULL; }
-    if (jobject) { json_object_put(jobject); jobject  = NULL; }
     
     return NULL;
 }
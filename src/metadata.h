@@ -1,20 +1,29 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include <json-c/json.h>
 #include <json-c/json_object_private.h>
 
 #include "common.h"
+#include "event_writer.h"
+#include "flow.h"
 #include "ioc.h"
+#include "json_writer.h"
 #include "nn_queue.h"
+#include "syslog.h"
 
 /* BEGIN PROTOTYPES */
 
-int ss_metadata_prepare_eth(const char* source, const char* rule, nn_queue_t* nn_queue, json_object* jobject, ss_frame_t* fbuf);
-int ss_metadata_prepare_ip(const char* source, const char* rule, nn_queue_t* nn_queue, json_object* jobject, ss_frame_t* fbuf);
+int ss_metadata_write_eth(ss_event_writer_t* writer, ss_frame_t* fbuf);
+int ss_metadata_write_ip(ss_event_writer_t* writer, ss_frame_t* fbuf);
+int ss_metadata_write_ioc(ss_event_writer_t* writer, ss_ioc_entry_t* iptr);
 int ss_metadata_prepare_ioc(const char* source, const char* rule, nn_queue_t* nn_queue, ss_ioc_entry_t* iptr, json_object* json);
-uint8_t* ss_metadata_prepare_frame(const char* source, const char* rule, nn_queue_t* nn_queue, ss_frame_t* fbuf, ss_ioc_entry_t* iptr);
-uint8_t* ss_metadata_prepare_syslog(const char* source, const char* rule, nn_queue_t* nn_queue, ss_frame_t* fbuf, uint8_t* l4_offset, uint16_t l4_length, ss_ioc_entry_t* iptr);
+uint8_t* ss_metadata_prepare_frame(const char* source, const char* rule, nn_queue_t* nn_queue, ss_frame_t* fbuf, ss_ioc_entry_t* iptr, size_t* length);
+int ss_metadata_write_flow_counters(ss_event_writer_t* writer, ss_flow_direction_t direction, ss_flow_counters_t* counters);
+uint8_t* ss_metadata_prepare_flow(const char* source, nn_queue_t* nn_queue, ss_flow_t* flow, ss_flow_reason_t reason, size_t* length);
+int ss_metadata_write_syslog_fields(ss_event_writer_t* writer, ss_syslog_t* syslog);
+uint8_t* ss_metadata_prepare_syslog(const char* source, const char* rule, nn_queue_t* nn_queue, ss_frame_t* fbuf, ss_syslog_t* syslog, uint8_t* l4_offset, uint16_t l4_length, ss_ioc_entry_t* iptr, size_t* length);
 
 /* END PROTOTYPES */
@@ -39,6 +39,7 @@
 
 #include "common.h"
 #include "ioc.h"
+#include "log.h"
 #include "netflow.h"
 #include "netflow_addr.h"
 #include "netflow_format.h"
@@ -148,11 +149,15 @@ int ss_extract_netflow(struct store_flow_complete* flow) {
     iptr = ss_ioc_netflow_match(flow);
     if (iptr) {
         // match
-        RTE_LOG(NOTICE, EXTRACTOR, "successful netflow ioc match from frame\n");
+        SS_LOG(NOTICE, EXTRACTOR, "successful netflow ioc match from frame\n");
         ss_ioc_entry_dump_dpdk(iptr);
         nn_queue_t* nn_queue = &ss_conf->ioc_files[iptr->file_id].nn_queue;
+        // a flow record has no frame of its own for NN_FORMAT_PACKET queues
+        if (nn_queue->format != NN_FORMAT_METADATA) return 0;
+        if (!ss_nn_queue_wants(nn_queue, NN_EVENT_IOC)) return 0;
         // XXX: fill in something useful in rule field
         metadata = ss_metadata_prepare_netflow("netflow_ioc", NULL, nn_queue, flow, iptr);
+        if (metadata == NULL) return -1;
         // XXX: for now assume the output is C char*
         mlength = strlen((char*) metadata);
         //printf("metadata: %s\n", metadata);
@@ -1278,7 +1283,6 @@ void process_netflow_v10(struct flow_packet* fp, struct peer_state* peer) {
 
 int process_packet(struct flow_packet* fp) {
     struct peer_state* peer;
-    struct NF_HEADER_COMMON* hdr = (struct NF_HEADER_COMMON*)fp->packet;
 
     if ((peer = find_peer(&fp->flow_source)) == NULL) {
         logit(LOG_WARNING, "flow source %s was expired between "
@@ -1287,6 +1291,12 @@ int process_packet(struct flow_packet* fp) {
         return -1;
     }
 
+    return process_packet_peer(fp, peer);
+}
+
+int process_packet_peer(struct flow_packet* fp, struct peer_state* peer) {
+    struct NF_HEADER_COMMON* hdr = (struct NF_HEADER_COMMON*)fp->packet;
+
     switch (ntohs(hdr->version)) {
     case 1:
         process_netflow_v1(fp, peer);
@@ -1361,10 +1371,43 @@ int netflow_frame_handle(ss_frame_t* fbuf) {
     }
     rte_memcpy(fp->packet, fbuf->l4_offset, fp->len);
     process_packet(fp);
+    flow_packet_dealloc(fp);
 
     return (1);
 }
 
+/*
+ * One IPFIX message framed out of a TCP session. The session brings its
+ * own peer state, see new_session_peer, and the message is decoded where
+ * it lies instead of being copied.
+ */
+int netflow_message_handle(struct peer_state* peer, const uint8_t* message, uint16_t length) {
+    struct flow_packet* fp;
+    int rv;
+
+    if ((fp = flow_packet_alloc()) == NULL) {
+        logit(LOG_WARNING, "flow packet metadata alloc failed");
+        return -1;
+    }
+
+    fp->len = length;
+    gettimeofday(&fp->recv_time, NULL);
+    memcpy(&fp->flow_source, &peer->from, sizeof(fp->flow_source));
+
+    if (fp->len < sizeof(struct NF_HEADER_COMMON)) {
+        peer->ninvalid++;
+        flow_packet_dealloc(fp);
+        return -1;
+    }
+
+    fp->packet = (u_int8_t*) message;
+    rv = process_packet_peer(fp, peer);
+    fp->packet = NULL;
+    flow_packet_dealloc(fp);
+
+    return rv;
+}
+
 int netflow_init(int argc, char **argv) {
     tzset();
     bzero(&netflow_peers, sizeof(netflow_peers));
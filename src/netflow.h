@@ -58,7 +58,9 @@ int process_netflow_v10_template(u_int8_t* pkt, size_t len, struct peer_state* p
 int process_netflow_v10_data(u_int8_t* pkt, size_t len, struct timeval* tv, struct peer_state* peer, u_int32_t source_id, struct NF10_HEADER* nf10_hdr, u_int* num_flows);
 void process_netflow_v10(struct flow_packet* fp, struct peer_state* peer);
 int process_packet(struct flow_packet* fp);
+int process_packet_peer(struct flow_packet* fp, struct peer_state* peer);
 int netflow_frame_handle(ss_frame_t* fbuf);
+int netflow_message_handle(struct peer_state* peer, const uint8_t* message, uint16_t length);
 int netflow_init(int argc, char** argv);
 
 /* END PROTOTYPES */
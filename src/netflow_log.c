@@ -22,6 +22,9 @@
 #include <errno.h>
 #include <string.h>
 
+#include <rte_log.h>
+
+#include "common.h"
 #include "netflow_log.h"
 
 #pragma clang diagnostic push
@@ -38,19 +41,16 @@ void loginit(const char* ident, int to_stderr, int debug_flag) {
     logstderr = 1;
 }
 
-/* Varargs vsyslog-like log interface */
+/*
+ * Varargs vsyslog-like log interface. Only the error paths below use it,
+ * and logerr exits right after, so it writes directly instead of through
+ * the lcore log ring.
+ */
 void vlogit(int level, const char* fmt, va_list args) {
-    vfprintf(stderr, fmt, args);
-    fputs("\n", stderr);
-}
-
-/* Standard syslog-like interface */
-void logit(int level, const char* fmt, ...) {
-    va_list args;
+    char buf[1024];
 
-    va_start(args, fmt);
-    vlogit(level, fmt, args);
-    va_end(args);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    rte_log((uint32_t) level + 1, RTE_LOGTYPE_EXTRACTOR, "EXTRACTOR: %s\n", buf);
 }
 
 /* Standard log interface that appends ": strerror(errno)" for convenience */
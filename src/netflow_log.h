@@ -2,11 +2,21 @@
 
 #include <stdarg.h>
 
+#include "log.h"
+
+/* MACROS */
+
+/*
+ * logit goes through SS_LOG, so each call site has its own rate limit and
+ * LOG_DEBUG lines compile out with the other debug levels. RTE_LOG levels
+ * are the syslog ones plus one.
+ */
+#define logit(level, ...) SS_LOG_LEVEL((level) + 1, EXTRACTOR, "EXTRACTOR: " __VA_ARGS__)
+
 /* BEGIN PROTOTYPES */
 
 void loginit(const char* ident, int to_stderr, int debug_flag);
 void vlogit(int level, const char* fmt, va_list args);
-void logit(int level, const char* fmt, ...);
 void logitm(int level, const char* fmt, ...);
 void logerr(const char* fmt, ...);
 void logerrx(const char* fmt, ...);
@@ -499,6 +499,7 @@ void delete_peer(struct peer_state* peer) {
     TAILQ_REMOVE(&netflow_peers.peer_list, peer, lp);
     SPLAY_REMOVE(peer_tree, &netflow_peers.peer_tree, peer);
     peer_nf9_delete(peer);
+    peer_nf10_delete(peer);
     je_free(peer);
     netflow_peers.num_peers--;
     rte_spinlock_recursive_unlock(&netflow_peers.peers_lock);
@@ -523,6 +524,7 @@ struct peer_state* new_peer(struct xaddr* addr) {
         logerrx("%s: je_calloc failed", __func__);
     memcpy(&peer->from, addr, sizeof(peer->from));
     TAILQ_INIT(&peer->nf9);
+    TAILQ_INIT(&peer->nf10);
 
     if (PEER_DEBUG) {
         logit(LOG_DEBUG, "new peer %s", addr_ntop_buf(addr));
@@ -536,10 +538,41 @@ struct peer_state* new_peer(struct xaddr* addr) {
     return (peer);
 }
 
+/*
+ * Peer state for one TCP session. RFC 7011 8.1 scopes templates to the
+ * transport session, so this is kept out of the shared tree and LRU list
+ * and lives exactly as long as the connection.
+ */
+struct peer_state* new_session_peer(struct xaddr* addr) {
+    struct peer_state* peer;
+
+    if ((peer = je_calloc(1, sizeof(*peer))) == NULL) {
+        logit(LOG_WARNING, "%s: je_calloc failed", __func__);
+        return (NULL);
+    }
+    memcpy(&peer->from, addr, sizeof(peer->from));
+    TAILQ_INIT(&peer->nf9);
+    TAILQ_INIT(&peer->nf10);
+    peer->is_session = 1;
+    gettimeofday(&peer->firstseen, NULL);
+
+    if (PEER_DEBUG) {
+        logit(LOG_DEBUG, "new session peer %s", addr_ntop_buf(addr));
+    }
+
+    return (peer);
+}
+
+void delete_session_peer(struct peer_state* peer) {
+    peer_nf9_delete(peer);
+    peer_nf10_delete(peer);
+    je_free(peer);
+}
+
 void update_peer(struct peer_state* peer, u_int nflows, u_int netflow_version) {
     rte_spinlock_recursive_lock(&netflow_peers.peers_lock);
     /* Push peer to front of LRU queue, if it isn't there already */
-    if (peer != TAILQ_FIRST(&netflow_peers.peer_list)) {
+    if (!peer->is_session && peer != TAILQ_FIRST(&netflow_peers.peer_list)) {
         TAILQ_REMOVE(&netflow_peers.peer_list, peer, lp);
         TAILQ_INSERT_HEAD(&netflow_peers.peer_list, peer, lp);
     }
@@ -118,6 +118,7 @@ struct peer_state {
     u_int64_t npackets, nflows, ninvalid, no_template;
     struct timeval firstseen, lastvalid;
     u_int last_version;
+    u_int is_session; /* owned by a TCP session, not in the tree */
 
     /* NetFlow v.9 specific portions */
     struct peer_nf9_list nf9;
@@ -168,6 +169,8 @@ void peer_tree_SPLAY(struct peer_tree* head, struct peer_state* elm);
 void peer_tree_SPLAY_MINMAX(struct peer_tree* head, int __comp);
 void delete_peer(struct peer_state* peer);
 struct peer_state* new_peer(struct xaddr* addr);
+struct peer_state* new_session_peer(struct xaddr* addr);
+void delete_session_peer(struct peer_state* peer);
 void update_peer(struct peer_state* peer, u_int nflows, u_int netflow_version);
 struct peer_state* find_peer(struct xaddr* addr);
 void dump_peers(void);
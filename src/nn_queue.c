@@ -1,11 +1,20 @@
+#include <errno.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 
 #include <bsd/string.h>
+#include <bsd/sys/queue.h>
 
+#include <rte_branch_prediction.h>
+#include <rte_byteorder.h>
+#include <rte_cycles.h>
+#include <rte_hash_crc.h>
+#include <rte_lcore.h>
 #include <rte_log.h>
+#include <rte_mbuf.h>
+#include <rte_memcpy.h>
 
 #include <jemalloc/jemalloc.h>
 
@@ -24,43 +33,369 @@
 /* #include "nn_queue.h" */
 
 #include "common.h"
+#include "egress.h"
+#include "event_schema.h"
+#include "event_writer.h"
+#include "je_utils.h"
+#include "journal.h"
 #include "json.h"
+#include "log.h"
+#include "sdn_sensor.h"
+#include "sensor_conf.h"
+#include "sink.h"
+
+#define NN_BATCH_BYTES_MAX (16 << 20)
+
+struct nn_batch_stats_s {
+    uint64_t batches;
+    uint64_t records;
+    uint64_t flushes[NN_FLUSH_MAX];
+    uint64_t sizes[NN_BATCH_BUCKETS];
+    uint64_t compressed;       // batches sent as NN_BATCH_VERSION_COMPRESSED
+    uint64_t uncompressed;     // nm_compress batches which did not get smaller
+    uint64_t compress_in;      // record bytes of nm_compress batches
+    uint64_t compress_out;     // bytes sent for them, headers not included
+    uint64_t compress_cycles;  // TSC spent compressing
+};
+
+typedef struct nn_batch_stats_s nn_batch_stats_t;
+
+/* the records an lcore has queued for one nn_queue, behind room for the header */
+struct nn_batch_s {
+    uint64_t         deadline; // TSC, set by the first record
+    uint32_t         records;
+    uint32_t         length;   // header included
+    uint32_t         size;
+    nn_batch_stats_t stats;
+    uint8_t*         compressed; // nm_compress output, header included
+    uint32_t         compressed_size;
+    uint8_t          data[];
+};
+
+typedef struct nn_batch_s nn_batch_t;
+
+/*
+ * Queues with nm_batch_records, for the deadline flush. Only changed while
+ * the config is loaded or torn down, when the lcores are not running.
+ */
+static TAILQ_HEAD(nn_batch_queue_list_s, nn_queue_s) nn_batch_queues = TAILQ_HEAD_INITIALIZER(nn_batch_queues);
+
+/* one set per lcore, used by whichever thread flushes the batches of the lcore */
+static ss_compress_ctx_t nn_compress_contexts[RTE_MAX_LCORE];
+
+static const char* nn_batch_bucket_names[NN_BATCH_BUCKETS] = {
+    "1", "2-3", "4-7", "8-15", "16-31", "32-63", "64-127", "128+",
+};
+
+/*
+ * nm_events, nm_fields, nm_rename and nm_tags. Names are resolved here
+ * into masks and pre-encoded tags, so events pay a bit test per field,
+ * never a string compare.
+ */
+static int ss_nn_queue_template_parse(json_object* items, nn_queue_t* nn_queue) {
+    json_object* item;
+    json_object* entry;
+    const char* name;
+    ss_event_field_t field;
+
+    nn_queue->event_mask = NN_EVENT_ALL;
+    item = ss_json_object_get(items, "nm_events");
+    if (item) {
+        if (!json_object_is_type(item, json_type_array)) {
+            fprintf(stderr, "nm_events is not array\n");
+            return -1;
+        }
+        nn_queue->event_mask = 0;
+        for (int i = 0; i < json_object_array_length(item); ++i) {
+            entry = json_object_array_get_idx(item, i);
+            name  = json_object_get_string(entry);
+            if      (!strcasecmp(name, "pcap"))   nn_queue->event_mask |= NN_EVENT_PCAP;
+            else if (!strcasecmp(name, "dns"))    nn_queue->event_mask |= NN_EVENT_DNS;
+            else if (!strcasecmp(name, "syslog")) nn_queue->event_mask |= NN_EVENT_SYSLOG;
+            else if (!strcasecmp(name, "ioc"))    nn_queue->event_mask |= NN_EVENT_IOC;
+            else if (!strcasecmp(name, "flow"))   nn_queue->event_mask |= NN_EVENT_FLOW;
+            else {
+                fprintf(stderr, "unknown nm_events entry %s\n", name);
+                return -1;
+            }
+        }
+    }
+
+    nn_queue->field_mask = ~0ULL;
+    item = ss_json_object_get(items, "nm_fields");
+    if (item) {
+        if (!json_object_is_type(item, json_type_array)) {
+            fprintf(stderr, "nm_fields is not array\n");
+            return -1;
+        }
+        if (nn_queue->format != NN_FORMAT_METADATA) {
+            fprintf(stderr, "nm_fields needs nm_format metadata\n");
+            return -1;
+        }
+        nn_queue->field_mask = 0;
+        for (int i = 0; i < json_object_array_length(item); ++i) {
+            entry = json_object_array_get_idx(item, i);
+            field = ss_event_field_lookup(json_object_get_string(entry));
+            if (field == 0) {
+                fprintf(stderr, "unknown nm_fields entry %s\n", json_object_get_string(entry));
+                return -1;
+            }
+            nn_queue->field_mask |= 1ULL << field;
+        }
+    }
+
+    item = ss_json_object_get(items, "nm_rename");
+    if (item) {
+        if (!json_object_is_type(item, json_type_object)) {
+            fprintf(stderr, "nm_rename is not object\n");
+            return -1;
+        }
+        if (nn_queue->format != NN_FORMAT_METADATA || nn_queue->encoding != NN_ENCODING_JSON) {
+            fprintf(stderr, "nm_rename needs nm_format metadata and nm_encoding json\n");
+            return -1;
+        }
+        nn_queue->field_names = je_calloc(SS_FIELD_MAX, sizeof(const char*));
+        if (nn_queue->field_names == NULL) {
+            fprintf(stderr, "could not allocate nm_rename\n");
+            return -1;
+        }
+        for (int i = 0; i < SS_FIELD_MAX; ++i) {
+            nn_queue->field_names[i] = ss_event_field_name((ss_event_field_t) i);
+        }
+        json_object_object_foreach(item, key, value) {
+            field = ss_event_field_lookup(key);
+            if (field == 0 || !json_object_is_type(value, json_type_string)) {
+                fprintf(stderr, "nm_rename %s is not field name to string\n", key);
+                return -1;
+            }
+            // a duplicate key leaves the earlier copy behind, freed by destroy
+            if (nn_queue->field_names[field] != ss_event_field_name(field)) continue;
+            nn_queue->field_names[field] = je_strdup(json_object_get_string(value));
+            if (nn_queue->field_names[field] == NULL) {
+                fprintf(stderr, "could not allocate nm_rename %s\n", key);
+                return -1;
+            }
+        }
+    }
+
+    item = ss_json_object_get(items, "nm_tags");
+    if (item) {
+        if (!json_object_is_type(item, json_type_object)) {
+            fprintf(stderr, "nm_tags is not object\n");
+            return -1;
+        }
+        if (nn_queue->format != NN_FORMAT_METADATA) {
+            fprintf(stderr, "nm_tags needs nm_format metadata\n");
+            return -1;
+        }
+        if (ss_event_writer_tags_build(nn_queue, item)) return -1;
+    }
+
+    return 0;
+}
+
+/* nm_compress, with nm_compress_level and nm_compress_dict, for batches only */
+static int ss_nn_queue_compress_parse(json_object* items, nn_queue_t* nn_queue) {
+    json_object* item;
+    ss_compress_type_t type;
+    const char* name;
+    const char* dict_path = NULL;
+    int level = 0;
+
+    if (!ss_json_object_get(items, "nm_compress")) return 0;
+    
+    name = ss_json_string_view(items, "nm_compress");
+    if (name == NULL) return -1;
+    type = ss_compress_type_parse(name);
+    if (type == SS_COMPRESS_MAX) {
+        fprintf(stderr, "unknown nm_compress %s\n", name);
+        return -1;
+    }
+    if (type != SS_COMPRESS_NONE && nn_queue->batch_records == 0) {
+        fprintf(stderr, "nm_compress needs nm_batch_records\n");
+        return -1;
+    }
+    item = ss_json_object_get(items, "nm_compress_level");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int)) {
+            fprintf(stderr, "nm_compress_level is not int\n");
+            return -1;
+        }
+        level = json_object_get_int(item);
+    }
+    if (ss_json_object_get(items, "nm_compress_dict")) {
+        dict_path = ss_json_string_view(items, "nm_compress_dict");
+        if (dict_path == NULL) return -1;
+    }
+    
+    return ss_compress_conf_init(&nn_queue->compress, type, level, dict_path);
+}
+
+/* an optional positive int, value is left alone when the key is absent */
+static int ss_nn_queue_uint_get(json_object* items, const char* key, uint64_t* value) {
+    json_object* item = ss_json_object_get(items, key);
+    
+    if (item == NULL) return 0;
+    if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+        fprintf(stderr, "%s is not positive int\n", key);
+        return -1;
+    }
+    *value = (uint64_t) json_object_get_int64(item);
+    return 0;
+}
+
+/* nm_journal and its bounds, once the socket exists for the replay to use and egress is parsed */
+static int ss_nn_queue_journal_parse(json_object* items, nn_queue_t* nn_queue) {
+    ss_journal_conf_t conf;
+    const char* path;
+    const char* name;
+    
+    if (!ss_json_object_get(items, "nm_journal")) return 0;
+    // spills write to disk, which only the egress threads may wait for
+    if (!ss_conf->egress_enabled) {
+        fprintf(stderr, "nm_journal needs egress enabled\n");
+        return -1;
+    }
+    
+    path = ss_json_string_view(items, "nm_journal");
+    if (path == NULL) return -1;
+    conf.bytes         = SS_JOURNAL_BYTES_DEFAULT;
+    conf.segment_bytes = SS_JOURNAL_SEGMENT_BYTES_DEFAULT;
+    conf.age           = SS_JOURNAL_AGE_DEFAULT;
+    conf.fsync         = SS_JOURNAL_FSYNC_INTERVAL;
+    conf.fsync_msecs   = SS_JOURNAL_FSYNC_MSECS_DEFAULT;
+    if (ss_nn_queue_uint_get(items, "nm_journal_bytes", &conf.bytes)) return -1;
+    if (ss_nn_queue_uint_get(items, "nm_journal_segment_bytes", &conf.segment_bytes)) return -1;
+    if (ss_nn_queue_uint_get(items, "nm_journal_age", &conf.age)) return -1;
+    if (ss_nn_queue_uint_get(items, "nm_journal_fsync_msecs", &conf.fsync_msecs)) return -1;
+    if (conf.segment_bytes > conf.bytes) {
+        fprintf(stderr, "nm_journal_segment_bytes is over nm_journal_bytes\n");
+        return -1;
+    }
+    if (ss_json_object_get(items, "nm_journal_fsync")) {
+        name = ss_json_string_view(items, "nm_journal_fsync");
+        if (name == NULL) return -1;
+        conf.fsync = ss_journal_fsync_parse(name);
+        if (conf.fsync == SS_JOURNAL_FSYNC_MAX) {
+            fprintf(stderr, "unknown nm_journal_fsync %s\n", name);
+            return -1;
+        }
+    }
+    
+    nn_queue->journal = ss_journal_open(path, &conf, nn_queue->conn);
+    return nn_queue->journal ? 0 : -1;
+}
+
+/* nm_file and its rotation and compression, after nm_format and nm_encoding */
+static int ss_nn_queue_sink_parse(json_object* items, nn_queue_t* nn_queue) {
+    ss_sink_conf_t conf;
+    json_object* item;
+    const char* path;
+    const char* name;
+    uint64_t buffer_bytes = SS_SINK_BUFFER_BYTES_DEFAULT;
+    
+    if (!ss_json_object_get(items, "nm_file")) return 0;
+    
+    path = ss_json_string_view(items, "nm_file");
+    if (path == NULL) return -1;
+    memset(&conf, 0, sizeof(conf));
+    conf.format         = nn_queue->format == NN_FORMAT_PACKET ? SS_SINK_PCAP : SS_SINK_NDJSON;
+    conf.rotate_bytes   = SS_SINK_ROTATE_BYTES_DEFAULT;
+    conf.rotate_secs    = SS_SINK_ROTATE_SECS_DEFAULT;
+    conf.compress       = SS_SINK_COMPRESS_NONE;
+    conf.compress_level = SS_SINK_COMPRESS_LEVEL_DEFAULT;
+    conf.snaplen        = nn_queue->snaplen;
+    if (ss_json_object_get(items, "nm_file_format")) {
+        name = ss_json_string_view(items, "nm_file_format");
+        if (name == NULL) return -1;
+        conf.format = ss_sink_format_parse(name);
+        if (conf.format == SS_SINK_FORMAT_MAX) {
+            fprintf(stderr, "unknown nm_file_format %s\n", name);
+            return -1;
+        }
+    }
+    if (conf.format == SS_SINK_NDJSON && (nn_queue->format != NN_FORMAT_METADATA || nn_queue->encoding != NN_ENCODING_JSON)) {
+        fprintf(stderr, "nm_file_format ndjson needs nm_format metadata and nm_encoding json\n");
+        return -1;
+    }
+    if (conf.format != SS_SINK_NDJSON && nn_queue->format != NN_FORMAT_PACKET) {
+        fprintf(stderr, "nm_file_format %s needs nm_format packet\n", ss_sink_format_dump(conf.format));
+        return -1;
+    }
+    if (ss_nn_queue_uint_get(items, "nm_file_rotate_bytes", &conf.rotate_bytes)) return -1;
+    if (ss_nn_queue_uint_get(items, "nm_file_rotate_secs", &conf.rotate_secs)) return -1;
+    if (ss_nn_queue_uint_get(items, "nm_file_buffer_bytes", &buffer_bytes)) return -1;
+    // a whole record must fit, and the ring size is 32 bits
+    conf.buffer_bytes = (uint32_t) SS_MIN(SS_MAX(buffer_bytes, 2 * NN_SNAPLEN_DEFAULT), 1U << 30);
+    if (ss_json_object_get(items, "nm_file_compress")) {
+        name = ss_json_string_view(items, "nm_file_compress");
+        if (name == NULL) return -1;
+        conf.compress = ss_sink_compress_parse(name);
+        if (conf.compress == SS_SINK_COMPRESS_MAX) {
+            fprintf(stderr, "unknown nm_file_compress %s\n", name);
+            return -1;
+        }
+    }
+    item = ss_json_object_get(items, "nm_file_compress_level");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int(item) < 0 || json_object_get_int(item) > 9) {
+            fprintf(stderr, "nm_file_compress_level is not int from 0 to 9\n");
+            return -1;
+        }
+        conf.compress_level = (uint32_t) json_object_get_int(item);
+    }
+    
+    nn_queue->sink = ss_sink_open(path, &conf);
+    return nn_queue->sink ? 0 : -1;
+}
 
 int ss_nn_queue_create(json_object* items, nn_queue_t* nn_queue) {
     // int rv;
     int so_value;
+    int file_only;
     char* value = NULL;
+    json_object* item;
     
     memset(nn_queue, 0, sizeof(nn_queue_t));
+    nn_queue->conn      = -1;
+    nn_queue->remote_id = -1;
     
-    value = ss_json_string_get(items, "nm_url");
+    // nm_url may be left out with nm_file, such a queue only writes files
+    // and goes by its nm_file in the logs
+    file_only = !ss_json_object_get(items, "nm_url") && ss_json_object_get(items, "nm_file");
+    value = ss_json_string_get(items, file_only ? "nm_file" : "nm_url");
     if (value == NULL) {
         fprintf(stderr, "nm_url is null\n");
         goto error_out;
     }
     strlcpy(nn_queue->url, value, sizeof(nn_queue->url));
     je_free(value);
+    value = NULL;
     
-    value = ss_json_string_get(items, "nm_type");
-    if (value == NULL) {
-        fprintf(stderr, "nm_type is null\n");
-        goto error_out;
-    }
-    if      (!strcasecmp(value, "BUS"))        nn_queue->type = NN_BUS;
-    else if (!strcasecmp(value, "PAIR"))       nn_queue->type = NN_PAIR;
-    else if (!strcasecmp(value, "PUSH"))       nn_queue->type = NN_PUSH;
-    else if (!strcasecmp(value, "PULL"))       nn_queue->type = NN_PULL;
-    else if (!strcasecmp(value, "PUB"))        nn_queue->type = NN_PUB;
-    else if (!strcasecmp(value, "SUB"))        nn_queue->type = NN_SUB;
-    else if (!strcasecmp(value, "REQ"))        nn_queue->type = NN_REQ;
-    else if (!strcasecmp(value, "REP"))        nn_queue->type = NN_REP;
-    else if (!strcasecmp(value, "SURVEYOR"))   nn_queue->type = NN_SURVEYOR;
-    else if (!strcasecmp(value, "RESPONDENT")) nn_queue->type = NN_RESPONDENT;
-    else {
-        fprintf(stderr, "unknown nm_type %s\n", value);
-        goto error_out;
+    nn_queue->type = -1;
+    if (!file_only) {
+        value = ss_json_string_get(items, "nm_type");
+        if (value == NULL) {
+            fprintf(stderr, "nm_type is null\n");
+            goto error_out;
+        }
+        if      (!strcasecmp(value, "BUS"))        nn_queue->type = NN_BUS;
+        else if (!strcasecmp(value, "PAIR"))       nn_queue->type = NN_PAIR;
+        else if (!strcasecmp(value, "PUSH"))       nn_queue->type = NN_PUSH;
+        else if (!strcasecmp(value, "PULL"))       nn_queue->type = NN_PULL;
+        else if (!strcasecmp(value, "PUB"))        nn_queue->type = NN_PUB;
+        else if (!strcasecmp(value, "SUB"))        nn_queue->type = NN_SUB;
+        else if (!strcasecmp(value, "REQ"))        nn_queue->type = NN_REQ;
+        else if (!strcasecmp(value, "REP"))        nn_queue->type = NN_REP;
+        else if (!strcasecmp(value, "SURVEYOR"))   nn_queue->type = NN_SURVEYOR;
+        else if (!strcasecmp(value, "RESPONDENT")) nn_queue->type = NN_RESPONDENT;
+        else {
+            fprintf(stderr, "unknown nm_type %s\n", value);
+            goto error_out;
+        }
+        je_free(value);
+        value = NULL;
     }
-    je_free(value);
     
     value = ss_json_string_get(items, "nm_format");
     if      (!strcasecmp(value, "metadata")) nn_queue->format = NN_FORMAT_METADATA;
@@ -70,6 +405,90 @@ int ss_nn_queue_create(json_object* items, nn_queue_t* nn_queue) {
         goto error_out;
     }
     je_free(value);
+    value = NULL;
+    
+    // optional, JSON unless the consumer asks for binary events
+    nn_queue->encoding = NN_ENCODING_JSON;
+    if (ss_json_object_get(items, "nm_encoding")) {
+        value = ss_json_string_get(items, "nm_encoding");
+        if      (value == NULL) goto error_out;
+        else if (!strcasecmp(value, "json"))   nn_queue->encoding = NN_ENCODING_JSON;
+        else if (!strcasecmp(value, "binary")) nn_queue->encoding = NN_ENCODING_BINARY;
+        else {
+            fprintf(stderr, "unknown nm_encoding %s\n", value);
+            goto error_out;
+        }
+        je_free(value);
+        value = NULL;
+    }
+    
+    nn_queue->snaplen = NN_SNAPLEN_DEFAULT;
+    item = ss_json_object_get(items, "nm_snaplen");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+            fprintf(stderr, "nm_snaplen is not positive int\n");
+            goto error_out;
+        }
+        nn_queue->snaplen = (uint16_t) SS_MIN(json_object_get_int64(item), NN_SNAPLEN_DEFAULT);
+    }
+    item = ss_json_object_get(items, "nm_rate");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+            fprintf(stderr, "nm_rate is not positive int\n");
+            goto error_out;
+        }
+        nn_queue->rate = (uint64_t) json_object_get_int64(item);
+    }
+    nn_queue->burst = NN_BURST_DEFAULT;
+    item = ss_json_object_get(items, "nm_burst");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+            fprintf(stderr, "nm_burst is not positive int\n");
+            goto error_out;
+        }
+        nn_queue->burst = (uint64_t) json_object_get_int64(item);
+    }
+    item = ss_json_object_get(items, "nm_batch_records");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+            fprintf(stderr, "nm_batch_records is not positive int\n");
+            goto error_out;
+        }
+        if (nn_queue->format != NN_FORMAT_METADATA) {
+            fprintf(stderr, "nm_batch_records needs nm_format metadata\n");
+            goto error_out;
+        }
+        nn_queue->batch_records = (uint32_t) SS_MIN(json_object_get_int64(item), NN_BATCH_RECORDS_MAX);
+    }
+    nn_queue->batch_bytes = NN_BATCH_BYTES_DEFAULT;
+    item = ss_json_object_get(items, "nm_batch_bytes");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+            fprintf(stderr, "nm_batch_bytes is not positive int\n");
+            goto error_out;
+        }
+        nn_queue->batch_bytes = (uint32_t) SS_MIN(json_object_get_int64(item), NN_BATCH_BYTES_MAX);
+    }
+    nn_queue->batch_usecs = NN_BATCH_USECS_DEFAULT;
+    item = ss_json_object_get(items, "nm_batch_usecs");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+            fprintf(stderr, "nm_batch_usecs is not positive int\n");
+            goto error_out;
+        }
+        nn_queue->batch_usecs = (uint64_t) json_object_get_int64(item);
+    }
+    if (ss_nn_queue_template_parse(items, nn_queue)) goto error_out;
+    if (ss_nn_queue_compress_parse(items, nn_queue)) goto error_out;
+    if (ss_nn_queue_sink_parse(items, nn_queue)) goto error_out;
+    if (file_only) {
+        if (nn_queue->batch_records || ss_json_object_get(items, "nm_journal")) {
+            fprintf(stderr, "nm_batch_records and nm_journal need nm_url\n");
+            goto error_out;
+        }
+        fprintf(stderr, "created nm_queue for files only, nm_file %s\n", nn_queue->url);
+        return 0;
+    }
     
     nn_queue->conn = nn_socket(AF_SP, nn_queue->type);
     if (nn_queue->conn < 0) {
@@ -89,6 +508,16 @@ int ss_nn_queue_create(json_object* items, nn_queue_t* nn_queue) {
         fprintf(stderr, "could not connect nm queue socket: %s\n", nn_strerror(nn_errno()));
         goto error_out;
     }
+    if (ss_nn_queue_journal_parse(items, nn_queue)) goto error_out;
+    
+    if (nn_queue->batch_records) {
+        nn_queue->batches = je_calloc(RTE_MAX_LCORE, sizeof(nn_batch_t*));
+        if (nn_queue->batches == NULL) {
+            fprintf(stderr, "could not allocate nm queue batches\n");
+            goto error_out;
+        }
+        TAILQ_INSERT_TAIL(&nn_batch_queues, nn_queue, entry);
+    }
     
     fprintf(stderr, "created nm_queue type %s url %s\n", ss_nn_queue_type_dump(nn_queue->type), nn_queue->url);
     return 0;
@@ -99,8 +528,45 @@ int ss_nn_queue_create(json_object* items, nn_queue_t* nn_queue) {
     return -1;
 }
 
+static int ss_nn_queue_flush(nn_queue_t* nn_queue, nn_batch_t* batch, unsigned int lcore_id, nn_flush_reason_t reason);
+
 int ss_nn_queue_destroy(nn_queue_t* nn_queue) {
     if (!nn_queue) return 0;
+    if (nn_queue->batches) {
+        TAILQ_REMOVE(&nn_batch_queues, nn_queue, entry);
+        for (unsigned int lcore_id = 0; lcore_id < RTE_MAX_LCORE; ++lcore_id) {
+            nn_batch_t* batch = nn_queue->batches[lcore_id];
+            if (batch == NULL) continue;
+            if (nn_queue->conn >= 0) ss_nn_queue_flush(nn_queue, batch, lcore_id, NN_FLUSH_CLOSE);
+            je_free(batch->compressed);
+            je_free(batch);
+        }
+        je_free(nn_queue->batches);
+        nn_queue->batches = NULL;
+    }
+    // after the last flush, which may have spilled into it
+    if (nn_queue->journal) {
+        ss_journal_close(nn_queue->journal);
+        nn_queue->journal = NULL;
+    }
+    if (nn_queue->sink) {
+        ss_sink_close(nn_queue->sink);
+        nn_queue->sink = NULL;
+    }
+    ss_compress_conf_destroy(&nn_queue->compress);
+    if (nn_queue->field_names) {
+        for (int i = 0; i < SS_FIELD_MAX; ++i) {
+            if (nn_queue->field_names[i] != ss_event_field_name((ss_event_field_t) i)) je_free((char*) nn_queue->field_names[i]);
+        }
+        je_free(nn_queue->field_names);
+        nn_queue->field_names = NULL;
+    }
+    if (nn_queue->tags) {
+        je_free(nn_queue->tags);
+        nn_queue->tags        = NULL;
+        nn_queue->tags_length = 0;
+        nn_queue->tags_fields = 0;
+    }
     if (nn_queue->conn >= 0) { nn_close(nn_queue->conn); nn_queue->conn = -1; }
     nn_queue->remote_id = -1;
     nn_queue->format    = (nn_queue_format_t) -1;
@@ -134,6 +600,14 @@ const char* ss_nn_queue_format_dump(nn_queue_format_t nn_format) {
     }
 }
 
+const char* ss_nn_queue_encoding_dump(nn_queue_encoding_t nn_encoding) {
+    switch (nn_encoding) {
+        case NN_ENCODING_JSON:   return "NN_ENCODING_JSON";
+        case NN_ENCODING_BINARY: return "NN_ENCODING_BINARY";
+        default:                 return "UNKNOWN";
+    }
+}
+
 const char* ss_nn_queue_content_dump(nn_content_type_t nn_type) {
     switch (nn_type) {
         case NN_OBJECT_PCAP:    return "NN_OBJECT_PCAP";
@@ -144,32 +618,443 @@ const char* ss_nn_queue_content_dump(nn_content_type_t nn_type) {
     }
 }
 
+const char* ss_nn_queue_flush_dump(nn_flush_reason_t reason) {
+    switch (reason) {
+        case NN_FLUSH_RECORDS:  return "records";
+        case NN_FLUSH_BYTES:    return "bytes";
+        case NN_FLUSH_DEADLINE: return "deadline";
+        case NN_FLUSH_CLOSE:    return "close";
+        default:                return "unknown";
+    }
+}
+
 int ss_nn_queue_dump(nn_queue_t* nn_queue) {
-    fprintf(stderr, "nn_queue: id [%d] remote [%d] format [%s] content [%s] type [%s]\n"
-        "TX: Messages [%'20lu] Bytes [%'20lu] Discards [%'20lu]\n",
+    fprintf(stderr, "nn_queue: id [%d] remote [%d] format [%s] encoding [%s] content [%s] type [%s]\n"
+        "TX: Messages [%'20lu] Bytes [%'20lu] Discards [%'20lu] Limited [%'20lu]\n",
         nn_queue->conn, nn_queue->remote_id,
-        ss_nn_queue_format_dump(nn_queue->format), ss_nn_queue_content_dump(nn_queue->content), ss_nn_queue_type_dump(nn_queue->type),
-        nn_queue->tx_messages, nn_queue->tx_bytes, nn_queue->tx_discards);
+        ss_nn_queue_format_dump(nn_queue->format), ss_nn_queue_encoding_dump(nn_queue->encoding), ss_nn_queue_content_dump(nn_queue->content), ss_nn_queue_type_dump(nn_queue->type),
+        nn_queue->tx_messages, nn_queue->tx_bytes, nn_queue->tx_discards, nn_queue->tx_limited);
+    if (nn_queue->batch_records) {
+        fprintf(stderr, "Batch: Records [%u] Bytes [%u] Usecs [%lu] Compress [%s] Level [%d] Dict [%08x]\n",
+            nn_queue->batch_records, nn_queue->batch_bytes, nn_queue->batch_usecs,
+            ss_compress_type_dump(nn_queue->compress.type), nn_queue->compress.level, nn_queue->compress.dict_id);
+    }
+    if (nn_queue->journal) {
+        fprintf(stderr, "Journal: Path [%s] Bytes [%lu] Segment [%lu] Age [%lu] Fsync [%s] Pending [%lu]\n",
+            nn_queue->journal->path, nn_queue->journal->conf.bytes, nn_queue->journal->conf.segment_bytes,
+            nn_queue->journal->conf.age, ss_journal_fsync_dump(nn_queue->journal->conf.fsync), nn_queue->journal->records);
+    }
+    if (nn_queue->sink) {
+        fprintf(stderr, "File: Prefix [%s] Format [%s] Rotate bytes [%lu] Rotate secs [%lu] Compress [%s]\n",
+            nn_queue->sink->prefix, ss_sink_format_dump(nn_queue->sink->conf.format),
+            nn_queue->sink->conf.rotate_bytes, nn_queue->sink->conf.rotate_secs,
+            ss_sink_compress_dump(nn_queue->sink->conf.compress));
+    }
+    if (nn_queue->event_mask != NN_EVENT_ALL || nn_queue->field_mask != ~0ULL || nn_queue->tags_length) {
+        fprintf(stderr, "Template: Events [0x%02x] Fields [0x%016lx] Tags [%u bytes]\n",
+            nn_queue->event_mask, nn_queue->field_mask, nn_queue->tags_length);
+    }
     return 0;
 }
 
-int ss_nn_queue_send(nn_queue_t* nn_queue, uint8_t* message, uint16_t length) {
+/* whether nm_events takes an event of these nn_event_class_t bits */
+int ss_nn_queue_wants(nn_queue_t* nn_queue, uint32_t events) {
+    return (nn_queue->event_mask & events) != 0;
+}
+
+/*
+ * nm_rate as GCRA, the token bucket kept as one timestamp: a message is
+ * due one interval after the previous one, and may run up to burst
+ * intervals early. A single compare and swap keeps it lock-free across
+ * the lcores sharing the queue.
+ */
+static int ss_nn_queue_admit(nn_queue_t* nn_queue) {
+    uint64_t now;
+    uint64_t tat;
+    uint64_t next;
+    
+    if (likely(nn_queue->rate == 0)) return 1;
+    // the TSC rate is unknown until the EAL is up, after config parsing
+    if (unlikely(nn_queue->rate_interval == 0)) {
+        nn_queue->rate_interval = SS_MAX(rte_get_tsc_hz() / nn_queue->rate, 1);
+    }
+    
+    now = rte_rdtsc();
+    do {
+        tat  = nn_queue->rate_tat;
+        next = SS_MAX(tat, now) + nn_queue->rate_interval;
+        if (next - now > nn_queue->rate_interval * nn_queue->burst) {
+            __sync_add_and_fetch(&nn_queue->tx_limited, 1);
+            return 0;
+        }
+    } while (!__sync_bool_compare_and_swap(&nn_queue->rate_tat, tat, next));
+    
+    return 1;
+}
+
+/*
+ * Compresses the records of the batch into batch->compressed, with the
+ * contexts of lcore_id. NULL when the frame would not be smaller, and the
+ * batch goes out as it is.
+ */
+static uint8_t* ss_nn_queue_compress(nn_queue_t* nn_queue, nn_batch_t* batch, unsigned int lcore_id, uint32_t* length) {
+    nn_batch_compressed_header_t* header = (nn_batch_compressed_header_t*) batch->compressed;
+    uint32_t raw_length = batch->length - (uint32_t) sizeof(nn_batch_header_t);
+    uint64_t start = rte_rdtsc();
+    ssize_t rv;
+    
+    rv = ss_compress(&nn_queue->compress, &nn_compress_contexts[lcore_id],
+        batch->data + sizeof(nn_batch_header_t), raw_length,
+        batch->compressed + sizeof(*header), batch->compressed_size - sizeof(*header));
+    batch->stats.compress_cycles += rte_rdtsc() - start;
+    batch->stats.compress_in     += raw_length;
+    if (rv < 0 || (uint64_t) rv + sizeof(*header) >= batch->length) {
+        ++batch->stats.uncompressed;
+        batch->stats.compress_out += raw_length;
+        return NULL;
+    }
+    ++batch->stats.compressed;
+    batch->stats.compress_out += (uint64_t) rv;
+    
+    memcpy(header->magic, NN_BATCH_MAGIC, sizeof(header->magic));
+    header->version           = NN_BATCH_VERSION_COMPRESSED;
+    header->header_length     = (uint8_t) sizeof(*header);
+    header->records           = rte_cpu_to_be_16((uint16_t) batch->records);
+    header->compression       = (uint8_t) nn_queue->compress.type;
+    header->reserved          = 0;
+    header->raw_length        = rte_cpu_to_be_32(raw_length);
+    header->compressed_length = rte_cpu_to_be_32((uint32_t) rv);
+    header->dict_id           = rte_cpu_to_be_32(nn_queue->compress.dict_id);
+    *length = (uint32_t) (sizeof(*header) + (size_t) rv);
+    return batch->compressed;
+}
+
+/*
+ * The message could not go out: nm_journal takes it, or its records are
+ * counted as discards.
+ */
+static int ss_nn_queue_spill(nn_queue_t* nn_queue, uint8_t* message, uint32_t length, uint32_t records) {
+    if (nn_queue->journal && ss_journal_append(nn_queue->journal, message, length) == 0) return (int) length;
+    __sync_add_and_fetch(&nn_queue->tx_discards, records);
+    return -1;
+}
+
+/*
+ * nn_send without blocking. While nm_journal holds messages, new ones
+ * queue up behind them, so the consumer sees them in order.
+ */
+static int ss_nn_queue_deliver(nn_queue_t* nn_queue, uint8_t* message, uint32_t length, uint32_t records) {
+    int rv;
+    
+    if (likely(nn_queue->journal == NULL || nn_queue->journal->records == 0)) {
+        rv = nn_send(nn_queue->conn, message, length, NN_DONTWAIT);
+        if (rv >= 0) {
+            __sync_add_and_fetch(&nn_queue->tx_bytes, (uint64_t) rv);
+            return rv;
+        }
+        if (nn_queue->journal == NULL || nn_errno() != EAGAIN) {
+            __sync_add_and_fetch(&nn_queue->tx_discards, records);
+            return rv;
+        }
+    }
+    
+    return ss_nn_queue_spill(nn_queue, message, length, records);
+}
+
+/* one nn_send for all the records of the batch, which starts over empty */
+static int ss_nn_queue_flush(nn_queue_t* nn_queue, nn_batch_t* batch, unsigned int lcore_id, nn_flush_reason_t reason) {
+    nn_batch_header_t* header = (nn_batch_header_t*) batch->data;
+    uint32_t records = batch->records;
+    uint8_t* message = NULL;
+    uint32_t length;
+    int rv;
+    
+    if (records == 0) return 0;
+    
+    memcpy(header->magic, NN_BATCH_MAGIC, sizeof(header->magic));
+    header->version       = NN_BATCH_VERSION;
+    header->header_length = (uint8_t) sizeof(nn_batch_header_t);
+    header->records       = rte_cpu_to_be_16((uint16_t) records);
+    if (batch->compressed) message = ss_nn_queue_compress(nn_queue, batch, lcore_id, &length);
+    if (message == NULL) {
+        message = batch->data;
+        length  = batch->length;
+    }
+    
+    ++batch->stats.batches;
+    batch->stats.records += records;
+    ++batch->stats.flushes[reason];
+    ++batch->stats.sizes[SS_MIN(31 - __builtin_clz(records), NN_BATCH_BUCKETS - 1)];
+    SS_LOG(DEBUG, NM, "nn_queue %s: batch of %u records, %u bytes, %u sent, flushed on %s\n",
+        nn_queue->url, records, batch->length, length, ss_nn_queue_flush_dump(reason));
+    
+    rv = ss_nn_queue_deliver(nn_queue, message, length, records);
+    
+    batch->records = 0;
+    batch->length  = (uint32_t) sizeof(nn_batch_header_t);
+    return rv;
+}
+
+static nn_batch_t* ss_nn_queue_batch_get(nn_queue_t* nn_queue, unsigned int lcore_id) {
+    nn_batch_t* batch = nn_queue->batches[lcore_id];
+    uint32_t size;
+    
+    if (likely(batch != NULL)) return batch;
+    
+    // nm_batch_bytes is where a flush starts, so leave room for one more record
+    size  = (uint32_t) sizeof(nn_batch_header_t) + nn_queue->batch_bytes + (uint32_t) sizeof(uint16_t) + UINT16_MAX;
+    batch = je_calloc(1, sizeof(nn_batch_t) + size);
+    if (batch == NULL) return NULL;
+    batch->size   = size;
+    batch->length = (uint32_t) sizeof(nn_batch_header_t);
+    if (nn_queue->compress.type != SS_COMPRESS_NONE) {
+        batch->compressed_size = (uint32_t) (sizeof(nn_batch_compressed_header_t) + ss_compress_bound(&nn_queue->compress, size));
+        batch->compressed      = je_malloc(batch->compressed_size);
+        if (batch->compressed == NULL) {
+            je_free(batch);
+            return NULL;
+        }
+    }
+    
+    // the TSC rate is unknown until the EAL is up, after config parsing
+    if (unlikely(nn_queue->batch_cycles == 0)) {
+        nn_queue->batch_cycles = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S * nn_queue->batch_usecs;
+    }
+    
+    nn_queue->batches[lcore_id] = batch;
+    return batch;
+}
+
+/* the batch is per lcore, and only its lcore or egress thread appends */
+static int ss_nn_queue_batch_add(nn_queue_t* nn_queue, uint8_t* message, uint16_t length, unsigned int lcore_id) {
+    nn_batch_t* batch;
+    uint16_t record_length = rte_cpu_to_be_16(length);
     int rv = 0;
     
-    // XXX: assume message is a C string for now
-    RTE_LOG(NOTICE, NM, "nn_queue %s: message id %014lu: %s\n",
-        nn_queue->url, nn_queue->tx_messages, message);
+    // every sender is an EAL lcore
+    if (unlikely(lcore_id >= RTE_MAX_LCORE || (batch = ss_nn_queue_batch_get(nn_queue, lcore_id)) == NULL)) {
+        __sync_add_and_fetch(&nn_queue->tx_discards, 1);
+        return -1;
+    }
     
-    rv = nn_send(nn_queue->conn, message, length, NN_DONTWAIT);
+    if (batch->records == 0) batch->deadline = rte_rdtsc() + nn_queue->batch_cycles;
+    memcpy(batch->data + batch->length, &record_length, sizeof(record_length));
+    rte_memcpy(batch->data + batch->length + sizeof(record_length), message, length);
+    batch->length += (uint32_t) sizeof(record_length) + length;
+    ++batch->records;
     
-    if (rv >= 0) {
-        // XXX: note: tx_messages is used as seq_num
-        // incremented in different code from this
-        __sync_add_and_fetch(&nn_queue->tx_bytes, (uint64_t) rv);
+    if (batch->records >= nn_queue->batch_records) {
+        rv = ss_nn_queue_flush(nn_queue, batch, lcore_id, NN_FLUSH_RECORDS);
+    }
+    else if (batch->length - sizeof(nn_batch_header_t) >= nn_queue->batch_bytes) {
+        rv = ss_nn_queue_flush(nn_queue, batch, lcore_id, NN_FLUSH_BYTES);
+    }
+    
+    return rv < 0 ? -1 : length;
+}
+
+/*
+ * Hands a finished message to nanomsg, or to the nm_batch buffer of
+ * lcore_id, and a copy to nm_file. Runs on the lcore which made the
+ * message, or on its egress thread when those are enabled.
+ */
+int ss_nn_queue_transmit(nn_queue_t* nn_queue, uint8_t* message, uint32_t length, unsigned int lcore_id) {
+    if (nn_queue->sink) {
+        ss_sink_write(nn_queue->sink, message, length, lcore_id);
+        if (nn_queue->conn < 0) return (int) length;
+    }
+    if (nn_queue->batch_records) return ss_nn_queue_batch_add(nn_queue, message, (uint16_t) length, lcore_id);
+    
+    // XXX: note: tx_messages is used as seq_num
+    // incremented in different code from this
+    return ss_nn_queue_deliver(nn_queue, message, length, 1);
+}
+
+int ss_nn_queue_send(nn_queue_t* nn_queue, uint8_t* message, uint16_t length) {
+    ss_egress_ring_t* ring;
+    ss_egress_event_t* event;
+    
+    if (!ss_nn_queue_admit(nn_queue)) return -1;
+    
+    // binary events are not printable, and JSON ones are not NUL-terminated everywhere
+    if (nn_queue->encoding == NN_ENCODING_BINARY) {
+        SS_LOG(DEBUG, NM, "nn_queue %s: message id %014lu: binary, %hu bytes\n",
+            nn_queue->url, nn_queue->tx_messages, length);
     }
     else {
+        SS_LOG(DEBUG, NM, "nn_queue %s: message id %014lu: %.*s\n",
+            nn_queue->url, nn_queue->tx_messages, (int) length, message);
+    }
+    
+    ring = ss_egress_ring_get();
+    if (ring == NULL) return ss_nn_queue_transmit(nn_queue, message, length, rte_lcore_id());
+    
+    // the message lives in the lcore's writer buffer, so the event takes a copy
+    event = ss_egress_event_alloc(ring, nn_queue, length);
+    if (event == NULL) return -1;
+    rte_memcpy(event->data, message, length);
+    ss_egress_event_enqueue(ring, event);
+    return length;
+}
+
+/*
+ * Sends the batches of lcore_id that are past due, from the drain tick of
+ * the lcore, or from its egress thread when those are enabled.
+ */
+void ss_nn_queue_timer_callback(uint16_t lcore_id) {
+    nn_queue_t* nn_queue;
+    nn_batch_t* batch;
+    uint64_t now;
+    
+    if (likely(TAILQ_EMPTY(&nn_batch_queues))) return;
+    
+    now = rte_rdtsc();
+    TAILQ_FOREACH(nn_queue, &nn_batch_queues, entry) {
+        batch = nn_queue->batches[lcore_id];
+        if (batch == NULL || batch->records == 0) continue;
+        if ((int64_t) (now - batch->deadline) < 0) continue;
+        ss_nn_queue_flush(nn_queue, batch, lcore_id, NN_FLUSH_DEADLINE);
+    }
+}
+
+int ss_nn_queue_stats_dump() {
+    nn_queue_t* nn_queue;
+    nn_batch_stats_t total;
+    const char* name;
+    
+    if (rte_get_log_level() < RTE_LOG_NOTICE) return 0;
+    
+    TAILQ_FOREACH(nn_queue, &nn_batch_queues, entry) {
+        memset(&total, 0, sizeof(total));
+        for (unsigned int lcore_id = 0; lcore_id < RTE_MAX_LCORE; ++lcore_id) {
+            nn_batch_t* batch = nn_queue->batches[lcore_id];
+            if (batch == NULL) continue;
+            total.batches += batch->stats.batches;
+            total.records += batch->stats.records;
+            for (int i = 0; i < NN_FLUSH_MAX; ++i) total.flushes[i] += batch->stats.flushes[i];
+            for (int i = 0; i < NN_BATCH_BUCKETS; ++i) total.sizes[i] += batch->stats.sizes[i];
+            total.compressed      += batch->stats.compressed;
+            total.uncompressed    += batch->stats.uncompressed;
+            total.compress_in     += batch->stats.compress_in;
+            total.compress_out    += batch->stats.compress_out;
+            total.compress_cycles += batch->stats.compress_cycles;
+        }
+        
+        printf("Nanomsg batch statistics ===========================\n"
+               "Queue: %s\n"
+               "Batches: %29lu\n"
+               "Records: %29lu\n"
+               "Flushed on records: %18lu\n"
+               "Flushed on bytes: %20lu\n"
+               "Flushed on deadline: %17lu\n"
+               "Flushed on close: %20lu\n",
+               nn_queue->url, total.batches, total.records,
+               total.flushes[NN_FLUSH_RECORDS], total.flushes[NN_FLUSH_BYTES],
+               total.flushes[NN_FLUSH_DEADLINE], total.flushes[NN_FLUSH_CLOSE]);
+        for (int i = 0; i < NN_BATCH_BUCKETS; ++i) {
+            name = nn_batch_bucket_names[i];
+            printf("Batches of %s:%*lu\n", name, (int) (38 - 12 - strlen(name)), total.sizes[i]);
+        }
+        if (nn_queue->compress.type != SS_COMPRESS_NONE) {
+            // ratio of what would have been sent to what was, cost per record byte
+            printf("Compressed batches: %18lu\n"
+                   "Uncompressed batches: %16lu\n"
+                   "Compression bytes in: %16lu\n"
+                   "Compression bytes out: %15lu\n"
+                   "Compression ratio: %19.2f\n"
+                   "Compression cycles/byte: %13.2f\n",
+                   total.compressed, total.uncompressed, total.compress_in, total.compress_out,
+                   total.compress_out ? (double) total.compress_in / (double) total.compress_out : 0.0,
+                   total.compress_in ? (double) total.compress_cycles / (double) total.compress_in : 0.0);
+        }
+        printf("====================================================\n");
+    }
+    
+    return 0;
+}
+
+/* crc32c of the rule name, stable across restarts and rule reordering */
+uint64_t ss_nn_queue_rule_id(const char* name) {
+    return name ? rte_hash_crc(name, (uint32_t) strlen(name), 0) : 0;
+}
+
+static void ss_nn_queue_packet_build(nn_queue_t* nn_queue, ss_frame_t* fbuf, nn_packet_source_t source, uint64_t rule_id, uint8_t* message, uint16_t snap_length) {
+    nn_packet_header_t* header = (nn_packet_header_t*) message;
+    
+    memcpy(header->magic, NN_PACKET_MAGIC, sizeof(header->magic));
+    header->version       = NN_PACKET_VERSION;
+    header->source        = (uint8_t) source;
+    header->header_length = rte_cpu_to_be_16(sizeof(nn_packet_header_t));
+    header->port_id       = rte_cpu_to_be_16(fbuf->data.port_id);
+    header->lcore_id      = rte_cpu_to_be_16((uint16_t) rte_lcore_id());
+    header->snap_length   = rte_cpu_to_be_16(snap_length);
+    header->orig_length   = rte_cpu_to_be_32(rte_pktmbuf_pkt_len(fbuf->mbuf));
+    header->timestamp     = rte_cpu_to_be_64(ss_tsc_to_nsec(fbuf->rx_tsc));
+    header->rule_id       = rte_cpu_to_be_64(rule_id);
+    // only the first segment, the rx path never chains
+    rte_memcpy(message + sizeof(nn_packet_header_t), rte_pktmbuf_mtod(fbuf->mbuf, uint8_t*), snap_length);
+    
+    __sync_add_and_fetch(&nn_queue->tx_messages, 1);
+    SS_LOG(DEBUG, NM, "nn_queue %s: packet message, %u of %u bytes\n",
+        nn_queue->url, snap_length, rte_pktmbuf_pkt_len(fbuf->mbuf));
+}
+
+/*
+ * Built straight into a nanomsg chunk, so the frame is copied once out of
+ * the mbuf and nn_send hands the chunk over instead of copying it again.
+ * With egress threads the frame is copied into the event instead, and
+ * nanomsg's copy happens on the egress thread.
+ */
+int ss_nn_queue_send_packet(nn_queue_t* nn_queue, ss_frame_t* fbuf, nn_packet_source_t source, uint64_t rule_id) {
+    uint32_t orig_length = rte_pktmbuf_pkt_len(fbuf->mbuf);
+    uint16_t snap_length = (uint16_t) SS_MIN(SS_MIN(orig_length, rte_pktmbuf_data_len(fbuf->mbuf)), nn_queue->snaplen);
+    size_t   length      = sizeof(nn_packet_header_t) + snap_length;
+    ss_egress_ring_t* ring;
+    ss_egress_event_t* event;
+    uint8_t* message;
+    int rv;
+    
+    if (nn_queue->format != NN_FORMAT_PACKET) return -1;
+    if (!ss_nn_queue_admit(nn_queue)) return -1;
+    
+    ring = ss_egress_ring_get();
+    if (ring) {
+        event = ss_egress_event_alloc(ring, nn_queue, (uint32_t) length);
+        if (event == NULL) return -1;
+        ss_nn_queue_packet_build(nn_queue, fbuf, source, rule_id, event->data, snap_length);
+        ss_egress_event_enqueue(ring, event);
+        return (int) length;
+    }
+    
+    message = nn_allocmsg(length, 0);
+    if (message == NULL) {
         __sync_add_and_fetch(&nn_queue->tx_discards, 1);
+        return -1;
+    }
+    ss_nn_queue_packet_build(nn_queue, fbuf, source, rule_id, message, snap_length);
+    if (nn_queue->sink) {
+        ss_sink_write(nn_queue->sink, message, (uint32_t) length, rte_lcore_id());
+        if (nn_queue->conn < 0) {
+            nn_freemsg(message);
+            return (int) length;
+        }
+    }
+    
+    // on success nanomsg owns the chunk
+    if (likely(nn_queue->journal == NULL || nn_queue->journal->records == 0)) {
+        rv = nn_send(nn_queue->conn, &message, NN_MSG, NN_DONTWAIT);
+        if (rv >= 0) {
+            __sync_add_and_fetch(&nn_queue->tx_bytes, (uint64_t) rv);
+            return rv;
+        }
+        if (nn_queue->journal == NULL || nn_errno() != EAGAIN) {
+            nn_freemsg(message);
+            __sync_add_and_fetch(&nn_queue->tx_discards, 1);
+            return rv;
+        }
     }
     
+    rv = ss_nn_queue_spill(nn_queue, message, (uint32_t) length, 1);
+    nn_freemsg(message);
     return rv;
 }
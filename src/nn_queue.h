@@ -2,12 +2,31 @@
 
 #include <stdint.h>
 
+#include <bsd/sys/queue.h>
+
 #include <json-c/json.h>
 #include <json-c/json_object_private.h>
 
+#include "compress.h"
+#include "event_schema.h"
+
 /* should be enough for the nanomsg queue URL */
 #define NN_URL_MAX 256
 
+#define NN_SNAPLEN_DEFAULT  65535 // NN_FORMAT_PACKET bytes kept per frame
+#define NN_BURST_DEFAULT       32 // messages sent back to back under nm_rate
+
+#define NN_PACKET_MAGIC      "SP"
+#define NN_PACKET_VERSION       1
+
+#define NN_BATCH_MAGIC       "SB"
+#define NN_BATCH_VERSION        1
+#define NN_BATCH_VERSION_COMPRESSED 2
+#define NN_BATCH_RECORDS_MAX 65535 // records is 16 bits
+#define NN_BATCH_BYTES_DEFAULT 65536
+#define NN_BATCH_USECS_DEFAULT  1000
+#define NN_BATCH_BUCKETS         8 // batch size histogram: 1, 2-3, 4-7, ... 128+
+
 enum nn_content_type_e {
     NN_OBJECT_PCAP    = 1,
     NN_OBJECT_SYSLOG  = 2,
@@ -26,16 +45,144 @@ enum nn_queue_format_e {
 
 typedef enum nn_queue_format_e nn_queue_format_t;
 
+/* wire encoding of NN_FORMAT_METADATA messages, see event_schema.h */
+enum nn_queue_encoding_e {
+    NN_ENCODING_JSON   = 0,
+    NN_ENCODING_BINARY = 1,
+    NN_ENCODING_MAX,
+};
+
+typedef enum nn_queue_encoding_e nn_queue_encoding_t;
+
+/* what matched an NN_FORMAT_PACKET frame, says how to read rule_id */
+enum nn_packet_source_e {
+    NN_PACKET_PCAP   = 1, // rule_id: crc32c of the pcap_chain rule name
+    NN_PACKET_DNS    = 2, // rule_id: crc32c of the dns_chain rule name
+    NN_PACKET_SYSLOG = 3, // rule_id: crc32c of the re_chain rule name
+    NN_PACKET_IOC    = 4, // rule_id: the IOC id
+    NN_PACKET_MAX,
+};
+
+typedef enum nn_packet_source_e nn_packet_source_t;
+
+/*
+ * Leads every NN_FORMAT_PACKET message, followed by snap_length bytes
+ * of the frame from its Ethernet header on. Multi-byte fields are
+ * big-endian; readers skip header_length bytes, so fields can be added.
+ */
+struct nn_packet_header_s {
+    uint8_t  magic[2];
+    uint8_t  version;
+    uint8_t  source;        // nn_packet_source_t
+    uint16_t header_length;
+    uint16_t port_id;
+    uint16_t lcore_id;
+    uint16_t snap_length;
+    uint32_t orig_length;   // the whole frame
+    uint64_t timestamp;     // nanoseconds since the Unix epoch, at rx
+    uint64_t rule_id;
+} __attribute__((packed));
+
+typedef struct nn_packet_header_s nn_packet_header_t;
+
+/*
+ * Leads every message of a queue with nm_batch_records set. Each record
+ * follows as a big-endian 16-bit length and one message as it would have
+ * been sent unbatched. Readers skip header_length bytes.
+ */
+struct nn_batch_header_s {
+    uint8_t  magic[2];
+    uint8_t  version;
+    uint8_t  header_length;
+    uint16_t records;
+} __attribute__((packed));
+
+typedef struct nn_batch_header_s nn_batch_header_t;
+
+/*
+ * Leads the batches of a queue with nm_compress which compression made
+ * smaller; the others are sent as version 1. compressed_length bytes of
+ * one LZ4 or zstd frame follow, which hold the records of a version 1
+ * batch, raw_length bytes, header not included. dict_id names the
+ * nm_compress_dict the frame needs, 0 for none.
+ */
+struct nn_batch_compressed_header_s {
+    uint8_t  magic[2];
+    uint8_t  version;           // NN_BATCH_VERSION_COMPRESSED
+    uint8_t  header_length;
+    uint16_t records;
+    uint8_t  compression;       // ss_compress_type_t
+    uint8_t  reserved;
+    uint32_t raw_length;
+    uint32_t compressed_length;
+    uint32_t dict_id;
+} __attribute__((packed));
+
+typedef struct nn_batch_compressed_header_s nn_batch_compressed_header_t;
+
+/*
+ * What an event reports, for nm_events. An event can be several at once,
+ * such as a dns_chain match on an IOC, and is sent when any of them is
+ * in the queue's event_mask.
+ */
+enum nn_event_class_e {
+    NN_EVENT_PCAP   = 1 << 0, // pcap_chain match
+    NN_EVENT_DNS    = 1 << 1, // dns_chain match
+    NN_EVENT_SYSLOG = 1 << 2, // re_chain match
+    NN_EVENT_IOC    = 1 << 3, // IOC match, on any of the others
+    NN_EVENT_FLOW   = 1 << 4, // flow_export record
+    NN_EVENT_ALL    = (1 << 5) - 1,
+};
+
+typedef enum nn_event_class_e nn_event_class_t;
+
+enum nn_flush_reason_e {
+    NN_FLUSH_RECORDS  = 0, // nm_batch_records reached
+    NN_FLUSH_BYTES    = 1, // nm_batch_bytes reached
+    NN_FLUSH_DEADLINE = 2, // oldest record waited nm_batch_usecs
+    NN_FLUSH_CLOSE    = 3, // queue destroyed
+    NN_FLUSH_MAX,
+};
+
+typedef enum nn_flush_reason_e nn_flush_reason_t;
+
+struct ss_frame_s; // common.h, which includes this file
+struct nn_batch_s; // private to nn_queue.c, one per lcore
+struct ss_journal_s; // journal.h
+struct ss_sink_s; // sink.h
+
 struct nn_queue_s {
     int               conn;
     int               remote_id;
     nn_queue_format_t format;
+    nn_queue_encoding_t encoding;
     nn_content_type_t content;
     int               type;
+    uint16_t          snaplen;
+    uint64_t          rate;          // messages per second, 0 is unlimited
+    uint64_t          burst;
+    uint64_t          rate_interval; // TSC per message, set on first use
+    uint64_t          rate_tat;      // GCRA theoretical arrival time, in TSC
     uint64_t          tx_messages;
     uint64_t          tx_bytes;
     uint64_t          tx_discards;
+    uint64_t          tx_limited;
+    uint32_t          batch_records; // 0 sends every message on its own
+    uint32_t          batch_bytes;
+    uint64_t          batch_usecs;
+    uint64_t          batch_cycles;  // TSC per nm_batch_usecs, set on first use
+    struct nn_batch_s** batches;     // RTE_MAX_LCORE, allocated on first use
+    ss_compress_conf_t compress;     // nm_compress, applied per batch
+    uint32_t          event_mask;    // nm_events, nn_event_class_t bits sent
+    uint64_t          field_mask;    // nm_fields, bit per ss_event_field_t written
+    const char**      field_names;   // nm_rename, JSON key per field, NULL for the schema names
+    uint8_t*          tags;          // nm_tags, pre-encoded in the queue's encoding
+    uint32_t          tags_length;
+    uint16_t          tags_fields;   // binary tag fields in tags
+    struct ss_journal_s* journal;    // nm_journal, takes messages on EAGAIN
+    struct ss_sink_s* sink;          // nm_file, gets a copy of every message
     char              url[NN_URL_MAX];
+    TAILQ_ENTRY(nn_queue_s) entry;
 };
 
 typedef struct nn_queue_s nn_queue_t;
@@ -46,8 +193,16 @@ int ss_nn_queue_create(json_object* items, nn_queue_t* nn_queue);
 int ss_nn_queue_destroy(nn_queue_t* nn_queue);
 const char* ss_nn_queue_type_dump(int nn_queue_type);
 const char* ss_nn_queue_format_dump(nn_queue_format_t nn_format);
+const char* ss_nn_queue_encoding_dump(nn_queue_encoding_t nn_encoding);
 const char* ss_nn_queue_content_dump(nn_content_type_t nn_type);
+const char* ss_nn_queue_flush_dump(nn_flush_reason_t reason);
 int ss_nn_queue_dump(nn_queue_t* nn_queue);
+int ss_nn_queue_transmit(nn_queue_t* nn_queue, uint8_t* message, uint32_t length, unsigned int lcore_id);
 int ss_nn_queue_send(nn_queue_t* nn_queue, uint8_t* message, uint16_t length);
+int ss_nn_queue_wants(nn_queue_t* nn_queue, uint32_t events);
+void ss_nn_queue_timer_callback(uint16_t lcore_id);
+int ss_nn_queue_stats_dump(void);
+uint64_t ss_nn_queue_rule_id(const char* name);
+int ss_nn_queue_send_packet(nn_queue_t* nn_queue, struct ss_frame_s* fbuf, nn_packet_source_t source, uint64_t rule_id);
 
 /* END PROTOTYPES */
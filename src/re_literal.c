@@ -0,0 +1,226 @@
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "re_literal.h"
+#include "str_utils.h"
+
+static const char* ss_re_brace_skip(const char* p, char close) {
+    const char* end = strchr(p, close);
+    return end ? end + 1 : p + strlen(p);
+}
+
+/*
+ * p points at a backslash followed by a letter or digit. Skip the escape
+ * with its whole operand: hex and octal codes, \cX, \p{..}, named groups
+ * and backreferences, so none of those bytes is taken for a literal.
+ * Skipping too much only shortens a run, which is always safe.
+ */
+static const char* ss_re_escape_skip(const char* p) {
+    char e = p[1];
+    int digits;
+
+    p += 2;
+    switch (e) {
+        case 'x': {
+            if (*p == '{') return ss_re_brace_skip(p, '}');
+            for (digits = 0; digits < 2 && isxdigit((unsigned char) *p); ++digits) ++p;
+            return p;
+        }
+        case 'o':
+        case 'N': {
+            return *p == '{' ? ss_re_brace_skip(p, '}') : p;
+        }
+        case 'p':
+        case 'P': {
+            if (*p == '{') return ss_re_brace_skip(p, '}');
+            return *p ? p + 1 : p;
+        }
+        case 'c': {
+            return *p ? p + 1 : p;
+        }
+        case 'g':
+        case 'k': {
+            if (*p == '{')  return ss_re_brace_skip(p, '}');
+            if (*p == '<')  return ss_re_brace_skip(p, '>');
+            if (*p == '\'') return ss_re_brace_skip(p + 1, '\'');
+            if (*p == '-' || *p == '+') ++p;
+            while (isdigit((unsigned char) *p)) ++p;
+            return p;
+        }
+        default: {
+            // octal \0nn and \nnn, or a backreference
+            if (isdigit((unsigned char) e)) {
+                while (isdigit((unsigned char) *p)) ++p;
+            }
+            return p;
+        }
+    }
+}
+
+static const char* ss_re_class_skip(const char* p) {
+    // p points at '['; a leading ']' or '^]' is a literal member
+    ++p;
+    if (*p == '^') ++p;
+    if (*p == ']') ++p;
+    while (*p && *p != ']') {
+        if (*p == '\\' && p[1]) {
+            p += 2;
+        }
+        else if (*p == '[' && p[1] == ':') {
+            const char* end = strstr(p + 2, ":]");
+            p = end ? end + 2 : p + 1;
+        }
+        else {
+            ++p;
+        }
+    }
+    return *p ? p + 1 : p;
+}
+
+static const char* ss_re_group_skip(const char* p) {
+    // p points at '('
+    int depth = 0;
+    while (*p) {
+        if (*p == '\\' && isalnum((unsigned char) p[1])) { p = ss_re_escape_skip(p); continue; }
+        if (*p == '\\' && p[1]) { p += 2; continue; }
+        if (*p == '[') { p = ss_re_class_skip(p); continue; }
+        if (*p == '(') ++depth;
+        else if (*p == ')' && --depth == 0) return p + 1;
+        ++p;
+    }
+    return p;
+}
+
+/*
+ * Return 1 if the pattern can be prefiltered at all. Top-level alternation
+ * means no single literal is required, and inline option groups such as
+ * (?i) or (?x) change how the literals after them must be interpreted.
+ */
+static int ss_re_literal_supported(const char* p) {
+    int depth = 0;
+    while (*p) {
+        if (*p == '\\') {
+            if (p[1] == 'Q') return 0;
+            if (isalnum((unsigned char) p[1])) p = ss_re_escape_skip(p);
+            else                               p += p[1] ? 2 : 1;
+            continue;
+        }
+        if (*p == '[') { p = ss_re_class_skip(p); continue; }
+        if (*p == '(') {
+            if (p[1] == '?' && (isalpha((unsigned char) p[2]) || p[2] == '-' || p[2] == '^')
+                && p[2] != 'P') return 0;
+            ++depth;
+        }
+        else if (*p == ')') --depth;
+        else if (*p == '|' && depth <= 0) return 0;
+        ++p;
+    }
+    return 1;
+}
+
+/*
+ * Under UTF-8 caseless matching K and S also match the Kelvin sign U+212A
+ * and the long s U+017F, which ss_memmem's ASCII folding cannot see, and
+ * escaped bytes past ASCII are pieces of characters with folds of their
+ * own. Such bytes are no plain byte for the prefilter.
+ */
+static int ss_re_literal_unicode_fold(uint8_t c) {
+    return c >= 0x80 || memchr("KkSs", c, 4) != NULL;
+}
+
+/*
+ * Walk the top level of the pattern and return the longest run of literal
+ * bytes which every match is required to contain. Anything which is not a
+ * plain byte (classes, groups, escapes, anchors, non-ASCII, and with
+ * SS_RE_LITERAL_NOCASE | SS_RE_LITERAL_UTF8 the letters above) ends the
+ * run. Returns 0 if no usable literal exists.
+ */
+size_t ss_re_literal_extract(const char* re_string, int flags, uint8_t* literal, size_t literal_size) {
+    const char* p = re_string;
+    uint8_t run[SS_RE_LITERAL_MAX];
+    size_t run_length  = 0;
+    size_t best_length = 0;
+    uint8_t c          = 0;
+    int nocase         = flags & SS_RE_LITERAL_NOCASE;
+    int unicode_fold   = nocase && (flags & SS_RE_LITERAL_UTF8);
+    int is_literal, optional, repeat;
+
+    if (!re_string || !ss_re_literal_supported(re_string)) return 0;
+    if (literal_size > sizeof(run)) literal_size = sizeof(run);
+
+    while (*p) {
+        is_literal = 0;
+        if (*p == '\\') {
+            if (!p[1]) break;
+            if (p[1] == 'Q') break;
+            if (isalnum((unsigned char) p[1])) {
+                // class escape, assertion, backreference or numeric escape
+                p = ss_re_escape_skip(p);
+            }
+            else {
+                c = (uint8_t) p[1];
+                is_literal = 1;
+                p += 2;
+            }
+        }
+        else if (*p == '[') {
+            p = ss_re_class_skip(p);
+        }
+        else if (*p == '(') {
+            p = ss_re_group_skip(p);
+        }
+        else if ((unsigned char) *p >= 0x80 || strchr(".^${}|)*+?", *p)) {
+            ++p;
+        }
+        else {
+            c = (uint8_t) *p;
+            is_literal = 1;
+            ++p;
+        }
+
+        optional = 0;
+        repeat   = 0;
+        if (*p == '*' || *p == '?') {
+            optional = 1;
+            ++p;
+        }
+        else if (*p == '+') {
+            repeat = 1;
+            ++p;
+        }
+        else if (*p == '{' && isdigit((unsigned char) p[1])) {
+            char* end = NULL;
+            unsigned long minimum = strtoul(p + 1, &end, 10);
+            if (*end == ',' || *end == '}') {
+                if (minimum == 0) optional = 1;
+                else              repeat   = 1;
+                end = strchr(end, '}');
+                p = end ? end + 1 : p + strlen(p);
+            }
+        }
+        // lazy or possessive suffix
+        if ((optional || repeat) && (*p == '?' || *p == '+')) ++p;
+        if (is_literal && unicode_fold && ss_re_literal_unicode_fold(c)) is_literal = 0;
+
+        if (is_literal && !optional && run_length < literal_size) {
+            run[run_length++] = nocase ? SS_ASCII_LOWER(c) : c;
+        }
+        if (!is_literal || optional || repeat || run_length == literal_size) {
+            if (run_length > best_length) {
+                memcpy(literal, run, run_length);
+                best_length = run_length;
+            }
+            run_length = 0;
+        }
+    }
+
+    if (run_length > best_length) {
+        memcpy(literal, run, run_length);
+        best_length = run_length;
+    }
+
+    return best_length;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Required-literal extraction for the re prefilter. Kept free of DPDK,
+ * PCRE and RE2 so src/tools can check it against a table of patterns.
+ */
+
+/* CONSTANTS */
+
+#define SS_RE_LITERAL_MAX      32
+
+// ss_re_literal_extract flags, as the rule's nocase and utf8 options
+#define SS_RE_LITERAL_NOCASE  0x01
+#define SS_RE_LITERAL_UTF8    0x02
+
+/* BEGIN PROTOTYPES */
+
+size_t ss_re_literal_extract(const char* re_string, int flags, uint8_t* literal, size_t literal_size);
+
+/* END PROTOTYPES */
@@ -1,9 +1,11 @@
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <bsd/sys/queue.h>
 
+#include <rte_cycles.h>
 #include <rte_log.h>
 #include <rte_memcpy.h>
 
@@ -17,6 +19,7 @@
 #include "re_utils.h"
 #include "sdn_sensor.h"
 #include "sensor_conf.h"
+#include "str_utils.h"
 
 int ss_re_init() {
     pcre_malloc       = &je_malloc;
@@ -182,6 +185,12 @@ ss_re_entry_t* ss_re_entry_create(json_object* re_json) {
         goto error_out;
     }
     
+    rv = ss_re_entry_prepare_field(re_json, re_entry);
+    if (rv) {
+        fprintf(stderr, "re_entry field is invalid\n");
+        goto error_out;
+    }
+    
     rv = ss_nn_queue_create(re_json, &re_entry->nn_queue);
     if (rv) {
         fprintf(stderr, "could not allocate re nm_queue\n");
@@ -203,6 +212,18 @@ ss_re_entry_t* ss_re_entry_create(json_object* re_json) {
         }
     }
     
+    rv = ss_re_entry_prepare_budget(re_json, re_entry);
+    if (rv) {
+        fprintf(stderr, "could not prepare re match budget\n");
+        goto error_out;
+    }
+    
+    rv = ss_re_entry_prepare_literal(re_json, re_entry);
+    if (rv) {
+        fprintf(stderr, "could not prepare re literal prefilter\n");
+        goto error_out;
+    }
+    
     fprintf(stderr, "created re entry [%s]\n", re_entry->name);
     return re_entry;
     
@@ -211,6 +232,39 @@ ss_re_entry_t* ss_re_entry_create(json_object* re_json) {
     return NULL;
 }
 
+/*
+ * Optional "field" scopes the rule to one part of the parsed message.
+ * "sd_param" additionally needs "sd_name" and optionally "sd_id".
+ */
+int ss_re_entry_prepare_field(json_object* re_json, ss_re_entry_t* re_entry) {
+    const char* tmp_string;
+
+    re_entry->field = SS_SYSLOG_FIELD_MESSAGE;
+    if (ss_json_object_get(re_json, "field") == NULL) return 0;
+
+    tmp_string = ss_json_string_view(re_json, "field");
+    if (tmp_string == NULL) return -1;
+    re_entry->field = ss_syslog_field_load(tmp_string);
+    if ((int) re_entry->field == -1) {
+        fprintf(stderr, "re_entry %s field %s is invalid\n", re_entry->name, tmp_string);
+        return -1;
+    }
+
+    if (re_entry->field != SS_SYSLOG_FIELD_SD_PARAM) return 0;
+
+    re_entry->sd_name = ss_json_string_get(re_json, "sd_name");
+    if (re_entry->sd_name == NULL) {
+        fprintf(stderr, "re_entry %s field sd_param needs sd_name\n", re_entry->name);
+        return -1;
+    }
+    if (ss_json_object_get(re_json, "sd_id")) {
+        re_entry->sd_id = ss_json_string_get(re_json, "sd_id");
+        if (re_entry->sd_id == NULL) return -1;
+    }
+
+    return 0;
+}
+
 int ss_re_entry_destroy(ss_re_entry_t* re_entry) {
     if (!re_entry) return 0;
     
@@ -221,34 +275,203 @@ int ss_re_entry_destroy(ss_re_entry_t* re_entry) {
     re_entry->backend  = SS_RE_BACKEND_EMPTY;
     re_entry->type     = SS_RE_TYPE_EMPTY;
     re_entry->ioc_type = SS_IOC_TYPE_EMPTY;
+    re_entry->field    = SS_SYSLOG_FIELD_EMPTY;
     
     if (re_entry->pcre_re_extra) { pcre_free_study(re_entry->pcre_re_extra); re_entry->pcre_re_extra = NULL; }
     if (re_entry->pcre_re)       { pcre_free(re_entry->pcre_re);             re_entry->pcre_re = NULL;       }
     if (re_entry->re2_re)        { cre2_delete(re_entry->re2_re);            re_entry->re2_re = NULL;        }
     if (re_entry->name)          { je_free(re_entry->name);                  re_entry->name = NULL;          }
+    if (re_entry->sd_id)         { je_free(re_entry->sd_id);                 re_entry->sd_id = NULL;         }
+    if (re_entry->sd_name)       { je_free(re_entry->sd_name);               re_entry->sd_name = NULL;       }
     
     je_free(re_entry);
     
     return 0;
 }
 
+/* LITERAL PREFILTER */
+
+int ss_re_entry_prepare_literal(json_object* re_json, ss_re_entry_t* re_entry) {
+    const char* re_string = ss_json_string_view(re_json, "re");
+    int flags             = 0;
+
+    re_entry->nocase         = ss_json_boolean_get(re_json, "nocase", 1);
+    re_entry->literal_length = 0;
+
+    if (!ss_json_boolean_get(re_json, "prefilter", 1)) return 0;
+
+    // same defaults as the pcre and re2 options
+    if (re_entry->nocase)                         flags |= SS_RE_LITERAL_NOCASE;
+    if (ss_json_boolean_get(re_json, "utf8", 1))  flags |= SS_RE_LITERAL_UTF8;
+    re_entry->literal_length = ss_re_literal_extract(re_string, flags,
+        re_entry->literal, sizeof(re_entry->literal));
+
+    fprintf(stderr, "re_entry %s prefilter literal length %zu [%.*s]\n",
+        re_entry->name, re_entry->literal_length,
+        (int) re_entry->literal_length, (char*) re_entry->literal);
+    return 0;
+}
+
+/*
+ * match_limit bounds the backtracking steps of pcre_exec, and the recursion
+ * depth with them; RE2 runs in linear time and ignores it. match_max bounds
+ * the substring matches examined per message, for both backends. Either
+ * counts as an abort of its own kind, and the evaluation does not match.
+ */
+int ss_re_entry_prepare_budget(json_object* re_json, ss_re_entry_t* re_entry) {
+    int64_t match_limit;
+    int64_t match_max;
+
+    re_entry->profile = ss_json_boolean_get(re_json, "profile", 0);
+
+    match_limit = ss_json_int_get(re_json, "match_limit", SS_RE_MATCH_LIMIT_DEFAULT);
+    if (match_limit < 0 || match_limit > UINT32_MAX) {
+        fprintf(stderr, "re_entry %s match_limit %ld is invalid\n", re_entry->name, match_limit);
+        return -1;
+    }
+    re_entry->match_limit = (uint32_t) match_limit;
+
+    match_max = ss_json_int_get(re_json, "match_max", SS_RE_MATCH_MAX_DEFAULT);
+    if (match_max < 0 || match_max > UINT32_MAX) {
+        fprintf(stderr, "re_entry %s match_max %ld is invalid\n", re_entry->name, match_max);
+        return -1;
+    }
+    re_entry->match_max = (uint32_t) match_max;
+
+    if (re_entry->match_limit && re_entry->pcre_re_extra) {
+        re_entry->pcre_re_extra->flags |= PCRE_EXTRA_MATCH_LIMIT | PCRE_EXTRA_MATCH_LIMIT_RECURSION;
+        re_entry->pcre_re_extra->match_limit           = re_entry->match_limit;
+        re_entry->pcre_re_extra->match_limit_recursion = re_entry->match_limit;
+    }
+
+    return 0;
+}
+
+/*
+ * Returns 1 if the rule needs to run the full regex, 0 if the required
+ * literal is absent and the rule cannot match.
+ */
+int ss_re_chain_prefilter(ss_re_entry_t* re_entry, uint8_t* l4_offset, uint16_t l4_length) {
+    ss_re_stats_t* stats = &re_entry->stats[rte_lcore_id()];
+
+    if (re_entry->literal_length == 0) return 1;
+
+    if (ss_memmem(l4_offset, l4_length, re_entry->literal, re_entry->literal_length, re_entry->nocase)) {
+        ++stats->prefilter_hits;
+        return 1;
+    }
+
+    ++stats->prefilter_skips;
+    return 0;
+}
+
+int ss_re_chain_stats_dump() {
+    ss_re_entry_t* rptr;
+    ss_re_stats_t* sptr;
+    ss_re_stats_t total;
+    uint64_t prefiltered;
+
+    if (rte_get_log_level() < RTE_LOG_NOTICE) return 0;
+
+    printf("Regex rule statistics ==============================\n");
+    TAILQ_FOREACH(rptr, &ss_conf->re_chain.re_list, entry) {
+        memset(&total, 0, sizeof(total));
+        for (unsigned int lcore_id = 0; lcore_id < RTE_MAX_LCORE; ++lcore_id) {
+            sptr = &rptr->stats[lcore_id];
+            total.prefilter_hits  += sptr->prefilter_hits;
+            total.prefilter_skips += sptr->prefilter_skips;
+            total.calls           += sptr->calls;
+            total.matches         += sptr->matches;
+            total.limit_aborts    += sptr->limit_aborts;
+            total.max_aborts      += sptr->max_aborts;
+            total.cycles          += sptr->cycles;
+            if (sptr->cycles_max > total.cycles_max) total.cycles_max = sptr->cycles_max;
+        }
+        prefiltered = total.prefilter_hits + total.prefilter_skips;
+        printf("Statistics for rule %s field %s literal [%.*s]\n"
+               "Prefilter hits: %22lu (%6.2f%%)\n"
+               "Prefilter skips: %21lu (%6.2f%%)\n"
+               "Evaluations: %25lu\n"
+               "Matches: %29lu\n"
+               "Limit aborts: %24lu\n"
+               "Max aborts: %26lu\n",
+               rptr->name, ss_syslog_field_dump(rptr->field),
+               (int) rptr->literal_length, (char*) rptr->literal,
+               total.prefilter_hits,  prefiltered ? 100.0 * (double) total.prefilter_hits  / (double) prefiltered : 0.0,
+               total.prefilter_skips, prefiltered ? 100.0 * (double) total.prefilter_skips / (double) prefiltered : 0.0,
+               total.calls, total.matches, total.limit_aborts, total.max_aborts);
+        if (rptr->profile) {
+            printf("Total cycles: %24lu\n"
+                   "Average cycles: %22lu\n"
+                   "Max cycles: %26lu\n",
+                   total.cycles, total.calls ? total.cycles / total.calls : 0, total.cycles_max);
+        }
+    }
+    printf("====================================================\n");
+    return 0;
+}
+
 /* RE MATCH INTERFACE */
 
-int ss_re_chain_match(ss_re_match_t* re_match, uint8_t* l4_offset, uint16_t l4_length) {
+int ss_re_chain_match_entry(ss_re_match_t* re_match, ss_re_entry_t* re_entry, uint8_t* l4_offset, uint16_t l4_length) {
+    ss_re_stats_t* stats = &re_entry->stats[rte_lcore_id()];
+    uint64_t start_tsc   = 0;
+    uint64_t cycles;
+    int rv;
+
+    if (!ss_re_chain_prefilter(re_entry, l4_offset, l4_length)) {
+        // literal absent: no match, which an inverted complete rule flips
+        return (re_entry->type == SS_RE_TYPE_COMPLETE && re_entry->inverted) ? 1 : 0;
+    }
+
+    if (re_entry->profile) start_tsc = rte_rdtsc();
+
+    if (re_entry->backend == SS_RE_BACKEND_PCRE) {
+        rv = ss_re_chain_match_pcre(re_match, re_entry, l4_offset, l4_length);
+    }
+    else if (re_entry->backend == SS_RE_BACKEND_RE2) {
+        rv = ss_re_chain_match_re2(re_match, re_entry, l4_offset, l4_length);
+    }
+    else {
+        rv = -1;
+    }
+
+    if (re_entry->profile) {
+        cycles = rte_rdtsc() - start_tsc;
+        stats->cycles += cycles;
+        if (cycles > stats->cycles_max) stats->cycles_max = cycles;
+    }
+    ++stats->calls;
+    if (rv > 0) ++stats->matches;
+
+    return rv;
+}
+
+int ss_re_chain_match(ss_re_match_t* re_match, ss_syslog_t* syslog, uint8_t* l4_offset, uint16_t l4_length) {
     int rv = 0;
     ss_re_entry_t* rptr;
     ss_re_entry_t* rtmp;
+    ss_slice_t field;
 
     TAILQ_FOREACH_SAFE(rptr, &ss_conf->re_chain.re_list, entry, rtmp) {
         RTE_LOG(FINE, EXTRACTOR, "attempt re backend %d match type %d against syslog rule %s\n",
             rptr->backend, rptr->type, rptr->name);
-        if (rptr->backend == SS_RE_BACKEND_PCRE) {
-            rv = ss_re_chain_match_pcre(re_match, rptr, l4_offset, l4_length);
+        
+        if (rptr->field == SS_SYSLOG_FIELD_MESSAGE) {
+            field.data   = l4_offset;
+            field.length = l4_length;
         }
-        else if (rptr->backend == SS_RE_BACKEND_RE2) {
-            rv = ss_re_chain_match_re2(re_match, rptr, l4_offset, l4_length);
+        else if (!syslog || !ss_syslog_field_get(syslog, rptr->field, rptr->sd_id, rptr->sd_name, &field)) {
+            RTE_LOG(FINER, EXTRACTOR, "skip syslog rule %s, field %s not present\n",
+                rptr->name, ss_syslog_field_dump(rptr->field));
+            continue;
         }
         
+        rv = ss_re_chain_match_entry(re_match, rptr, (uint8_t*) field.data, (uint16_t) field.length);
+        
+        // a failed rule must not keep the rest of the chain from running
+        if (rv < 0) continue;
+        
         if (rv) {
             RTE_LOG(DEBUG, EXTRACTOR, "finish re match type %d against syslog rule %s with result %d\n",
                 rptr->type, rptr->name, rv);
@@ -262,6 +485,12 @@ int ss_re_chain_match(ss_re_match_t* re_match, uint8_t* l4_offset, uint16_t l4_l
 
 /* PCRE BACKEND */
 
+static inline int ss_re_pcre_is_abort(int pcre_errno) {
+    return pcre_errno == PCRE_ERROR_MATCHLIMIT
+        || pcre_errno == PCRE_ERROR_RECURSIONLIMIT
+        || pcre_errno == PCRE_ERROR_JIT_STACKLIMIT;
+}
+
 int ss_re_entry_prepare_pcre(json_object* re_json, ss_re_entry_t* re_entry) {
     const char* re_string    = NULL;
     const char* re_perror    = NULL;
@@ -330,7 +559,13 @@ int ss_re_chain_match_pcre_complete(ss_re_match_t* re_match, ss_re_entry_t* re_e
         else if (match_count == PCRE_ERROR_NOMATCH) match_count = 1;
     }
     
-    if (match_count < 0 && match_count != PCRE_ERROR_NOMATCH) {
+    if (ss_re_pcre_is_abort(match_count)) {
+        RTE_LOG(DEBUG, EXTRACTOR, "abort complete match error %s against syslog rule %s\n",
+            ss_pcre_strerror(match_count), re_entry->name);
+        ++re_entry->stats[rte_lcore_id()].limit_aborts;
+        return 0;
+    }
+    else if (match_count < 0 && match_count != PCRE_ERROR_NOMATCH) {
         RTE_LOG(ERR, EXTRACTOR, "failed complete match error %s against syslog rule %s\n",
             ss_pcre_strerror(match_count), re_entry->name);
         return -1;
@@ -351,7 +586,8 @@ int ss_re_chain_match_pcre_substring(ss_re_match_t* re_match, ss_re_entry_t* re_
     int             have_match  = 0;
     int             match_vector[(0 + 1) * 3];
     int             match_index = 0;
-    uint8_t*        match_string;
+    int             match_length;
+    const char*     match_string;
     ss_ioc_entry_t* iptr;
     
     // XXX: this is buggy because it will not be a true per-thread stack
@@ -366,29 +602,41 @@ int ss_re_chain_match_pcre_substring(ss_re_match_t* re_match, ss_re_entry_t* re_
         if (match_count == 0 || match_count == PCRE_ERROR_NOMATCH) {
             goto end_loop;
         }
+        else if (ss_re_pcre_is_abort(match_count)) {
+            RTE_LOG(DEBUG, EXTRACTOR, "abort substring match error %s against syslog rule %s\n",
+                ss_pcre_strerror(match_count), re_entry->name);
+            ++re_entry->stats[rte_lcore_id()].limit_aborts;
+            return 0;
+        }
         else if (match_count < 0) {
             RTE_LOG(ERR, EXTRACTOR, "failed substring match error %s against syslog rule %s\n",
                 ss_pcre_strerror(match_count), re_entry->name);
             return -1;
         }
         
-        if (pcre_get_substring((char*) l4_offset,
-                               match_vector, match_count,
-                               0, (const char**) &match_string) >= 0) {
-            RTE_LOG(FINER, EXTRACTOR, "attempt ioc match against substring %d: %s\n",
-                match_index, match_string);
-            iptr = ss_ioc_syslog_match((char*) match_string, re_entry->ioc_type);
-            if (iptr) {
-                RTE_LOG(FINE, EXTRACTOR, "successful ioc match for syslog rule %s against substring %s\n",
-                    re_entry->name, match_string);
-                have_match = 1;
-                re_match->ioc_entry = iptr;
-            }
-            pcre_free_substring((char*) match_string);
-            ++match_index;
+        // substring 0 is the full match, looked up in place
+        match_string = (char*) l4_offset + match_vector[0];
+        match_length = match_vector[1] - match_vector[0];
+        RTE_LOG(FINER, EXTRACTOR, "attempt ioc match against substring %d: %.*s\n",
+            match_index, match_length, match_string);
+        iptr = ss_ioc_syslog_match(match_string, (size_t) match_length, re_entry->ioc_type);
+        if (iptr) {
+            RTE_LOG(FINE, EXTRACTOR, "successful ioc match for syslog rule %s against substring %.*s\n",
+                re_entry->name, match_length, match_string);
+            have_match = 1;
+            re_match->ioc_entry = iptr;
         }
+        ++match_index;
         
-        start_point = match_vector[1];
+        // step past empty matches so the loop always advances
+        start_point = match_vector[1] > match_vector[0] ? match_vector[1] : match_vector[1] + 1;
+        
+        if (re_entry->match_max && (uint32_t) match_index >= re_entry->match_max && !have_match) {
+            RTE_LOG(DEBUG, EXTRACTOR, "abort substring match after %d substrings against syslog rule %s\n",
+                match_index, re_entry->name);
+            ++re_entry->stats[rte_lcore_id()].max_aborts;
+            return 0;
+        }
     } while (match_count > 0 && start_point < l4_length && !have_match);
     
     end_loop:
@@ -412,6 +660,7 @@ int ss_re_entry_prepare_re2(json_object* re_json, ss_re_entry_t* re_entry) {
     cre2_options_t* re2_options = NULL;
     cre2_string_t   re_serror;
     int re_flag                 = 0;
+    int64_t max_mem             = 0;
     
     re2_options = cre2_opt_new();
     if (!re2_options) {
@@ -439,6 +688,12 @@ int ss_re_entry_prepare_re2(json_object* re_json, ss_re_entry_t* re_entry) {
     re_flag = ss_json_boolean_get(re_json, "verbose", 1);
     cre2_opt_set_log_errors(re2_options, 1);
     
+    // bounds the DFA cache; RE2 falls back to the slower NFA past it
+    max_mem = ss_json_int_get(re_json, "max_mem", 0);
+    if (max_mem > 0) {
+        cre2_opt_set_max_mem(re2_options, max_mem);
+    }
+    
     re_entry->re2_re = cre2_new(re_string, (int) strlen(re_string), re2_options);
     if (re_entry->re2_re == NULL) {
         fprintf(stderr, "could not allocate re_entry re2_re\n");
@@ -504,13 +759,13 @@ int ss_re_chain_match_re2_substring(ss_re_match_t* re_match, ss_re_entry_t* re_e
     int             match_index = 0;
     ss_ioc_entry_t* iptr;
     cre2_string_t   match[1];
-    char            substring[SS_IOC_DNS_SIZE + 1];
     
     match[0].data   = (char*) l4_offset;
     match[0].length = 0;
     
     do {
         start_point = (int) ((char*) match[0].data + match[0].length - (char*) l4_offset);
+        if (start_point > l4_length) goto end_loop;
         match_flag = cre2_match(re_entry->re2_re,
             (char*) l4_offset, l4_length,
             start_point, l4_length,
@@ -520,23 +775,31 @@ int ss_re_chain_match_re2_substring(ss_re_match_t* re_match, ss_re_entry_t* re_e
             goto end_loop;
         }
         
-        // extract substring 0 (full content of match)
+        // substring 0 (full content of match) is looked up in place
         match_length = match[0].length;
-        rte_memcpy(substring, match[0].data, (size_t) (match_length > SS_IOC_DNS_SIZE? SS_IOC_DNS_SIZE : match_length));
-        substring[match_length] = '\0';
         
-        RTE_LOG(FINER, EXTRACTOR, "attempt ioc match against substring %d: %s\n",
-            match_index, substring);
+        RTE_LOG(FINER, EXTRACTOR, "attempt ioc match against substring %d: %.*s\n",
+            match_index, match_length, match[0].data);
         
-        iptr = ss_ioc_syslog_match(substring, re_entry->ioc_type);
+        iptr = ss_ioc_syslog_match(match[0].data, (size_t) match_length, re_entry->ioc_type);
         if (iptr) {
-            RTE_LOG(FINE, EXTRACTOR, "successful ioc match for syslog rule %s against substring %s\n",
-                re_entry->name, substring);
+            RTE_LOG(FINE, EXTRACTOR, "successful ioc match for syslog rule %s against substring %.*s\n",
+                re_entry->name, match_length, match[0].data);
             have_match = 1;
             re_match->ioc_entry = iptr;
             return 1;
         }
         ++match_index;
+        
+        // step past empty matches so the loop always advances
+        if (match[0].length == 0) match[0].length = 1;
+        
+        if (re_entry->match_max && (uint32_t) match_index >= re_entry->match_max) {
+            RTE_LOG(DEBUG, EXTRACTOR, "abort substring match after %d substrings against syslog rule %s\n",
+                match_index, re_entry->name);
+            ++re_entry->stats[rte_lcore_id()].max_aborts;
+            return 0;
+        }
     } while (match_flag > 0 && !have_match);
     
     end_loop:
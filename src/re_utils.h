@@ -4,6 +4,7 @@
 
 #include <bsd/sys/queue.h>
 
+#include <rte_lcore.h>
 #include <rte_memory.h>
 
 #include <pcre.h>
@@ -11,11 +12,16 @@
 
 #include "ioc.h"
 #include "nn_queue.h"
+#include "re_literal.h"
+#include "syslog.h"
 
 /* CONSTANTS */
 
 #define SS_RE_MATCH_MAX  (16 * 3)
 
+#define SS_RE_MATCH_LIMIT_DEFAULT 100000 // match_limit, pcre steps per evaluation
+#define SS_RE_MATCH_MAX_DEFAULT      256 // match_max, substrings examined per message
+
 /* RE CHAIN */
 
 enum ss_re_type_e {
@@ -36,6 +42,20 @@ enum ss_re_backend_e {
 
 typedef enum ss_re_backend_e ss_re_backend_t;
 
+/* per-lcore counters, kept apart to avoid cache line bouncing */
+struct ss_re_stats_s {
+    uint64_t prefilter_hits;
+    uint64_t prefilter_skips;
+    uint64_t calls;
+    uint64_t matches;
+    uint64_t limit_aborts; // pcre hit match_limit
+    uint64_t max_aborts;   // substring loop hit match_max
+    uint64_t cycles;
+    uint64_t cycles_max;
+} __rte_cache_aligned;
+
+typedef struct ss_re_stats_s ss_re_stats_t;
+
 struct ss_re_entry_s {
     uint64_t matches;
     int inverted;
@@ -48,11 +68,28 @@ struct ss_re_entry_s {
     
     cre2_regexp_t* re2_re;
     
+    // longest literal every match must contain, lowercased if nocase
+    int     nocase;
+    size_t  literal_length;
+    uint8_t literal[SS_RE_LITERAL_MAX];
+    
+    // TSC accounting and runaway evaluation budget
+    int      profile;
+    uint32_t match_limit;
+    uint32_t match_max;
+    
     ss_ioc_type_t ioc_type;
     
+    // part of the parsed syslog message the rule runs against
+    ss_syslog_field_t field;
+    char* sd_id;
+    char* sd_name;
+    
     nn_queue_t nn_queue;
     char* name;
     
+    ss_re_stats_t stats[RTE_MAX_LCORE];
+    
     TAILQ_ENTRY(ss_re_entry_s) entry;
 } __rte_cache_aligned;
 
@@ -85,8 +122,14 @@ int ss_re_chain_add(ss_re_entry_t* re_entry);
 int ss_re_chain_remove_index(int index);
 int ss_re_chain_remove_name(char* name);
 ss_re_entry_t* ss_re_entry_create(json_object* re_json);
+int ss_re_entry_prepare_field(json_object* re_json, ss_re_entry_t* re_entry);
 int ss_re_entry_destroy(ss_re_entry_t* re_entry);
-int ss_re_chain_match(ss_re_match_t* re_match, uint8_t* l4_offset, uint16_t l4_length);
+int ss_re_entry_prepare_literal(json_object* re_json, ss_re_entry_t* re_entry);
+int ss_re_entry_prepare_budget(json_object* re_json, ss_re_entry_t* re_entry);
+int ss_re_chain_stats_dump(void);
+int ss_re_chain_prefilter(ss_re_entry_t* re_entry, uint8_t* l4_offset, uint16_t l4_length);
+int ss_re_chain_match_entry(ss_re_match_t* re_match, ss_re_entry_t* re_entry, uint8_t* l4_offset, uint16_t l4_length);
+int ss_re_chain_match(ss_re_match_t* re_match, ss_syslog_t* syslog, uint8_t* l4_offset, uint16_t l4_length);
 int ss_re_entry_prepare_pcre(json_object* re_json, ss_re_entry_t* re_entry);
 int ss_re_chain_match_pcre(ss_re_match_t* re_match, ss_re_entry_t* re_entry, uint8_t* l4_offset, uint16_t l4_length);
 int ss_re_chain_match_pcre_complete(ss_re_match_t* re_match, ss_re_entry_t* re_entry, uint8_t* l4_offset, uint16_t l4_length);
@@ -31,13 +31,19 @@
 #include <pcap/pcap.h>
 
 #include "common.h"
+#include "dns_tcp.h"
 #include "dpdk.h"
+#include "egress.h"
 #include "ethernet.h"
+#include "flow.h"
 #include "je_utils.h"
+#include "journal.h"
+#include "log.h"
 #include "re_utils.h"
 #include "sdn_sensor.h"
 #include "sensor_conf.h"
 #include "sflow_cb.h"
+#include "sink.h"
 #include "tcp.h"
 
 /* GLOBAL VARIABLES */
@@ -48,6 +54,8 @@ rte_mempool_t* ss_pool[SOCKET_COUNT] = { NULL };
 
 /* ethernet addresses of ports */
 struct ether_addr port_eth_addrs[RTE_MAX_ETHPORTS];
+// ports whose TX queues were set up to compute IPv4 / TCP checksums
+uint8_t port_tx_cksum_offload[RTE_MAX_ETHPORTS];
 
 static mbuf_table_entry_t mbuf_table[RTE_MAX_ETHPORTS][RTE_MAX_LCORE];
 
@@ -57,6 +65,12 @@ static rte_timer_t          power_timers[RTE_MAX_LCORE] __rte_cache_aligned;
 
 static uint8_t port_count = 0;
 
+// set from SIGUSR1 to dump statistics without waiting for timer_cycles
+static volatile sig_atomic_t stats_requested = 0;
+
+// set from the fatal signal handler: the lcores leave their loops, then main shuts down
+static volatile sig_atomic_t stop_signal = 0;
+
 // http://www.ndsl.kaist.edu/~kyoungsoo/papers/TR-symRSS.pdf
 static uint8_t rss_key[] = {
     0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
@@ -155,6 +169,15 @@ int ss_send_packet(rte_mbuf_t* mbuf, uint8_t port_id, uint16_t lcore_id) {
 static void ss_timer_callback(uint16_t lcore_id, uint64_t* timer_tsc) {
     uint8_t port_id;
 
+    // every lcore runs the tcp socket deadlines in its own shard,
+    // ahead of the drain so delayed ACKs leave on this tick
+    ss_tcp_timer_callback(lcore_id);
+    ss_dns_tcp_timer_callback(lcore_id);
+    ss_flow_timer_callback(lcore_id);
+    // after the flow records, so expired ones leave on this tick too;
+    // with egress threads they own the batches instead
+    if (!ss_conf->egress_enabled) ss_nn_queue_timer_callback(lcore_id);
+
     for (port_id = 0; port_id < RTE_MAX_ETHPORTS; port_id++) {
         //RTE_LOG(INFO, SS, "attempt send for port %d\n", port_id);
         if (mbuf_table[port_id][lcore_id].length == 0) {
@@ -166,6 +189,20 @@ static void ss_timer_callback(uint16_t lcore_id, uint64_t* timer_tsc) {
         mbuf_table[port_id][lcore_id].length = 0;
     }
 
+    if (unlikely(stats_requested) && lcore_id == rte_get_master_lcore()) {
+        stats_requested = 0;
+        ss_port_stats_print(port_statistics, port_count);
+        ss_re_chain_stats_dump();
+        ss_tcp_stats_dump();
+        ss_dns_tcp_stats_dump();
+        ss_flow_stats_dump();
+        ss_nn_queue_stats_dump();
+        ss_egress_stats_dump();
+        ss_journal_stats_dump();
+        ss_sink_stats_dump();
+        ss_log_stats_dump();
+    }
+
     // return if statistics timer is not ready yet
     if (likely(*timer_tsc < ss_conf->timer_cycles)) return;
 
@@ -175,8 +212,16 @@ static void ss_timer_callback(uint16_t lcore_id, uint64_t* timer_tsc) {
     double elapsed = *timer_tsc / (double) rte_get_tsc_hz();
     RTE_LOG(NOTICE, SS, "call ss_port_stats_print after %011.6f secs.\n", elapsed);
     ss_port_stats_print(port_statistics, port_count);
+    ss_re_chain_stats_dump();
+    ss_tcp_stats_dump();
+    ss_dns_tcp_stats_dump();
+    ss_flow_stats_dump();
+    ss_nn_queue_stats_dump();
+    ss_egress_stats_dump();
+    ss_journal_stats_dump();
+    ss_sink_stats_dump();
+    ss_log_stats_dump();
 
-    ss_tcp_timer_callback();
     sflow_timer_callback();
 
     *timer_tsc = 0;
@@ -287,7 +332,7 @@ int ss_power_irq_handle() {
 
     RTE_LOG(INFO, SS, "lcore_id %u sleeping for irq...\n", rte_lcore_id());
 
-    rv = rte_epoll_wait(RTE_EPOLL_PER_THREAD, event, port_count, -1);
+    rv = rte_epoll_wait(RTE_EPOLL_PER_THREAD, event, port_count, LCORE_IRQ_WAIT_MSECS);
     for (int i = 0; i < rv; i++) {
         data = event[i].epdata.data;
         port_id  = ((uintptr_t) data) >> CHAR_BIT & 0x0ff;
@@ -302,14 +347,15 @@ int ss_power_irq_handle() {
 }
 
 /* main processing loop */
-int ss_main_loop(__attribute__((unused)) void* arg) __attribute__ ((noreturn)) {
+int ss_main_loop(__attribute__((unused)) void* arg) {
     rte_mbuf_t* mbufs[BURST_PACKETS_MAX];
+    ss_flow_t* flows[BURST_PACKETS_MAX];
     rte_mbuf_t* mbuf;
     ss_queue_statistics_t queue_statistics[RTE_MAX_ETHPORTS];
 
     uint16_t lcore_id;
     uint16_t socket_id;
-    uint64_t prev_tsc, diff_tsc, curr_tsc, timer_tsc;
+    uint64_t prev_tsc, diff_tsc, curr_tsc, timer_tsc, rx_tsc;
     uint64_t prev_tsc_power, curr_tsc_power, diff_tsc_power;
     uint64_t drain_tsc = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S * BURST_TX_DRAIN_USECS;
     unsigned int rx_count;
@@ -342,7 +388,7 @@ int ss_main_loop(__attribute__((unused)) void* arg) __attribute__ ((noreturn)) {
 
     prev_tsc = 0;
 
-    while (1) {
+    while (likely(!stop_signal)) {
         core_statistics[lcore_id].loop_iterations++;
 
         curr_tsc = rte_rdtsc();
@@ -395,13 +441,21 @@ start_rx:
 
             port_statistics[port_id].rx += rx_count;
 
+            // one arrival time for the whole burst
+            rx_tsc = rte_rdtsc();
+
+            // prefetches the headers and finds the flows for the whole burst
+            ss_flow_burst(lcore_id, (uint8_t) port_id, mbufs, flows, rx_count);
+
             for (i = 0; i < rx_count; i++) {
                 mbuf = mbufs[i];
-                rte_prefetch0(rte_pktmbuf_mtod(mbuf, void *));
-                ss_frame_handle(mbuf, lcore_id, port_id);
+                ss_frame_handle(mbuf, flows[i], rx_tsc, lcore_id, port_id);
             }
         }
 
+        // one ACK per connection for the whole burst
+        ss_tcp_ack_flush(lcore_id, 0);
+
         if (likely(idle_count != port_count)) {
             for (port_id = 1, freq_hint = queue_statistics[0].freq_hint; port_id < port_count; ++port_id) {
                 if (queue_statistics[port_id].freq_hint > freq_hint) {
@@ -441,10 +495,22 @@ start_rx:
         }
     }
 
-    //return 0;
+    RTE_LOG(INFO, SS, "leaving main loop on lcore_id %u\n", lcore_id);
+    return 0;
 }
 
+/*
+ * Only async-signal-safe work here: the lcores see the flag and leave
+ * their loops, and main runs ss_shutdown once they all have. A second
+ * signal finds the default action back (SA_RESETHAND) and ends the
+ * process at once.
+ */
 void ss_fatal_signal_handler(int signal) {
+    stop_signal = signal;
+}
+
+/* from main, with every lcore out of its loop and the helper threads still running */
+void ss_shutdown(int signal) {
     int rv;
 
     fprintf(stderr, "received fatal signal %d...\n", signal);
@@ -464,6 +530,11 @@ void ss_fatal_signal_handler(int signal) {
             fprintf(stderr, "could not disable librte_power on lcore_id %d", lcore_id);
         }
     }
+    // nothing may send on the queues ss_conf_destroy tears down
+    ss_egress_stop();
+    ss_journal_stop();
+    ss_sink_stop();
+    ss_log_stop();
     ss_conf_destroy();
     kill(getpid(), signal);
 }
@@ -485,6 +556,27 @@ void ss_signal_handler_init(const char* signal_name, int signal) {
     }
 }
 
+void ss_stats_signal_handler(int signal) {
+    stats_requested = 1;
+}
+
+void ss_stats_signal_handler_init() {
+    int rv;
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+
+    sa.sa_handler = &ss_stats_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags   = SA_RESTART;
+
+    rv = sigaction(SIGUSR1, &sa, NULL);
+    if (rv) {
+        fprintf(stderr, "warning: could not install SIGUSR1 handler: rv %d: %s\n",
+            rv, strerror(errno));
+    }
+}
+
 int main(int argc, char* argv[]) {
     struct rte_eth_dev_info dev_info;
     int rv;
@@ -560,6 +652,16 @@ int main(int argc, char* argv[]) {
 
     rte_timer_subsystem_init();
 
+    rv = ss_clock_init();
+    if (rv) {
+        rte_exit(EXIT_FAILURE, "could not initialize clock\n");
+    }
+
+    rv = ss_log_init();
+    if (rv) {
+        rte_exit(EXIT_FAILURE, "could not initialize logging\n");
+    }
+
     /* create the mbuf pool */
     for (int i = 0; i < SOCKET_COUNT; ++i) {
         snprintf(pool_name, sizeof(pool_name), "mbuf_pool_socket_%02d", i);
@@ -586,11 +688,36 @@ int main(int argc, char* argv[]) {
         rte_exit(EXIT_FAILURE, "could not initialize tcp protocol\n");
     }
 
+    rv = ss_dns_tcp_init();
+    if (rv) {
+        rte_exit(EXIT_FAILURE, "could not initialize dns over tcp\n");
+    }
+
+    rv = ss_flow_init();
+    if (rv) {
+        rte_exit(EXIT_FAILURE, "could not initialize flow cache\n");
+    }
+
     rv = sflow_init();
     if (rv) {
         rte_exit(EXIT_FAILURE, "could not initialize sflow protocol\n");
     }
 
+    rv = ss_egress_init();
+    if (rv) {
+        rte_exit(EXIT_FAILURE, "could not initialize egress threads\n");
+    }
+
+    rv = ss_journal_start();
+    if (rv) {
+        rte_exit(EXIT_FAILURE, "could not initialize journal thread\n");
+    }
+
+    rv = ss_sink_start();
+    if (rv) {
+        rte_exit(EXIT_FAILURE, "could not initialize sink thread\n");
+    }
+
     lcore_count = (uint16_t) rte_lcore_count();
     port_count = rte_eth_dev_count();
     RTE_LOG(NOTICE, SS, "lcore_count %d port_count %d\n", lcore_count, port_count);
@@ -611,6 +738,7 @@ int main(int argc, char* argv[]) {
     ss_signal_handler_init("SIGPIPE", SIGPIPE);
     ss_signal_handler_init("SIGTERM", SIGTERM);
     ss_signal_handler_init("SIGBUS",  SIGBUS);
+    ss_stats_signal_handler_init();
 
     last_port = 0;
 
@@ -619,6 +747,17 @@ int main(int argc, char* argv[]) {
     for (port_id = 0; port_id < port_count; ++port_id) {
         rte_eth_dev_info_get(port_id, &dev_info);
 
+        /* offload TX checksums when the port can do both IPv4 and TCP */
+        struct rte_eth_txconf port_tx_conf = tx_conf;
+        port_tx_cksum_offload[port_id] = ss_conf->tx_checksum_offload &&
+            (dev_info.tx_offload_capa & DEV_TX_OFFLOAD_IPV4_CKSUM) &&
+            (dev_info.tx_offload_capa & DEV_TX_OFFLOAD_TCP_CKSUM);
+        if (port_tx_cksum_offload[port_id]) {
+            port_tx_conf.txq_flags &= ~ETH_TXQ_FLAGS_NOXSUMTCP;
+        }
+        RTE_LOG(INFO, SS, "port %u: tx checksum offload %s\n",
+            (unsigned) port_id, port_tx_cksum_offload[port_id] ? "enabled" : "disabled");
+
         /* Configure port */
         RTE_LOG(INFO, SS, "initializing port %u...\n", (unsigned) port_id);
         fflush(stderr);
@@ -647,7 +786,7 @@ int main(int argc, char* argv[]) {
             fflush(stderr);
             rv = rte_eth_tx_queue_setup(
                 port_id, lcore_id /*queue_id*/, ss_conf->txd_count,
-                u_eth_socket_id, &tx_conf);
+                u_eth_socket_id, &port_tx_conf);
             if (rv < 0) {
                 rte_exit(EXIT_FAILURE, "rte_eth_tx_queue_setup: error: port: %u lcore_id: %d error: %d\n", port_id, lcore_id, rv);
             }
@@ -706,5 +845,7 @@ int main(int argc, char* argv[]) {
             return -1;
     }
 
+    // the lcores only return once a fatal signal asked them to
+    ss_shutdown(stop_signal);
     return 0;
 }
@@ -68,6 +68,7 @@
 
 #define LCORE_SLEEP_USECS       1
 #define LCORE_SUSPEND_USECS     300
+#define LCORE_IRQ_WAIT_MSECS    100 // rx irq sleep, bounded so the lcore sees a stop request
 
 /* GLOBAL VARIABLES */
 
@@ -75,6 +76,7 @@ extern pcap_t*        ss_pcap;
 extern ss_conf_t*     ss_conf;
 extern rte_mempool_t* ss_pool[SOCKET_COUNT];
 extern struct ether_addr port_eth_addrs[];
+extern uint8_t port_tx_cksum_offload[];
 
 /* STRUCTURES */
 
@@ -148,7 +150,10 @@ int ss_power_irq_enable(uint16_t lcore_id);
 int ss_power_irq_handle(void);
 int ss_main_loop(void* arg);
 void ss_fatal_signal_handler(int signal);
+void ss_shutdown(int signal);
 void ss_signal_handler_init(const char* signal_name, int signal);
+void ss_stats_signal_handler(int signal);
+void ss_stats_signal_handler_init(void);
 int main(int argc, char* argv[]);
 
 /* END PROTOTYPES */
@@ -4,6 +4,7 @@
 #include <limits.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
@@ -27,8 +28,10 @@
 #include "common.h"
 #include "ip_utils.h"
 #include "json.h"
+#include "log.h"
 #include "sdn_sensor.h"
 #include "sensor_conf.h"
+#include "tcp.h"
 
 #define PROGRAM_PATH "/proc/self/exe"
 #define CONF_PATH "/../conf/sdn_sensor.json"
@@ -52,6 +55,7 @@ int ss_conf_destroy() {
     ss_dns_chain_destroy();
     ss_re_chain_destroy();
     ss_ioc_chain_destroy();
+    if (ss_conf->flow_export_enabled) ss_nn_queue_destroy(&ss_conf->flow_export);
 
     // XXX: destroy ss_ioc_entry_t* tables
 
@@ -218,6 +222,121 @@ int ss_conf_network_parse(json_object* items) {
         }
         ss_conf->mtu = (uint16_t) json_object_get_int(item);
     }
+    ss_conf->tcp_message_max = L4_TCP_MESSAGE_MAX;
+    item = ss_json_object_get(items, "tcp_message_max");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+            fprintf(stderr, "tcp_message_max is not positive int\n");
+            return -1;
+        }
+        ss_conf->tcp_message_max = (uint32_t) SS_MIN(json_object_get_int64(item), L4_TCP_MESSAGE_MAX);
+    }
+    ss_conf->tcp_socket_max = L4_TCP_SOCKET_MAX;
+    item = ss_json_object_get(items, "tcp_socket_max");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+            fprintf(stderr, "tcp_socket_max is not positive int\n");
+            return -1;
+        }
+        ss_conf->tcp_socket_max = (uint32_t) SS_MIN(json_object_get_int64(item), UINT32_MAX);
+    }
+    ss_conf->tcp_ooo_mbufs = L4_TCP_OOO_POOL_SIZE;
+    item = ss_json_object_get(items, "tcp_ooo_mbufs");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+            fprintf(stderr, "tcp_ooo_mbufs is not positive int\n");
+            return -1;
+        }
+        // every clone pins an rx mbuf, too many of them starve the ports
+        if (json_object_get_int64(item) > MBUF_COUNT / L4_TCP_OOO_MBUF_SHARE) {
+            fprintf(stderr, "tcp_ooo_mbufs is more than %d, 1/%d of the rx mbufs\n",
+                MBUF_COUNT / L4_TCP_OOO_MBUF_SHARE, L4_TCP_OOO_MBUF_SHARE);
+            return -1;
+        }
+        ss_conf->tcp_ooo_mbufs = (uint32_t) json_object_get_int64(item);
+    }
+    ss_conf->dns_tcp_stream_max = L4_DNS_TCP_STREAM_MAX;
+    item = ss_json_object_get(items, "dns_tcp_stream_max");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+            fprintf(stderr, "dns_tcp_stream_max is not positive int\n");
+            return -1;
+        }
+        ss_conf->dns_tcp_stream_max = (uint32_t) SS_MIN(json_object_get_int64(item), UINT32_MAX);
+    }
+    ss_conf->tcp_ack_delay_msec = L4_TCP_ACK_DELAY_MSEC;
+    item = ss_json_object_get(items, "tcp_ack_delay_msec");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) < 0) {
+            fprintf(stderr, "tcp_ack_delay_msec is not non-negative int\n");
+            return -1;
+        }
+        // RFC 1122 4.2.3.2: the delay MUST be less than 0.5 seconds
+        ss_conf->tcp_ack_delay_msec = (uint32_t) SS_MIN(json_object_get_int64(item), 500);
+    }
+    // 0 turns either SYN cookie limit off, see ss_tcp_syn_cookie_wanted
+    ss_conf->tcp_syn_backlog = L4_TCP_SYN_BACKLOG;
+    item = ss_json_object_get(items, "tcp_syn_backlog");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) < 0) {
+            fprintf(stderr, "tcp_syn_backlog is not non-negative int\n");
+            return -1;
+        }
+        ss_conf->tcp_syn_backlog = (uint32_t) SS_MIN(json_object_get_int64(item), UINT32_MAX);
+    }
+    ss_conf->tcp_syn_source_max = L4_TCP_SYN_SOURCE_MAX;
+    item = ss_json_object_get(items, "tcp_syn_source_max");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) < 0) {
+            fprintf(stderr, "tcp_syn_source_max is not non-negative int\n");
+            return -1;
+        }
+        ss_conf->tcp_syn_source_max = (uint32_t) SS_MIN(json_object_get_int64(item), UINT32_MAX);
+    }
+    ss_conf->flow_max = L4_FLOW_MAX;
+    item = ss_json_object_get(items, "flow_max");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+            fprintf(stderr, "flow_max is not positive int\n");
+            return -1;
+        }
+        ss_conf->flow_max = (uint32_t) SS_MIN(json_object_get_int64(item), UINT32_MAX);
+    }
+    ss_conf->flow_idle_timeout = L4_FLOW_IDLE_SECONDS;
+    item = ss_json_object_get(items, "flow_idle_timeout");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+            fprintf(stderr, "flow_idle_timeout is not positive int\n");
+            return -1;
+        }
+        ss_conf->flow_idle_timeout = (uint32_t) SS_MIN(json_object_get_int64(item), UINT32_MAX);
+    }
+    ss_conf->flow_active_timeout = L4_FLOW_ACTIVE_SECONDS;
+    item = ss_json_object_get(items, "flow_active_timeout");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+            fprintf(stderr, "flow_active_timeout is not positive int\n");
+            return -1;
+        }
+        ss_conf->flow_active_timeout = (uint32_t) SS_MIN(json_object_get_int64(item), UINT32_MAX);
+    }
+    rv = ss_conf_tcp_timeouts_parse(ss_json_object_get(items, "tcp_timeouts"));
+    if (rv) return -1;
+    rv = ss_conf_netflow_tcp_ports_parse(ss_json_object_get(items, "netflow_tcp_ports"));
+    if (rv) return -1;
+    ss_conf->syslog_framing = SS_TCP_FRAMING_EMPTY;
+    item = ss_json_object_get(items, "syslog_framing");
+    if (item) {
+        if (!json_object_is_type(item, json_type_string)) {
+            fprintf(stderr, "syslog_framing is not string\n");
+            return -1;
+        }
+        ss_conf->syslog_framing = ss_tcp_framing_load(json_object_get_string(item));
+        if ((int) ss_conf->syslog_framing == -1) {
+            fprintf(stderr, "invalid syslog_framing %s\n", json_object_get_string(item));
+            return -1;
+        }
+    }
     item = ss_json_object_get(items, "ipv4_address");
     if (item) {
         if (!json_object_is_type(item, json_type_string)) {
@@ -277,6 +396,116 @@ int ss_conf_network_parse(json_object* items) {
     return 0;
 }
 
+/* one tcp_timeouts value in seconds; an absent key keeps *value */
+static int ss_conf_tcp_timeout_get(json_object* items, const char* port, const char* key, int64_t minimum, uint32_t* value) {
+    json_object* item = ss_json_object_get(items, key);
+    int64_t seconds;
+
+    if (item == NULL) return 0;
+    if (!json_object_is_type(item, json_type_int)) {
+        fprintf(stderr, "tcp_timeouts %s %s is not int\n", port, key);
+        return -1;
+    }
+    seconds = json_object_get_int64(item);
+    if (seconds < minimum || seconds > L4_TCP_TIMEOUT_MAX) {
+        fprintf(stderr, "tcp_timeouts %s %s %ld is not between %ld and %d seconds\n",
+            port, key, seconds, minimum, L4_TCP_TIMEOUT_MAX);
+        return -1;
+    }
+    *value = (uint32_t) seconds;
+    return 0;
+}
+
+/*
+ * "tcp_timeouts": { "default": { ... }, "601": { ... } }
+ * Ports inherit unset values from "default", which inherits the built-ins.
+ */
+int ss_conf_tcp_timeouts_parse(json_object* items) {
+    ss_tcp_timeouts_t* timeouts = &ss_conf->tcp_timeouts[0];
+    json_object* defaults;
+    char* end;
+    long port;
+
+    timeouts->port              = 0;
+    timeouts->syn_timeout       = L4_TCP_SYN_SECONDS;
+    timeouts->idle_timeout      = L4_TCP_EXPIRED_SECONDS;
+    timeouts->time_wait_timeout = L4_TCP_TIME_WAIT_SECONDS;
+    ss_conf->tcp_timeouts_count = 1;
+
+    if (items == NULL) return 0;
+    if (!json_object_is_type(items, json_type_object)) {
+        fprintf(stderr, "tcp_timeouts is not object\n");
+        return -1;
+    }
+
+    defaults = ss_json_object_get(items, "default");
+    if (defaults) {
+        if (ss_conf_tcp_timeout_get(defaults, "default", "syn_timeout",       1, &timeouts->syn_timeout))       return -1;
+        if (ss_conf_tcp_timeout_get(defaults, "default", "idle_timeout",      1, &timeouts->idle_timeout))      return -1;
+        if (ss_conf_tcp_timeout_get(defaults, "default", "time_wait_timeout", 0, &timeouts->time_wait_timeout)) return -1;
+    }
+
+    json_object_object_foreach(items, key, value) {
+        if (!strcmp(key, "default")) continue;
+        port = strtol(key, &end, 10);
+        if (*end || port <= 0 || port > UINT16_MAX || !json_object_is_type(value, json_type_object)) {
+            fprintf(stderr, "invalid tcp_timeouts port %s\n", key);
+            return -1;
+        }
+        if (ss_conf->tcp_timeouts_count >= L4_TCP_TIMEOUTS_MAX) {
+            fprintf(stderr, "too many tcp_timeouts ports, max %d\n", L4_TCP_TIMEOUTS_MAX - 1);
+            return -1;
+        }
+        timeouts = &ss_conf->tcp_timeouts[ss_conf->tcp_timeouts_count++];
+        *timeouts      = ss_conf->tcp_timeouts[0];
+        timeouts->port = (uint16_t) port;
+        if (ss_conf_tcp_timeout_get(value, key, "syn_timeout",       1, &timeouts->syn_timeout))       return -1;
+        if (ss_conf_tcp_timeout_get(value, key, "idle_timeout",      1, &timeouts->idle_timeout))      return -1;
+        if (ss_conf_tcp_timeout_get(value, key, "time_wait_timeout", 0, &timeouts->time_wait_timeout)) return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * "netflow_tcp_ports": [ 2055, 4739, ... ]
+ * TCP ports whose streams are framed as IPFIX; unset means the NetFlow
+ * and IPFIX well-known ports.
+ */
+int ss_conf_netflow_tcp_ports_parse(json_object* items) {
+    static const uint16_t defaults[] = { L4_PORT_NETFLOW_1, L4_PORT_IPFIX, L4_PORT_NETFLOW_2, L4_PORT_NETFLOW_3 };
+    json_object* item;
+    int64_t port;
+
+    if (items == NULL) {
+        memcpy(ss_conf->netflow_tcp_ports, defaults, sizeof(defaults));
+        ss_conf->netflow_tcp_ports_count = RTE_DIM(defaults);
+        return 0;
+    }
+
+    if (!json_object_is_type(items, json_type_array)) {
+        fprintf(stderr, "netflow_tcp_ports is not an array\n");
+        return -1;
+    }
+    if (json_object_array_length(items) > L4_NETFLOW_TCP_PORTS_MAX) {
+        fprintf(stderr, "netflow_tcp_ports has more than %d ports\n", L4_NETFLOW_TCP_PORTS_MAX);
+        return -1;
+    }
+
+    ss_conf->netflow_tcp_ports_count = 0;
+    for (int i = 0; i < json_object_array_length(items); ++i) {
+        item = json_object_array_get_idx(items, i);
+        port = json_object_is_type(item, json_type_int) ? json_object_get_int64(item) : 0;
+        if (port <= 0 || port > UINT16_MAX) {
+            fprintf(stderr, "netflow_tcp_ports entry %d is not a port\n", i);
+            return -1;
+        }
+        ss_conf->netflow_tcp_ports[ss_conf->netflow_tcp_ports_count++] = (uint16_t) port;
+    }
+
+    return 0;
+}
+
 int ss_conf_dpdk_parse(json_object* items) {
     int64_t rv;
     json_object* item = NULL;
@@ -349,6 +578,18 @@ int ss_conf_dpdk_parse(json_object* items) {
     else {
         ss_conf->rss_enabled = 1;
     }
+
+    item = ss_json_object_get(items, "tx_checksum_offload");
+    if (item) {
+        if (!json_object_is_type(item, json_type_boolean)) {
+            fprintf(stderr, "tx_checksum_offload is not boolean\n");
+            return -1;
+        }
+        ss_conf->tx_checksum_offload = json_object_get_boolean(item);
+    }
+    else {
+        ss_conf->tx_checksum_offload = 1;
+    }
     
     rv = (int64_t) ss_conf_tsc_hz_get();
     if (rv == ~0) return -1;
@@ -421,6 +662,74 @@ int ss_conf_dpdk_parse(json_object* items) {
         ss_conf->log_level = RTE_LOG_WARNING;
     }
     
+    ss_conf->log_rate = SS_LOG_RATE_DEFAULT;
+    item = ss_json_object_get(items, "log_rate");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) < 0) {
+            fprintf(stderr, "log_rate is not non-negative int\n");
+            return -1;
+        }
+        ss_conf->log_rate = (uint32_t) SS_MIN(json_object_get_int64(item), UINT32_MAX);
+    }
+    ss_conf->log_burst = SS_LOG_BURST_DEFAULT;
+    item = ss_json_object_get(items, "log_burst");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+            fprintf(stderr, "log_burst is not positive int\n");
+            return -1;
+        }
+        ss_conf->log_burst = (uint32_t) SS_MIN(json_object_get_int64(item), UINT32_MAX);
+    }
+    
+    return 0;
+}
+
+int ss_conf_egress_parse(json_object* items) {
+    json_object* item;
+    char* value;
+    
+    ss_conf->egress_threads = SS_EGRESS_THREADS_DEFAULT;
+    item = ss_json_object_get(items, "threads");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+            fprintf(stderr, "egress threads is not positive int\n");
+            return -1;
+        }
+        ss_conf->egress_threads = (uint32_t) SS_MIN(json_object_get_int64(item), SS_EGRESS_THREADS_MAX);
+    }
+    ss_conf->egress_ring_size = SS_EGRESS_RING_SIZE;
+    item = ss_json_object_get(items, "ring_size");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+            fprintf(stderr, "egress ring_size is not positive int\n");
+            return -1;
+        }
+        ss_conf->egress_ring_size = (uint32_t) SS_MIN(json_object_get_int64(item), SS_EGRESS_RING_SIZE_MAX);
+    }
+    ss_conf->egress_ring_bytes = SS_EGRESS_RING_BYTES;
+    item = ss_json_object_get(items, "ring_bytes");
+    if (item) {
+        if (!json_object_is_type(item, json_type_int) || json_object_get_int64(item) <= 0) {
+            fprintf(stderr, "egress ring_bytes is not positive int\n");
+            return -1;
+        }
+        ss_conf->egress_ring_bytes = (uint64_t) json_object_get_int64(item);
+    }
+    ss_conf->egress_policy = SS_EGRESS_DROP_NEWEST;
+    if (ss_json_object_get(items, "policy")) {
+        value = ss_json_string_get(items, "policy");
+        if (value == NULL) return -1;
+        if      (!strcasecmp(value, "drop_newest")) ss_conf->egress_policy = SS_EGRESS_DROP_NEWEST;
+        else if (!strcasecmp(value, "drop_oldest")) ss_conf->egress_policy = SS_EGRESS_DROP_OLDEST;
+        else {
+            fprintf(stderr, "unknown egress policy %s\n", value);
+            je_free(value);
+            return -1;
+        }
+        je_free(value);
+    }
+    
+    ss_conf->egress_enabled = 1;
     return 0;
 }
 
@@ -500,6 +809,21 @@ ss_conf_t* ss_conf_file_parse(char* conf_path) {
         is_ok = 0; goto error_out;
     }
     
+    // ahead of the queues, nm_journal needs egress
+    items = ss_json_object_get(ss_conf->json, "egress");
+    if (items) {
+        is_ok = json_object_is_type(items, json_type_object);
+        if (!is_ok) {
+            fprintf(stderr, "egress is not an object\n");
+            goto error_out;
+        }
+        rv = ss_conf_egress_parse(items);
+        if (rv) {
+            fprintf(stderr, "could not parse egress configuration\n");
+            is_ok = 0; goto error_out;
+        }
+    }
+    
     items = ss_json_object_get(ss_conf->json, "re_chain");
     if (items) {
         is_ok = json_object_is_type(items, json_type_array);
@@ -589,6 +913,25 @@ ss_conf_t* ss_conf_file_parse(char* conf_path) {
         }
     }
     
+    items = ss_json_object_get(ss_conf->json, "flow_export");
+    if (items) {
+        is_ok = json_object_is_type(items, json_type_object);
+        if (!is_ok) {
+            fprintf(stderr, "flow_export is not an object\n");
+            goto error_out;
+        }
+        rv = ss_nn_queue_create(items, &ss_conf->flow_export);
+        if (rv) {
+            fprintf(stderr, "could not create flow_export nm_queue\n");
+            is_ok = 0; goto error_out;
+        }
+        ss_conf->flow_export_enabled = 1;
+        if (ss_conf->flow_export.format != NN_FORMAT_METADATA) {
+            fprintf(stderr, "flow_export nm_format must be metadata\n");
+            is_ok = 0; goto error_out;
+        }
+    }
+    
     // XXX: do more stuff
     error_out:
     if (conf_buffer)        { je_free(conf_buffer);       conf_buffer = NULL; }
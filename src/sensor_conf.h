@@ -9,6 +9,7 @@
 #include <json-c/json_object_private.h>
 
 #include "common.h"
+#include "egress.h"
 #include "ip_utils.h"
 #include "ioc.h"
 #include "re_utils.h"
@@ -20,6 +21,21 @@ struct ss_conf_s {
     // options
     int promiscuous_mode;
     uint16_t mtu;
+    uint32_t tcp_message_max;
+    uint32_t tcp_socket_max;
+    uint32_t tcp_ack_delay_msec;
+    uint32_t tcp_ooo_mbufs;
+    uint32_t dns_tcp_stream_max;
+    uint16_t netflow_tcp_ports[L4_NETFLOW_TCP_PORTS_MAX];
+    uint32_t netflow_tcp_ports_count;
+    uint32_t tcp_syn_backlog;
+    uint32_t tcp_syn_source_max;
+    uint32_t flow_max;
+    uint32_t flow_idle_timeout;
+    uint32_t flow_active_timeout;
+    ss_tcp_framing_t syslog_framing;
+    uint32_t tcp_timeouts_count;
+    ss_tcp_timeouts_t tcp_timeouts[L4_TCP_TIMEOUTS_MAX];
     
     ip_addr_t ip4_address;
     ip_addr_t ip4_gateway;
@@ -28,10 +44,13 @@ struct ss_conf_s {
     
     char* eal_options;
     uint32_t log_level;
+    uint32_t log_rate;
+    uint32_t log_burst;
     uint32_t port_mask;
     uint16_t rxd_count;
     uint16_t txd_count;
     int      rss_enabled;
+    int      tx_checksum_offload;
     uint64_t timer_cycles;
     
     wordexp_t eal_vector;
@@ -43,15 +62,24 @@ struct ss_conf_s {
     ss_dns_chain_t dns_chain;
     ss_re_chain_t re_chain;
     
+    int flow_export_enabled;
+    nn_queue_t flow_export;
+    
+    int egress_enabled;
+    uint32_t egress_threads;
+    uint32_t egress_ring_size;
+    uint64_t egress_ring_bytes;
+    ss_egress_policy_t egress_policy;
+    
     uint64_t ioc_file_id;
     ss_ioc_file_t ioc_files[SS_IOC_FILE_MAX];
     ss_ioc_chain_t ioc_chain;
     
     ss_ioc_entry_t* ip4_table;
     ss_ioc_entry_t* ip6_table;
-    ss_ioc_entry_t* domain_table;
-    ss_ioc_entry_t* url_table;
-    ss_ioc_entry_t* email_table;
+    ss_ioc_str_table_t domain_table;
+    ss_ioc_str_table_t url_table;
+    ss_ioc_str_table_t email_table;
     
     rte_lpm4_t* cidr4;
     rte_lpm6_t* cidr6;
@@ -71,7 +99,10 @@ uint64_t ss_conf_tsc_read(void);
 uint64_t ss_conf_tsc_hz_get(void);
 char* ss_conf_file_read(char* conf_path);
 int ss_conf_network_parse(json_object* items);
+int ss_conf_tcp_timeouts_parse(json_object* items);
+int ss_conf_netflow_tcp_ports_parse(json_object* items);
 int ss_conf_dpdk_parse(json_object* items);
+int ss_conf_egress_parse(json_object* items);
 ss_conf_t* ss_conf_file_parse(char* conf_path);
 int ss_conf_ioc_file_parse(void);
 
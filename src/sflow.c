@@ -14,6 +14,7 @@
 #include <rte_log.h>
 
 #include "common.h"
+#include "log.h"
 #include "sflow.h"
 #include "sflow_cb.h"
 #include "sflow_utils.h"
@@ -467,7 +468,7 @@ void sflow_read_extended_gateway(sflow_sample_t* sample) {
                 as_number = sflow_get_data_32(sample);
                 /* mark the first one as the dst_peer_as */
                 if (i == 0 && seg == 0) sample->dst_peer_as = as_number;
-                else printf("-");
+                else sflow_log(sample, "-");
                 /* make sure the AS sets are in parentheses */
                 if (i == 0 && seg_type == SFLOW_EXTENDED_AS_SET) sflow_log(sample, "(");
                 sflow_log(sample, "%u", as_number);
@@ -493,8 +494,8 @@ void sflow_read_extended_gateway(sflow_sample_t* sample) {
     if (sample->communities_len > 0) {
         for (uint32_t j = 0; j < sample->communities_len; j++) {
             if (j == 0) sflow_log(sample, "bgp_communities ");
-            else printf("-");
-            printf("%u", ntohl(sample->communities[j]));
+            else sflow_log(sample, "-");
+            sflow_log(sample, "%u", ntohl(sample->communities[j]));
         }
         sflow_log(sample, "\n");
     }
@@ -530,7 +531,7 @@ void sflow_read_mpls_label_stack(sflow_sample_t* sample, char* field_name) {
     if (label_stack.depth > 0) {
         for (uint32_t j = 0; j < label_stack.depth; j++) {
             if (j == 0) sflow_log(sample, "%s ", field_name);
-            else printf("-");
+            else sflow_log(sample, "-");
             label = ntohl(label_stack.stack[j]);
             sflow_log(sample, "%u.%u.%u.%u",
                     (label >> 12),     /* label */
@@ -622,7 +623,7 @@ void sflow_read_extended_vlan_tunnel(sflow_sample_t* sample) {
     if (label_stack.depth > 0) {
         for (uint32_t j = 0; j < label_stack.depth; j++) {
             if (j == 0) sflow_log(sample, "vlan_tunnel ");
-            else printf("-");
+            else sflow_log(sample, "-");
             lab = ntohl(label_stack.stack[j]);
             sflow_log(sample, "0x%04x.%u.%u.%u",
                     (lab >> 16),       /* TPI */
@@ -652,8 +653,8 @@ void sflow_read_extended_wifi_rx(sflow_sample_t* sample) {
 
     bssid = sample->offset8;
     sflow_log(sample, "rx_BSSID ");
-    for (i = 0; i < 6; i++) printf("%02x", bssid[i]);
-    printf("\n");
+    for (i = 0; i < 6; i++) sflow_log(sample, "%02x", bssid[i]);
+    sflow_log(sample, "\n");
     sflow_skip_bytes(sample, 6);
 
     sflow_log_next_32(sample, "rx_version");
@@ -675,8 +676,8 @@ void sflow_read_extended_wifi_tx(sflow_sample_t* sample) {
 
     bssid = sample->offset8;
     sflow_log(sample, "tx_BSSID ");
-    for (i = 0; i < 6; i++) printf("%02x", bssid[i]);
-    printf("\n");
+    for (i = 0; i < 6; i++) sflow_log(sample, "%02x", bssid[i]);
+    sflow_log(sample, "\n");
     sflow_skip_bytes(sample, 6);
 
     sflow_log_next_32(sample, "tx_version");
@@ -708,7 +709,7 @@ void sflow_read_header(sflow_sample_t* sample) {
     sample->header.bytes = sample->offset8;
     sflow_skip_bytes(sample, sample->header.header_size);
 
-    if (rte_get_log_level() >= RTE_LOG_FINEST) {
+    if (SS_LOG_ENABLED(FINEST)) {
         rte_hexdump(stderr, "header_bytes", sample->header.bytes, sample->header.header_size);
     }
 
@@ -746,11 +747,11 @@ void sflow_read_header(sflow_sample_t* sample) {
         case SFLOW_HEADER_IEEE80211_AMPDU:
         case SFLOW_HEADER_IEEE80211_AMSDU_SUBFRAME: {
             // XXX: what to do?
-            RTE_LOG(ERR, EXTRACTOR, "skip decoding obscure header protocol: %u\n", sample->header.protocol);
+            SS_LOG(ERR, EXTRACTOR, "skip decoding obscure header protocol: %u\n", sample->header.protocol);
             break;
         }
         default: {
-            RTE_LOG(ERR, EXTRACTOR, "undefined header protocol: %u\n", sample->header.protocol);
+            SS_LOG(ERR, EXTRACTOR, "undefined header protocol: %u\n", sample->header.protocol);
             // XXX: what to do?
             break;
         }
@@ -1046,7 +1047,7 @@ void sflow_read_flow_sample(sflow_sample_t* sample, bool is_expanded, uint32_t s
 
     uint32_t e_index = 0;
     for (; e_index < elements; e_index++) {
-        RTE_LOG(FINE, EXTRACTOR, "read flow element %u/%u\n", e_index + 1, elements);
+        SS_LOG(FINE, EXTRACTOR, "read flow element %u/%u\n", e_index + 1, elements);
         sample->data_format = sflow_get_data_32(sample);
         uint32_t length = sflow_get_data_32(sample);
         uint8_t* start = sample->offset8;
@@ -1102,7 +1103,7 @@ void sflow_read_flow_sample(sflow_sample_t* sample, bool is_expanded, uint32_t s
 
     // called once after all sample elements are processed
     if (sflow_sample_cb) {
-        RTE_LOG(FINER, EXTRACTOR, "invoke sflow_sample_cb on flow sample id: %02d\n", s_index);
+        SS_LOG(FINER, EXTRACTOR, "invoke sflow_sample_cb on flow sample id: %02d\n", s_index);
         sflow_sample_cb(sample, s_index, e_index);
     }
 
@@ -1396,13 +1397,13 @@ void sflow_read_counters_sample(sflow_sample_t* sample, bool is_expanded, uint32
     elements = sflow_get_data_32(sample);
 
     for (uint32_t e_index = 0; e_index < elements; e_index++) {
-        RTE_LOG(FINER, EXTRACTOR, "read counter element %u/%u\n", e_index + 1, elements);
+        SS_LOG(FINER, EXTRACTOR, "read counter element %u/%u\n", e_index + 1, elements);
         sample->data_format = sflow_get_data_32(sample);
         uint32_t length = sflow_get_data_32(sample);
         uint8_t* start = sample->offset8;
         //sflow_log(sample, "counter_block_tag mhall %s\n", sflow_tag_dump(sample->data_format));
 
-        if (rte_get_log_level() >= RTE_LOG_FINEST) {
+        if (SS_LOG_ENABLED(FINEST)) {
             rte_hexdump(stderr, "counter_bytes", start, length);
         }
 
@@ -1449,7 +1450,7 @@ void sflow_read_counters_sample(sflow_sample_t* sample, bool is_expanded, uint32
         sample->offset8 = start + length;
         // called once after for each sample element
         if (sflow_sample_cb) {
-            RTE_LOG(FINER, EXTRACTOR, "invoke sflow_sample_cb on counter sample id: %02d element id: %02d\n", s_index, e_index);
+            SS_LOG(FINER, EXTRACTOR, "invoke sflow_sample_cb on counter sample id: %02d element id: %02d\n", s_index, e_index);
             sflow_sample_cb(sample, s_index, e_index);
         }
     }
@@ -1462,7 +1463,7 @@ void sflow_read_datagram(sflow_sample_t* sample) {
     /* check the version */
     sample->sflow_version = sflow_get_data_32(sample);
     if (sample->sflow_version != SFLOW_VERSION_5) {
-        RTE_LOG(ERR, EXTRACTOR, "unexpected datagram version number: %u\n",
+        SS_LOG(ERR, EXTRACTOR, "unexpected datagram version number: %u\n",
             sample->sflow_version);
         rte_hexdump(stderr, "sflow_unknown_version_bytes", sample->raw_sample, (uint32_t) sample->raw_sample_len);
     }
@@ -1477,12 +1478,12 @@ void sflow_read_datagram(sflow_sample_t* sample) {
     sample->sys_up_time = sflow_get_data_32(sample);
     samples = sflow_get_data_32(sample);
 
-    RTE_LOG(FINER, EXTRACTOR, "start new sflow datagram\n");
+    SS_LOG(FINER, EXTRACTOR, "start new sflow datagram\n");
     /* now iterate and pull out the flows and counters samples */
     for (uint32_t s_index = 0; s_index < samples; s_index++) {
-        RTE_LOG(FINER, EXTRACTOR, "read sample %u / %u\n", s_index + 1, samples);
+        SS_LOG(FINER, EXTRACTOR, "read sample %u / %u\n", s_index + 1, samples);
         if (sample->offset8 >= sample->end8) {
-            RTE_LOG(ERR, EXTRACTOR, "unexpected end of datagram after sample %u/%u\n", s_index, samples);
+            SS_LOG(ERR, EXTRACTOR, "unexpected end of datagram after sample %u/%u\n", s_index, samples);
             rte_hexdump(stderr, "sflow_corrupt_payload_bytes", sample->raw_sample, (uint32_t) sample->raw_sample_len);
         }
         /* just read the tag, then call the approriate decode fn */
@@ -1504,7 +1505,7 @@ void sflow_read_datagram(sflow_sample_t* sample) {
             }
             default: {
                 uint32_t skip_length = sflow_get_data_32(sample);
-                RTE_LOG(ERR, EXTRACTOR, "unknown sample type: %u of size: %u\n", sample->sample_type, skip_length);
+                SS_LOG(ERR, EXTRACTOR, "unknown sample type: %u of size: %u\n", sample->sample_type, skip_length);
                 sflow_skip_tlv(sample, sample->sample_type, skip_length, "unknown_sample");
                 break;
             }
@@ -1,11 +1,14 @@
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <time.h>
 
 #include <rte_byteorder.h>
 #include <rte_cycles.h>
 #include <rte_hash_crc.h>
+#include <rte_lcore.h>
 #include <rte_log.h>
 #include <rte_rwlock.h>
 
@@ -19,6 +22,7 @@
 #include "ip_utils.h"
 #include "je_utils.h"
 #include "json.h"
+#include "log.h"
 #include "metadata.h"
 #include "nn_queue.h"
 #include "sdn_sensor.h"
@@ -51,7 +55,7 @@ int sflow_init() {
 
     sflow_hash = rte_hash_create(&sflow_hash_params);
     if (sflow_hash == NULL) {
-        RTE_LOG(ERR, L3L4, "could not initialize sflow socket hash\n");
+        SS_LOG(ERR, L3L4, "could not initialize sflow socket hash\n");
         return -1;
     }
 
@@ -78,7 +82,7 @@ int sflow_timer_callback() {
     }
     rte_rwlock_write_unlock(&sflow_hash_lock);
 
-    RTE_LOG(NOTICE, L3L4, "deleted %d expired sflow sockets\n", expired_sockets);
+    SS_LOG(NOTICE, L3L4, "deleted %d expired sflow sockets\n", expired_sockets);
     return 0;
 }
 
@@ -140,7 +144,7 @@ sflow_socket_t* sflow_socket_create(sflow_key_t* key, ss_frame_t* rx_buf) {
     error_out:
     if (unlikely(is_error)) {
         if (socket) { je_free(socket); socket = NULL; }
-        RTE_LOG(ERR, L3L4, "failed to allocate sflow socket\n");
+        SS_LOG(ERR, L3L4, "failed to allocate sflow socket\n");
         return NULL;
     }
 
@@ -170,7 +174,7 @@ sflow_socket_t* sflow_socket_lookup(sflow_key_t* key) {
     rte_rwlock_read_unlock(&sflow_hash_lock);
     sflow_socket_t* socket = ((int32_t) socket_id) < 0 ? NULL : sflow_sockets[socket_id];
     if (socket) {
-        RTE_LOG(DEBUG, L3L4, "found socket at id: %u\n", socket_id);
+        SS_LOG(DEBUG, L3L4, "found socket at id: %u\n", socket_id);
     }
     return socket;
 }
@@ -189,7 +193,7 @@ void sflow_sample_callback(sflow_sample_t* sample, uint32_t s_index, uint32_t e_
     char* data_format = sflow_sample_format_dump(sample->sample_type, sample->data_format);
     char* ds_type     = sflow_ds_type_dump(sample->ds_type);
 
-    RTE_LOG(INFO, EXTRACTOR, "sample_meta %u/%u:\n"
+    SS_LOG(INFO, EXTRACTOR, "sample_meta %u/%u:\n"
            "    agent_ip %s sub_id %u\n"
            "    packet_seq_num %u\n"
            "    sys_up_time %u\n"
@@ -217,7 +221,7 @@ void sflow_sample_callback(sflow_sample_t* sample, uint32_t s_index, uint32_t e_
         sample->sample_type == SFLOW_COUNTERS_SAMPLE_EXPANDED) {
         
         if (sample->counters_type != SFLOW_COUNTERS_GENERIC) {
-            RTE_LOG(NOTICE, EXTRACTOR, "skip counters_type: %s\n",
+            SS_LOG(NOTICE, EXTRACTOR, "skip counters_type: %s\n",
                 sflow_counters_format_dump(sample->counters_type));
             return;
         }
@@ -242,7 +246,7 @@ void sflow_flow_sample_callback(sflow_sample_t* sample, sflow_sampled_header_t*
     char nat_src_ip[SS_IPV6_STR_MAX];
     char nat_dst_ip[SS_IPV6_STR_MAX];
 
-    RTE_LOG(INFO, EXTRACTOR, "flow_sample_meta %u/%u:\n"
+    SS_LOG(INFO, EXTRACTOR, "flow_sample_meta %u/%u:\n"
            "    sample_rate %u\n"
            "    sample_pool %u\n"
            "    drop_count %u\n"
@@ -255,7 +259,7 @@ void sflow_flow_sample_callback(sflow_sample_t* sample, sflow_sampled_header_t*
         sflow_port_id_dump(sample->input_port_format, sample->input_port),
         sflow_port_id_dump(sample->output_port_format, sample->output_port));
 
-    RTE_LOG(INFO, EXTRACTOR, "header_meta %u/%u:\n"
+    SS_LOG(INFO, EXTRACTOR, "header_meta %u/%u:\n"
            "    protocol %s\n"
            "    packet_size %u\n"
            "    stripped_size %u\n"
@@ -272,7 +276,7 @@ void sflow_flow_sample_callback(sflow_sample_t* sample, sflow_sampled_header_t*
     sflow_ip_string(&sample->nat_src_ip, nat_src_ip, sizeof(nat_src_ip));
     sflow_ip_string(&sample->nat_dst_ip, nat_dst_ip, sizeof(nat_dst_ip));
 
-    RTE_LOG(INFO, EXTRACTOR, "header_data: %u/%u\n"
+    SS_LOG(INFO, EXTRACTOR, "header_data: %u/%u\n"
            "    smac %s\n"
            "    dmac %s\n"
            "    rx_vlan %u\n"
@@ -318,11 +322,15 @@ void sflow_flow_sample_callback(sflow_sample_t* sample, sflow_sampled_header_t*
     iptr = ss_ioc_sflow_match(sample);
     if (iptr) {
         // match
-        RTE_LOG(NOTICE, EXTRACTOR, "successful sflow ioc match from sample\n");
+        SS_LOG(NOTICE, EXTRACTOR, "successful sflow ioc match from sample\n");
         ss_ioc_entry_dump_dpdk(iptr);
         nn_queue_t* nn_queue = &ss_conf->ioc_files[iptr->file_id].nn_queue;
+        // a sample has no frame of its own for NN_FORMAT_PACKET queues
+        if (nn_queue->format != NN_FORMAT_METADATA) return;
+        if (!ss_nn_queue_wants(nn_queue, NN_EVENT_IOC)) return;
         // XXX: fill in something useful in rule field
         metadata = ss_metadata_prepare_sflow("sflow_ioc", NULL, nn_queue, sample, iptr);
+        if (metadata == NULL) return;
         // XXX: for now assume the output is C char*
         mlength = strlen((char*) metadata);
         //printf("metadata: %s\n", metadata);
@@ -361,7 +369,7 @@ uint8_t* ss_metadata_prepare_sflow(
 
     jobject = json_object_new_object();
     if (jobject == NULL) {
-        RTE_LOG(ERR, EXTRACTOR, "could not allocate sflow json object\n");
+        SS_LOG(ERR, EXTRACTOR, "could not allocate sflow json object\n");
         goto error_out;
     }
 
@@ -551,7 +559,7 @@ uint8_t* ss_metadata_prepare_sflow(
     return rv;
     
     error_out:
-    fprintf(stderr, "could not serialize sflow metadata\n");
+    SS_LOG(ERR, EXTRACTOR, "could not serialize sflow metadata\n");
     if (rv)      { je_free(rv); rv = NULL; }
     if (jobject) { json_object_put(jobject); jobject = NULL; }
     if (item)    { json_object_put(item);    item = NULL;    }
@@ -562,8 +570,8 @@ uint8_t* ss_metadata_prepare_sflow(
 void sflow_counter_sample_callback(sflow_sample_t* sample, sflow_if_counters_t* if_counters, uint32_t s_index, uint32_t e_index) {
     sflow_if_counters_t c;
 
-    if (rte_get_log_level() >= RTE_LOG_FINE) {    
-        RTE_LOG(INFO, EXTRACTOR, "if_counters %u/%u:\n"
+    if (SS_LOG_ENABLED(FINE)) {    
+        SS_LOG(INFO, EXTRACTOR, "if_counters %u/%u:\n"
                "    skipped\n",
             s_index, e_index);
         return;
@@ -591,7 +599,7 @@ void sflow_counter_sample_callback(sflow_sample_t* sample, sflow_if_counters_t*
     c.ifOutErrors        = be32(if_counters->ifOutErrors);
     c.ifPromiscuousMode  = be32(if_counters->ifPromiscuousMode);
 
-    RTE_LOG(FINE, EXTRACTOR, "if_counters %u/%u:\n"
+    SS_LOG(FINE, EXTRACTOR, "if_counters %u/%u:\n"
            "    ifIndex %u\n"
            "    ifType %u\n"
            "    ifSpeed %lu\n"
@@ -633,19 +641,42 @@ void sflow_counter_sample_callback(sflow_sample_t* sample, sflow_if_counters_t*
            c.ifPromiscuousMode);
 }
 
+/* sflow_log callers print lines in pieces, so each lcore collects one until its newline */
+static char   sflow_log_lines[RTE_MAX_LCORE][SS_LOG_LINE_MAX];
+static size_t sflow_log_lengths[RTE_MAX_LCORE];
+
 void sflow_log(sflow_sample_t* sample, char* fmt, ...) __attribute__ ((__format__ (__printf__, 2, 3))) {
-    /* scripts like to have all the context on every line */
-    printf("%s %u %u %u:%u %s %s ",
-            "mhall",// sflow_ip_string(&sample->agent_ip),
-            sample->agent_sub_id,
-            sample->packet_seq_num,
-            sample->ds_type,
-            sample->ds_index,
-            sflow_tag_dump(sample->sample_type),
-            sflow_tag_dump(sample->data_format));
+    unsigned int lcore_id = rte_lcore_id();
+    char* line;
+    size_t* length;
     va_list args;
+    int rv;
+
+    if (!SS_LOG_ENABLED(DEBUG) || lcore_id >= RTE_MAX_LCORE) return;
+    line   = sflow_log_lines[lcore_id];
+    length = &sflow_log_lengths[lcore_id];
+
+    /* scripts like to have all the context on every line */
+    if (*length == 0) {
+        rv = snprintf(line, SS_LOG_LINE_MAX, "%s %u %u %u:%u %s %s ",
+                "mhall",// sflow_ip_string(&sample->agent_ip),
+                sample->agent_sub_id,
+                sample->packet_seq_num,
+                sample->ds_type,
+                sample->ds_index,
+                sflow_tag_dump(sample->sample_type),
+                sflow_tag_dump(sample->data_format));
+        *length = SS_MIN((size_t) SS_MAX(rv, 0), SS_LOG_LINE_MAX - 1);
+    }
     va_start(args, fmt);
-    vprintf(fmt, args);
+    rv = vsnprintf(line + *length, SS_LOG_LINE_MAX - *length, fmt, args);
+    va_end(args);
+    *length = SS_MIN(*length + (size_t) SS_MAX(rv, 0), SS_LOG_LINE_MAX - 1);
+
+    if (*length == SS_LOG_LINE_MAX - 1 || (*length && line[*length - 1] == '\n')) {
+        SS_LOG(DEBUG, EXTRACTOR, "%s", line);
+        *length = 0;
+    }
 }
 
 static const char* sflow_http_method_names[] = { "-", "OPTIONS", "GET", "HEAD", "POST", "PUT", "DELETE", "TRACE", "CONNECT" };
@@ -654,7 +685,7 @@ void sflow_log_clf(sflow_sample_t* sample, char* auth_user, char* uri, uint32_t
     time_t now = time(NULL);
     char now_str[200];
     strftime(now_str, sizeof(now_str), "%d/%b/%Y:%H:%M:%S %z", localtime(&now));
-    printf("%s - %s [%s] \"%s %s HTTP/%u.%u\" %u %lu \"%s\" \"%s\"",
+    SS_LOG(DEBUG, EXTRACTOR, "%s - %s [%s] \"%s %s HTTP/%u.%u\" %u %lu \"%s\" \"%s\"\n",
         sample->client,
         auth_user[0] ? auth_user : "-",
         now_str,
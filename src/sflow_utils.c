@@ -14,6 +14,7 @@
 
 #include "common.h"
 #include "ip_utils.h"
+#include "log.h"
 #include "sflow.h"
 #include "sflow_cb.h"
 #include "sflow_utils.h"
@@ -115,7 +116,7 @@ uint64_t sflow_get_data_64(sflow_sample_t* sample) {
 
 void sflow_skip_bytes(sflow_sample_t* sample, size_t bytes) {
     size_t words = (bytes + 3) / 4;
-    RTE_LOG(FINER, UTILS, "increment offset32 by %lu words\n", words);
+    SS_LOG(FINER, UTILS, "increment offset32 by %lu words\n", words);
     sample->offset32 += words;
     if (bytes > sample->raw_sample_len || sample->offset8 > sample->end8) {
         // XXX: safety check here???
@@ -423,7 +424,7 @@ char* sflow_counters_status_dump(uint32_t ifStatus) {
 }
 
 void sflow_skip_tlv(sflow_sample_t* sample, uint32_t tag, uint32_t len, char *description) {
-    RTE_LOG(INFO, EXTRACTOR, "skipping unknown item %s of type %s and length %u\n",
+    SS_LOG(INFO, EXTRACTOR, "skipping unknown item %s of type %s and length %u\n",
         description, sflow_tag_dump(tag), len);
     sflow_skip_bytes(sample, len);
 }
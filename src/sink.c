@@ -0,0 +1,613 @@
+#define _GNU_SOURCE /* pthread_setname_np */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <bsd/string.h>
+#include <bsd/sys/queue.h>
+
+#include <lzma.h>
+
+#include <rte_atomic.h>
+#include <rte_branch_prediction.h>
+#include <rte_byteorder.h>
+#include <rte_common.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_memcpy.h>
+
+#include <jemalloc/jemalloc.h>
+
+#include "common.h"
+#include "log.h"
+#include "sink.h"
+
+#define SS_SINK_NS_PER_SEC 1000000000ULL
+#define SS_SINK_XZ_BUFFER   (64 << 10) // each half of xz_buffer
+
+/*
+ * Every open sink, for the sink thread. The lock only covers membership:
+ * producers never take it, the thread holds it to step to the next sink,
+ * and the config load and teardown to add and remove them. Sinks are
+ * only closed while the thread is not running, and the list only changes
+ * while no lcore runs, so the thread works on a sink, and the stats dump
+ * walks the list, without it.
+ */
+static TAILQ_HEAD(ss_sink_list_s, ss_sink_s) sink_list = TAILQ_HEAD_INITIALIZER(sink_list);
+static pthread_mutex_t sink_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t sink_thread;
+static int sink_started;
+static volatile int sink_stopping;
+
+static const uint8_t sink_pad[4] = { 0, 0, 0, 0 };
+
+const char* ss_sink_format_dump(ss_sink_format_t format) {
+    switch (format) {
+        case SS_SINK_NDJSON: return "ndjson";
+        case SS_SINK_PCAP:   return "pcap";
+        case SS_SINK_PCAPNG: return "pcapng";
+        default:             return "unknown";
+    }
+}
+
+/* SS_SINK_FORMAT_MAX when the name is unknown */
+ss_sink_format_t ss_sink_format_parse(const char* name) {
+    if      (!strcasecmp(name, "ndjson")) return SS_SINK_NDJSON;
+    else if (!strcasecmp(name, "pcap"))   return SS_SINK_PCAP;
+    else if (!strcasecmp(name, "pcapng")) return SS_SINK_PCAPNG;
+    return SS_SINK_FORMAT_MAX;
+}
+
+const char* ss_sink_compress_dump(ss_sink_compress_t compress) {
+    switch (compress) {
+        case SS_SINK_COMPRESS_NONE: return "none";
+        case SS_SINK_COMPRESS_XZ:   return "xz";
+        default:                    return "unknown";
+    }
+}
+
+/* SS_SINK_COMPRESS_MAX when the name is unknown */
+ss_sink_compress_t ss_sink_compress_parse(const char* name) {
+    if      (!strcasecmp(name, "none")) return SS_SINK_COMPRESS_NONE;
+    else if (!strcasecmp(name, "xz"))   return SS_SINK_COMPRESS_XZ;
+    return SS_SINK_COMPRESS_MAX;
+}
+
+static uint64_t ss_sink_now(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t) now.tv_sec * SS_SINK_NS_PER_SEC + (uint64_t) now.tv_nsec;
+}
+
+static const char* ss_sink_extension(ss_sink_format_t format) {
+    switch (format) {
+        case SS_SINK_NDJSON: return "ndjson";
+        case SS_SINK_PCAP:   return "pcap";
+        case SS_SINK_PCAPNG: return "pcapng";
+        default:             return "out";
+    }
+}
+
+/*
+ * Opens the sink for files named <prefix>.<UTC time>.<sequence>.<format>.
+ * The directory must exist; the first file is only created with the
+ * first record.
+ */
+ss_sink_t* ss_sink_open(const char* prefix, ss_sink_conf_t* conf) {
+    ss_sink_t* sink;
+    char directory[PATH_MAX];
+
+    strlcpy(directory, prefix, sizeof(directory));
+    if (access(dirname(directory), W_OK)) {
+        fprintf(stderr, "nm_file directory of %s is not writable: %s\n", prefix, strerror(errno));
+        return NULL;
+    }
+
+    sink = je_calloc(1, sizeof(ss_sink_t));
+    if (sink == NULL) goto error_out;
+    strlcpy(sink->prefix, prefix, sizeof(sink->prefix));
+    sink->conf              = *conf;
+    sink->conf.buffer_bytes = rte_align32pow2(conf->buffer_bytes);
+    sink->fd                = -1;
+    sink->xz_in             = -1;
+    sink->xz_out            = -1;
+    TAILQ_INIT(&sink->closed);
+    sink->rings = je_calloc(RTE_MAX_LCORE, sizeof(ss_sink_ring_t*));
+    if (sink->rings == NULL) goto error_out;
+    if (sink->conf.compress == SS_SINK_COMPRESS_XZ) {
+        sink->xz_buffer = je_malloc(2 * SS_SINK_XZ_BUFFER);
+        if (sink->xz_buffer == NULL) goto error_out;
+    }
+
+    pthread_mutex_lock(&sink_list_lock);
+    TAILQ_INSERT_TAIL(&sink_list, sink, entry);
+    pthread_mutex_unlock(&sink_list_lock);
+    fprintf(stderr, "opened nm_file %s format %s\n", sink->prefix, ss_sink_format_dump(sink->conf.format));
+    return sink;
+
+    error_out:
+    fprintf(stderr, "could not allocate nm_file %s\n", prefix);
+    if (sink) {
+        je_free(sink->rings);
+        je_free(sink);
+    }
+    return NULL;
+}
+
+static ss_sink_ring_t* ss_sink_ring_get(ss_sink_t* sink, unsigned int lcore_id) {
+    ss_sink_ring_t* ring = sink->rings[lcore_id];
+
+    if (likely(ring != NULL)) return ring;
+
+    ring = je_calloc(1, sizeof(ss_sink_ring_t) + sink->conf.buffer_bytes);
+    if (ring == NULL) return NULL;
+    ring->size = sink->conf.buffer_bytes;
+    // the ring must be set up before the sink thread sees it
+    rte_smp_wmb();
+    sink->rings[lcore_id] = ring;
+    return ring;
+}
+
+static void ss_sink_ring_put(ss_sink_ring_t* ring, uint64_t* head, const void* data, uint32_t length) {
+    uint64_t offset = *head & (ring->size - 1);
+    uint32_t first  = (uint32_t) SS_MIN(length, ring->size - offset);
+
+    rte_memcpy(ring->data + offset, data, first);
+    if (first < length) rte_memcpy(ring->data, (const uint8_t*) data + first, length - first);
+    *head += length;
+}
+
+/*
+ * Copies one message into the ring of lcore_id, as the record of the
+ * sink's format. Packet messages are read back from their
+ * nn_packet_header_t, for the rx timestamp and the lengths.
+ */
+int ss_sink_write(ss_sink_t* sink, const uint8_t* message, uint32_t length, unsigned int lcore_id) {
+    const nn_packet_header_t* packet = (const nn_packet_header_t*) message;
+    ss_sink_ring_t* ring;
+    ss_sink_pcap_record_t record;
+    ss_sink_pcapng_epb_t block;
+    const uint8_t* frame = message;
+    uint32_t frame_length = length;
+    uint32_t need;
+    uint32_t pad = 0;
+    uint64_t timestamp;
+    uint64_t head;
+
+    // every sender is an EAL lcore
+    if (unlikely(lcore_id >= RTE_MAX_LCORE || (ring = ss_sink_ring_get(sink, lcore_id)) == NULL)) return -1;
+
+    switch (sink->conf.format) {
+        case SS_SINK_NDJSON: {
+            need = length + 1;
+            break;
+        }
+        case SS_SINK_PCAP:
+        case SS_SINK_PCAPNG: {
+            if (length < sizeof(nn_packet_header_t) || rte_be_to_cpu_16(packet->header_length) > length) {
+                ++ring->dropped;
+                return -1;
+            }
+            frame        = message + rte_be_to_cpu_16(packet->header_length);
+            frame_length = (uint32_t) SS_MIN(rte_be_to_cpu_16(packet->snap_length), length - rte_be_to_cpu_16(packet->header_length));
+            timestamp    = rte_be_to_cpu_64(packet->timestamp);
+            if (sink->conf.format == SS_SINK_PCAP) {
+                record.ts_sec  = (uint32_t) (timestamp / SS_SINK_NS_PER_SEC);
+                record.ts_nsec = (uint32_t) (timestamp % SS_SINK_NS_PER_SEC);
+                record.caplen  = frame_length;
+                record.len     = rte_be_to_cpu_32(packet->orig_length);
+                need = (uint32_t) sizeof(record) + frame_length;
+            }
+            else {
+                pad  = (4 - (frame_length & 3)) & 3;
+                need = (uint32_t) sizeof(block) + frame_length + pad + (uint32_t) sizeof(uint32_t);
+                block.type         = SS_SINK_PCAPNG_EPB;
+                block.total_length = need;
+                block.interface_id = 0;
+                block.ts_high      = (uint32_t) (timestamp >> 32);
+                block.ts_low       = (uint32_t) timestamp;
+                block.caplen       = frame_length;
+                block.len          = rte_be_to_cpu_32(packet->orig_length);
+            }
+            break;
+        }
+        default: return -1;
+    }
+
+    head = ring->head;
+    if (unlikely(ring->size - (head - ring->tail) < need)) {
+        ++ring->dropped;
+        return -1;
+    }
+    switch (sink->conf.format) {
+        case SS_SINK_NDJSON: {
+            ss_sink_ring_put(ring, &head, message, length);
+            ss_sink_ring_put(ring, &head, "\n", 1);
+            break;
+        }
+        case SS_SINK_PCAP: {
+            ss_sink_ring_put(ring, &head, &record, sizeof(record));
+            ss_sink_ring_put(ring, &head, frame, frame_length);
+            break;
+        }
+        default: {
+            ss_sink_ring_put(ring, &head, &block, sizeof(block));
+            ss_sink_ring_put(ring, &head, frame, frame_length);
+            ss_sink_ring_put(ring, &head, sink_pad, pad);
+            ss_sink_ring_put(ring, &head, &need, sizeof(need));
+            break;
+        }
+    }
+    // the record must be in the ring before the head which covers it
+    rte_smp_wmb();
+    ring->head = head;
+    ++ring->records;
+    return (int) length;
+}
+
+static int ss_sink_file_write(ss_sink_t* sink, const void* data, size_t length) {
+    const uint8_t* next = data;
+    ssize_t rv;
+
+    while (length) {
+        rv = write(sink->fd, next, length);
+        if (rv < 0 && errno == EINTR) continue;
+        if (rv <= 0) return -1;
+        next           += rv;
+        length         -= (size_t) rv;
+        sink->length   += (uint64_t) rv;
+        sink->stats.bytes += (uint64_t) rv;
+    }
+    return 0;
+}
+
+static void ss_sink_file_open(ss_sink_t* sink, uint64_t now) {
+    ss_sink_pcap_header_t pcap;
+    ss_sink_pcapng_shb_t shb;
+    ss_sink_pcapng_idb_t idb;
+    time_t seconds = (time_t) (now / SS_SINK_NS_PER_SEC);
+    struct tm tm;
+    char stamp[32];
+    int rv = 0;
+
+    gmtime_r(&seconds, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%SZ", &tm);
+    snprintf(sink->path, sizeof(sink->path), "%s.%s.%04lu.%s",
+        sink->prefix, stamp, sink->sequence++ % 10000, ss_sink_extension(sink->conf.format));
+    sink->fd = open(sink->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (sink->fd < 0) {
+        RTE_LOG(ERR, SS, "could not create nm_file %s: %s\n", sink->path, strerror(errno));
+        return;
+    }
+    sink->length    = 0;
+    sink->opened_ns = now;
+    ++sink->stats.files;
+
+    switch (sink->conf.format) {
+        case SS_SINK_PCAP: {
+            memset(&pcap, 0, sizeof(pcap));
+            pcap.magic         = SS_SINK_PCAP_MAGIC_NSEC;
+            pcap.version_major = 2;
+            pcap.version_minor = 4;
+            pcap.snaplen       = sink->conf.snaplen;
+            pcap.network       = SS_SINK_LINKTYPE_ETHERNET;
+            rv = ss_sink_file_write(sink, &pcap, sizeof(pcap));
+            break;
+        }
+        case SS_SINK_PCAPNG: {
+            shb.type                 = SS_SINK_PCAPNG_SHB;
+            shb.total_length         = sizeof(shb);
+            shb.byte_order           = SS_SINK_PCAPNG_BYTE_ORDER;
+            shb.version_major        = 1;
+            shb.version_minor        = 0;
+            shb.section_length       = -1;
+            shb.total_length_trailer = sizeof(shb);
+            memset(&idb, 0, sizeof(idb));
+            idb.type                 = SS_SINK_PCAPNG_IDB;
+            idb.total_length         = sizeof(idb);
+            idb.linktype             = SS_SINK_LINKTYPE_ETHERNET;
+            idb.snaplen              = sink->conf.snaplen;
+            idb.tsresol_code         = 9;
+            idb.tsresol_length       = 1;
+            idb.tsresol              = 9;
+            idb.total_length_trailer = sizeof(idb);
+            rv = ss_sink_file_write(sink, &shb, sizeof(shb));
+            if (rv == 0) rv = ss_sink_file_write(sink, &idb, sizeof(idb));
+            break;
+        }
+        default: break;
+    }
+    if (rv) ++sink->stats.write_errors;
+}
+
+/* rotation: the file is done, and queued up for xz if the sink wants it */
+static void ss_sink_file_close(ss_sink_t* sink) {
+    ss_sink_closed_t* closed;
+
+    if (sink->fd < 0) return;
+    close(sink->fd);
+    sink->fd = -1;
+    if (sink->conf.compress == SS_SINK_COMPRESS_NONE) return;
+
+    closed = je_calloc(1, sizeof(ss_sink_closed_t));
+    if (closed == NULL) {
+        ++sink->stats.compress_errors;
+        return;
+    }
+    strlcpy(closed->path, sink->path, sizeof(closed->path));
+    TAILQ_INSERT_TAIL(&sink->closed, closed, entry);
+}
+
+/* writes out what the rings hold, returns the bytes taken from them */
+static uint64_t ss_sink_drain(ss_sink_t* sink, uint64_t now) {
+    ss_sink_ring_t* ring;
+    uint64_t head;
+    uint64_t offset;
+    uint64_t length;
+    uint64_t total = 0;
+
+    for (unsigned int lcore_id = 0; lcore_id < RTE_MAX_LCORE; ++lcore_id) {
+        ring = sink->rings[lcore_id];
+        if (ring == NULL) continue;
+        head = ring->head;
+        // read the records only after the head which covers them
+        rte_smp_rmb();
+        while (ring->tail != head) {
+            offset = ring->tail & (ring->size - 1);
+            length = SS_MIN(head - ring->tail, ring->size - offset);
+            if (sink->fd < 0) ss_sink_file_open(sink, now);
+            // on a write error the records are lost, the ring must move on
+            if (sink->fd < 0 || ss_sink_file_write(sink, ring->data + offset, length)) ++sink->stats.write_errors;
+            ring->tail += length;
+            total      += length;
+        }
+    }
+    return total;
+}
+
+static void ss_sink_rotate(ss_sink_t* sink, uint64_t now) {
+    if (sink->fd < 0) return;
+    if (sink->length < sink->conf.rotate_bytes && now - sink->opened_ns < sink->conf.rotate_secs * SS_SINK_NS_PER_SEC) return;
+    ss_sink_file_close(sink);
+}
+
+static void ss_sink_compress_end(ss_sink_t* sink, int ok) {
+    ss_sink_closed_t* closed = TAILQ_FIRST(&sink->closed);
+    char path[PATH_MAX];
+
+    lzma_end(&sink->xz);
+    close(sink->xz_in);
+    close(sink->xz_out);
+    sink->xz_in  = -1;
+    sink->xz_out = -1;
+    snprintf(path, sizeof(path), "%s.xz.tmp", closed->path);
+    if (ok) {
+        char done[PATH_MAX];
+        snprintf(done, sizeof(done), "%s.xz", closed->path);
+        if (rename(path, done) == 0 && unlink(closed->path) == 0) ++sink->stats.compressed;
+        else ++sink->stats.compress_errors;
+    }
+    else {
+        RTE_LOG(ERR, SS, "could not compress nm_file %s, keeping it as it is\n", closed->path);
+        unlink(path);
+        ++sink->stats.compress_errors;
+    }
+    TAILQ_REMOVE(&sink->closed, closed, entry);
+    je_free(closed);
+}
+
+/*
+ * Compresses up to budget bytes of the oldest closed file, so a big file
+ * does not keep the rings waiting. Returns the bytes read.
+ */
+static uint64_t ss_sink_compress_step(ss_sink_t* sink, uint64_t budget) {
+    ss_sink_closed_t* closed = TAILQ_FIRST(&sink->closed);
+    uint8_t* input  = sink->xz_buffer;
+    uint8_t* output = sink->xz_buffer + SS_SINK_XZ_BUFFER;
+    lzma_stream init = LZMA_STREAM_INIT;
+    lzma_action action;
+    lzma_ret ret;
+    char path[PATH_MAX];
+    uint64_t total = 0;
+    ssize_t rv;
+
+    if (closed == NULL) return 0;
+    if (sink->xz_in < 0) {
+        snprintf(path, sizeof(path), "%s.xz.tmp", closed->path);
+        sink->xz    = init;
+        sink->xz_in = open(closed->path, O_RDONLY | O_CLOEXEC);
+        sink->xz_out = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+        ret = lzma_easy_encoder(&sink->xz, sink->conf.compress_level, LZMA_CHECK_CRC64);
+        if (sink->xz_in < 0 || sink->xz_out < 0 || ret != LZMA_OK) {
+            ss_sink_compress_end(sink, 0);
+            return 1;
+        }
+    }
+
+    while (total < budget) {
+        rv = read(sink->xz_in, input, SS_SINK_XZ_BUFFER);
+        if (rv < 0) {
+            ss_sink_compress_end(sink, 0);
+            return total + 1;
+        }
+        total += (uint64_t) rv;
+        sink->stats.compress_in += (uint64_t) rv;
+        action = rv == 0 ? LZMA_FINISH : LZMA_RUN;
+        sink->xz.next_in  = input;
+        sink->xz.avail_in = (size_t) rv;
+        do {
+            sink->xz.next_out  = output;
+            sink->xz.avail_out = SS_SINK_XZ_BUFFER;
+            ret = lzma_code(&sink->xz, action);
+            if (ret != LZMA_OK && ret != LZMA_STREAM_END) {
+                ss_sink_compress_end(sink, 0);
+                return total + 1;
+            }
+            rv = write(sink->xz_out, output, SS_SINK_XZ_BUFFER - sink->xz.avail_out);
+            if (rv != (ssize_t) (SS_SINK_XZ_BUFFER - sink->xz.avail_out)) {
+                ss_sink_compress_end(sink, 0);
+                return total + 1;
+            }
+            sink->stats.compress_out += (uint64_t) rv;
+        } while (sink->xz.avail_in || (action == LZMA_FINISH && ret != LZMA_STREAM_END));
+        if (action == LZMA_FINISH) {
+            ss_sink_compress_end(sink, 1);
+            return total + 1;
+        }
+    }
+    return total;
+}
+
+/*
+ * Drains the rings one last time; closed files are compressed before it
+ * returns. Before ss_sink_start or after ss_sink_stop only.
+ */
+void ss_sink_close(ss_sink_t* sink) {
+    if (sink == NULL) return;
+    pthread_mutex_lock(&sink_list_lock);
+    TAILQ_REMOVE(&sink_list, sink, entry);
+    pthread_mutex_unlock(&sink_list_lock);
+
+    ss_sink_drain(sink, ss_sink_now());
+    ss_sink_file_close(sink);
+    while (!TAILQ_EMPTY(&sink->closed)) ss_sink_compress_step(sink, UINT64_MAX);
+    for (unsigned int lcore_id = 0; lcore_id < RTE_MAX_LCORE; ++lcore_id) je_free(sink->rings[lcore_id]);
+    je_free(sink->rings);
+    je_free(sink->xz_buffer);
+    je_free(sink);
+}
+
+static void ss_sink_snapshot_publish(ss_sink_t* sink) {
+    ++sink->snapshot_seq;
+    rte_smp_wmb();
+    sink->snapshot = sink->stats;
+    rte_smp_wmb();
+    ++sink->snapshot_seq;
+}
+
+/* a consistent copy of the snapshot, without waiting on the sink thread */
+static void ss_sink_snapshot_read(ss_sink_t* sink, ss_sink_stats_t* snapshot) {
+    uint32_t seq;
+
+    do {
+        while ((seq = sink->snapshot_seq) & 1) rte_pause();
+        rte_smp_rmb();
+        *snapshot = sink->snapshot;
+        rte_smp_rmb();
+    } while (sink->snapshot_seq != seq);
+}
+
+static void* ss_sink_thread(void* arg) {
+    ss_sink_t* sink;
+    uint64_t now;
+    uint64_t total;
+
+    while (!sink_stopping) {
+        total = 0;
+        now   = ss_sink_now();
+        pthread_mutex_lock(&sink_list_lock);
+        sink = TAILQ_FIRST(&sink_list);
+        pthread_mutex_unlock(&sink_list_lock);
+        while (sink) {
+            total += ss_sink_drain(sink, now);
+            ss_sink_rotate(sink, now);
+            total += ss_sink_compress_step(sink, SS_SINK_COMPRESS_CHUNK);
+            ss_sink_snapshot_publish(sink);
+            pthread_mutex_lock(&sink_list_lock);
+            sink = TAILQ_NEXT(sink, entry);
+            pthread_mutex_unlock(&sink_list_lock);
+        }
+        if (total == 0) usleep(SS_SINK_IDLE_USECS);
+    }
+
+    return NULL;
+}
+
+int ss_sink_start() {
+    int rv;
+
+    if (TAILQ_EMPTY(&sink_list)) return 0;
+
+    rv = ss_thread_create(&sink_thread, ss_sink_thread, NULL);
+    if (rv) {
+        RTE_LOG(ERR, SS, "could not start sink thread: %s\n", strerror(rv));
+        return -1;
+    }
+    pthread_setname_np(sink_thread, "ss_sink");
+    sink_started = 1;
+    RTE_LOG(NOTICE, SS, "sink thread started\n");
+    return 0;
+}
+
+/*
+ * Joins the sink thread after its current pass. The final drain, the
+ * file close and the compression of closed files are left to
+ * ss_sink_close, which the queue teardown calls with no thread left.
+ */
+void ss_sink_stop() {
+    int rv;
+
+    if (!sink_started) return;
+
+    sink_stopping = 1;
+    rv = pthread_join(sink_thread, NULL);
+    if (rv) fprintf(stderr, "could not join sink thread: %s\n", strerror(rv));
+    sink_started = 0;
+}
+
+/* runs on the master lcore: no lock, the rings and the snapshot only */
+int ss_sink_stats_dump() {
+    ss_sink_t* sink;
+    ss_sink_ring_t* ring;
+    ss_sink_stats_t stats;
+    uint64_t records;
+    uint64_t dropped;
+    uint64_t buffered;
+
+    if (rte_get_log_level() < RTE_LOG_NOTICE) return 0;
+
+    TAILQ_FOREACH(sink, &sink_list, entry) {
+        ss_sink_snapshot_read(sink, &stats);
+        records  = 0;
+        dropped  = 0;
+        buffered = 0;
+        for (unsigned int lcore_id = 0; lcore_id < RTE_MAX_LCORE; ++lcore_id) {
+            ring = sink->rings[lcore_id];
+            if (ring == NULL) continue;
+            records  += ring->records;
+            dropped  += ring->dropped;
+            buffered += ring->head - ring->tail;
+        }
+
+        printf("File sink statistics ===============================\n"
+               "Sink: %s\n"
+               "Records: %29lu\n"
+               "Dropped: %29lu\n"
+               "Bytes buffered: %22lu\n"
+               "Bytes written: %23lu\n"
+               "Files: %31lu\n"
+               "Write errors: %24lu\n",
+               sink->prefix, records, dropped, buffered,
+               stats.bytes, stats.files, stats.write_errors);
+        if (sink->conf.compress != SS_SINK_COMPRESS_NONE) {
+            printf("Files compressed: %20lu\n"
+                   "Compression errors: %18lu\n"
+                   "Compression ratio: %19.2f\n",
+                   stats.compressed, stats.compress_errors,
+                   stats.compress_out ? (double) stats.compress_in / (double) stats.compress_out : 0.0);
+        }
+        printf("====================================================\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <limits.h>
+#include <stdint.h>
+
+#include <bsd/sys/queue.h>
+
+#include <lzma.h>
+
+/*
+ * nm_file: every message of a queue also goes to local files, as
+ * newline-delimited JSON events, or for nm_format packet queues as pcap
+ * or pcapng with the rx timestamp of each frame. The lcore, or its egress
+ * thread, only copies the record into a ring of its own; the sink thread
+ * writes the rings out, rotates the files, and xz-compresses closed ones
+ * a slice at a time, so a slow disk costs dropped records, never stalls.
+ */
+
+/* CONSTANTS */
+
+#define SS_SINK_BUFFER_BYTES_DEFAULT  (1 << 20) // nm_file_buffer_bytes, per lcore
+#define SS_SINK_ROTATE_BYTES_DEFAULT (64ULL << 20) // nm_file_rotate_bytes
+#define SS_SINK_ROTATE_SECS_DEFAULT       3600 // nm_file_rotate_secs
+#define SS_SINK_COMPRESS_LEVEL_DEFAULT       1 // nm_file_compress_level, xz preset
+#define SS_SINK_COMPRESS_CHUNK       (256 << 10) // closed file bytes compressed per pass
+#define SS_SINK_IDLE_USECS                1000 // sink thread sleep when there was nothing to do
+
+#define SS_SINK_PCAP_MAGIC_NSEC     0xa1b23c4d // pcap with nanosecond timestamps
+#define SS_SINK_PCAPNG_SHB          0x0a0d0d0a
+#define SS_SINK_PCAPNG_IDB          0x00000001
+#define SS_SINK_PCAPNG_EPB          0x00000006
+#define SS_SINK_PCAPNG_BYTE_ORDER   0x1a2b3c4d
+#define SS_SINK_LINKTYPE_ETHERNET            1
+
+enum ss_sink_format_e {
+    SS_SINK_NDJSON = 1, // nm_format metadata, nm_encoding json
+    SS_SINK_PCAP   = 2, // nm_format packet
+    SS_SINK_PCAPNG = 3, // nm_format packet
+    SS_SINK_FORMAT_MAX,
+};
+
+typedef enum ss_sink_format_e ss_sink_format_t;
+
+enum ss_sink_compress_e {
+    SS_SINK_COMPRESS_NONE = 0,
+    SS_SINK_COMPRESS_XZ   = 1,
+    SS_SINK_COMPRESS_MAX,
+};
+
+typedef enum ss_sink_compress_e ss_sink_compress_t;
+
+/* DATA TYPES */
+
+/* the files are in host byte order, which their magic numbers tell readers */
+struct ss_sink_pcap_header_s {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t  thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t network;
+} __attribute__((packed));
+
+typedef struct ss_sink_pcap_header_s ss_sink_pcap_header_t;
+
+struct ss_sink_pcap_record_s {
+    uint32_t ts_sec;
+    uint32_t ts_nsec;
+    uint32_t caplen;
+    uint32_t len;
+} __attribute__((packed));
+
+typedef struct ss_sink_pcap_record_s ss_sink_pcap_record_t;
+
+struct ss_sink_pcapng_shb_s {
+    uint32_t type;
+    uint32_t total_length;
+    uint32_t byte_order;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int64_t  section_length; // -1, unknown
+    uint32_t total_length_trailer;
+} __attribute__((packed));
+
+typedef struct ss_sink_pcapng_shb_s ss_sink_pcapng_shb_t;
+
+/* one interface per file, if_tsresol 9 for nanosecond timestamps */
+struct ss_sink_pcapng_idb_s {
+    uint32_t type;
+    uint32_t total_length;
+    uint16_t linktype;
+    uint16_t reserved;
+    uint32_t snaplen;
+    uint16_t tsresol_code;
+    uint16_t tsresol_length;
+    uint8_t  tsresol;
+    uint8_t  tsresol_pad[3];
+    uint16_t end_code;
+    uint16_t end_length;
+    uint32_t total_length_trailer;
+} __attribute__((packed));
+
+typedef struct ss_sink_pcapng_idb_s ss_sink_pcapng_idb_t;
+
+/* followed by caplen bytes padded to 32 bits, then total_length again */
+struct ss_sink_pcapng_epb_s {
+    uint32_t type;
+    uint32_t total_length;
+    uint32_t interface_id;
+    uint32_t ts_high;
+    uint32_t ts_low;
+    uint32_t caplen;
+    uint32_t len;
+} __attribute__((packed));
+
+typedef struct ss_sink_pcapng_epb_s ss_sink_pcapng_epb_t;
+
+struct ss_sink_conf_s {
+    ss_sink_format_t   format;
+    uint64_t           rotate_bytes;
+    uint64_t           rotate_secs;
+    ss_sink_compress_t compress;
+    uint32_t           compress_level;
+    uint32_t           buffer_bytes;  // rounded up to a power of 2
+    uint32_t           snaplen;       // for the pcap headers
+};
+
+typedef struct ss_sink_conf_s ss_sink_conf_t;
+
+/*
+ * Single producer, single consumer, like the log rings: the lcore copies
+ * whole records in at head, the sink thread writes them out from tail.
+ */
+struct ss_sink_ring_s {
+    volatile uint64_t head;
+    volatile uint64_t tail;
+    uint64_t          records;
+    uint64_t          dropped;  // no room, the sink thread fell behind
+    uint64_t          size;
+    uint8_t           data[];
+};
+
+typedef struct ss_sink_ring_s ss_sink_ring_t;
+
+struct ss_sink_stats_s {
+    uint64_t bytes;           // written to the files
+    uint64_t files;
+    uint64_t write_errors;
+    uint64_t compressed;      // closed files replaced by their .xz
+    uint64_t compress_in;
+    uint64_t compress_out;
+    uint64_t compress_errors; // the closed file is kept as it is
+};
+
+typedef struct ss_sink_stats_s ss_sink_stats_t;
+
+/* a closed file waiting for xz */
+struct ss_sink_closed_s {
+    char path[PATH_MAX];
+    TAILQ_ENTRY(ss_sink_closed_s) entry;
+};
+
+typedef struct ss_sink_closed_s ss_sink_closed_t;
+
+/* past rings, only the sink thread, or close once it let go, touches these */
+struct ss_sink_s {
+    char               prefix[PATH_MAX];
+    ss_sink_conf_t     conf;
+    ss_sink_ring_t**   rings;      // RTE_MAX_LCORE, allocated on first use
+    int                fd;
+    char               path[PATH_MAX];
+    uint64_t           length;
+    uint64_t           opened_ns;
+    uint64_t           sequence;   // keeps names apart within a second
+    ss_sink_stats_t    stats;
+    // stats as of the last pass, for the dump; odd seq while rewritten
+    volatile uint32_t  snapshot_seq;
+    ss_sink_stats_t    snapshot;
+    TAILQ_HEAD(ss_sink_closed_list_s, ss_sink_closed_s) closed;
+    lzma_stream        xz;
+    int                xz_in;      // -1 when no file is being compressed
+    int                xz_out;
+    uint8_t*           xz_buffer;  // input, then output half
+    TAILQ_ENTRY(ss_sink_s) entry;
+};
+
+typedef struct ss_sink_s ss_sink_t;
+
+/* BEGIN PROTOTYPES */
+
+const char* ss_sink_format_dump(ss_sink_format_t format);
+ss_sink_format_t ss_sink_format_parse(const char* name);
+const char* ss_sink_compress_dump(ss_sink_compress_t compress);
+ss_sink_compress_t ss_sink_compress_parse(const char* name);
+ss_sink_t* ss_sink_open(const char* prefix, ss_sink_conf_t* conf);
+void ss_sink_close(ss_sink_t* sink);
+int ss_sink_write(ss_sink_t* sink, const uint8_t* message, uint32_t length, unsigned int lcore_id);
+int ss_sink_start(void);
+void ss_sink_stop(void);
+int ss_sink_stats_dump(void);
+
+/* END PROTOTYPES */
@@ -0,0 +1,61 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "siphash.h"
+
+/*
+ * SipHash-2-4 (Aumasson, Bernstein 2012): a keyed PRF for short inputs,
+ * used where an attacker must not be able to predict or forge the output,
+ * e.g. TCP SYN cookies. Assumes a little-endian host like the rest of
+ * the sensor.
+ */
+
+#define SS_SIP_ROTL(x, b) (uint64_t) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SS_SIP_ROUND(v0, v1, v2, v3)                                       \
+    do {                                                                   \
+        v0 += v1; v1 = SS_SIP_ROTL(v1, 13); v1 ^= v0; v0 = SS_SIP_ROTL(v0, 32); \
+        v2 += v3; v3 = SS_SIP_ROTL(v3, 16); v3 ^= v2;                      \
+        v0 += v3; v3 = SS_SIP_ROTL(v3, 21); v3 ^= v0;                      \
+        v2 += v1; v1 = SS_SIP_ROTL(v1, 17); v1 ^= v2; v2 = SS_SIP_ROTL(v2, 32); \
+    } while (0)
+
+uint64_t ss_siphash24(const uint8_t* key, const void* data, size_t length) {
+    const uint8_t* ptr = (const uint8_t*) data;
+    uint64_t k0, k1, m;
+    uint64_t b = ((uint64_t) length) << 56;
+
+    memcpy(&k0, key, sizeof(k0));
+    memcpy(&k1, key + sizeof(k0), sizeof(k1));
+
+    uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+
+    for (; length >= sizeof(m); ptr += sizeof(m), length -= sizeof(m)) {
+        memcpy(&m, ptr, sizeof(m));
+        v3 ^= m;
+        SS_SIP_ROUND(v0, v1, v2, v3);
+        SS_SIP_ROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+
+    m = 0;
+    memcpy(&m, ptr, length);
+    b |= m;
+
+    v3 ^= b;
+    SS_SIP_ROUND(v0, v1, v2, v3);
+    SS_SIP_ROUND(v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    SS_SIP_ROUND(v0, v1, v2, v3);
+    SS_SIP_ROUND(v0, v1, v2, v3);
+    SS_SIP_ROUND(v0, v1, v2, v3);
+    SS_SIP_ROUND(v0, v1, v2, v3);
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
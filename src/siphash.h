@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* CONSTANTS */
+
+#define SS_SIPHASH_KEY_SIZE 16
+
+/* BEGIN PROTOTYPES */
+
+uint64_t ss_siphash24(const uint8_t* key, const void* data, size_t length);
+
+/* END PROTOTYPES */
@@ -0,0 +1,113 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <emmintrin.h>
+
+#include "str_utils.h"
+
+/*
+ * Compare data against a needle which was already lowercased.
+ * Only ASCII letters are folded, matching what the prefilter extracts.
+ */
+int ss_memeq_nocase(const uint8_t* data, const uint8_t* lower, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        if (SS_ASCII_LOWER(data[i]) != lower[i]) return 0;
+    }
+    return 1;
+}
+
+int ss_memcaseeq(const uint8_t* a, const uint8_t* b, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        if (SS_ASCII_LOWER(a[i]) != SS_ASCII_LOWER(b[i])) return 0;
+    }
+    return 1;
+}
+
+static inline int ss_memeq(const uint8_t* data, const uint8_t* needle, size_t length, int nocase) {
+    if (nocase) return ss_memeq_nocase(data, needle, length);
+    return !memcmp(data, needle, length);
+}
+
+/*
+ * SSE2 scan for the first of up to three delimiter bytes. Repeat a byte
+ * to look for fewer than three.
+ */
+const uint8_t* ss_memchr3(const uint8_t* data, size_t length, uint8_t a, uint8_t b, uint8_t c) {
+    __m128i v_a = _mm_set1_epi8((char) a);
+    __m128i v_b = _mm_set1_epi8((char) b);
+    __m128i v_c = _mm_set1_epi8((char) c);
+    __m128i block;
+    unsigned int mask;
+    size_t i = 0;
+
+    for (; i + sizeof(__m128i) <= length; i += sizeof(__m128i)) {
+        block = _mm_loadu_si128((const __m128i*) (data + i));
+        mask  = (unsigned int) _mm_movemask_epi8(_mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, v_a), _mm_cmpeq_epi8(block, v_b)),
+            _mm_cmpeq_epi8(block, v_c)));
+        if (mask) return data + i + __builtin_ctz(mask);
+    }
+
+    for (; i < length; ++i) {
+        if (data[i] == a || data[i] == b || data[i] == c) return data + i;
+    }
+
+    return NULL;
+}
+
+/*
+ * SSE2 substring search. Compares the first and last needle bytes against
+ * 16 haystack positions at a time and only verifies the candidates where
+ * both of them hit. With nocase set the needle must already be lowercase.
+ */
+const uint8_t* ss_memmem(const uint8_t* haystack, size_t haystack_length, const uint8_t* needle, size_t needle_length, int nocase) {
+    uint8_t first, last, fold_first, fold_last;
+    __m128i v_first, v_last, v_fold_first, v_fold_last;
+    __m128i block_first, block_last;
+    unsigned int mask, bit;
+    size_t i = 0;
+
+    if (needle_length == 0) return haystack;
+    if (needle_length > haystack_length) return NULL;
+
+    first = needle[0];
+    last  = needle[needle_length - 1];
+
+    // OR-ing 0x20 maps 'A' and 'a' to the same byte and nothing else onto it
+    fold_first = (nocase && first >= 'a' && first <= 'z') ? 0x20 : 0x00;
+    fold_last  = (nocase && last  >= 'a' && last  <= 'z') ? 0x20 : 0x00;
+
+    v_first      = _mm_set1_epi8((char) first);
+    v_last       = _mm_set1_epi8((char) last);
+    v_fold_first = _mm_set1_epi8((char) fold_first);
+    v_fold_last  = _mm_set1_epi8((char) fold_last);
+
+    for (; i + needle_length - 1 + sizeof(__m128i) <= haystack_length; i += sizeof(__m128i)) {
+        block_first = _mm_loadu_si128((const __m128i*) (haystack + i));
+        block_last  = _mm_loadu_si128((const __m128i*) (haystack + i + needle_length - 1));
+        block_first = _mm_or_si128(block_first, v_fold_first);
+        block_last  = _mm_or_si128(block_last,  v_fold_last);
+
+        mask = (unsigned int) _mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(block_first, v_first),
+            _mm_cmpeq_epi8(block_last,  v_last)));
+
+        while (mask) {
+            bit = (unsigned int) __builtin_ctz(mask);
+            if (ss_memeq(haystack + i + bit, needle, needle_length, nocase)) {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    // scalar tail for the last partial block
+    for (; i + needle_length <= haystack_length; ++i) {
+        if (ss_memeq(haystack + i, needle, needle_length, nocase)) {
+            return haystack + i;
+        }
+    }
+
+    return NULL;
+}
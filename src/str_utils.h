@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* CONSTANTS */
+
+#define SS_ASCII_LOWER(c) ((uint8_t) (((c) >= 'A' && (c) <= 'Z') ? ((c) | 0x20) : (c)))
+
+/* DATA TYPES */
+
+/* a (pointer, length) view into a buffer owned by someone else */
+struct ss_slice_s {
+    const uint8_t* data;
+    size_t length;
+};
+
+typedef struct ss_slice_s ss_slice_t;
+
+/* lowercase the ASCII letters in 8 bytes at once, leaving other bytes alone */
+static inline uint64_t ss_ascii_lower64(uint64_t x) {
+    uint64_t heptets = x & 0x7f7f7f7f7f7f7f7fULL;
+    uint64_t ge_a    = heptets + 0x3f3f3f3f3f3f3f3fULL;
+    uint64_t gt_z    = heptets + 0x2525252525252525ULL;
+    uint64_t upper   = ge_a & ~gt_z & ~x & 0x8080808080808080ULL;
+    return x | (upper >> 2);
+}
+
+/* BEGIN PROTOTYPES */
+
+int ss_memeq_nocase(const uint8_t* data, const uint8_t* lower, size_t length);
+int ss_memcaseeq(const uint8_t* a, const uint8_t* b, size_t length);
+const uint8_t* ss_memchr3(const uint8_t* data, size_t length, uint8_t a, uint8_t b, uint8_t c);
+const uint8_t* ss_memmem(const uint8_t* haystack, size_t haystack_length, const uint8_t* needle, size_t needle_length, int nocase);
+
+/* END PROTOTYPES */
@@ -0,0 +1,311 @@
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "str_utils.h"
+#include "syslog.h"
+
+static const char ss_syslog_months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+ss_syslog_field_t ss_syslog_field_load(const char* field) {
+    if (!strcasecmp(field, "message"))   return SS_SYSLOG_FIELD_MESSAGE;
+    if (!strcasecmp(field, "timestamp")) return SS_SYSLOG_FIELD_TIMESTAMP;
+    if (!strcasecmp(field, "host"))      return SS_SYSLOG_FIELD_HOST;
+    if (!strcasecmp(field, "app_name"))  return SS_SYSLOG_FIELD_APP_NAME;
+    if (!strcasecmp(field, "procid"))    return SS_SYSLOG_FIELD_PROCID;
+    if (!strcasecmp(field, "msgid"))     return SS_SYSLOG_FIELD_MSGID;
+    if (!strcasecmp(field, "sd"))        return SS_SYSLOG_FIELD_SD;
+    if (!strcasecmp(field, "msg"))       return SS_SYSLOG_FIELD_MSG;
+    if (!strcasecmp(field, "sd_param"))  return SS_SYSLOG_FIELD_SD_PARAM;
+    return (ss_syslog_field_t) -1;
+}
+
+const char* ss_syslog_field_dump(ss_syslog_field_t field) {
+    switch (field) {
+        case SS_SYSLOG_FIELD_MESSAGE:   return "message";
+        case SS_SYSLOG_FIELD_TIMESTAMP: return "timestamp";
+        case SS_SYSLOG_FIELD_HOST:      return "host";
+        case SS_SYSLOG_FIELD_APP_NAME:  return "app_name";
+        case SS_SYSLOG_FIELD_PROCID:    return "procid";
+        case SS_SYSLOG_FIELD_MSGID:     return "msgid";
+        case SS_SYSLOG_FIELD_SD:        return "sd";
+        case SS_SYSLOG_FIELD_MSG:       return "msg";
+        case SS_SYSLOG_FIELD_SD_PARAM:  return "sd_param";
+        default:                        return "unknown";
+    }
+}
+
+const char* ss_syslog_format_dump(ss_syslog_format_t format) {
+    switch (format) {
+        case SS_SYSLOG_FORMAT_RFC3164: return "rfc3164";
+        case SS_SYSLOG_FORMAT_RFC5424: return "rfc5424";
+        default:                       return "unknown";
+    }
+}
+
+static inline void ss_syslog_field_set(ss_syslog_t* syslog, ss_syslog_field_t field, const uint8_t* start, const uint8_t* end) {
+    // empty fields and the RFC 5424 NILVALUE are left unset
+    if (end <= start) return;
+    if (end - start == 1 && *start == '-') return;
+    syslog->fields[field].data   = start;
+    syslog->fields[field].length = (size_t) (end - start);
+}
+
+/* token is [p, *token_end), returns the start of the next token */
+static inline const uint8_t* ss_syslog_token(const uint8_t* p, const uint8_t* end, const uint8_t** token_end) {
+    const uint8_t* space = memchr(p, ' ', (size_t) (end - p));
+    if (space == NULL) {
+        *token_end = end;
+        return end;
+    }
+    *token_end = space;
+    return space + 1;
+}
+
+/*
+ * Skip a run of bracketed SD-ELEMENTs starting at p. Inside PARAM-VALUEs
+ * '"', '\\' and ']' may be escaped, so the scan jumps between those three
+ * bytes only. Returns NULL if the structured data is unterminated.
+ */
+static const uint8_t* ss_syslog_sd_skip(const uint8_t* p, const uint8_t* end) {
+    const uint8_t* q;
+    int quoted;
+
+    while (p < end && *p == '[') {
+        quoted = 0;
+        ++p;
+        for (;;) {
+            q = ss_memchr3(p, (size_t) (end - p), '"', '\\', ']');
+            if (q == NULL) return NULL;
+            if (*q == '\\' && quoted) {
+                p = q + 2;
+                if (p > end) return NULL;
+            }
+            else if (*q == '"') {
+                quoted = !quoted;
+                p = q + 1;
+            }
+            else if (*q == ']' && !quoted) {
+                p = q + 1;
+                break;
+            }
+            else {
+                p = q + 1;
+            }
+        }
+    }
+
+    return p;
+}
+
+static int ss_syslog_parse_5424(ss_syslog_t* syslog, const uint8_t* p, const uint8_t* end) {
+    static const ss_syslog_field_t header[] = {
+        SS_SYSLOG_FIELD_TIMESTAMP,
+        SS_SYSLOG_FIELD_HOST,
+        SS_SYSLOG_FIELD_APP_NAME,
+        SS_SYSLOG_FIELD_PROCID,
+        SS_SYSLOG_FIELD_MSGID,
+    };
+    const uint8_t* start;
+    const uint8_t* token_end;
+    const uint8_t* q;
+
+    syslog->format = SS_SYSLOG_FORMAT_RFC5424;
+
+    for (size_t i = 0; i < sizeof(header) / sizeof(header[0]); ++i) {
+        if (p >= end) return 0;
+        start = p;
+        p = ss_syslog_token(p, end, &token_end);
+        ss_syslog_field_set(syslog, header[i], start, token_end);
+    }
+
+    if (p >= end) return 0;
+    if (*p == '-') {
+        ++p;
+    }
+    else if (*p == '[') {
+        q = ss_syslog_sd_skip(p, end);
+        if (q == NULL) {
+            // unterminated SD: keep what is there as the message
+            ss_syslog_field_set(syslog, SS_SYSLOG_FIELD_MSG, p, end);
+            return 0;
+        }
+        ss_syslog_field_set(syslog, SS_SYSLOG_FIELD_SD, p, q);
+        p = q;
+    }
+    else {
+        ss_syslog_field_set(syslog, SS_SYSLOG_FIELD_MSG, p, end);
+        return 0;
+    }
+
+    if (p < end && *p == ' ') ++p;
+    // optional UTF-8 BOM in front of MSG
+    if (end - p >= 3 && p[0] == 0xef && p[1] == 0xbb && p[2] == 0xbf) p += 3;
+    ss_syslog_field_set(syslog, SS_SYSLOG_FIELD_MSG, p, end);
+
+    return 0;
+}
+
+/* "Mmm dd hh:mm:ss " with a space padded day */
+static int ss_syslog_3164_timestamp(const uint8_t* p, const uint8_t* end) {
+    int month = 0;
+
+    if (end - p < SS_SYSLOG_3164_TS_SIZE + 1) return 0;
+
+    for (const char* m = ss_syslog_months; *m; m += 3) {
+        if (!memcmp(p, m, 3)) {
+            month = 1;
+            break;
+        }
+    }
+
+    return month && p[3] == ' '
+        && (p[4] == ' ' || isdigit(p[4])) && isdigit(p[5]) && p[6] == ' '
+        && isdigit(p[7])  && isdigit(p[8])  && p[9]  == ':'
+        && isdigit(p[10]) && isdigit(p[11]) && p[12] == ':'
+        && isdigit(p[13]) && isdigit(p[14]) && p[15] == ' ';
+}
+
+static int ss_syslog_parse_3164(ss_syslog_t* syslog, const uint8_t* p, const uint8_t* end) {
+    const uint8_t* start;
+    const uint8_t* q;
+    size_t limit;
+
+    syslog->format = SS_SYSLOG_FORMAT_RFC3164;
+
+    if (ss_syslog_3164_timestamp(p, end)) {
+        ss_syslog_field_set(syslog, SS_SYSLOG_FIELD_TIMESTAMP, p, p + SS_SYSLOG_3164_TS_SIZE);
+        p += SS_SYSLOG_3164_TS_SIZE + 1;
+
+        // HOSTNAME only counts if something follows it
+        q = memchr(p, ' ', (size_t) (end - p));
+        if (q) {
+            ss_syslog_field_set(syslog, SS_SYSLOG_FIELD_HOST, p, q);
+            p = q + 1;
+        }
+    }
+
+    // TAG ends at '[' (PID follows) or ':'; a space first means no TAG
+    start = p;
+    limit = (size_t) (end - p) < SS_SYSLOG_TAG_MAX + 1 ? (size_t) (end - p) : SS_SYSLOG_TAG_MAX + 1;
+    q = ss_memchr3(p, limit, '[', ':', ' ');
+    if (q && q > start && *q != ' ') {
+        ss_syslog_field_set(syslog, SS_SYSLOG_FIELD_APP_NAME, start, q);
+        p = q;
+        if (*p == '[') {
+            q = memchr(p, ']', (size_t) (end - p));
+            if (q) {
+                ss_syslog_field_set(syslog, SS_SYSLOG_FIELD_PROCID, p + 1, q);
+                p = q + 1;
+            }
+        }
+        if (p < end && *p == ':') ++p;
+        if (p < end && *p == ' ') ++p;
+    }
+
+    ss_syslog_field_set(syslog, SS_SYSLOG_FIELD_MSG, p, end);
+    return 0;
+}
+
+/*
+ * Best-effort split of a syslog message into RFC 5424 or RFC 3164 fields.
+ * Returns -1 if there is no valid PRI, in which case the whole message
+ * is reported as MSG.
+ */
+int ss_syslog_parse(ss_syslog_t* syslog, const uint8_t* data, size_t length) {
+    const uint8_t* p   = data;
+    const uint8_t* end = data + length;
+    int pri            = 0;
+
+    memset(syslog, 0, sizeof(*syslog));
+    syslog->pri = -1;
+
+    // trailing framing bytes are not part of the message
+    while (end > data && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == '\0')) --end;
+    ss_syslog_field_set(syslog, SS_SYSLOG_FIELD_MESSAGE, data, end);
+
+    // PRI is '<' 1-3 digits '>'
+    if (p >= end || *p != '<') goto raw;
+    for (++p; p < end && p < data + 4 && isdigit(*p); ++p) {
+        pri = pri * 10 + (*p - '0');
+    }
+    if (p >= end || *p != '>' || p == data + 1 || pri > SS_SYSLOG_PRI_MAX) goto raw;
+    ++p;
+
+    syslog->pri      = pri;
+    syslog->facility = (uint8_t) (pri >> 3);
+    syslog->severity = (uint8_t) (pri & 0x07);
+
+    // RFC 5424 continues with a 1-2 digit VERSION and SP
+    if (p + 1 < end && *p >= '1' && *p <= '9') {
+        if (p[1] == ' ') return ss_syslog_parse_5424(syslog, p + 2, end);
+        if (p + 2 < end && isdigit(p[1]) && p[2] == ' ') return ss_syslog_parse_5424(syslog, p + 3, end);
+    }
+
+    return ss_syslog_parse_3164(syslog, p, end);
+
+    raw:
+    ss_syslog_field_set(syslog, SS_SYSLOG_FIELD_MSG, data, end);
+    return -1;
+}
+
+/*
+ * Find the PARAM-VALUE for sd_name, optionally restricted to SD-ID sd_id.
+ * The value is returned raw, with RFC 5424 escapes still in place.
+ */
+int ss_syslog_sd_param_get(ss_syslog_t* syslog, const char* sd_id, const char* sd_name, ss_slice_t* value) {
+    const uint8_t* p   = syslog->fields[SS_SYSLOG_FIELD_SD].data;
+    const uint8_t* end = p + syslog->fields[SS_SYSLOG_FIELD_SD].length;
+    const uint8_t* id_end;
+    const uint8_t* name;
+    const uint8_t* equals;
+    const uint8_t* q;
+    size_t id_length   = sd_id ? strlen(sd_id) : 0;
+    size_t name_length = strlen(sd_name);
+    int id_match;
+
+    if (p == NULL) return 0;
+
+    while (p < end && *p == '[') {
+        ++p;
+        id_end = ss_memchr3(p, (size_t) (end - p), ' ', ']', ']');
+        if (id_end == NULL) return 0;
+        id_match = !sd_id || ((size_t) (id_end - p) == id_length && !memcmp(p, sd_id, id_length));
+        p = id_end;
+
+        // SD-PARAMs are SP PARAM-NAME '=' '"' PARAM-VALUE '"'
+        while (p < end && *p == ' ') {
+            name   = p + 1;
+            equals = memchr(name, '=', (size_t) (end - name));
+            if (equals == NULL || equals + 1 >= end || equals[1] != '"') return 0;
+            for (q = equals + 2; ; q += 2) {
+                q = ss_memchr3(q, (size_t) (end - q), '"', '\\', '\\');
+                if (q == NULL || q + 1 >= end) return 0;
+                if (*q == '"') break;
+            }
+            if (id_match && (size_t) (equals - name) == name_length && !memcmp(name, sd_name, name_length)) {
+                value->data   = equals + 2;
+                value->length = (size_t) (q - value->data);
+                return 1;
+            }
+            p = q + 1;
+        }
+
+        if (p >= end || *p != ']') return 0;
+        ++p;
+    }
+
+    return 0;
+}
+
+int ss_syslog_field_get(ss_syslog_t* syslog, ss_syslog_field_t field, const char* sd_id, const char* sd_name, ss_slice_t* value) {
+    if (field == SS_SYSLOG_FIELD_SD_PARAM) {
+        return ss_syslog_sd_param_get(syslog, sd_id, sd_name, value);
+    }
+    if (field <= SS_SYSLOG_FIELD_EMPTY || field >= SS_SYSLOG_FIELD_MAX) return 0;
+
+    *value = syslog->fields[field];
+    return value->data != NULL;
+}
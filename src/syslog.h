@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "str_utils.h"
+
+/* CONSTANTS */
+
+#define SS_SYSLOG_PRI_MAX     191
+#define SS_SYSLOG_TAG_MAX      48
+#define SS_SYSLOG_3164_TS_SIZE 15
+
+enum ss_syslog_format_e {
+    SS_SYSLOG_FORMAT_EMPTY   = 0,
+    SS_SYSLOG_FORMAT_RFC3164 = 1,
+    SS_SYSLOG_FORMAT_RFC5424 = 2,
+    SS_SYSLOG_FORMAT_MAX,
+};
+
+typedef enum ss_syslog_format_e ss_syslog_format_t;
+
+enum ss_syslog_field_e {
+    SS_SYSLOG_FIELD_EMPTY     = 0,
+    SS_SYSLOG_FIELD_MESSAGE   = 1,
+    SS_SYSLOG_FIELD_TIMESTAMP = 2,
+    SS_SYSLOG_FIELD_HOST      = 3,
+    SS_SYSLOG_FIELD_APP_NAME  = 4,
+    SS_SYSLOG_FIELD_PROCID    = 5,
+    SS_SYSLOG_FIELD_MSGID     = 6,
+    SS_SYSLOG_FIELD_SD        = 7,
+    SS_SYSLOG_FIELD_MSG       = 8,
+    SS_SYSLOG_FIELD_SD_PARAM  = 9,
+    SS_SYSLOG_FIELD_MAX,
+};
+
+typedef enum ss_syslog_field_e ss_syslog_field_t;
+
+/* DATA TYPES */
+
+/*
+ * Parsed view of one syslog message. Every field is a slice into the
+ * original message; absent and NILVALUE fields have a NULL data pointer.
+ * SD_PARAM is never filled in here, see ss_syslog_sd_param_get.
+ */
+struct ss_syslog_s {
+    ss_syslog_format_t format;
+    int                pri;
+    uint8_t            facility;
+    uint8_t            severity;
+    ss_slice_t         fields[SS_SYSLOG_FIELD_MAX];
+};
+
+typedef struct ss_syslog_s ss_syslog_t;
+
+/* BEGIN PROTOTYPES */
+
+ss_syslog_field_t ss_syslog_field_load(const char* field);
+const char* ss_syslog_field_dump(ss_syslog_field_t field);
+const char* ss_syslog_format_dump(ss_syslog_format_t format);
+int ss_syslog_parse(ss_syslog_t* syslog, const uint8_t* data, size_t length);
+int ss_syslog_sd_param_get(ss_syslog_t* syslog, const char* sd_id, const char* sd_name, ss_slice_t* value);
+int ss_syslog_field_get(ss_syslog_t* syslog, ss_syslog_field_t field, const char* sd_id, const char* sd_name, ss_slice_t* value);
+
+/* END PROTOTYPES */
@@ -8,8 +8,10 @@
 #include <netinet/ip6.h>
 #include <netinet/tcp.h>
 
+#include <rte_atomic.h>
 #include <rte_branch_prediction.h>
 #include <rte_byteorder.h>
+#include <rte_common.h>
 #include <rte_cycles.h>
 #include <rte_hash.h>
 #include <rte_hash_crc.h>
@@ -26,71 +28,215 @@
 
 #include "checksum.h"
 #include "common.h"
+#include "dns_tcp.h"
 #include "ethernet.h"
 #include "extractor.h"
 #include "ip_utils.h"
 #include "je_utils.h"
 #include "l4_utils.h"
+#include "log.h"
+#include "netflow.h"
 #include "sdn_sensor.h"
 #include "sensor_conf.h"
+#include "siphash.h"
 #include "tcp.h"
 
-// XXX: how can I place a TCP hash on each socket?
-static struct rte_hash_parameters tcp_hash_params = {
-    .name               = "tcp_hash_socket_0",
-    .entries            = L4_TCP_HASH_SIZE,
-    //.bucket_entries     = L4_TCP_BUCKET_SIZE,
-    .key_len            = sizeof(ss_tcp_key_t),
-    .hash_func          = rte_hash_crc,
-    .hash_func_init_val = 0,
-    .socket_id          = 0,
-};
-
-static rte_rwlock_t tcp_hash_lock;
-static rte_hash_t* tcp_hash;
-static ss_tcp_socket_t* tcp_sockets[L4_TCP_HASH_SIZE];
+/*
+ * TCP state is sharded per lcore. The port RSS key is symmetric, so both
+ * directions of a connection hash to the same rx queue and therefore the
+ * same lcore. An lcore only ever writes its own shard, so its lookups
+ * need no lock; the shard lock is taken for writes by the owner and for
+ * reads by other lcores on the rare slow path where a segment arrives on
+ * the wrong queue (RSS disabled, reconfigured, or fragments).
+ */
+struct ss_tcp_shard_s {
+    rte_rwlock_t lock;
+    rte_hash_t* hash;
+    uint32_t size;
+    ss_tcp_socket_t** sockets;
+    // only the owner allocates and frees sockets
+    rte_mempool_t* socket_pool;
+    // any lcore may grow a buffer on the slow path
+    rte_mempool_t* buffer_pools[L4_TCP_BUFFER_CLASSES];
+    // socket deadlines, only touched by the owner
+    ss_timer_wheel_t wheel;
+    // sockets owing a delayed ACK, only touched by the owner; forced
+    // ACKs sit at the head, the rest follow in deadline order
+    TAILQ_HEAD(ss_tcp_ack_list_s, ss_tcp_socket_s) ack_list;
+    // indirect mbufs pinning out-of-order payload in the rx mbufs
+    rte_mempool_t* ooo_pool;
+    // SYN backlog; any lcore may complete or close a handshake
+    rte_atomic32_t half_open;
+    rte_atomic32_t syn_sources[L4_TCP_SYN_SOURCE_BUCKETS];
+    // when the last SYN cookie went out; ACKs are checked for a while after
+    uint64_t cookie_tsc;
+} __rte_cache_aligned;
+
+typedef struct ss_tcp_shard_s ss_tcp_shard_t;
+
+/*
+ * Reassembly buffers are only held while a message is incomplete, so
+ * idle connections cost just their socket. Most syslog lines fit the
+ * smallest class. Each lcore gets one buffer of a class per that many
+ * sockets of its shard, at least L4_TCP_BUFFER_MIN.
+ */
+static const uint32_t tcp_buffer_sizes[L4_TCP_BUFFER_CLASSES]  = { 512, 2048, 8192, 65536 };
+static const uint32_t tcp_buffer_shares[L4_TCP_BUFFER_CLASSES] = {   4,   16,   64,   512 };
+
+static ss_tcp_shard_t tcp_shards[RTE_MAX_LCORE];
+static ss_tcp_stats_t tcp_stats[RTE_MAX_LCORE];
+static uint64_t tcp_ack_delay_cycles;
+static uint32_t tcp_syn_backlog;
+static uint8_t  tcp_cookie_secret[SS_SIPHASH_KEY_SIZE];
+
+// peer MSS values a SYN cookie can carry, rounded down to the nearest
+static const uint16_t tcp_cookie_mss[8] = { 536, 1024, 1220, 1300, 1360, 1400, 1440, 1460 };
 
 int ss_tcp_init() {
-    rte_rwlock_init(&tcp_hash_lock);
+    char name[RTE_MEMPOOL_NAMESIZE];
+    unsigned int lcore_id;
+    int socket_id;
+    ss_tcp_shard_t* shard;
+    uint32_t shard_size = SS_MAX(ss_conf->tcp_socket_max / rte_lcore_count(), L4_TCP_SOCKET_MIN);
+    uint32_t ooo_size   = SS_MAX(ss_conf->tcp_ooo_mbufs / rte_lcore_count(), 1);
+    uint32_t buffer_counts[L4_TCP_BUFFER_CLASSES];
+    struct rte_hash_parameters tcp_hash_params = {
+        .name               = name,
+        .entries            = shard_size,
+        .key_len            = sizeof(ss_tcp_key_t),
+        .hash_func          = rte_hash_crc,
+        .hash_func_init_val = 0,
+    };
 
-    tcp_hash = rte_hash_create(&tcp_hash_params);
-    if (tcp_hash == NULL) {
-        RTE_LOG(ERR, L3L4, "could not initialize tcp socket hash\n");
-        return -1;
+    SS_LOG(NOTICE, L3L4, "tcp sockets per lcore: %u\n", shard_size);
+    for (int i = 0; i < L4_TCP_BUFFER_CLASSES; ++i) {
+        // 2^n - 1 elements use the mempool ring best
+        buffer_counts[i] = rte_align32pow2(SS_MAX(shard_size / tcp_buffer_shares[i], L4_TCP_BUFFER_MIN)) - 1;
+        SS_LOG(NOTICE, L3L4, "tcp %u byte buffers per lcore: %u\n", tcp_buffer_sizes[i], buffer_counts[i]);
+    }
+    tcp_ack_delay_cycles = rte_get_tsc_hz() * ss_conf->tcp_ack_delay_msec / 1000;
+    // 0 turns the backlog limit off, so it stays 0 rather than becoming 1
+    tcp_syn_backlog = ss_conf->tcp_syn_backlog ? SS_MAX(ss_conf->tcp_syn_backlog / rte_lcore_count(), 1) : 0;
+    ss_tcp_syn_cookie_init();
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        shard     = &tcp_shards[lcore_id];
+        socket_id = (int) rte_lcore_to_socket_id(lcore_id);
+        rte_rwlock_init(&shard->lock);
+        shard->size = shard_size;
+        ss_timer_wheel_init(&shard->wheel, rte_get_tsc_hz() * L4_TCP_TIMER_TICK_MSEC / 1000, rte_rdtsc());
+        TAILQ_INIT(&shard->ack_list);
+        rte_atomic32_init(&shard->half_open);
+        for (int i = 0; i < L4_TCP_SYN_SOURCE_BUCKETS; ++i) rte_atomic32_init(&shard->syn_sources[i]);
+
+        snprintf(name, sizeof(name), "tcp_hash_lcore_%u", lcore_id);
+        tcp_hash_params.socket_id = socket_id;
+        shard->hash = rte_hash_create(&tcp_hash_params);
+        if (shard->hash == NULL) {
+            SS_LOG(ERR, L3L4, "could not initialize tcp socket hash for lcore %u\n", lcore_id);
+            return -1;
+        }
+
+        shard->sockets = je_calloc(shard_size, sizeof(ss_tcp_socket_t*));
+        if (shard->sockets == NULL) {
+            SS_LOG(ERR, L3L4, "could not allocate tcp socket table for lcore %u\n", lcore_id);
+            return -1;
+        }
+
+        snprintf(name, sizeof(name), "tcp_socket_lcore_%u", lcore_id);
+        shard->socket_pool = rte_mempool_create(name, shard_size, sizeof(ss_tcp_socket_t), 0, 0,
+            NULL, NULL, NULL, NULL, socket_id, MEMPOOL_F_SP_PUT | MEMPOOL_F_SC_GET);
+        if (shard->socket_pool == NULL) {
+            SS_LOG(ERR, L3L4, "could not create tcp socket pool for lcore %u\n", lcore_id);
+            return -1;
+        }
+
+        // clones carry no data room of their own; no cache, as the lcore's
+        // share of tcp_ooo_mbufs can be smaller than one would need
+        snprintf(name, sizeof(name), "tcp_ooo_lcore_%u", lcore_id);
+        shard->ooo_pool = rte_mempool_create(name, ooo_size, sizeof(rte_mbuf_t), 0,
+            sizeof(struct rte_pktmbuf_pool_private), rte_pktmbuf_pool_init, NULL,
+            rte_pktmbuf_init, NULL, socket_id, 0);
+        if (shard->ooo_pool == NULL) {
+            SS_LOG(ERR, L3L4, "could not create tcp out-of-order pool for lcore %u\n", lcore_id);
+            return -1;
+        }
+
+        for (int i = 0; i < L4_TCP_BUFFER_CLASSES; ++i) {
+            snprintf(name, sizeof(name), "tcp_buffer_%u_lcore_%u", tcp_buffer_sizes[i], lcore_id);
+            shard->buffer_pools[i] = rte_mempool_create(name, buffer_counts[i], tcp_buffer_sizes[i], 0, 0,
+                NULL, NULL, NULL, NULL, socket_id, 0);
+            if (shard->buffer_pools[i] == NULL) {
+                SS_LOG(ERR, L3L4, "could not create tcp buffer pool %s\n", name);
+                return -1;
+            }
+        }
     }
-    
-    memset(tcp_sockets, 0, sizeof(tcp_sockets));
     
     return 0;
 }
 
-int ss_tcp_timer_callback() {
-    uint64_t expired_ticks = rte_rdtsc() - (rte_get_tsc_hz() * L4_TCP_EXPIRED_SECONDS);
-    int expired_sockets = 0;
-    ss_tcp_socket_t* socket;
+ss_tcp_timeouts_t* ss_tcp_timeouts_get(uint16_t port) {
+    for (uint32_t i = 1; i < ss_conf->tcp_timeouts_count; ++i) {
+        if (ss_conf->tcp_timeouts[i].port == port) return &ss_conf->tcp_timeouts[i];
+    }
+    return &ss_conf->tcp_timeouts[0];
+}
 
-    rte_rwlock_write_lock(&tcp_hash_lock);
-    for (int i = 0; i < L4_TCP_HASH_SIZE; ++i) {
-        socket = tcp_sockets[i];
-        if (!socket) continue;
-        if (socket->rx_ticks < expired_ticks &&
-            socket->tx_ticks < expired_ticks) {
-            rte_spinlock_recursive_lock(&socket->lock);
-            ss_tcp_socket_delete(&socket->key, 1);
-            rte_spinlock_recursive_unlock(&socket->lock);
-            ++expired_sockets;
-        }
+/*
+ * When the socket should go away given its state and last activity.
+ * Traffic does not touch the wheel; a timer which fires early because
+ * the socket saw traffic since is simply re-armed for the new deadline.
+ */
+uint64_t ss_tcp_socket_deadline(ss_tcp_socket_t* socket) {
+    uint64_t hz   = rte_get_tsc_hz();
+    uint64_t last = SS_MAX(socket->rx_ticks, socket->tx_ticks);
+
+    switch (socket->state) {
+        case SS_TCP_SYN_RX:    return last + hz * socket->timeouts->syn_timeout;
+        case SS_TCP_TIME_WAIT: return last + hz * socket->timeouts->time_wait_timeout;
+        case SS_TCP_CLOSED:    return 0;
+        default:               return last + hz * socket->timeouts->idle_timeout;
+    }
+}
+
+static void ss_tcp_socket_expire(ss_timer_wheel_entry_t* entry, void* arg) {
+    ss_tcp_socket_t* socket = (ss_tcp_socket_t*) ((uint8_t*) entry - offsetof(ss_tcp_socket_t, timer));
+    ss_tcp_stats_t* stats   = arg;
+    uint64_t deadline       = ss_tcp_socket_deadline(socket);
+
+    if (deadline > rte_rdtsc()) {
+        ss_timer_wheel_add(&tcp_shards[socket->lcore_id].wheel, &socket->timer, deadline);
+        return;
+    }
+
+    switch (socket->state) {
+        case SS_TCP_SYN_RX:    ++stats->expired_syn;       break;
+        case SS_TCP_TIME_WAIT: ++stats->expired_time_wait; break;
+        default:               ++stats->expired_idle;      break;
+    }
+    ss_tcp_socket_delete(socket);
+}
+
+/* run the calling lcore's socket deadlines, called every drain tick */
+int ss_tcp_timer_callback(unsigned int lcore_id) {
+    ss_tcp_shard_t* shard = &tcp_shards[lcore_id];
+    uint64_t now = rte_rdtsc();
+    uint64_t expired_sockets;
+
+    if (shard->sockets == NULL) return 0;
+
+    ss_tcp_ack_flush(lcore_id, now);
+    expired_sockets = ss_timer_wheel_advance(&shard->wheel, now, ss_tcp_socket_expire, &tcp_stats[lcore_id]);
+    if (expired_sockets) {
+        SS_LOG(FINE, L3L4, "ran %lu tcp socket timers on lcore %u\n", expired_sockets, lcore_id);
     }
-    rte_rwlock_write_unlock(&tcp_hash_lock);
-    
-    RTE_LOG(NOTICE, L3L4, "deleted %d expired tcp sockets\n", expired_sockets);
     return 0;
 }
 
 int ss_frame_handle_tcp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
     int rv = 0;
-    
-    SS_CHECK_SELF(rx_buf, 0);    
+    ss_tcp_state_t state;
     
     ss_tcp_key_t key;
     memset(&key, 0, sizeof(key));
@@ -111,7 +257,9 @@ int ss_frame_handle_tcp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
     
     // tcp_data_len must be based on ip_total_len or padding will be included
     // adjust L4 data to account for TCP options
-    uint16_t tcp_data_len  = rte_bswap16(rx_buf->ip4->tot_len) - sizeof(ip4_hdr_t) - hdr_length;
+    uint16_t tcp_data_len  = rx_buf->data.eth_type == ETHER_TYPE_IPV4 ?
+        (uint16_t) (rte_bswap16(rx_buf->ip4->tot_len) - sizeof(ip4_hdr_t) - hdr_length) :
+        (uint16_t) (rte_bswap16(rx_buf->ip6->ip6_plen) - hdr_length);
     rx_buf->l4_offset      = (uint8_t*) rx_buf->tcp + hdr_length;
     rx_buf->data.l4_length = tcp_data_len;
 
@@ -132,22 +280,67 @@ int ss_frame_handle_tcp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
     else {
         // XXX: now panic and freak out?
     }
+
+    // mirrored traffic between other hosts: only DNS streams are followed
+    if (!rx_buf->data.self) {
+        if (sport != L4_PORT_DNS && dport != L4_PORT_DNS) return 0;
+        return ss_frame_handle_dns_tcp(rx_buf, &key);
+    }
     
-    RTE_LOG(DEBUG, L3L4, "rx tcp packet: sport: %hu dport: %hu seq: %u ack: %u hlen: %hu dlen: %hu flags: %s wsize: %hu\n",
+    SS_LOG(DEBUG, L3L4, "rx tcp packet: sport: %hu dport: %hu seq: %u ack: %u hlen: %hu dlen: %hu flags: %s wsize: %hu\n",
         sport, dport, seq, ack_seq, hdr_length, rx_buf->data.l4_length, ss_tcp_flags_dump(tcp_flags), wsize);
 
+    // a new connection always belongs to the lcore which saw its SYN
+    int is_foreign              = 0;
+    int is_busy                 = 0;
+    uint16_t cookie_mss         = 0;
     ss_tcp_socket_t* socket     = ss_tcp_socket_lookup(&key);
+    if (socket == NULL && tcp_flags != TH_SYN) {
+        socket = ss_tcp_socket_lookup_foreign(&key, &is_busy);
+        is_foreign = socket != NULL;
+    }
+    // another lcore owns the connection; a socket here would split the stream
+    if (unlikely(is_busy)) {
+        SS_LOG(FINE, L3L4, "rx tcp packet for busy foreign socket dropped\n");
+        return 0;
+    }
+    if (socket == NULL && tcp_flags == TH_SYN && ss_tcp_syn_cookie_wanted(&key)) {
+        return ss_tcp_syn_cookie_send(&key, rx_buf, tx_buf);
+    }
+    if (socket == NULL && (tcp_flags & (TH_SYN | TH_RST | TH_FIN | TH_ACK)) == TH_ACK && ss_tcp_syn_cookie_active()) {
+        // while cookies are outstanding an unknown ACK must carry a valid one
+        cookie_mss = ss_tcp_syn_cookie_check(&key, rx_buf);
+        if (cookie_mss == 0) return 0;
+    }
     if (socket == NULL) {
         socket = ss_tcp_socket_create(&key, rx_buf);
     }
     if (unlikely(socket == NULL)) {
-        RTE_LOG(ERR, L3L4, "could not find or create tcp socket\n");
+        SS_LOG(ERR, L3L4, "could not find or create tcp socket\n");
         return -1;
     }
     
-    rte_spinlock_recursive_lock(&socket->lock);
+    // foreign sockets come back already locked
+    if (likely(!is_foreign)) rte_spinlock_recursive_lock(&socket->lock);
+    state = socket->state;
+    ss_tcp_ack_t ack = SS_TCP_ACK_NONE;
+
+    // the cookie stood in for SYN_RX, the handshake is already complete
+    if (cookie_mss) {
+        socket->state  = SS_TCP_OPEN;
+        socket->rx_mss = SS_MIN(cookie_mss, ss_tcp_rx_mss_get(socket));
+    }
+
+    // TIME_WAIT absorbs late segments; only a new SYN may reuse the tuple
+    if (socket->state == SS_TCP_TIME_WAIT) {
+        if (tcp_flags != TH_SYN) {
+            SS_LOG(FINE, L3L4, "rx tcp packet in time_wait dropped\n");
+            goto out;
+        }
+        socket->state = SS_TCP_SYN_RX;
+    }
+
     ss_tcp_prepare_rx(rx_buf, socket);
-    uint32_t curr_seq = 0;
 
     /*    
      * C: SYN
@@ -156,127 +349,500 @@ int ss_frame_handle_tcp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
      */
 
     if      (tcp_flags & TH_RST) {
-        RTE_LOG(FINE, L3L4, "rx tcp rst packet\n");
+        SS_LOG(FINE, L3L4, "rx tcp rst packet\n");
         // just delete the connection
         rv = ss_tcp_handle_close(socket, rx_buf, tx_buf);
     }
     else if (tcp_flags & TH_FIN) {
         // send RST (as if SO_LINGER is 0) and delete the connection
-        RTE_LOG(FINE, L3L4, "rx tcp fin packet\n");
+        SS_LOG(FINE, L3L4, "rx tcp fin packet\n");
         rv = ss_tcp_handle_close(socket, rx_buf, tx_buf);
     }
     else if (tcp_flags == TH_SYN) {
-        RTE_LOG(FINE, L3L4, "rx tcp syn packet\n");
+        SS_LOG(FINE, L3L4, "rx tcp syn packet\n");
         rv = ss_tcp_handle_open(socket, rx_buf, tx_buf);
     }
     else if (tcp_flags & TH_ACK || tcp_flags == 0) {
-        RTE_LOG(FINE, L3L4, "rx tcp ack packet\n");
-        rv = ss_tcp_handle_update(socket, rx_buf, tx_buf, &curr_seq);
+        SS_LOG(FINE, L3L4, "rx tcp ack packet\n");
+        rv = ss_tcp_handle_update(socket, rx_buf, tx_buf, &ack);
     }
     else {
-        RTE_LOG(ERR, L3L4, "unknown tcp flags: %s\n",
+        SS_LOG(ERR, L3L4, "unknown tcp flags: %s\n",
             ss_tcp_flags_dump(tcp_flags));
         rv = -1;
     }
     
-    // check for stale packets
-    if (socket->state != SS_TCP_SYN_RX && curr_seq < socket->last_ack_seq) {
-        RTE_LOG(DEBUG, L3L4, "rx tcp stale skipped packet\n");
+    // handle_update trims payload we already have, stale packets end up empty
+    if (socket->state == SS_TCP_TIME_WAIT) {
         goto out;
     }
     else if (rx_buf->data.l4_length == 0) {
-        RTE_LOG(FINE, L3L4, "rx tcp control packet\n");
+        SS_LOG(FINE, L3L4, "rx tcp control or stale packet\n");
         goto out;
     }
     else {
-        RTE_LOG(FINE, L3L4, "rx tcp data packet\n");
+        SS_LOG(FINE, L3L4, "rx tcp data packet\n");
     }
 
+    ss_tcp_handle_data(socket, rx_buf);
+    // the segment may have filled a hole in front of queued data
+    if (socket->rx_ooo_count) ss_tcp_ooo_drain(socket, rx_buf);
+    
+    out:
+    if (ack != SS_TCP_ACK_NONE) {
+        // delivering a message may have reopened a window the peer is stuck on
+        if (socket->rx_window < socket->rx_mss && ss_tcp_rx_window(socket) >= socket->rx_mss) {
+            ack = SS_TCP_ACK_NOW;
+        }
+        // the ack_list belongs to the owner, other lcores answer inline
+        if (likely(socket->lcore_id == rte_lcore_id())) {
+            ss_tcp_ack_schedule(socket, ack);
+        }
+        else {
+            ss_tcp_prepare_ack(socket, tx_buf);
+        }
+    }
+
+    ss_tcp_half_open_update(socket);
+
+    // a state change may bring the deadline forward; other lcores leave
+    // the wheel alone and the owner re-arms when the old deadline fires
+    if (socket->state != state && socket->lcore_id == rte_lcore_id()) {
+        ss_timer_wheel_add(&tcp_shards[socket->lcore_id].wheel, &socket->timer, ss_tcp_socket_deadline(socket));
+    }
+    rte_spinlock_recursive_unlock(&socket->lock);
+
+    return rv;
+}
+
+/* hand in-order payload at rx_buf->l4_offset to the port's extractor */
+int ss_tcp_handle_data(ss_tcp_socket_t* socket, ss_frame_t* rx_buf) {
     switch (rx_buf->data.dport) {
         case L4_PORT_DNS: {
-            RTE_LOG(DEBUG, L3L4, "rx tcp dns packet\n");
+            SS_LOG(DEBUG, L3L4, "rx tcp dns packet\n");
+            ss_dns_tcp_consume(&socket->rx_dns, rx_buf, rx_buf->l4_offset, rx_buf->data.l4_length);
             break;
         }
         case L4_PORT_SYSLOG: {
-            RTE_LOG(DEBUG, L3L4, "rx tcp syslog packet\n");
+            SS_LOG(DEBUG, L3L4, "rx tcp syslog packet\n");
             ss_tcp_extract_syslog(socket, rx_buf);
             break;
         }
         case L4_PORT_SYSLOG_TCP: {
-            RTE_LOG(DEBUG, L3L4, "rx tcp syslog-conn packet\n");
+            SS_LOG(DEBUG, L3L4, "rx tcp syslog-conn packet\n");
             ss_tcp_extract_syslog(socket, rx_buf);
             break;
         }
-        case L4_PORT_NETFLOW_1:
-        case L4_PORT_NETFLOW_2:
-        case L4_PORT_NETFLOW_3: {
-            RTE_LOG(DEBUG, L3L4, "rx tcp NetFlow packet\n");
+        default: {
+            if (ss_tcp_netflow_port(rx_buf->data.dport)) {
+                SS_LOG(DEBUG, L3L4, "rx tcp NetFlow packet\n");
+                ss_tcp_extract_netflow(socket, rx_buf);
+            }
             break;
         }
     }
     
-    out:
-    rte_spinlock_recursive_unlock(&socket->lock);
+    return 0;
+}
 
-    return rv;
+ss_tcp_framing_t ss_tcp_framing_load(const char* framing) {
+    if (!strcasecmp(framing, "auto"))            return SS_TCP_FRAMING_EMPTY;
+    if (!strcasecmp(framing, "octet_counted"))   return SS_TCP_FRAMING_OCTET_COUNTED;
+    if (!strcasecmp(framing, "non_transparent")) return SS_TCP_FRAMING_NON_TRANSPARENT;
+    return (ss_tcp_framing_t) -1;
+}
+
+const char* ss_tcp_framing_dump(ss_tcp_framing_t framing) {
+    switch (framing) {
+        case SS_TCP_FRAMING_EMPTY:           return "auto";
+        case SS_TCP_FRAMING_OCTET_COUNTED:   return "octet_counted";
+        case SS_TCP_FRAMING_NON_TRANSPARENT: return "non_transparent";
+        default:                             return "unknown";
+    }
+}
+
+/*
+ * Every foreign lookup ends in a hit, a miss, or a busy drop, and a busy
+ * drop only after its retries. Read in the reverse of the order the lcore
+ * writes them, so a running lcore cannot trip the check.
+ */
+static void ss_tcp_stats_check(unsigned int lcore_id) {
+    ss_tcp_stats_t* stats = &tcp_stats[lcore_id];
+    uint64_t busy, hits, retries, lookups;
+
+    busy    = stats->foreign_busy;
+    hits    = stats->foreign_hits;
+    rte_smp_rmb();
+    retries = stats->foreign_retries;
+    rte_smp_rmb();
+    lookups = stats->foreign_lookups;
+
+    if (hits + busy > lookups || retries < busy * (L4_TCP_FOREIGN_RETRIES - 1)) {
+        SS_LOG(ERR, L3L4, "lcore %u cross-lcore stats disagree: lookups %lu hits %lu retries %lu busy %lu\n",
+            lcore_id, lookups, hits, retries, busy);
+    }
+}
+
+int ss_tcp_stats_dump() {
+    ss_tcp_stats_t total;
+
+    if (rte_get_log_level() < RTE_LOG_NOTICE) return 0;
+
+    memset(&total, 0, sizeof(total));
+    for (unsigned int lcore_id = 0; lcore_id < RTE_MAX_LCORE; ++lcore_id) {
+        ss_tcp_stats_check(lcore_id);
+        total.half_open         += (uint64_t) rte_atomic32_read(&tcp_shards[lcore_id].half_open);
+        total.sockets_active    += tcp_stats[lcore_id].sockets_active;
+        total.sockets_peak       = SS_MAX(total.sockets_peak, tcp_stats[lcore_id].sockets_peak);
+        total.sockets_rejected  += tcp_stats[lcore_id].sockets_rejected;
+        total.buffer_exhausted  += tcp_stats[lcore_id].buffer_exhausted;
+        total.expired_syn       += tcp_stats[lcore_id].expired_syn;
+        total.expired_idle      += tcp_stats[lcore_id].expired_idle;
+        total.expired_time_wait += tcp_stats[lcore_id].expired_time_wait;
+        total.foreign_lookups   += tcp_stats[lcore_id].foreign_lookups;
+        total.foreign_hits      += tcp_stats[lcore_id].foreign_hits;
+        total.foreign_retries   += tcp_stats[lcore_id].foreign_retries;
+        total.foreign_busy      += tcp_stats[lcore_id].foreign_busy;
+        total.syslog_messages   += tcp_stats[lcore_id].syslog_messages;
+        total.syslog_truncated  += tcp_stats[lcore_id].syslog_truncated;
+        total.syslog_oversized  += tcp_stats[lcore_id].syslog_oversized;
+        total.framing_errors    += tcp_stats[lcore_id].framing_errors;
+        total.acks_sent         += tcp_stats[lcore_id].acks_sent;
+        total.acks_suppressed   += tcp_stats[lcore_id].acks_suppressed;
+        total.syn_source_limited += tcp_stats[lcore_id].syn_source_limited;
+        total.cookies_sent      += tcp_stats[lcore_id].cookies_sent;
+        total.cookies_validated += tcp_stats[lcore_id].cookies_validated;
+        total.cookies_rejected  += tcp_stats[lcore_id].cookies_rejected;
+        total.rx_retransmitted  += tcp_stats[lcore_id].rx_retransmitted;
+        total.rx_duplicate      += tcp_stats[lcore_id].rx_duplicate;
+        total.rx_out_of_window  += tcp_stats[lcore_id].rx_out_of_window;
+        total.rx_ooo_queued     += tcp_stats[lcore_id].rx_ooo_queued;
+        total.rx_ooo_dropped    += tcp_stats[lcore_id].rx_ooo_dropped;
+        total.netflow_messages  += tcp_stats[lcore_id].netflow_messages;
+        total.netflow_truncated += tcp_stats[lcore_id].netflow_truncated;
+        total.netflow_framing_errors += tcp_stats[lcore_id].netflow_framing_errors;
+    }
+
+    printf("TCP statistics =====================================\n"
+           "Active sockets: %22lu\n"
+           "Peak sockets per lcore: %14lu\n"
+           "Rejected sockets: %20lu\n"
+           "Buffer pool exhausted: %15lu\n"
+           "Expired handshakes: %18lu\n"
+           "Expired idle: %24lu\n"
+           "Expired time_wait: %19lu\n"
+           "Cross-lcore lookups: %17lu\n"
+           "Cross-lcore hits: %20lu\n"
+           "Cross-lcore retries: %17lu\n"
+           "Cross-lcore busy drops: %14lu\n"
+           "Syslog messages: %21lu\n"
+           "Truncated: %27lu\n"
+           "Oversized frames: %20lu\n"
+           "Framing errors: %22lu\n"
+           "ACKs sent: %27lu\n"
+           "ACKs suppressed: %21lu\n"
+           "Half-open sockets: %19lu\n"
+           "SYN source limited: %18lu\n"
+           "SYN cookies sent: %20lu\n"
+           "SYN cookies validated: %15lu\n"
+           "SYN cookies rejected: %16lu\n"
+           "Segments retransmitted: %14lu\n"
+           "Segments duplicate: %18lu\n"
+           "Segments out of window: %14lu\n"
+           "Segments out of order: %15lu\n"
+           "Out-of-order dropped: %16lu\n"
+           "IPFIX messages: %22lu\n"
+           "IPFIX truncated: %21lu\n"
+           "IPFIX framing errors: %16lu\n"
+           "====================================================\n",
+           total.sockets_active, total.sockets_peak, total.sockets_rejected, total.buffer_exhausted,
+           total.expired_syn, total.expired_idle, total.expired_time_wait,
+           total.foreign_lookups, total.foreign_hits, total.foreign_retries, total.foreign_busy,
+           total.syslog_messages, total.syslog_truncated,
+           total.syslog_oversized, total.framing_errors,
+           total.acks_sent, total.acks_suppressed,
+           total.half_open, total.syn_source_limited,
+           total.cookies_sent, total.cookies_validated, total.cookies_rejected,
+           total.rx_retransmitted, total.rx_duplicate, total.rx_out_of_window,
+           total.rx_ooo_queued, total.rx_ooo_dropped,
+           total.netflow_messages, total.netflow_truncated, total.netflow_framing_errors);
+
+    return 0;
+}
+
+static void ss_tcp_rx_release(ss_tcp_socket_t* socket) {
+    if (socket->rx_data == NULL) return;
+    rte_mempool_put(tcp_shards[socket->lcore_id].buffer_pools[socket->rx_class], socket->rx_data);
+    socket->rx_data = NULL;
+    socket->rx_size = 0;
+}
+
+static void ss_tcp_rx_reset(ss_tcp_socket_t* socket) {
+    ss_tcp_rx_release(socket);
+    socket->rx_framing         = ss_conf->syslog_framing;
+    socket->rx_frame_length    = 0;
+    socket->rx_frame_digits    = 0;
+    socket->rx_frame_remaining = 0;
+    socket->rx_in_frame        = 0;
+    socket->rx_truncated       = 0;
+    socket->rx_length          = 0;
+}
+
+/*
+ * Move the message into the smallest free buffer class holding size
+ * bytes. Falls back to larger classes when one is exhausted.
+ */
+static int ss_tcp_rx_grow(ss_tcp_socket_t* socket, uint32_t size) {
+    ss_tcp_shard_t* shard = &tcp_shards[socket->lcore_id];
+    void* rx_data = NULL;
+    int i;
+
+    for (i = 0; i < L4_TCP_BUFFER_CLASSES; ++i) {
+        if (tcp_buffer_sizes[i] < size) continue;
+        if (rte_mempool_get(shard->buffer_pools[i], &rx_data) == 0) break;
+    }
+    if (rx_data == NULL) {
+        ++tcp_stats[rte_lcore_id()].buffer_exhausted;
+        return -1;
+    }
+
+    if (socket->rx_length) rte_memcpy(rx_data, socket->rx_data, socket->rx_length);
+    ss_tcp_rx_release(socket);
+    socket->rx_data  = rx_data;
+    socket->rx_size  = tcp_buffer_sizes[i];
+    socket->rx_class = (uint8_t) i;
+    return 0;
+}
+
+/*
+ * Append to the reassembly buffer, growing it through the size classes
+ * up to tcp_message_max. Bytes past the cap (or past an exhausted pool)
+ * are dropped and the message is flagged as truncated.
+ */
+static void ss_tcp_rx_append(ss_tcp_socket_t* socket, const uint8_t* data, uint32_t length) {
+    uint32_t room = ss_conf->tcp_message_max - socket->rx_length;
+
+    if (length > room) {
+        socket->rx_truncated = 1;
+        length = room;
+    }
+    if (length == 0) return;
+
+    if (socket->rx_length + length > socket->rx_size &&
+        ss_tcp_rx_grow(socket, socket->rx_length + length)) {
+        SS_LOG(ERR, L3L4, "syslog_tcp: could not grow rx_data to %u bytes\n", socket->rx_length + length);
+        socket->rx_truncated = 1;
+        length = socket->rx_size - socket->rx_length;
+        if (length == 0) return;
+    }
+
+    rte_memcpy(socket->rx_data + socket->rx_length, data, length);
+    socket->rx_length += length;
+}
+
+static void ss_tcp_rx_deliver(ss_tcp_socket_t* socket, ss_frame_t* rx_buf) {
+    ss_tcp_stats_t* stats = &tcp_stats[rte_lcore_id()];
+    uint32_t length = socket->rx_length;
+
+    // non-transparent senders commonly use CRLF
+    while (length && (socket->rx_data[length - 1] == '\r' || socket->rx_data[length - 1] == '\0')) --length;
+
+    if (length) {
+        SS_LOG(FINER, L3L4, "syslog_tcp: deliver %u byte %s message truncated %d\n",
+            length, ss_tcp_framing_dump(socket->rx_framing), socket->rx_truncated);
+        ++stats->syslog_messages;
+        if (socket->rx_truncated) ++stats->syslog_truncated;
+        // XXX: check return value
+        ss_extract_syslog("tcp_syslog", rx_buf, socket->rx_data, (uint16_t) length);
+    }
+
+    socket->rx_length    = 0;
+    socket->rx_truncated = 0;
+    ss_tcp_rx_release(socket);
+}
+
+/*
+ * RFC 6587 3.4.2: messages are delimited by LF. A message which exceeds
+ * tcp_message_max is delivered cut short once its LF arrives.
+ */
+static const uint8_t* ss_tcp_syslog_delimited(ss_tcp_socket_t* socket, ss_frame_t* rx_buf, const uint8_t* p, const uint8_t* end) {
+    const uint8_t* lf = memchr(p, '\n', (size_t) (end - p));
+
+    ss_tcp_rx_append(socket, p, (uint32_t) ((lf ? lf : end) - p));
+    if (!lf) return end;
+
+    ss_tcp_rx_deliver(socket, rx_buf);
+    return lf + 1;
+}
+
+/*
+ * RFC 6587 3.4.1: each message is preceded by MSG-LEN SP. Frames larger
+ * than tcp_message_max are counted as oversized; their first bytes are
+ * delivered and the remainder skipped so the stream stays in sync.
+ */
+static const uint8_t* ss_tcp_syslog_octet_counted(ss_tcp_socket_t* socket, ss_frame_t* rx_buf, const uint8_t* p, const uint8_t* end) {
+    uint32_t length;
+    char digits[L4_TCP_FRAME_DIGITS_MAX + 1];
+
+    if (socket->rx_in_frame) {
+        length = (uint32_t) SS_MIN((size_t) (end - p), socket->rx_frame_remaining);
+        ss_tcp_rx_append(socket, p, length);
+        socket->rx_frame_remaining -= length;
+        if (socket->rx_frame_remaining == 0) {
+            socket->rx_in_frame = 0;
+            ss_tcp_rx_deliver(socket, rx_buf);
+        }
+        return p + length;
+    }
+
+    if (*p >= '0' && *p <= '9' && (socket->rx_frame_digits || *p != '0') &&
+        socket->rx_frame_digits < L4_TCP_FRAME_DIGITS_MAX) {
+        socket->rx_frame_length = socket->rx_frame_length * 10 + (uint32_t) (*p - '0');
+        ++socket->rx_frame_digits;
+        return p + 1;
+    }
+
+    if (*p == ' ' && socket->rx_frame_digits) {
+        if (socket->rx_frame_length > ss_conf->tcp_message_max) {
+            ++tcp_stats[rte_lcore_id()].syslog_oversized;
+        }
+        socket->rx_frame_remaining = socket->rx_frame_length;
+        socket->rx_in_frame        = 1;
+        socket->rx_frame_length    = 0;
+        socket->rx_frame_digits    = 0;
+        return p + 1;
+    }
+
+    // some senders add a trailer between frames anyway
+    if ((*p == '\n' || *p == '\r') && !socket->rx_frame_digits) return p + 1;
+
+    // not octet counting after all, replay the digits as message data
+    ++tcp_stats[rte_lcore_id()].framing_errors;
+    ss_tcp_key_dump("syslog_tcp: octet framing error, fall back to non_transparent", &socket->key);
+    if (socket->rx_frame_digits) {
+        snprintf(digits, sizeof(digits), "%u", socket->rx_frame_length);
+        ss_tcp_rx_append(socket, (uint8_t*) digits, socket->rx_frame_digits);
+    }
+    socket->rx_framing      = SS_TCP_FRAMING_NON_TRANSPARENT;
+    socket->rx_frame_length = 0;
+    socket->rx_frame_digits = 0;
+    return p;
 }
 
 int ss_tcp_extract_syslog(ss_tcp_socket_t* socket, ss_frame_t* rx_buf) {
-    int    rv    = 0;
-    size_t len   = 0;
-    char*  c     = (char*) rx_buf->l4_offset;
-    char*  limit = (char*) (rx_buf->l4_offset + rx_buf->data.l4_length);
-    char*  next  = (char*) rx_buf->l4_offset;
+    const uint8_t* p   = rx_buf->l4_offset;
+    const uint8_t* end = rx_buf->l4_offset + rx_buf->data.l4_length;
     
-    if (rte_get_log_level() >= RTE_LOG_FINEST) {
-        RTE_LOG(FINEST, L3L4, "dump tcp syslog segment:\n");
+    if (SS_LOG_ENABLED(FINEST)) {
+        SS_LOG(FINEST, L3L4, "dump tcp syslog segment:\n");
         rte_pktmbuf_dump(stderr, rx_buf->mbuf, rte_pktmbuf_pkt_len(rx_buf->mbuf));
     }
     
-    while (c < limit) {
-        if (*c == '\n') {
-            // append to existing rx_data
-            len = (size_t) SS_MIN((uint8_t*) c - rx_buf->l4_offset, (long) sizeof(socket->rx_data) - socket->rx_length);
-            RTE_LOG(FINER, L3L4, "syslog_tcp: copy %zu bytes to rx_data from %hu to %hu due to delimiter\n",
-                len, socket->rx_length, (uint16_t) (socket->rx_length + len));
-            rte_memcpy((uint8_t*) (socket->rx_data + socket->rx_length), (uint8_t*) rx_buf->l4_offset, len);
-            socket->rx_length += len;
-            socket->rx_data[socket->rx_length + 1]  = '\0';
-
-            //ss_buffer_dump("delimited message", socket->rx_data, socket->rx_length);
-            // process full message, XXX: check return value
-            rv = ss_extract_syslog("tcp_syslog", rx_buf, socket->rx_data, socket->rx_length);
-
-            // mark new message start
-            socket->rx_length = 0;
-            next = c + 1;
+    // RFC 6587 3.4: octet counting starts with a non-zero digit, a
+    // non-transparent message starts with its PRI '<'
+    if (socket->rx_framing == SS_TCP_FRAMING_EMPTY && p < end) {
+        socket->rx_framing = (*p >= '1' && *p <= '9') ?
+            SS_TCP_FRAMING_OCTET_COUNTED : SS_TCP_FRAMING_NON_TRANSPARENT;
+        SS_LOG(FINE, L3L4, "syslog_tcp: detected %s framing\n", ss_tcp_framing_dump(socket->rx_framing));
+    }
+    
+    while (p < end) {
+        if (socket->rx_framing == SS_TCP_FRAMING_OCTET_COUNTED) {
+            p = ss_tcp_syslog_octet_counted(socket, rx_buf, p, end);
+        }
+        else {
+            p = ss_tcp_syslog_delimited(socket, rx_buf, p, end);
         }
-        ++c;
     }
+    
+    return 0;
+}
 
-    if (next < limit) {
-        len = (size_t) SS_MIN(limit - next, (long) sizeof(socket->rx_data) - socket->rx_length);
-        RTE_LOG(FINER, L3L4, "syslog_tcp: copy %zu bytes to rx_data from %hu to %hu due to segment end\n",
-            len, socket->rx_length, (uint16_t) (socket->rx_length + len));
-        rte_memcpy((uint8_t*) (socket->rx_data + socket->rx_length), (uint8_t*) next, len);
-        socket->rx_length += len;
-        socket->rx_data[socket->rx_length + 1]  = '\0';
+int ss_tcp_netflow_port(uint16_t port) {
+    for (uint32_t i = 0; i < ss_conf->netflow_tcp_ports_count; ++i) {
+        if (ss_conf->netflow_tcp_ports[i] == port) return 1;
     }
-    
-    if (socket->rx_length >= L4_TCP_BUFFER_SIZE) {
-        char message[256];
-        snprintf(message, sizeof(message), "syslog_tcp: truncate message at %hu bytes due to buffer limit",
-            socket->rx_length);
-        ss_tcp_key_dump(message, &socket->key);
+    return 0;
+}
+
+static void ss_tcp_netflow_deliver(ss_tcp_socket_t* socket, const uint8_t* message, uint32_t length) {
+    ++tcp_stats[rte_lcore_id()].netflow_messages;
+    netflow_message_handle(socket->rx_netflow_peer, message, (uint16_t) length);
+}
+
+/* check the version and length words, the first 4 bytes of a message header */
+static int ss_tcp_netflow_header(ss_tcp_socket_t* socket, const uint8_t* header, uint32_t* length) {
+    uint16_t version = (uint16_t) (header[0] << 8 | header[1]);
 
-        //ss_buffer_dump("truncated message", socket->rx_data, socket->rx_length);
-        // process full message, XXX: check return value
-        rv = ss_extract_syslog("tcp_syslog", rx_buf, socket->rx_data, socket->rx_length);
+    *length = (uint32_t) (header[2] << 8 | header[3]);
+    if (version == 10 && *length >= L4_IPFIX_HEADER_SIZE) return 0;
 
-        // mark new message start
-        socket->rx_length = 0;
+    ++tcp_stats[rte_lcore_id()].netflow_framing_errors;
+    SS_LOG(ERR, L3L4, "netflow_tcp: cannot frame version %hu length %u\n", version, *length);
+    ss_tcp_key_dump("netflow_tcp: framing lost, ignore the rest of the stream", &socket->key);
+    socket->rx_desync = 1;
+    ss_tcp_rx_reset(socket);
+    return -1;
+}
+
+/*
+ * RFC 7011 10.4: IPFIX over TCP is a bare stream of messages, each framed
+ * by the length in its own header. A message inside one segment is
+ * decoded from the mbuf, a split one is collected in the reassembly
+ * buffer first. NetFlow v9 headers carry a record count instead of a
+ * length, so v9 cannot be framed and ends decoding like any bad header.
+ */
+int ss_tcp_extract_netflow(ss_tcp_socket_t* socket, ss_frame_t* rx_buf) {
+    const uint8_t* p   = rx_buf->l4_offset;
+    const uint8_t* end = rx_buf->l4_offset + rx_buf->data.l4_length;
+    struct xaddr source;
+    uint32_t length, count;
+
+    if (socket->rx_desync) return 0;
+    if (socket->rx_netflow_peer == NULL) {
+        if (addr_frame_to_xaddr(rx_buf, &source) == -1) return -1;
+        socket->rx_netflow_peer = new_session_peer(&source);
+        if (socket->rx_netflow_peer == NULL) return -1;
     }
-    
+
+    while (p < end) {
+        if (!socket->rx_in_frame) {
+            if (socket->rx_length == 0 && end - p >= 4) {
+                if (ss_tcp_netflow_header(socket, p, &length)) return -1;
+                if (length <= (uint32_t) (end - p)) {
+                    ss_tcp_netflow_deliver(socket, p, length);
+                    p += length;
+                    continue;
+                }
+            }
+            count = (uint32_t) SS_MIN((size_t) (end - p), 4 - socket->rx_length);
+            ss_tcp_rx_append(socket, p, count);
+            p += count;
+            if (socket->rx_length < 4) continue;
+            if (ss_tcp_netflow_header(socket, socket->rx_data, &length)) return -1;
+            socket->rx_frame_remaining = length - 4;
+            socket->rx_in_frame        = 1;
+            continue;
+        }
+
+        count = (uint32_t) SS_MIN((size_t) (end - p), socket->rx_frame_remaining);
+        ss_tcp_rx_append(socket, p, count);
+        socket->rx_frame_remaining -= count;
+        p += count;
+        if (socket->rx_frame_remaining) continue;
+
+        if (socket->rx_truncated) {
+            ++tcp_stats[rte_lcore_id()].netflow_truncated;
+        }
+        else {
+            ss_tcp_netflow_deliver(socket, socket->rx_data, socket->rx_length);
+        }
+        socket->rx_in_frame  = 0;
+        socket->rx_length    = 0;
+        socket->rx_truncated = 0;
+        ss_tcp_rx_release(socket);
+    }
+
     return 0;
 }
 
@@ -285,18 +851,31 @@ int ss_tcp_socket_init(ss_tcp_key_t* key, ss_tcp_socket_t* socket) {
     rte_memcpy(&socket->key, key, sizeof(ss_tcp_key_t));
     rte_spinlock_recursive_init(&socket->lock);
     socket->state = SS_TCP_CLOSED;
+    socket->rx_framing = ss_conf->syslog_framing;
+    socket->rx_mss = L4_TCP_MSS_MIN;
     return 0;
 }
 
 ss_tcp_socket_t* ss_tcp_socket_create(ss_tcp_key_t* key, ss_frame_t* rx_buf) {
     int is_error = 0;
+    unsigned int lcore_id = rte_lcore_id();
+    ss_tcp_shard_t* shard = &tcp_shards[lcore_id];
+    ss_tcp_stats_t* stats = &tcp_stats[lcore_id];
+    ss_tcp_socket_t* socket = NULL;
     
     ss_tcp_key_dump("create socket for key", key);
-    // XXX: should these be allocated from jemalloc or RTE alloc?
-    ss_tcp_socket_t* socket = je_calloc(1, sizeof(ss_tcp_socket_t));
-    if (socket == NULL) { is_error = 1; goto error_out; }
+    if (rte_mempool_get(shard->socket_pool, (void**) &socket)) {
+        socket = NULL;
+        is_error = 1;
+        goto error_out;
+    }
     
     ss_tcp_socket_init(key, socket);
+    socket->lcore_id = (uint16_t) lcore_id;
+    socket->timeouts = ss_tcp_timeouts_get(rte_bswap16(key->dport));
+    socket->rx_ticks = rte_rdtsc();
+    // picked up mid-stream, e.g. after a restart; a SYN resets this in prepare_rx
+    socket->rx_next_seq = rte_bswap32(rx_buf->tcp->seq);
 
     if (rx_buf->tcp->th_flags == TH_SYN) {
         socket->state = SS_TCP_SYN_RX;
@@ -305,64 +884,145 @@ ss_tcp_socket_t* ss_tcp_socket_create(ss_tcp_key_t* key, ss_frame_t* rx_buf) {
         socket->state = SS_TCP_UNKNOWN;
     }
     
-    rte_rwlock_write_lock(&tcp_hash_lock);
-    int32_t socket_id = rte_hash_add_key(tcp_hash, key);
+    rte_rwlock_write_lock(&shard->lock);
+    int32_t socket_id = rte_hash_add_key(shard->hash, key);
     socket->id = (uint64_t) socket_id;
     if (socket_id >= 0) {
-        tcp_sockets[socket->id] = socket;
+        shard->sockets[socket->id] = socket;
     }
     else {
         is_error = 1;
     }
-    rte_rwlock_write_unlock(&tcp_hash_lock);
+    rte_rwlock_write_unlock(&shard->lock);
 
-    RTE_LOG(INFO, L3L4, "new tcp socket: sport: %hu dport: %hu id: %lu is_error: %d\n",
-        rte_bswap16(key->sport), rte_bswap16(key->dport), socket->id, is_error);
+    SS_LOG(INFO, L3L4, "new tcp socket: sport: %hu dport: %hu lcore: %u id: %lu is_error: %d\n",
+        rte_bswap16(key->sport), rte_bswap16(key->dport), lcore_id, socket->id, is_error);
 
     error_out:
     if (unlikely(is_error)) {
-        if (socket) { je_free(socket); socket = NULL; }
-        RTE_LOG(ERR, L3L4, "failed to allocate tcp socket\n");
+        if (socket) { rte_mempool_put(shard->socket_pool, socket); socket = NULL; }
+        ++stats->sockets_rejected;
+        SS_LOG(ERR, L3L4, "failed to allocate tcp socket, table full\n");
         return NULL;
     }
 
+    ++stats->sockets_active;
+    if (stats->sockets_active > stats->sockets_peak) stats->sockets_peak = stats->sockets_active;
+    ss_timer_wheel_add(&shard->wheel, &socket->timer, ss_tcp_socket_deadline(socket));
+
     return socket;
 }
 
-int ss_tcp_socket_delete(ss_tcp_key_t* key, bool is_locked) {
-    ss_tcp_key_dump("delete socket for key", key);
+/*
+ * Only the owning lcore deletes. Once the key is gone from the shard no
+ * other lcore can find the socket, and taking its lock waits out any
+ * other lcore still using it from the slow path.
+ */
+int ss_tcp_socket_delete(ss_tcp_socket_t* socket) {
+    ss_tcp_shard_t* shard = &tcp_shards[socket->lcore_id];
+
+    ss_tcp_key_dump("delete socket for key", &socket->key);
 
-    if (likely(!is_locked)) rte_rwlock_write_lock(&tcp_hash_lock);
-    int32_t socket_id = rte_hash_del_key(tcp_hash, key);
-    ss_tcp_socket_t* socket = ((int32_t) socket_id) < 0 ? NULL : tcp_sockets[socket_id];
-    if (likely(!is_locked)) rte_rwlock_write_unlock(&tcp_hash_lock);
+    rte_rwlock_write_lock(&shard->lock);
+    int32_t socket_id = rte_hash_del_key(shard->hash, &socket->key);
+    if (socket_id >= 0) shard->sockets[socket_id] = NULL;
+    rte_rwlock_write_unlock(&shard->lock);
 
-    if (!socket) return -1;
+    if (socket_id < 0) return -1;
     
+    ss_timer_wheel_remove(&shard->wheel, &socket->timer);
+    if (socket->ack_queued) TAILQ_REMOVE(&shard->ack_list, socket, ack_entry);
+    rte_spinlock_recursive_lock(&socket->lock);
     socket->state = SS_TCP_CLOSED;
-    je_free(socket);
-    tcp_sockets[socket_id] = NULL;
+    ss_tcp_half_open_update(socket);
+    rte_spinlock_recursive_unlock(&socket->lock);
+
+    ss_tcp_rx_release(socket);
+    ss_tcp_ooo_release(socket);
+    ss_dns_tcp_reasm_reset(&socket->rx_dns);
+    if (socket->rx_netflow_peer) delete_session_peer(socket->rx_netflow_peer);
+    socket->rx_netflow_peer = NULL;
+    rte_mempool_put(shard->socket_pool, socket);
+    --tcp_stats[rte_lcore_id()].sockets_active;
 
     return 0;
 }
 
+/* fast path: the calling lcore's own shard, no locking */
 ss_tcp_socket_t* ss_tcp_socket_lookup(ss_tcp_key_t* key) {
+    ss_tcp_shard_t* shard = &tcp_shards[rte_lcore_id()];
+
     ss_tcp_key_dump("find socket for key", key);
-    rte_rwlock_read_lock(&tcp_hash_lock);
-    int32_t socket_id = rte_hash_lookup(tcp_hash, key);
-    rte_rwlock_read_unlock(&tcp_hash_lock);
-    ss_tcp_socket_t* socket = ((int32_t) socket_id) < 0 ? NULL : tcp_sockets[socket_id];
+    int32_t socket_id = rte_hash_lookup(shard->hash, key);
+    ss_tcp_socket_t* socket = socket_id < 0 ? NULL : shard->sockets[socket_id];
+    if (socket) {
+        SS_LOG(DEBUG, L3L4, "found socket at id: %d\n", socket_id);
+    }
+    return socket;
+}
+
+/*
+ * Slow path: search the other lcores' shards. The socket is returned
+ * locked so its owner cannot free it underneath us. The lock is only
+ * tried, since the owner may hold it while waiting for our read lock;
+ * the read lock is let go between tries. When the owner still holds it
+ * after L4_TCP_FOREIGN_RETRIES, returns NULL with *busy set: the
+ * connection exists, so the caller must drop the segment, never create
+ * a second socket for it.
+ */
+ss_tcp_socket_t* ss_tcp_socket_lookup_foreign(ss_tcp_key_t* key, int* busy) {
+    unsigned int self = rte_lcore_id();
+    unsigned int lcore_id;
+    ss_tcp_stats_t* stats = &tcp_stats[self];
+    ss_tcp_shard_t* shard;
+    ss_tcp_socket_t* socket = NULL;
+    int32_t socket_id;
+
+    *busy = 0;
+    ++stats->foreign_lookups;
+    for (int attempt = 0; attempt < L4_TCP_FOREIGN_RETRIES; ++attempt) {
+        if (attempt) {
+            ++stats->foreign_retries;
+            rte_pause();
+        }
+        *busy = 0;
+        RTE_LCORE_FOREACH(lcore_id) {
+            if (lcore_id == self) continue;
+            shard = &tcp_shards[lcore_id];
+            rte_rwlock_read_lock(&shard->lock);
+            socket_id = rte_hash_lookup(shard->hash, key);
+            socket = socket_id < 0 ? NULL : shard->sockets[socket_id];
+            if (socket && !rte_spinlock_recursive_trylock(&socket->lock)) {
+                socket = NULL;
+                *busy = 1;
+            }
+            rte_rwlock_read_unlock(&shard->lock);
+            // a key lives in one shard at most
+            if (socket_id >= 0) break;
+        }
+        if (!*busy) break;
+    }
+
+    if (*busy) {
+        ++stats->foreign_busy;
+        return NULL;
+    }
     if (socket) {
-        RTE_LOG(DEBUG, L3L4, "found socket at id: %u\n", socket_id);
+        ++stats->foreign_hits;
+        SS_LOG(DEBUG, L3L4, "found socket owned by lcore %u on lcore %u\n", socket->lcore_id, self);
     }
     return socket;
 }
 
 int ss_tcp_prepare_rx(ss_frame_t* rx_buf, ss_tcp_socket_t* socket) {
     socket->rx_ticks = rte_rdtsc();
-    if (socket->state == SS_TCP_SYN_RX) {
+    socket->port_id  = rx_buf->data.port_id;
+    ether_addr_copy(&rx_buf->eth->s_addr, &socket->peer_addr);
+    if (socket->state == SS_TCP_SYN_RX && rx_buf->tcp->th_flags == TH_SYN) {
         socket->last_seq = rte_bswap32(rx_buf->tcp->seq);
         socket->last_ack_seq = rte_bswap32(rx_buf->tcp->ack_seq);
+        socket->rx_next_seq = socket->last_seq + 1;
+        ss_tcp_ooo_release(socket);
     }
     return 0;
 }
@@ -378,8 +1038,8 @@ int ss_tcp_prepare_tx(ss_frame_t* tx_buf, ss_tcp_socket_t* socket, ss_tcp_state_
         socket->last_ack_seq = rte_bswap32(tx_buf->tcp->ack_seq);
     }
 
-    if (rte_get_log_level() >= RTE_LOG_DEBUG) {
-        RTE_LOG(DEBUG, L3L4, "tx tcp packet: sport: %hu dport: %hu seq: %u ack: %u hlen: %hu flags: %s wsize: %hu\n",
+    if (SS_LOG_ENABLED(DEBUG)) {
+        SS_LOG(DEBUG, L3L4, "tx tcp packet: sport: %hu dport: %hu seq: %u ack: %u hlen: %hu flags: %s wsize: %hu\n",
             rte_bswap16(tcp->source), rte_bswap16(tcp->dest),
             rte_bswap32(tcp->seq),    rte_bswap32(tcp->ack_seq),
             (uint16_t) (4 * tcp->doff), ss_tcp_flags_dump(tcp->th_flags),
@@ -401,7 +1061,7 @@ int ss_tcp_handle_close(ss_tcp_socket_t* socket, ss_frame_t* rx_buf, ss_frame_t*
     
     rv = ss_frame_prepare_tcp(rx_buf, tx_buf);
     if (rv) {
-        RTE_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf, error: %d\n", rv);
+        SS_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf, error: %d\n", rv);
         return -1;
     }
     
@@ -411,111 +1071,559 @@ int ss_tcp_handle_close(ss_tcp_socket_t* socket, ss_frame_t* rx_buf, ss_frame_t*
     tx_buf->tcp->ack_seq  = 0;
     tx_buf->tcp->doff     = L4_TCP_HEADER_OFFSET;
     tx_buf->tcp->th_flags = TH_RST;
-    tx_buf->tcp->window   = rte_bswap16(L4_TCP_WINDOW_SIZE);
+    tx_buf->tcp->window   = rte_bswap16(0x0000);
     tx_buf->tcp->check    = rte_bswap16(0x0000);
     tx_buf->tcp->urg_ptr  = rte_bswap16(0x0000);
     
     rv = ss_tcp_prepare_checksum(tx_buf);
     if (rv) {
-        RTE_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf checksum, error: %d\n", rv);
+        SS_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf checksum, error: %d\n", rv);
         return -1;
     }
     
     shutdown_only:
     ss_tcp_prepare_tx(tx_buf, socket, SS_TCP_CLOSED);
-    return ss_tcp_socket_delete(&socket->key, 0);
+    // linger in TIME_WAIT so retransmitted FINs do not recreate the socket
+    socket->state = SS_TCP_TIME_WAIT;
+    ss_tcp_rx_reset(socket);
+    return 0;
 }
 
 int ss_tcp_handle_open(ss_tcp_socket_t* socket, ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
     int rv = 0;
 
+    // SYN flag is set. Client is opening connection.
+    // Send back server's initial seq_num.
+    uint32_t rand_seq     = (uint32_t) rte_rand();
+    socket->tx_next_seq   = rand_seq + 1;
+    socket->rx_window     = ss_tcp_rx_window(socket);
+
+    rv = ss_tcp_prepare_syn_ack(rx_buf, tx_buf, rand_seq, socket->rx_window);
+    if (rv) return -1;
+
+    ss_tcp_prepare_tx(tx_buf, socket, SS_TCP_SYN_TX);
+    
+    return 0;
+}
+
+int ss_tcp_prepare_syn_ack(ss_frame_t* rx_buf, ss_frame_t* tx_buf, uint32_t isn, uint16_t window) {
+    int rv = 0;
+
     rv = ss_frame_prepare_tcp(rx_buf, tx_buf);
     if (rv) {
-        RTE_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf, error: %d\n", rv);
+        SS_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf, error: %d\n", rv);
         return -1;
     }
     
-    // SYN flag is set. Client is opening connection.
-    // Send back server's initial seq_num.
-    uint32_t rand_seq     = (uint32_t) rte_rand();
-    tx_buf->tcp->seq      = rte_bswap32(rand_seq);
+    tx_buf->tcp->seq      = rte_bswap32(isn);
     // ACK flag is set. Client sent initial seq_num.
     // Send back initial seq_num + 1.
     tx_buf->tcp->ack_seq  = rte_bswap32(rte_bswap32(rx_buf->tcp->seq) + 1);
-    tx_buf->tcp->doff     = L4_TCP_HEADER_OFFSET + 2; // 1-byte MSS, 1-byte window scale
+    tx_buf->tcp->doff     = L4_TCP_HEADER_OFFSET + 1; // 4-byte MSS
     tx_buf->tcp->th_flags = TH_SYN | TH_ACK;
-    tx_buf->tcp->window   = rte_bswap16(L4_TCP_WINDOW_SIZE);
+    tx_buf->tcp->window   = rte_bswap16(window);
     tx_buf->tcp->check    = rte_bswap16(0x0000);
     tx_buf->tcp->urg_ptr  = rte_bswap16(0x0000);
-    // add the two most fundamental hard-coded options
+    // the window never exceeds tcp_message_max, so no window scale option
     uint32_t* tcp_mss     = (uint32_t*) rte_pktmbuf_append(tx_buf->mbuf, sizeof(uint32_t));
     if (!tcp_mss) {
-        RTE_LOG(ERR, L3L4, "could not add tcp_mss to tx_mbuf\n");
+        SS_LOG(ERR, L3L4, "could not add tcp_mss to tx_mbuf\n");
         return -1;
     }
     // mss: kind 2, length 4, uint16_t mss
-    *tcp_mss              = rte_bswap32(0x0204 << 16 | ss_tcp_rx_mss_get(socket));
-
-    uint32_t* win_scale   = (uint32_t*) rte_pktmbuf_append(tx_buf->mbuf, sizeof(uint32_t));
-    if (!win_scale) {
-        RTE_LOG(ERR, L3L4, "could not add win_scale to tx_mbuf\n");
-        return -1;
-    }
-    // win_scale: kind 3, length 3, uint8_t shift, followed by uint8_t nop (0x01)
-    *win_scale            = rte_bswap32(0x0303 << 16 | ((L4_TCP_WINDOW_SHIFT & 0xff) << 8) | 0x1);
+    *tcp_mss              = rte_bswap32(0x0204 << 16 | ss_tcp_rx_mss_get(NULL));
     
     rv = ss_tcp_prepare_checksum(tx_buf);
     if (rv) {
-        RTE_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf checksum, error: %d\n", rv);
+        SS_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf checksum, error: %d\n", rv);
         return -1;
     }
-    
-    ss_tcp_prepare_tx(tx_buf, socket, SS_TCP_SYN_TX);
-    
+
     return 0;
 }
 
-int ss_tcp_handle_update(ss_tcp_socket_t* socket, ss_frame_t* rx_buf, ss_frame_t* tx_buf, uint32_t* curr_ack_seq_ptr) {
-    int rv = 0;
-    
+/* the MSS option of a SYN, or the RFC 879 default when there is none */
+uint16_t ss_tcp_syn_mss_get(ss_frame_t* rx_buf) {
+    uint8_t* opt = (uint8_t*) rx_buf->tcp + sizeof(tcp_hdr_t);
+    uint8_t* end = (uint8_t*) rx_buf->tcp + 4 * rx_buf->tcp->doff;
+    uint8_t* pkt_end = rte_pktmbuf_mtod(rx_buf->mbuf, uint8_t*) + rte_pktmbuf_data_len(rx_buf->mbuf);
+
+    if (end > pkt_end) end = pkt_end;
+    while (opt < end && *opt != TCPOPT_EOL) {
+        if (*opt == TCPOPT_NOP) { ++opt; continue; }
+        if (opt + 1 >= end || opt[1] < 2 || opt + opt[1] > end) break;
+        if (*opt == TCPOPT_MAXSEG && opt[1] == TCPOLEN_MAXSEG) return (uint16_t) (opt[2] << 8 | opt[3]);
+        opt += opt[1];
+    }
+
+    return L4_TCP_MSS_MIN;
+}
+
+static uint32_t ss_tcp_syn_source_bucket(ss_tcp_key_t* key) {
+    return rte_hash_crc(key->sip, IPV6_ALEN, 0) & (L4_TCP_SYN_SOURCE_BUCKETS - 1);
+}
+
+/*
+ * Keep the owner's SYN backlog in step with the socket state. Per-source
+ * counts are bucketed by address hash, so collisions only ever make the
+ * per-source limit stricter.
+ */
+void ss_tcp_half_open_update(ss_tcp_socket_t* socket) {
+    ss_tcp_shard_t* shard = &tcp_shards[socket->lcore_id];
+    uint8_t half_open     = socket->state == SS_TCP_SYN_RX;
+    uint32_t bucket;
+
+    if (half_open == socket->half_open) return;
+
+    socket->half_open = half_open;
+    bucket = ss_tcp_syn_source_bucket(&socket->key);
+    if (half_open) {
+        rte_atomic32_inc(&shard->half_open);
+        rte_atomic32_inc(&shard->syn_sources[bucket]);
+    }
+    else {
+        rte_atomic32_dec(&shard->half_open);
+        rte_atomic32_dec(&shard->syn_sources[bucket]);
+    }
+}
+
+void ss_tcp_syn_cookie_init(void) {
+    uint64_t word;
+    FILE* urandom = fopen("/dev/urandom", "r");
+
+    if (urandom && fread(tcp_cookie_secret, sizeof(tcp_cookie_secret), 1, urandom) == 1) {
+        fclose(urandom);
+        return;
+    }
+    if (urandom) fclose(urandom);
+
+    SS_LOG(WARNING, L3L4, "could not read /dev/urandom, seeding syn cookies from rte_rand\n");
+    for (size_t i = 0; i < sizeof(tcp_cookie_secret); i += sizeof(word)) {
+        word = rte_rand() ^ rte_rdtsc();
+        rte_memcpy(tcp_cookie_secret + i, &word, sizeof(word));
+    }
+}
+
+/* whether a SYN for key should get a cookie instead of a socket, a limit of 0 is off */
+int ss_tcp_syn_cookie_wanted(ss_tcp_key_t* key) {
+    ss_tcp_shard_t* shard = &tcp_shards[rte_lcore_id()];
+
+    if (tcp_syn_backlog && (uint32_t) rte_atomic32_read(&shard->half_open) >= tcp_syn_backlog) return 1;
+    if (ss_conf->tcp_syn_source_max &&
+        (uint32_t) rte_atomic32_read(&shard->syn_sources[ss_tcp_syn_source_bucket(key)]) >= ss_conf->tcp_syn_source_max) {
+        ++tcp_stats[rte_lcore_id()].syn_source_limited;
+        return 1;
+    }
+    return 0;
+}
+
+/* cookies are only worth checking while some may still be outstanding */
+int ss_tcp_syn_cookie_active(void) {
+    ss_tcp_shard_t* shard = &tcp_shards[rte_lcore_id()];
+    uint64_t lifetime     = (2ULL << L4_TCP_COOKIE_SHIFT) * rte_get_tsc_hz();
+
+    return shard->cookie_tsc && rte_rdtsc() - shard->cookie_tsc < lifetime;
+}
+
+static uint32_t ss_tcp_syn_cookie_count(void) {
+    return (uint32_t) ((rte_rdtsc() / rte_get_tsc_hz()) >> L4_TCP_COOKIE_SHIFT) & 0x1f;
+}
+
+static uint32_t ss_tcp_syn_cookie_mac(ss_tcp_key_t* key, uint32_t peer_isn, uint32_t count, uint32_t mss_index) {
+    uint8_t data[sizeof(ss_tcp_key_t) + 2 * sizeof(uint32_t)];
+    uint32_t extra = count << 8 | mss_index;
+
+    rte_memcpy(data, key, sizeof(ss_tcp_key_t));
+    rte_memcpy(data + sizeof(ss_tcp_key_t), &peer_isn, sizeof(peer_isn));
+    rte_memcpy(data + sizeof(ss_tcp_key_t) + sizeof(peer_isn), &extra, sizeof(extra));
+    return (uint32_t) ss_siphash24(tcp_cookie_secret, data, sizeof(data)) & 0x00ffffff;
+}
+
+/*
+ * SYN cookies (RFC 4987 3.6): answer the SYN without keeping any state.
+ * Our ISN is a 5-bit clock ticking every 64 seconds, the peer's MSS as a
+ * 3-bit tcp_cookie_mss index and a 24-bit SipHash MAC over the tuple, the
+ * peer's ISN and both of those.
+ */
+int ss_tcp_syn_cookie_send(ss_tcp_key_t* key, ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
+    unsigned int lcore_id = rte_lcore_id();
+    uint16_t mss          = ss_tcp_syn_mss_get(rx_buf);
+    uint32_t peer_isn     = rte_bswap32(rx_buf->tcp->seq);
+    uint32_t count        = ss_tcp_syn_cookie_count();
+    uint32_t mss_index    = RTE_DIM(tcp_cookie_mss) - 1;
+    uint32_t cookie;
+
+    while (mss_index && tcp_cookie_mss[mss_index] > mss) --mss_index;
+    cookie = count << 27 | mss_index << 24 | ss_tcp_syn_cookie_mac(key, peer_isn, count, mss_index);
+
+    if (ss_tcp_prepare_syn_ack(rx_buf, tx_buf, cookie, (uint16_t) ss_conf->tcp_message_max)) return -1;
+
+    tcp_shards[lcore_id].cookie_tsc = rte_rdtsc();
+    ++tcp_stats[lcore_id].cookies_sent;
+    SS_LOG(FINE, L3L4, "tx tcp syn cookie 0x%08x mss %u\n", cookie, tcp_cookie_mss[mss_index]);
+    return 0;
+}
+
+/*
+ * Check the ACK completing a cookie handshake. Returns the peer's MSS
+ * from the cookie, or 0 when it is forged or older than two clock ticks.
+ */
+uint16_t ss_tcp_syn_cookie_check(ss_tcp_key_t* key, ss_frame_t* rx_buf) {
+    ss_tcp_stats_t* stats = &tcp_stats[rte_lcore_id()];
+    uint32_t cookie       = rte_bswap32(rx_buf->tcp->ack_seq) - 1;
+    uint32_t peer_isn     = rte_bswap32(rx_buf->tcp->seq) - 1;
+    uint32_t count        = cookie >> 27;
+    uint32_t mss_index    = (cookie >> 24) & 0x7;
+    uint32_t age          = (ss_tcp_syn_cookie_count() - count) & 0x1f;
+
+    if (age > 1 || (cookie & 0x00ffffff) != ss_tcp_syn_cookie_mac(key, peer_isn, count, mss_index)) {
+        ++stats->cookies_rejected;
+        ss_tcp_key_dump("rx tcp ack with invalid syn cookie", key);
+        return 0;
+    }
+
+    ++stats->cookies_validated;
+    return tcp_cookie_mss[mss_index];
+}
+
+/* detach the chain at index from the queue, the caller owns it after */
+static rte_mbuf_t* ss_tcp_ooo_unlink(ss_tcp_socket_t* socket, int index) {
+    rte_mbuf_t* chain = socket->rx_ooo[index].chain;
+
+    socket->rx_ooo_mbufs = (uint8_t) (socket->rx_ooo_mbufs - chain->nb_segs);
+    --socket->rx_ooo_count;
+    memmove(&socket->rx_ooo[index], &socket->rx_ooo[index + 1],
+        (size_t) (socket->rx_ooo_count - index) * sizeof(ss_tcp_ooo_t));
+    return chain;
+}
+
+/* append the range after index onto it, once the two are contiguous */
+static void ss_tcp_ooo_merge(ss_tcp_socket_t* socket, int index) {
+    ss_tcp_ooo_t* entry = &socket->rx_ooo[index];
+    uint32_t length     = socket->rx_ooo[index + 1].length;
+    uint8_t  segments   = socket->rx_ooo[index + 1].chain->nb_segs;
+    rte_mbuf_t* tail    = ss_tcp_ooo_unlink(socket, index + 1);
+
+    rte_pktmbuf_lastseg(entry->chain)->next = tail;
+    entry->chain->nb_segs  = (uint8_t) (entry->chain->nb_segs + segments);
+    entry->chain->pkt_len += tail->pkt_len;
+    entry->length         += length;
+    socket->rx_ooo_mbufs   = (uint8_t) (socket->rx_ooo_mbufs + segments);
+}
+
+/*
+ * Queue a segment which arrived ahead of a hole. The payload stays where
+ * the NIC put it: an indirect clone of the rx mbuf is trimmed down to the
+ * bytes no queued range already covers, then chained onto its neighbours
+ * as they become contiguous. Segments beyond the advertised window or
+ * past the L4_TCP_OOO_* bounds are dropped, the peer retransmits them.
+ */
+void ss_tcp_ooo_insert(ss_tcp_socket_t* socket, ss_frame_t* rx_buf, uint32_t seq) {
+    ss_tcp_stats_t* stats = &tcp_stats[rte_lcore_id()];
+    uint32_t end_seq      = seq + rx_buf->data.l4_length;
+    uint32_t window       = socket->rx_window ? socket->rx_window : ss_conf->tcp_message_max;
+    uint32_t skip         = (uint32_t) (rx_buf->l4_offset - rte_pktmbuf_mtod(rx_buf->mbuf, uint8_t*));
+    uint32_t start_seq    = seq;
+    int is_retransmit     = 0;
+    int i                 = 0;
+    rte_mbuf_t* clone;
+    ss_tcp_ooo_t* entry;
+
+    if (SS_TCP_SEQ_LT(socket->rx_next_seq + window, end_seq)) {
+        SS_LOG(DEBUG, L3L4, "rx tcp packet out of window, seq: %u expected: %u window: %u\n", seq, socket->rx_next_seq, window);
+        ++stats->rx_out_of_window;
+        return;
+    }
+
+    // i is the first range starting after seq, trim what i - 1 already has
+    while (i < socket->rx_ooo_count && SS_TCP_SEQ_LEQ(socket->rx_ooo[i].seq, seq)) ++i;
+    if (i > 0) {
+        entry = &socket->rx_ooo[i - 1];
+        if (SS_TCP_SEQ_LEQ(end_seq, entry->seq + entry->length)) {
+            ++stats->rx_retransmitted;
+            ++stats->rx_duplicate;
+            return;
+        }
+        if (SS_TCP_SEQ_LT(seq, entry->seq + entry->length)) {
+            seq = entry->seq + entry->length;
+            is_retransmit = 1;
+        }
+    }
+    // ranges the segment covers entirely are replaced by it, a partial one trims its tail
+    while (i < socket->rx_ooo_count && SS_TCP_SEQ_LEQ(socket->rx_ooo[i].seq + socket->rx_ooo[i].length, end_seq)) {
+        rte_pktmbuf_free(ss_tcp_ooo_unlink(socket, i));
+        is_retransmit = 1;
+    }
+    if (i < socket->rx_ooo_count && SS_TCP_SEQ_LT(socket->rx_ooo[i].seq, end_seq)) {
+        end_seq = socket->rx_ooo[i].seq;
+        is_retransmit = 1;
+    }
+    if (is_retransmit) ++stats->rx_retransmitted;
+
+    if (socket->rx_ooo_count >= L4_TCP_OOO_SEGMENTS || socket->rx_ooo_mbufs + rx_buf->mbuf->nb_segs > L4_TCP_OOO_MBUFS) {
+        ++stats->rx_ooo_dropped;
+        return;
+    }
+
+    clone = rte_pktmbuf_clone(rx_buf->mbuf, tcp_shards[rte_lcore_id()].ooo_pool);
+    if (clone == NULL) {
+        ++stats->rx_ooo_dropped;
+        return;
+    }
+    if (rte_pktmbuf_adj(clone, (uint16_t) (skip + seq - start_seq)) == NULL ||
+        rte_pktmbuf_trim(clone, (uint16_t) (rte_pktmbuf_pkt_len(clone) - (end_seq - seq)))) {
+        SS_LOG(ERR, L3L4, "could not trim tcp out-of-order clone\n");
+        rte_pktmbuf_free(clone);
+        ++stats->rx_ooo_dropped;
+        return;
+    }
+
+    memmove(&socket->rx_ooo[i + 1], &socket->rx_ooo[i],
+        (size_t) (socket->rx_ooo_count - i) * sizeof(ss_tcp_ooo_t));
+    socket->rx_ooo[i].seq    = seq;
+    socket->rx_ooo[i].length = end_seq - seq;
+    socket->rx_ooo[i].chain  = clone;
+    ++socket->rx_ooo_count;
+    socket->rx_ooo_mbufs = (uint8_t) (socket->rx_ooo_mbufs + clone->nb_segs);
+    ++stats->rx_ooo_queued;
+
+    if (i + 1 < socket->rx_ooo_count && end_seq == socket->rx_ooo[i + 1].seq) {
+        ss_tcp_ooo_merge(socket, i);
+    }
+    if (i > 0 && socket->rx_ooo[i - 1].seq + socket->rx_ooo[i - 1].length == seq) {
+        ss_tcp_ooo_merge(socket, i - 1);
+    }
+}
+
+/* deliver the queued ranges rx_next_seq has caught up with, in order */
+void ss_tcp_ooo_drain(ss_tcp_socket_t* socket, ss_frame_t* rx_buf) {
+    ss_tcp_ooo_t entry;
+    uint32_t skip;
+
+    while (socket->rx_ooo_count && SS_TCP_SEQ_LEQ(socket->rx_ooo[0].seq, socket->rx_next_seq)) {
+        entry = socket->rx_ooo[0];
+        ss_tcp_ooo_unlink(socket, 0);
+        skip  = socket->rx_next_seq - entry.seq;
+        if (skip < entry.length) {
+            for (rte_mbuf_t* mbuf = entry.chain; mbuf; mbuf = mbuf->next) {
+                if (skip >= mbuf->data_len) {
+                    skip -= mbuf->data_len;
+                    continue;
+                }
+                rx_buf->l4_offset      = rte_pktmbuf_mtod(mbuf, uint8_t*) + skip;
+                rx_buf->data.l4_length = (uint16_t) (mbuf->data_len - skip);
+                skip = 0;
+                ss_tcp_handle_data(socket, rx_buf);
+            }
+            socket->rx_next_seq = entry.seq + entry.length;
+        }
+        rte_pktmbuf_free(entry.chain);
+    }
+}
+
+void ss_tcp_ooo_release(ss_tcp_socket_t* socket) {
+    while (socket->rx_ooo_count) rte_pktmbuf_free(ss_tcp_ooo_unlink(socket, 0));
+}
+
+/*
+ * Account a data or ACK segment against the receive state. Payload which
+ * was already received is trimmed off rx_buf, so a stale segment is left
+ * with l4_length 0. *ack_ptr says whether, and how soon, to acknowledge.
+ */
+int ss_tcp_handle_update(ss_tcp_socket_t* socket, ss_frame_t* rx_buf, __attribute__((unused)) ss_frame_t* tx_buf, ss_tcp_ack_t* ack_ptr) {
+    ss_tcp_stats_t* stats = &tcp_stats[rte_lcore_id()];
+    uint32_t seq      = rte_bswap32(rx_buf->tcp->seq);
+    uint16_t length   = rx_buf->data.l4_length;
+    uint32_t end_seq  = seq + length;
+    uint32_t overlap;
+
+    *ack_ptr = SS_TCP_ACK_NONE;
     if (socket->state == SS_TCP_CLOSED) return 0;
+    // ACK of our SYN, ACK completes the handshake
+    if (socket->state == SS_TCP_SYN_RX && rx_buf->tcp->th_flags & TH_ACK) socket->state = SS_TCP_OPEN;
+    // we never send data, so the peer always acknowledges our next byte
+    if (rx_buf->tcp->th_flags & TH_ACK) socket->tx_next_seq = rte_bswap32(rx_buf->tcp->ack_seq);
 
-    uint16_t tcp_data_len  = rte_bswap16(rx_buf->ip4->tot_len) - (4 * rx_buf->tcp->doff) - sizeof(tcp_hdr_t);
-    uint32_t curr_seq      = rx_buf->tcp->ack_seq;
-    uint32_t curr_ack_seq  = rte_bswap32(rx_buf->tcp->seq) + (tcp_data_len ? tcp_data_len : 1);
+    if (length == 0) {
+        // pure ACKs get no reply, keepalives (RFC 1122 4.2.3.6) do
+        if (SS_TCP_SEQ_LT(seq, socket->rx_next_seq)) *ack_ptr = SS_TCP_ACK_NOW;
+        return 0;
+    }
 
-    if (curr_ack_seq <= socket->last_ack_seq) {
-        socket->last_ack_seq = curr_ack_seq;
-        *curr_ack_seq_ptr = curr_ack_seq;
+    if (SS_TCP_SEQ_LEQ(end_seq, socket->rx_next_seq)) {
+        // a retransmission of delivered data means our ACK was lost
+        SS_LOG(DEBUG, L3L4, "rx tcp duplicate packet, seq: %u expected: %u\n", seq, socket->rx_next_seq);
+        ++stats->rx_retransmitted;
+        ++stats->rx_duplicate;
+        rx_buf->data.l4_length = 0;
+        *ack_ptr = SS_TCP_ACK_NOW;
         return 0;
     }
-        
-    rv = ss_frame_prepare_tcp(rx_buf, tx_buf);
+    if (SS_TCP_SEQ_LT(socket->rx_next_seq, seq)) {
+        // a hole: hold on to the segment and send a duplicate ACK to
+        // trigger fast retransmit (RFC 5681 4.2)
+        SS_LOG(DEBUG, L3L4, "rx tcp out of order packet, seq: %u expected: %u\n", seq, socket->rx_next_seq);
+        ss_tcp_ooo_insert(socket, rx_buf, seq);
+        rx_buf->data.l4_length = 0;
+        *ack_ptr = SS_TCP_ACK_NOW;
+        return 0;
+    }
+    if (SS_TCP_SEQ_LT(seq, socket->rx_next_seq)) ++stats->rx_retransmitted;
+
+    overlap                 = socket->rx_next_seq - seq;
+    rx_buf->l4_offset      += overlap;
+    rx_buf->data.l4_length  = (uint16_t) (length - overlap);
+    socket->rx_next_seq     = end_seq;
+
+    // RFC 5681 4.2: ACK at least every second full-sized segment, and at
+    // once when the segment fills a hole
+    if (length > socket->rx_mss) socket->rx_mss = length;
+    if (socket->rx_ooo_count) {
+        *ack_ptr = SS_TCP_ACK_NOW;
+    }
+    else if (length >= socket->rx_mss && ++socket->ack_segments >= L4_TCP_ACK_SEGMENTS) {
+        *ack_ptr = SS_TCP_ACK_NOW;
+    }
+    else {
+        *ack_ptr = SS_TCP_ACK_DELAYED;
+    }
+
+    return 0;
+}
+
+/*
+ * Receive window: room left in the reassembly buffer for the message in
+ * progress. Bytes past tcp_message_max are discarded rather than held, so
+ * a truncated message does not close the window on the sender.
+ */
+uint16_t ss_tcp_rx_window(ss_tcp_socket_t* socket) {
+    if (socket->rx_truncated) return (uint16_t) ss_conf->tcp_message_max;
+    return (uint16_t) (ss_conf->tcp_message_max - socket->rx_length);
+}
+
+/* build an ACK for everything received so far, from the socket alone */
+int ss_tcp_prepare_ack(ss_tcp_socket_t* socket, ss_frame_t* tx_buf) {
+    int rv = 0;
+    uint16_t eth_type = socket->key.protocol == L4_TCP4 ? ETHER_TYPE_IPV4 : ETHER_TYPE_IPV6;
+
+    rv = ss_frame_prepare_eth(tx_buf, socket->port_id, &socket->peer_addr, eth_type);
     if (rv) {
-        RTE_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf, error: %d\n", rv);
+        SS_LOG(ERR, L3L4, "could not prepare tcp ack tx_mbuf, ethernet error: %d\n", rv);
         return -1;
     }
 
-    // XXX: Make the client "happy", and just ACK everything.
-    // This is lossy, but back-pressure on syslog messages is pointless.
-    tx_buf->tcp->seq       = curr_seq;
-    tx_buf->tcp->ack_seq   = rte_bswap32(curr_ack_seq);
+    if (eth_type == ETHER_TYPE_IPV4) {
+        rv = ss_frame_prepare_ip4_addr(tx_buf, IPPROTO_TCP, socket->key.sip);
+    }
+    else {
+        rv = ss_frame_prepare_ip6_addr(tx_buf, IPPROTO_TCP, socket->key.sip);
+    }
+    if (rv) {
+        SS_LOG(ERR, L3L4, "could not prepare tcp ack tx_mbuf, L3 error: %d\n", rv);
+        goto error_out;
+    }
+
+    tx_buf->tcp = (tcp_hdr_t*) rte_pktmbuf_append(tx_buf->mbuf, sizeof(tcp_hdr_t));
+    if (tx_buf->tcp == NULL) {
+        SS_LOG(ERR, L3L4, "could not allocate tcp ack tx_mbuf tcp header\n");
+        goto error_out;
+    }
+
+    // advertise the room left for the message in progress, see ss_tcp_rx_window
+    socket->rx_window      = ss_tcp_rx_window(socket);
+    tx_buf->tcp->source    = socket->key.dport;
+    tx_buf->tcp->dest      = socket->key.sport;
+    tx_buf->tcp->seq       = rte_bswap32(socket->tx_next_seq);
+    tx_buf->tcp->ack_seq   = rte_bswap32(socket->rx_next_seq);
     tx_buf->tcp->doff      = L4_TCP_HEADER_OFFSET;
     tx_buf->tcp->th_flags  = TH_ACK;
-    tx_buf->tcp->window    = rte_bswap16(L4_TCP_WINDOW_SIZE);
+    tx_buf->tcp->window    = rte_bswap16(socket->rx_window);
     tx_buf->tcp->check     = rte_bswap16(0x0000);
     tx_buf->tcp->urg_ptr   = rte_bswap16(0x0000);
 
     rv = ss_tcp_prepare_checksum(tx_buf);
     if (rv) {
-        RTE_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf checksum, error: %d\n", rv);
+        SS_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf checksum, error: %d\n", rv);
         return -1;
     }
-    
-    ss_tcp_prepare_tx(tx_buf, socket, SS_TCP_OPEN);
-    
-    *curr_ack_seq_ptr = curr_ack_seq;
+
+    ss_tcp_prepare_tx(tx_buf, socket, socket->state);
+    socket->ack_segments = 0;
+    ++tcp_stats[rte_lcore_id()].acks_sent;
+
     return 0;
+
+    error_out:
+    if (tx_buf->mbuf) {
+        tx_buf->active = 0;
+        rte_pktmbuf_free(tx_buf->mbuf);
+        tx_buf->mbuf = NULL;
+    }
+    return -1;
+}
+
+/*
+ * Delayed ACK, RFC 1122 4.2.3.2. Segments only queue their socket on the
+ * owner's ack_list. Forced ACKs go out when the rx burst is done, the rest
+ * once tcp_ack_delay_msec has passed, so however many segments of a
+ * connection arrive in between they are answered by one ACK.
+ */
+void ss_tcp_ack_schedule(ss_tcp_socket_t* socket, ss_tcp_ack_t ack) {
+    ss_tcp_shard_t* shard = &tcp_shards[socket->lcore_id];
+
+    if (socket->ack_queued) {
+        ++tcp_stats[socket->lcore_id].acks_suppressed;
+        if (ack == SS_TCP_ACK_NOW && !socket->ack_now) {
+            socket->ack_now = 1;
+            TAILQ_REMOVE(&shard->ack_list, socket, ack_entry);
+            TAILQ_INSERT_HEAD(&shard->ack_list, socket, ack_entry);
+        }
+        return;
+    }
+
+    socket->ack_queued   = 1;
+    socket->ack_now      = ack == SS_TCP_ACK_NOW || tcp_ack_delay_cycles == 0;
+    socket->ack_deadline = rte_rdtsc() + tcp_ack_delay_cycles;
+    if (socket->ack_now) {
+        TAILQ_INSERT_HEAD(&shard->ack_list, socket, ack_entry);
+    }
+    else {
+        TAILQ_INSERT_TAIL(&shard->ack_list, socket, ack_entry);
+    }
+}
+
+/*
+ * Send the ACKs owed by the calling lcore's sockets: the forced ones after
+ * every rx burst (now == 0), plus the delayed ones due by now from the
+ * drain tick.
+ */
+int ss_tcp_ack_flush(unsigned int lcore_id, uint64_t now) {
+    ss_tcp_shard_t* shard = &tcp_shards[lcore_id];
+    ss_tcp_socket_t* socket;
+    ss_frame_t tx_buf;
+    int count = 0;
+
+    if (shard->sockets == NULL) return 0;
+
+    while ((socket = TAILQ_FIRST(&shard->ack_list)) != NULL) {
+        if (!socket->ack_now && (now == 0 || socket->ack_deadline > now)) break;
+        TAILQ_REMOVE(&shard->ack_list, socket, ack_entry);
+
+        rte_spinlock_recursive_lock(&socket->lock);
+        socket->ack_queued = 0;
+        socket->ack_now    = 0;
+        // closed meanwhile, the RST already went out
+        if (socket->state == SS_TCP_OPEN || socket->state == SS_TCP_UNKNOWN) {
+            memset(&tx_buf, 0, offsetof(ss_frame_t, data));
+            if (ss_tcp_prepare_ack(socket, &tx_buf) == 0) {
+                ss_send_packet(tx_buf.mbuf, tx_buf.data.port_id, (uint16_t) lcore_id);
+                ++count;
+            }
+        }
+        rte_spinlock_recursive_unlock(&socket->lock);
+    }
+
+    return count;
 }
 
 int ss_frame_prepare_tcp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
@@ -523,7 +1631,7 @@ int ss_frame_prepare_tcp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
     
     rv = ss_frame_prepare_eth(tx_buf, rx_buf->data.port_id, (eth_addr_t*) &rx_buf->eth->s_addr, rx_buf->data.eth_type);
     if (rv) {
-        RTE_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf, ethernet error: %d\n", rv);
+        SS_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf, ethernet error: %d\n", rv);
         goto error_out;
     }
     
@@ -534,18 +1642,18 @@ int ss_frame_prepare_tcp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
         rv = ss_frame_prepare_ip6(rx_buf, tx_buf);
     }
     else {
-        RTE_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf, unknown L3 protocol: %hhu\n", rx_buf->data.ip_protocol);
+        SS_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf, unknown L3 protocol: %hhu\n", rx_buf->data.ip_protocol);
         goto error_out;
     }
     
     if (rv) {
-        RTE_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf, L3 error: %d\n", rv);
+        SS_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf, L3 error: %d\n", rv);
         goto error_out;
     }
 
     tx_buf->tcp = (tcp_hdr_t*) rte_pktmbuf_append(tx_buf->mbuf, sizeof(tcp_hdr_t));
     if (tx_buf->tcp == NULL) {
-        RTE_LOG(ERR, L3L4, "could not allocate tcp tx_mbuf tcp header\n");
+        SS_LOG(ERR, L3L4, "could not allocate tcp tx_mbuf tcp header\n");
         goto error_out;
     }
     tx_buf->tcp->source = rte_bswap16(rx_buf->data.dport);
@@ -555,7 +1663,7 @@ int ss_frame_prepare_tcp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
 
     error_out:
     if (tx_buf->mbuf) {
-        RTE_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf\n");
+        SS_LOG(ERR, L3L4, "could not prepare tcp tx_mbuf\n");
         tx_buf->active = 0;
         rte_pktmbuf_free(tx_buf->mbuf);
         tx_buf->mbuf = NULL;
@@ -563,83 +1671,57 @@ int ss_frame_prepare_tcp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
     return -1;
 }
 
+/*
+ * Fill in the IP length and the TCP checksum. The pseudo-header is summed
+ * in place from the IP header. When the port offloads checksums the NIC
+ * finishes the job from the pseudo-header sum left in tcp->check.
+ */
 int ss_tcp_prepare_checksum(ss_frame_t* tx_buf) {
-    rte_mbuf_t* pmbuf = NULL;
-
     if (!tx_buf || !tx_buf->mbuf) goto error_out;
 
-    uint8_t* pptr;
-    uint16_t ip_checksum;
-    uint16_t tcp_checksum;
-    
-    uint8_t  zeros         = 0x00;
-    uint8_t  protocol      = IPPROTO_TCP;
-    uint16_t tcp_len_le    = (uint16_t) (rte_pktmbuf_pkt_len(tx_buf->mbuf) - ((uint8_t*) tx_buf->tcp - rte_pktmbuf_mtod(tx_buf->mbuf, uint8_t*)));
-    uint16_t tcp_data_len  = tcp_len_le - sizeof(tcp_hdr_t);
-    uint16_t tcp_len       = rte_bswap16(tcp_len_le);
-    uint8_t  doff_rsvd     = (uint8_t) (tx_buf->tcp->doff << 4 | 0x0);
-    uint16_t check_zeros   = rte_bswap16(0x0000);
-    
-    uint8_t* data_ptr      = ((uint8_t*) tx_buf->tcp) + sizeof(tcp_hdr_t); // XXX: better way?
-    
-    pmbuf = rte_pktmbuf_alloc(ss_pool[rte_socket_id()]);
-    if (pmbuf == NULL) {
-        RTE_LOG(ERR, L3L4, "could not allocate mbuf tcp pseudo header\n");
+    rte_mbuf_t* mbuf  = tx_buf->mbuf;
+    int is_offload    = port_tx_cksum_offload[tx_buf->data.port_id];
+    uint16_t tcp_len;
+    uint64_t sum;
+
+    tx_buf->tcp->check = 0;
+    if (tx_buf->ip4) {
+        tcp_len = ss_frame_prepare_ip4_length(tx_buf);
+        sum     = ss_cksum_phdr(&tx_buf->ip4->saddr, &tx_buf->ip4->daddr, sizeof(tx_buf->ip4->saddr), IPPROTO_TCP, tcp_len);
+        mbuf->l3_len = sizeof(ip4_hdr_t);
+        if (is_offload) {
+            tx_buf->ip4->check = 0;
+            mbuf->ol_flags |= PKT_TX_IPV4 | PKT_TX_IP_CKSUM;
+        }
+    }
+    else if (tx_buf->ip6) {
+        tcp_len = ss_frame_prepare_ip6_length(tx_buf);
+        sum     = ss_cksum_phdr(&tx_buf->ip6->ip6_src, &tx_buf->ip6->ip6_dst, sizeof(tx_buf->ip6->ip6_src), IPPROTO_TCP, tcp_len);
+        mbuf->l3_len = sizeof(ip6_hdr_t);
+        if (is_offload) {
+            mbuf->ol_flags |= PKT_TX_IPV6;
+        }
+    }
+    else {
         goto error_out;
     }
-    
-    pptr = ss_phdr_append(pmbuf, &tx_buf->ip4->saddr,    sizeof(tx_buf->ip4->saddr));
-    if (pptr == NULL) goto error_out;
-    pptr = ss_phdr_append(pmbuf, &tx_buf->ip4->daddr,    sizeof(tx_buf->ip4->daddr));
-    if (pptr == NULL) goto error_out;
-    pptr = ss_phdr_append(pmbuf, &zeros,                 sizeof(zeros));
-    if (pptr == NULL) goto error_out;
-    pptr = ss_phdr_append(pmbuf, &protocol,              sizeof(protocol));
-    if (pptr == NULL) goto error_out;
-    pptr = ss_phdr_append(pmbuf, &tcp_len,               sizeof(tcp_len));
-    if (pptr == NULL) goto error_out;
-    pptr = ss_phdr_append(pmbuf, &tx_buf->tcp->source,   sizeof(tx_buf->tcp->source));
-    if (pptr == NULL) goto error_out;
-    pptr = ss_phdr_append(pmbuf, &tx_buf->tcp->dest,     sizeof(tx_buf->tcp->dest));
-    if (pptr == NULL) goto error_out;
-    pptr = ss_phdr_append(pmbuf, &tx_buf->tcp->seq,      sizeof(tx_buf->tcp->seq));
-    if (pptr == NULL) goto error_out;
-    pptr = ss_phdr_append(pmbuf, &tx_buf->tcp->ack_seq,  sizeof(tx_buf->tcp->ack_seq));
-    if (pptr == NULL) goto error_out;
-    pptr = ss_phdr_append(pmbuf, &doff_rsvd,             sizeof(doff_rsvd));
-    if (pptr == NULL) goto error_out;
-    pptr = ss_phdr_append(pmbuf, &tx_buf->tcp->th_flags, sizeof(tx_buf->tcp->th_flags));
-    if (pptr == NULL) goto error_out;
-    pptr = ss_phdr_append(pmbuf, &tx_buf->tcp->window,   sizeof(tx_buf->tcp->window));
-    if (pptr == NULL) goto error_out;
-    pptr = ss_phdr_append(pmbuf, &check_zeros,           sizeof(check_zeros));
-    if (pptr == NULL) goto error_out;
-    pptr = ss_phdr_append(pmbuf, &tx_buf->tcp->urg_ptr,  sizeof(check_zeros));
-    if (pptr == NULL) goto error_out;
-    pptr = ss_phdr_append(pmbuf, data_ptr,               tcp_data_len);
-    if (pptr == NULL) goto error_out;
-
-    if (rte_get_log_level() >= RTE_LOG_FINER) {
-        printf("tcp pseudo-header:\n");
-        rte_pktmbuf_dump(stderr, pmbuf, rte_pktmbuf_pkt_len(pmbuf));
-    }
-    tcp_checksum = ss_in_cksum(rte_pktmbuf_mtod(pmbuf, uint16_t*), rte_pktmbuf_pkt_len(pmbuf));
-    rte_pktmbuf_free(pmbuf);
-    tx_buf->tcp->check = tcp_checksum;
-    
-    uint16_t ip_len = rte_bswap16(rte_pktmbuf_pkt_len(tx_buf->mbuf) - sizeof(eth_hdr_t));
-    tx_buf->ip4->tot_len = ip_len; // XXX: better way?
-    ip_checksum = ss_in_cksum((uint16_t*) tx_buf->ip4, sizeof(ip4_hdr_t));
-    tx_buf->ip4->check   = ip_checksum;
-    RTE_LOG(DEBUG, L3L4, "prepare tcp: tcp data len: %u, tcp checksum: 0x%04hX, ip4 checksum: 0x%04hX\n",
-        tcp_data_len, tcp_checksum, ip_checksum);
-    
+
+    if (is_offload) {
+        mbuf->l2_len        = (uint16_t) ((uint8_t*) tx_buf->tcp - rte_pktmbuf_mtod(mbuf, uint8_t*) - mbuf->l3_len);
+        mbuf->ol_flags     |= PKT_TX_TCP_CKSUM;
+        tx_buf->tcp->check  = ss_cksum_fold(sum);
+    }
+    else {
+        tx_buf->tcp->check  = (uint16_t) ~ss_cksum_fold(ss_cksum_add(sum, tx_buf->tcp, tcp_len));
+    }
+    SS_LOG(DEBUG, L3L4, "prepare tcp: tcp len: %u, tcp checksum: 0x%04hX, offload: %d\n",
+        tcp_len, tx_buf->tcp->check, is_offload);
+
     return 0;
 
     error_out:
-    if (tx_buf->mbuf) {
-        RTE_LOG(ERR, L3L4, "could not process tcp frame\n");
-        if (pmbuf) rte_pktmbuf_free(pmbuf);
+    if (tx_buf && tx_buf->mbuf) {
+        SS_LOG(ERR, L3L4, "could not process tcp frame\n");
         tx_buf->active = 0;
         rte_pktmbuf_free(tx_buf->mbuf);
         tx_buf->mbuf = NULL;
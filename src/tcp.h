@@ -5,22 +5,92 @@
 
 #include "common.h"
 
+/* DATA TYPES */
+
+enum ss_tcp_ack_e {
+    SS_TCP_ACK_NONE    = 0,
+    SS_TCP_ACK_DELAYED = 1,
+    SS_TCP_ACK_NOW     = 2,
+};
+
+typedef enum ss_tcp_ack_e ss_tcp_ack_t;
+
+// indexed by the lcore doing the work, so no atomics; peak is summed across lcores
+struct ss_tcp_stats_s {
+    uint64_t sockets_active;
+    uint64_t sockets_peak;
+    uint64_t sockets_rejected;
+    uint64_t buffer_exhausted;
+    uint64_t expired_syn;
+    uint64_t expired_idle;
+    uint64_t expired_time_wait;
+    uint64_t foreign_lookups;
+    uint64_t foreign_hits;
+    uint64_t foreign_retries;  // owner held the socket lock, looked again
+    uint64_t foreign_busy;     // still held after the retries, segment dropped
+    uint64_t syslog_messages;
+    uint64_t syslog_truncated;
+    uint64_t syslog_oversized;
+    uint64_t framing_errors;
+    uint64_t acks_sent;
+    uint64_t acks_suppressed;
+    uint64_t half_open;
+    uint64_t syn_source_limited;
+    uint64_t cookies_sent;
+    uint64_t cookies_validated;
+    uint64_t cookies_rejected;
+    uint64_t rx_retransmitted;
+    uint64_t rx_duplicate;
+    uint64_t rx_out_of_window;
+    uint64_t rx_ooo_queued;
+    uint64_t rx_ooo_dropped;
+    uint64_t netflow_messages;
+    uint64_t netflow_truncated;
+    uint64_t netflow_framing_errors;
+} __rte_cache_aligned;
+
+typedef struct ss_tcp_stats_s ss_tcp_stats_t;
+
 /* BEGIN PROTOTYPES */
 
 int ss_tcp_init(void);
-int ss_tcp_timer_callback(void);
+ss_tcp_timeouts_t* ss_tcp_timeouts_get(uint16_t port);
+uint64_t ss_tcp_socket_deadline(ss_tcp_socket_t* socket);
+int ss_tcp_timer_callback(unsigned int lcore_id);
 int ss_frame_handle_tcp(ss_frame_t* rx_buf, ss_frame_t* tx_buf);
+int ss_tcp_handle_data(ss_tcp_socket_t* socket, ss_frame_t* rx_buf);
+ss_tcp_framing_t ss_tcp_framing_load(const char* framing);
+const char* ss_tcp_framing_dump(ss_tcp_framing_t framing);
+int ss_tcp_stats_dump(void);
 int ss_tcp_extract_syslog(ss_tcp_socket_t* socket, ss_frame_t* rx_buf);
+int ss_tcp_netflow_port(uint16_t port);
+int ss_tcp_extract_netflow(ss_tcp_socket_t* socket, ss_frame_t* rx_buf);
 int ss_tcp_socket_init(ss_tcp_key_t* key, ss_tcp_socket_t* socket);
 ss_tcp_socket_t* ss_tcp_socket_create(ss_tcp_key_t* key, ss_frame_t* rx_buf);
-int ss_tcp_socket_delete(ss_tcp_key_t* key, _Bool is_locked);
+int ss_tcp_socket_delete(ss_tcp_socket_t* socket);
 ss_tcp_socket_t* ss_tcp_socket_lookup(ss_tcp_key_t* key);
+ss_tcp_socket_t* ss_tcp_socket_lookup_foreign(ss_tcp_key_t* key, int* busy);
 int ss_tcp_prepare_rx(ss_frame_t* rx_buf, ss_tcp_socket_t* socket);
 int ss_tcp_prepare_tx(ss_frame_t* tx_buf, ss_tcp_socket_t* socket, ss_tcp_state_t state);
 uint16_t ss_tcp_rx_mss_get(ss_tcp_socket_t* socket);
 int ss_tcp_handle_close(ss_tcp_socket_t* socket, ss_frame_t* rx_buf, ss_frame_t* tx_buf);
 int ss_tcp_handle_open(ss_tcp_socket_t* socket, ss_frame_t* rx_buf, ss_frame_t* tx_buf);
-int ss_tcp_handle_update(ss_tcp_socket_t* socket, ss_frame_t* rx_buf, ss_frame_t* tx_buf, uint32_t* curr_ack_seq_ptr);
+int ss_tcp_prepare_syn_ack(ss_frame_t* rx_buf, ss_frame_t* tx_buf, uint32_t isn, uint16_t window);
+uint16_t ss_tcp_syn_mss_get(ss_frame_t* rx_buf);
+void ss_tcp_half_open_update(ss_tcp_socket_t* socket);
+void ss_tcp_syn_cookie_init(void);
+int ss_tcp_syn_cookie_wanted(ss_tcp_key_t* key);
+int ss_tcp_syn_cookie_active(void);
+int ss_tcp_syn_cookie_send(ss_tcp_key_t* key, ss_frame_t* rx_buf, ss_frame_t* tx_buf);
+uint16_t ss_tcp_syn_cookie_check(ss_tcp_key_t* key, ss_frame_t* rx_buf);
+void ss_tcp_ooo_insert(ss_tcp_socket_t* socket, ss_frame_t* rx_buf, uint32_t seq);
+void ss_tcp_ooo_drain(ss_tcp_socket_t* socket, ss_frame_t* rx_buf);
+void ss_tcp_ooo_release(ss_tcp_socket_t* socket);
+int ss_tcp_handle_update(ss_tcp_socket_t* socket, ss_frame_t* rx_buf, ss_frame_t* tx_buf, ss_tcp_ack_t* ack_ptr);
+uint16_t ss_tcp_rx_window(ss_tcp_socket_t* socket);
+int ss_tcp_prepare_ack(ss_tcp_socket_t* socket, ss_frame_t* tx_buf);
+void ss_tcp_ack_schedule(ss_tcp_socket_t* socket, ss_tcp_ack_t ack);
+int ss_tcp_ack_flush(unsigned int lcore_id, uint64_t now);
 int ss_frame_prepare_tcp(ss_frame_t* rx_buf, ss_frame_t* tx_buf);
 int ss_tcp_prepare_checksum(ss_frame_t* tx_buf);
 
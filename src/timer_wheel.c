@@ -0,0 +1,117 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <bsd/sys/queue.h>
+
+#include "timer_wheel.h"
+
+#define SS_TIMER_WHEEL_SPAN (1ULL << (SS_TIMER_WHEEL_BITS * SS_TIMER_WHEEL_LEVELS))
+
+int ss_timer_wheel_init(ss_timer_wheel_t* wheel, uint64_t tick_cycles, uint64_t now_cycles) {
+    if (tick_cycles == 0) return -1;
+
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->tick_cycles = tick_cycles;
+    wheel->now         = now_cycles / tick_cycles;
+    for (int level = 0; level < SS_TIMER_WHEEL_LEVELS; ++level) {
+        for (int slot = 0; slot < SS_TIMER_WHEEL_SLOTS; ++slot) {
+            TAILQ_INIT(&wheel->slots[level][slot]);
+        }
+    }
+
+    return 0;
+}
+
+uint64_t ss_timer_wheel_ticks(ss_timer_wheel_t* wheel, uint64_t cycles) {
+    return cycles / wheel->tick_cycles;
+}
+
+/*
+ * File an entry by how far away it is. Entries never go before earliest:
+ * new ones land on the next tick, cascaded ones may still make this one.
+ */
+static void ss_timer_wheel_insert(ss_timer_wheel_t* wheel, ss_timer_wheel_entry_t* entry, uint64_t earliest) {
+    uint64_t expires;
+    uint64_t delta;
+    int level;
+
+    if (entry->expires < earliest) entry->expires = earliest;
+
+    // past the span: park in the furthest slot, it is re-filed on cascade
+    expires = entry->expires;
+    delta   = expires - wheel->now;
+    if (delta >= SS_TIMER_WHEEL_SPAN) {
+        expires = wheel->now + SS_TIMER_WHEEL_SPAN - 1;
+        delta   = SS_TIMER_WHEEL_SPAN - 1;
+    }
+
+    for (level = 0; level < SS_TIMER_WHEEL_LEVELS - 1; ++level) {
+        if (delta < (1ULL << (SS_TIMER_WHEEL_BITS * (level + 1)))) break;
+    }
+
+    entry->list = &wheel->slots[level][(expires >> (SS_TIMER_WHEEL_BITS * level)) & SS_TIMER_WHEEL_MASK];
+    TAILQ_INSERT_TAIL(entry->list, entry, entry);
+}
+
+/* (re-)arm an entry to fire on the first tick at or after expires_cycles */
+void ss_timer_wheel_add(ss_timer_wheel_t* wheel, ss_timer_wheel_entry_t* entry, uint64_t expires_cycles) {
+    ss_timer_wheel_remove(wheel, entry);
+    entry->expires = (expires_cycles + wheel->tick_cycles - 1) / wheel->tick_cycles;
+    ss_timer_wheel_insert(wheel, entry, wheel->now + 1);
+    ++wheel->count;
+}
+
+void ss_timer_wheel_remove(ss_timer_wheel_t* wheel, ss_timer_wheel_entry_t* entry) {
+    if (entry->list == NULL) return;
+    TAILQ_REMOVE(entry->list, entry, entry);
+    entry->list = NULL;
+    --wheel->count;
+}
+
+/* move every entry in a higher level slot down to where it now belongs */
+static void ss_timer_wheel_cascade(ss_timer_wheel_t* wheel, int level) {
+    ss_timer_wheel_list_t* list = &wheel->slots[level][(wheel->now >> (SS_TIMER_WHEEL_BITS * level)) & SS_TIMER_WHEEL_MASK];
+    ss_timer_wheel_list_t pending;
+    ss_timer_wheel_entry_t* entry;
+
+    TAILQ_INIT(&pending);
+    TAILQ_CONCAT(&pending, list, entry);
+    while ((entry = TAILQ_FIRST(&pending)) != NULL) {
+        TAILQ_REMOVE(&pending, entry, entry);
+        ss_timer_wheel_insert(wheel, entry, wheel->now);
+    }
+}
+
+/*
+ * Run every entry due up to now_cycles. Entries are disarmed before the
+ * callback, which may re-arm or free them. Returns the number fired.
+ */
+uint64_t ss_timer_wheel_advance(ss_timer_wheel_t* wheel, uint64_t now_cycles, ss_timer_wheel_cb_t callback, void* arg) {
+    uint64_t target = now_cycles / wheel->tick_cycles;
+    uint64_t fired  = 0;
+    ss_timer_wheel_list_t* list;
+    ss_timer_wheel_entry_t* entry;
+
+    while (wheel->now < target) {
+        ++wheel->now;
+
+        // cascade from the top so entries settle in one pass
+        for (int level = SS_TIMER_WHEEL_LEVELS - 1; level > 0; --level) {
+            if ((wheel->now & ((1ULL << (SS_TIMER_WHEEL_BITS * level)) - 1)) == 0) {
+                ss_timer_wheel_cascade(wheel, level);
+            }
+        }
+
+        list = &wheel->slots[0][wheel->now & SS_TIMER_WHEEL_MASK];
+        while ((entry = TAILQ_FIRST(list)) != NULL) {
+            TAILQ_REMOVE(list, entry, entry);
+            entry->list = NULL;
+            --wheel->count;
+            ++fired;
+            callback(entry, arg);
+        }
+    }
+
+    return fired;
+}
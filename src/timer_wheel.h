@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <bsd/sys/queue.h>
+
+/* CONSTANTS */
+
+#define SS_TIMER_WHEEL_BITS   8
+#define SS_TIMER_WHEEL_SLOTS  (1 << SS_TIMER_WHEEL_BITS)
+#define SS_TIMER_WHEEL_MASK   (SS_TIMER_WHEEL_SLOTS - 1)
+#define SS_TIMER_WHEEL_LEVELS 3 // spans 2^24 ticks
+
+/* DATA TYPES */
+
+TAILQ_HEAD(ss_timer_wheel_list_s, ss_timer_wheel_entry_s);
+
+typedef struct ss_timer_wheel_list_s ss_timer_wheel_list_t;
+
+struct ss_timer_wheel_entry_s {
+    TAILQ_ENTRY(ss_timer_wheel_entry_s) entry;
+    uint64_t expires;             // in ticks
+    ss_timer_wheel_list_t* list;  // NULL when not armed
+};
+
+typedef struct ss_timer_wheel_entry_s ss_timer_wheel_entry_t;
+
+typedef void (*ss_timer_wheel_cb_t)(ss_timer_wheel_entry_t* entry, void* arg);
+
+/*
+ * Hierarchical timing wheel, owned by a single lcore. Level 0 holds
+ * entries due within 256 ticks, level 1 within 65536 ticks, level 2 the
+ * rest. Higher levels cascade down as time reaches them, so each tick
+ * only touches the entries which are actually due.
+ */
+struct ss_timer_wheel_s {
+    uint64_t tick_cycles;
+    uint64_t now; // in ticks
+    uint64_t count;
+    ss_timer_wheel_list_t slots[SS_TIMER_WHEEL_LEVELS][SS_TIMER_WHEEL_SLOTS];
+};
+
+typedef struct ss_timer_wheel_s ss_timer_wheel_t;
+
+/* BEGIN PROTOTYPES */
+
+int ss_timer_wheel_init(ss_timer_wheel_t* wheel, uint64_t tick_cycles, uint64_t now_cycles);
+uint64_t ss_timer_wheel_ticks(ss_timer_wheel_t* wheel, uint64_t cycles);
+void ss_timer_wheel_add(ss_timer_wheel_t* wheel, ss_timer_wheel_entry_t* entry, uint64_t expires_cycles);
+void ss_timer_wheel_remove(ss_timer_wheel_t* wheel, ss_timer_wheel_entry_t* entry);
+uint64_t ss_timer_wheel_advance(ss_timer_wheel_t* wheel, uint64_t now_cycles, ss_timer_wheel_cb_t callback, void* arg);
+
+/* END PROTOTYPES */
@@ -0,0 +1,392 @@
+/*
+ * ss_batch_compress: round-trip captured sensor output through nm_compress.
+ *
+ * ss_batch_compress [-a lz4|zstd] [-l level] [-D dict] [-T dict_out]
+ *                   [-n records] [-b bytes] [-o out] [file ...]
+ *
+ * Reads what ss_event_decode reads, from files or stdin: back-to-back
+ * binary events and batches, compressed ones too given their -D, and
+ * JSON messages one per line. The records are batched again the way a
+ * queue with nm_batch_records -n and nm_batch_bytes -b would, each batch
+ * is compressed with the sensor's code, decompressed, and compared.
+ * Prints the ratio and the speed either way; exits 1 on any mismatch.
+ *
+ * -T trains a zstd dictionary from the records first, writes it to
+ * dict_out for nm_compress_dict, and compresses with it. -o writes the
+ * batches as the sensor would send them, for ss_event_decode.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <zdict.h>
+
+#include "compress.h"
+#include "event_schema.h"
+
+/* mirrors nn_batch_header_t and nn_batch_compressed_header_t, nn_queue.h needs DPDK and json-c */
+#define SS_BATCH_MAGIC                  "SB"
+#define SS_BATCH_VERSION                   1
+#define SS_BATCH_VERSION_COMPRESSED        2
+#define SS_BATCH_HEADER_SIZE               6
+#define SS_BATCH_COMPRESSED_HEADER_SIZE   20
+#define SS_BATCH_RECORDS_DEFAULT          64
+#define SS_BATCH_BYTES_DEFAULT         65536
+
+/* every record read, back to back, as ZDICT_trainFromBuffer takes samples */
+struct ss_records_s {
+    uint8_t* data;
+    size_t   length;
+    size_t   capacity;
+    size_t*  lengths;
+    size_t   count;
+    size_t   count_max;
+};
+
+typedef struct ss_records_s ss_records_t;
+
+static ss_compress_conf_t input_confs[SS_COMPRESS_MAX];
+static ss_compress_ctx_t ctx;
+static const char* dict_path = NULL;
+
+static uint16_t ss_read_be16(const uint8_t* data) {
+    return (uint16_t) (data[0] << 8 | data[1]);
+}
+
+static uint32_t ss_read_be32(const uint8_t* data) {
+    return (uint32_t) data[0] << 24 | (uint32_t) data[1] << 16 | (uint32_t) data[2] << 8 | data[3];
+}
+
+static void ss_write_be16(uint8_t* data, uint32_t value) {
+    data[0] = (uint8_t) (value >> 8);
+    data[1] = (uint8_t) value;
+}
+
+static void ss_write_be32(uint8_t* data, uint32_t value) {
+    data[0] = (uint8_t) (value >> 24);
+    data[1] = (uint8_t) (value >> 16);
+    data[2] = (uint8_t) (value >> 8);
+    data[3] = (uint8_t) value;
+}
+
+static double ss_now(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+static int ss_records_add(ss_records_t* records, const uint8_t* data, size_t length) {
+    if (length == 0 || length > SS_EVENT_SIZE_MAX) {
+        fprintf(stderr, "record of %zu bytes does not fit a batch\n", length);
+        return -1;
+    }
+    if (records->length + length > records->capacity) {
+        records->capacity = (records->length + length) * 2;
+        records->data     = realloc(records->data, records->capacity);
+    }
+    if (records->count == records->count_max) {
+        records->count_max = records->count_max ? records->count_max * 2 : 1024;
+        records->lengths   = realloc(records->lengths, records->count_max * sizeof(size_t));
+    }
+    if (records->data == NULL || records->lengths == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    memcpy(records->data + records->length, data, length);
+    records->length += length;
+    records->lengths[records->count++] = length;
+    return 0;
+}
+
+/* the length-prefixed records of a batch, returns where they end */
+static ssize_t ss_read_records(ss_records_t* records, const uint8_t* data, size_t size, size_t offset, uint16_t count) {
+    uint16_t length;
+
+    for (uint16_t i = 0; i < count; ++i) {
+        if (size - offset < sizeof(length)) return -1;
+        length  = ss_read_be16(data + offset);
+        offset += sizeof(length);
+        if (length > size - offset || ss_records_add(records, data + offset, length)) return -1;
+        offset += length;
+    }
+    return (ssize_t) offset;
+}
+
+static ssize_t ss_read_batch(ss_records_t* records, const uint8_t* data, size_t size) {
+    ss_compress_conf_t* conf;
+    uint8_t* raw;
+    uint32_t raw_length;
+    uint32_t compressed_length;
+    uint8_t type;
+    ssize_t rv;
+
+    if (size < SS_BATCH_HEADER_SIZE || data[3] > size) return -1;
+    if (data[2] == SS_BATCH_VERSION) return ss_read_records(records, data, size, data[3], ss_read_be16(data + 4));
+    if (data[2] != SS_BATCH_VERSION_COMPRESSED || data[3] < SS_BATCH_COMPRESSED_HEADER_SIZE) return -1;
+
+    type              = data[6];
+    raw_length        = ss_read_be32(data + 8);
+    compressed_length = ss_read_be32(data + 12);
+    if (type == SS_COMPRESS_NONE || type >= SS_COMPRESS_MAX || compressed_length > size - data[3]) return -1;
+    conf = &input_confs[type];
+    if (conf->type == SS_COMPRESS_NONE && ss_compress_conf_init(conf, (ss_compress_type_t) type, 0, dict_path)) return -1;
+
+    raw = malloc(raw_length ? raw_length : 1);
+    if (raw == NULL) return -1;
+    rv = ss_decompress(conf, &ctx, data + data[3], compressed_length, raw, raw_length);
+    if (rv == (ssize_t) raw_length) rv = ss_read_records(records, raw, raw_length, 0, ss_read_be16(data + 4));
+    free(raw);
+    return rv == (ssize_t) raw_length ? (ssize_t) (data[3] + compressed_length) : -1;
+}
+
+static int ss_read_file(ss_records_t* records, FILE* file, const char* name) {
+    uint8_t* data = NULL;
+    uint8_t* end;
+    size_t size = 0;
+    size_t capacity = 0;
+    size_t count;
+    size_t offset = 0;
+    ssize_t length;
+    int rv = 0;
+
+    do {
+        if (size == capacity) {
+            capacity = capacity ? capacity * 2 : 65536;
+            data = realloc(data, capacity);
+            if (data == NULL) {
+                fprintf(stderr, "%s: out of memory\n", name);
+                return -1;
+            }
+        }
+        count = fread(data + size, 1, capacity - size, file);
+        size += count;
+    } while (count);
+
+    while (offset < size) {
+        if (size - offset >= 2 && !memcmp(data + offset, SS_BATCH_MAGIC, 2)) {
+            length = ss_read_batch(records, data + offset, size - offset);
+        }
+        else if (size - offset >= SS_EVENT_HEADER_SIZE && !memcmp(data + offset, SS_EVENT_MAGIC, 2)) {
+            length = ss_read_be16(data + offset + 4);
+            if ((size_t) length > size - offset || ss_records_add(records, data + offset, (size_t) length)) length = -1;
+        }
+        else if (data[offset] == '\n') {
+            length = 1;
+        }
+        else {
+            // a JSON message, the newline is the capture's, not the record's
+            end    = memchr(data + offset, '\n', size - offset);
+            length = end ? end - (data + offset) : (ssize_t) (size - offset);
+            if (ss_records_add(records, data + offset, (size_t) length)) length = -1;
+        }
+        if (length <= 0) {
+            fprintf(stderr, "%s: unreadable record at offset %zu\n", name, offset);
+            rv = -1;
+            break;
+        }
+        offset += (size_t) length;
+    }
+    free(data);
+    return rv;
+}
+
+static int ss_dict_train(ss_records_t* records, const char* path) {
+    uint8_t* dict;
+    size_t length;
+    FILE* file;
+
+    dict = malloc(SS_COMPRESS_DICT_SIZE);
+    if (dict == NULL) return -1;
+    length = ZDICT_trainFromBuffer(dict, SS_COMPRESS_DICT_SIZE, records->data, records->lengths, (unsigned) records->count);
+    if (ZDICT_isError(length)) {
+        fprintf(stderr, "could not train dictionary from %zu records: %s\n", records->count, ZDICT_getErrorName(length));
+        free(dict);
+        return -1;
+    }
+    file = fopen(path, "wb");
+    if (file == NULL || fwrite(dict, 1, length, file) != length || fclose(file)) {
+        fprintf(stderr, "could not write dictionary %s: %s\n", path, strerror(errno));
+        free(dict);
+        return -1;
+    }
+    fprintf(stderr, "trained %zu byte dictionary %08x from %zu records\n", length, ZDICT_getDictID(dict, length), records->count);
+    free(dict);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    ss_records_t records;
+    ss_compress_conf_t conf;
+    ss_compress_type_t type = SS_COMPRESS_ZSTD;
+    const char* train_path = NULL;
+    const char* out_path = NULL;
+    FILE* out = NULL;
+    FILE* file;
+    uint8_t* raw;
+    uint8_t* batch;
+    uint8_t* check;
+    size_t raw_size;
+    size_t batch_size;
+    size_t raw_length;
+    size_t next = 0;
+    size_t offset = 0;
+    ssize_t length;
+    uint64_t batches = 0;
+    uint64_t uncompressed = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    uint32_t batch_records = SS_BATCH_RECORDS_DEFAULT;
+    uint32_t batch_bytes = SS_BATCH_BYTES_DEFAULT;
+    uint32_t count;
+    double compress_time = 0;
+    double decompress_time = 0;
+    double start;
+    int level = 0;
+    int rv = 0;
+    int c;
+
+    memset(&records, 0, sizeof(records));
+    while ((c = getopt(argc, argv, "a:l:D:T:n:b:o:")) != -1) {
+        switch (c) {
+            case 'a': type = ss_compress_type_parse(optarg); break;
+            case 'l': level = atoi(optarg); break;
+            case 'D': dict_path = optarg; break;
+            case 'T': train_path = optarg; break;
+            case 'n': batch_records = (uint32_t) strtoul(optarg, NULL, 0); break;
+            case 'b': batch_bytes = (uint32_t) strtoul(optarg, NULL, 0); break;
+            case 'o': out_path = optarg; break;
+            default: {
+                fprintf(stderr, "usage: %s [-a lz4|zstd] [-l level] [-D dict] [-T dict_out] [-n records] [-b bytes] [-o out] [file ...]\n", argv[0]);
+                return 2;
+            }
+        }
+    }
+    if (type == SS_COMPRESS_NONE || type == SS_COMPRESS_MAX || batch_records == 0 || batch_records > UINT16_MAX || batch_bytes == 0) {
+        fprintf(stderr, "-a takes lz4 or zstd, -n 1 to 65535 records, -b a positive size\n");
+        return 2;
+    }
+
+    if (optind == argc && ss_read_file(&records, stdin, "stdin")) return 1;
+    for (int i = optind; i < argc; ++i) {
+        file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            fprintf(stderr, "could not open %s: %s\n", argv[i], strerror(errno));
+            return 1;
+        }
+        if (ss_read_file(&records, file, argv[i])) return 1;
+        fclose(file);
+    }
+    if (records.count == 0) {
+        fprintf(stderr, "no records read\n");
+        return 1;
+    }
+
+    if (train_path) {
+        if (ss_dict_train(&records, train_path)) return 1;
+        dict_path = train_path;
+    }
+    if (ss_compress_conf_init(&conf, type, level, dict_path)) return 1;
+    if (out_path && (out = fopen(out_path, "wb")) == NULL) {
+        fprintf(stderr, "could not open %s: %s\n", out_path, strerror(errno));
+        return 1;
+    }
+
+    // as in ss_nn_queue_batch_get: a flush starts at batch_bytes, so one more record fits
+    raw_size   = SS_BATCH_HEADER_SIZE + batch_bytes + sizeof(uint16_t) + UINT16_MAX;
+    batch_size = SS_BATCH_COMPRESSED_HEADER_SIZE + ss_compress_bound(&conf, raw_size);
+    raw   = malloc(raw_size);
+    batch = malloc(batch_size);
+    check = malloc(raw_size);
+    if (raw == NULL || batch == NULL || check == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    while (next < records.count) {
+        raw_length = SS_BATCH_HEADER_SIZE;
+        for (count = 0; next < records.count && count < batch_records && raw_length - SS_BATCH_HEADER_SIZE < batch_bytes; ++count, ++next) {
+            ss_write_be16(raw + raw_length, (uint32_t) records.lengths[next]);
+            memcpy(raw + raw_length + sizeof(uint16_t), records.data + offset, records.lengths[next]);
+            raw_length += sizeof(uint16_t) + records.lengths[next];
+            offset     += records.lengths[next];
+        }
+        raw_length -= SS_BATCH_HEADER_SIZE;
+
+        start  = ss_now();
+        length = ss_compress(&conf, &ctx, raw + SS_BATCH_HEADER_SIZE, raw_length, batch + SS_BATCH_COMPRESSED_HEADER_SIZE, batch_size - SS_BATCH_COMPRESSED_HEADER_SIZE);
+        compress_time += ss_now() - start;
+        if (length < 0) {
+            fprintf(stderr, "batch %lu: could not compress %zu bytes\n", batches, raw_length);
+            rv = 1;
+            break;
+        }
+        start = ss_now();
+        if (ss_decompress(&conf, &ctx, batch + SS_BATCH_COMPRESSED_HEADER_SIZE, (size_t) length, check, raw_size) != (ssize_t) raw_length ||
+            memcmp(check, raw + SS_BATCH_HEADER_SIZE, raw_length)) {
+            fprintf(stderr, "batch %lu: round trip of %zu bytes does not match\n", batches, raw_length);
+            rv = 1;
+        }
+        decompress_time += ss_now() - start;
+
+        ++batches;
+        bytes_in += raw_length;
+        // the sensor sends the batch as it is when compression does not pay
+        if ((size_t) length + SS_BATCH_COMPRESSED_HEADER_SIZE >= raw_length + SS_BATCH_HEADER_SIZE) {
+            ++uncompressed;
+            bytes_out += raw_length;
+            memcpy(raw, SS_BATCH_MAGIC, 2);
+            raw[2] = SS_BATCH_VERSION;
+            raw[3] = SS_BATCH_HEADER_SIZE;
+            ss_write_be16(raw + 4, count);
+            if (out) fwrite(raw, 1, raw_length + SS_BATCH_HEADER_SIZE, out);
+            continue;
+        }
+        bytes_out += (uint64_t) length;
+        memcpy(batch, SS_BATCH_MAGIC, 2);
+        batch[2] = SS_BATCH_VERSION_COMPRESSED;
+        batch[3] = SS_BATCH_COMPRESSED_HEADER_SIZE;
+        ss_write_be16(batch + 4, count);
+        batch[6] = (uint8_t) conf.type;
+        batch[7] = 0;
+        ss_write_be32(batch + 8, (uint32_t) raw_length);
+        ss_write_be32(batch + 12, (uint32_t) length);
+        ss_write_be32(batch + 16, conf.dict_id);
+        if (out) fwrite(batch, 1, (size_t) length + SS_BATCH_COMPRESSED_HEADER_SIZE, out);
+    }
+    if (out && fclose(out)) {
+        fprintf(stderr, "could not write %s: %s\n", out_path, strerror(errno));
+        rv = 1;
+    }
+
+    printf("compression:          %s level %d dictionary %08x\n"
+           "records:              %zu\n"
+           "batches:              %lu (%lu sent uncompressed)\n"
+           "bytes in:             %lu\n"
+           "bytes out:            %lu\n"
+           "ratio:                %.2f\n"
+           "compress MB/s:        %.1f\n"
+           "decompress MB/s:      %.1f\n"
+           "round trip:           %s\n",
+           ss_compress_type_dump(conf.type), conf.level, conf.dict_id,
+           records.count, batches, uncompressed, bytes_in, bytes_out,
+           bytes_out ? (double) bytes_in / (double) bytes_out : 0.0,
+           compress_time > 0 ? (double) bytes_in / compress_time / 1e6 : 0.0,
+           decompress_time > 0 ? (double) bytes_in / decompress_time / 1e6 : 0.0,
+           rv ? "FAILED" : "ok");
+
+    ss_compress_conf_destroy(&conf);
+    ss_compress_ctx_destroy(&ctx);
+    free(raw);
+    free(batch);
+    free(check);
+    free(records.data);
+    free(records.lengths);
+    return rv;
+}
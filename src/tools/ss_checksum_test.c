@@ -0,0 +1,189 @@
+/*
+ * ss_checksum_test: check and time the sensor's Internet checksum code.
+ *
+ * ss_checksum_test [-n cases] [-s seed] [-q]
+ *
+ * Compares ss_cksum_add, folded, against a plain RFC 1071 sum over random
+ * buffers: every length up to 600 bytes at every alignment in a 16 byte
+ * block, odd tails included, then random lengths and alignments up to a
+ * jumbo frame. Sums chained at random even offsets and RFC 1624 updates
+ * of random 16 and 32 bit fields must give the same checksum as a full
+ * recomputation. Then prints cycles per byte of both sums at common
+ * packet sizes; -q skips the timing. Exits 1 on any mismatch.
+ */
+
+#include <getopt.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <x86intrin.h>
+
+#include "checksum.h"
+
+#define SS_CKSUM_TEST_LENGTH_MAX  9216 // jumbo frame
+#define SS_CKSUM_TEST_CASES      20000
+#define SS_CKSUM_BENCH_BYTES  (64 << 20) // summed per size and alignment
+
+static uint64_t seed = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t ss_random(void) {
+    // xorshift64*, reproducible with -s
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return seed * 0x2545f4914f6cdd1dULL;
+}
+
+static void ss_random_fill(uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; ++i) data[i] = (uint8_t) ss_random();
+}
+
+/* RFC 1071 section 4.1, big endian 16 bit words, odd byte padded with zero */
+static uint16_t ss_naive_cksum(const uint8_t* data, size_t length) {
+    uint32_t sum = 0;
+
+    while (length > 1) {
+        sum += (uint32_t) (data[0] << 8 | data[1]);
+        data += 2;
+        length -= 2;
+    }
+    if (length) sum += (uint32_t) (data[0] << 8);
+    while (sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+
+    return (uint16_t) ~sum;
+}
+
+/* the sensor's sum, NOT inverted in memory order, as a host order checksum */
+static uint16_t ss_sensor_cksum(const uint8_t* data, size_t length) {
+    return rte_be_to_cpu_16((uint16_t) ~ss_cksum_fold(ss_cksum_add(0, data, length)));
+}
+
+static int ss_check_sum(const uint8_t* data, size_t length, size_t alignment) {
+    uint16_t expected = ss_naive_cksum(data, length);
+    uint16_t actual   = ss_sensor_cksum(data, length);
+
+    if (actual == expected) return 0;
+    fprintf(stderr, "sum mismatch length %zu alignment %zu: 0x%04x expected 0x%04x\n",
+        length, alignment, actual, expected);
+    return 1;
+}
+
+static int ss_check_chain(const uint8_t* data, size_t length) {
+    size_t split = length ? (ss_random() % length) & ~(size_t) 1 : 0;
+    uint64_t sum = ss_cksum_add(ss_cksum_add(0, data, split), data + split, length - split);
+    uint16_t expected = ss_naive_cksum(data, length);
+    uint16_t actual   = rte_be_to_cpu_16((uint16_t) ~ss_cksum_fold(sum));
+
+    if (actual == expected) return 0;
+    fprintf(stderr, "chained sum mismatch length %zu split %zu: 0x%04x expected 0x%04x\n",
+        length, split, actual, expected);
+    return 1;
+}
+
+/* rewrite a random aligned field of the buffer and update its checksum in place */
+static int ss_check_update(uint8_t* data, size_t length, size_t width) {
+    size_t offset;
+    uint16_t check, expected;
+    uint16_t old16, new16;
+    uint32_t old32, new32;
+
+    if (length < width) return 0;
+    offset = (ss_random() % (length - width + 1)) & ~(size_t) 1;
+    check  = ss_in_cksum((uint16_t*) data, length);
+
+    if (width == sizeof(old16)) {
+        memcpy(&old16, data + offset, width);
+        new16 = (uint16_t) ss_random();
+        memcpy(data + offset, &new16, width);
+        check = ss_cksum_update16(check, old16, new16);
+    }
+    else {
+        memcpy(&old32, data + offset, width);
+        new32 = (uint32_t) ss_random();
+        memcpy(data + offset, &new32, width);
+        check = ss_cksum_update32(check, old32, new32);
+    }
+
+    // an all zero buffer has two encodings of its sum, skip it
+    expected = ss_in_cksum((uint16_t*) data, length);
+    if (check == expected || expected == 0xffff) return 0;
+    fprintf(stderr, "update%zu mismatch length %zu offset %zu: 0x%04x expected 0x%04x\n",
+        width * 8, length, offset, check, expected);
+    return 1;
+}
+
+static double ss_bench(uint16_t (*cksum)(const uint8_t*, size_t), const uint8_t* data, size_t length) {
+    size_t rounds = SS_CKSUM_BENCH_BYTES / length;
+    volatile uint16_t sink = 0;
+    uint64_t start;
+
+    sink = (uint16_t) (sink ^ cksum(data, length));
+    start = __rdtsc();
+    for (size_t i = 0; i < rounds; ++i) {
+        sink = (uint16_t) (sink ^ cksum(data, length));
+    }
+    return (double) (__rdtsc() - start) / (double) (rounds * length);
+}
+
+int main(int argc, char* argv[]) {
+    static const size_t bench_lengths[] = { 20, 40, 64, 255, 256, 576, 1500, 9000 };
+    static uint8_t block[SS_CKSUM_TEST_LENGTH_MAX + 16];
+    uint8_t* data;
+    size_t cases = SS_CKSUM_TEST_CASES;
+    size_t length, alignment;
+    int quiet = 0;
+    int errors = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:s:q")) != -1) {
+        switch (c) {
+            case 'n': cases = strtoul(optarg, NULL, 0); break;
+            case 's': seed  = strtoull(optarg, NULL, 0) | 1; break;
+            case 'q': quiet = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-n cases] [-s seed] [-q]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    // every length and alignment around the scalar and SSE2 boundaries
+    for (length = 0; length <= 600; ++length) {
+        for (alignment = 0; alignment < 16; ++alignment) {
+            data = block + alignment;
+            ss_random_fill(data, length);
+            errors += ss_check_sum(data, length, alignment);
+        }
+    }
+
+    // random lengths up to a jumbo frame, all bytes set to stress the carries
+    for (size_t i = 0; i < cases; ++i) {
+        length    = ss_random() % (SS_CKSUM_TEST_LENGTH_MAX + 1);
+        alignment = ss_random() % 16;
+        data      = block + alignment;
+        if (i % 8 == 0) memset(data, 0xff, length);
+        else            ss_random_fill(data, length);
+        errors += ss_check_sum(data, length, alignment);
+        errors += ss_check_chain(data, length);
+        errors += ss_check_update(data, length, sizeof(uint16_t));
+        errors += ss_check_update(data, length, sizeof(uint32_t));
+    }
+
+    printf("%zu random cases, %d failed\n", cases, errors);
+    if (errors || quiet) return errors ? 1 : 0;
+
+    printf("%-8s %-9s %14s %14s\n", "length", "alignment", "sensor cyc/B", "naive cyc/B");
+    for (size_t i = 0; i < sizeof(bench_lengths) / sizeof(bench_lengths[0]); ++i) {
+        for (alignment = 0; alignment < 2; ++alignment) {
+            data = block + alignment;
+            ss_random_fill(data, bench_lengths[i]);
+            printf("%-8zu %-9zu %14.3f %14.3f\n", bench_lengths[i], alignment,
+                ss_bench(ss_sensor_cksum, data, bench_lengths[i]),
+                ss_bench(ss_naive_cksum,  data, bench_lengths[i]));
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,448 @@
+/*
+ * ss_event_decode: validate and print binary sdn_sensor events.
+ *
+ * ss_event_decode [-q] [-D dict] [file ...]
+ *     decode back-to-back events from files, or stdin with no files
+ * ss_event_decode [-q] [-D dict] -u url
+ *     bind a nanomsg PULL socket at url and decode each message; JSON
+ *     messages (sFlow, NetFlow, or queues left on nm_encoding json) are
+ *     printed as they are
+ *
+ * Batches from queues with nm_batch_records (nn_batch_header_t in
+ * nn_queue.h) are split into their records, which are printed the same
+ * way, one per line. Batches compressed under nm_compress are inflated
+ * first; -D gives the nm_compress_dict of the queue, when it has one.
+ *
+ * Each event is printed as one JSON line using the schema field names,
+ * so output lines up with the sensor's own JSON encoding. -q only
+ * validates. Exits 1 when any event is malformed.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <nanomsg/nn.h>
+#include <nanomsg/pipeline.h>
+
+#include "compress.h"
+#include "event_schema.h"
+
+#define SS_DECODE_VARINT_MAX 10
+
+/* mirrors nn_batch_header_t, nn_queue.h needs DPDK and json-c */
+#define SS_BATCH_MAGIC       "SB"
+#define SS_BATCH_VERSION        1
+#define SS_BATCH_HEADER_SIZE    6
+#define SS_BATCH_VERSION_COMPRESSED  2
+#define SS_BATCH_COMPRESSED_HEADER_SIZE 20
+
+static int quiet = 0;
+static const char* dict_path = NULL;
+static ss_compress_conf_t compress_confs[SS_COMPRESS_MAX];
+static ss_compress_ctx_t compress_ctx;
+static uint8_t* inflated = NULL;
+static size_t inflated_size = 0;
+
+static int ss_decode_varint(const uint8_t** p, const uint8_t* end, uint64_t* value) {
+    uint64_t result = 0;
+
+    for (int i = 0; i < SS_DECODE_VARINT_MAX && *p < end; ++i) {
+        uint8_t byte = *(*p)++;
+        result |= (uint64_t) (byte & 0x7f) << (7 * i);
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* escaped the way the sensor's JSON writer does it, so outputs diff cleanly */
+static void ss_decode_string(const uint8_t* data, uint64_t length) {
+    putchar('"');
+    for (uint64_t i = 0; i < length; ++i) {
+        uint8_t c = data[i];
+        switch (c) {
+            case '\b': printf("\\b");  break;
+            case '\n': printf("\\n");  break;
+            case '\r': printf("\\r");  break;
+            case '\t': printf("\\t");  break;
+            case '\f': printf("\\f");  break;
+            case '"':  printf("\\\""); break;
+            case '\\': printf("\\\\"); break;
+            case '/':  printf("\\/");  break;
+            default: {
+                if (c < 0x20) printf("\\u%04x", c);
+                else          putchar(c);
+            }
+        }
+    }
+    putchar('"');
+}
+
+static int ss_decode_value(const ss_event_field_info_t* info, uint32_t wire, const uint8_t* data, uint64_t length, uint64_t varint) {
+    char address[INET6_ADDRSTRLEN];
+
+    if (info == NULL) {
+        // newer field, skipped by design
+        if (!quiet) printf(", \"unknown\": %s", wire == SS_EVENT_WIRE_VARINT ? "\"varint\"" : "\"bytes\"");
+        return 0;
+    }
+    if ((info->value == SS_EVENT_VALUE_INT) != (wire == SS_EVENT_WIRE_VARINT)) {
+        fprintf(stderr, "field %s has wire type %u\n", info->name, wire);
+        return -1;
+    }
+    switch (info->value) {
+        case SS_EVENT_VALUE_ADDRESS: {
+            if (length != 4 && length != 16) {
+                fprintf(stderr, "field %s has address length %lu\n", info->name, length);
+                return -1;
+            }
+            if (quiet) return 0;
+            inet_ntop(length == 4 ? AF_INET : AF_INET6, data, address, sizeof(address));
+            printf(", \"%s\": \"%s\"", info->name, address);
+            return 0;
+        }
+        case SS_EVENT_VALUE_MAC: {
+            if (length != 6) {
+                fprintf(stderr, "field %s has mac length %lu\n", info->name, length);
+                return -1;
+            }
+            if (quiet) return 0;
+            printf(", \"%s\": \"%02x:%02x:%02x:%02x:%02x:%02x\"", info->name,
+                data[0], data[1], data[2], data[3], data[4], data[5]);
+            return 0;
+        }
+        case SS_EVENT_VALUE_STRING: {
+            const uint8_t* equals;
+            if (quiet) return 0;
+            // nm_tags, printed as the JSON encoding has them, values as strings
+            equals = info == ss_event_field_info(SS_FIELD_TAG) ? memchr(data, '=', length) : NULL;
+            if (equals) {
+                printf(", ");
+                ss_decode_string(data, (uint64_t) (equals - data));
+                printf(": ");
+                ss_decode_string(equals + 1, length - (uint64_t) (equals - data) - 1);
+                return 0;
+            }
+            printf(", \"%s\": ", info->name);
+            ss_decode_string(data, length);
+            return 0;
+        }
+        case SS_EVENT_VALUE_INT: {
+            if (quiet) return 0;
+            // undo the zigzag
+            printf(", \"%s\": %ld", info->name, (int64_t) (varint >> 1) ^ -(int64_t) (varint & 1));
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* returns the event length, or -1 when it is malformed */
+static ssize_t ss_decode_event(const uint8_t* data, size_t size) {
+    ss_event_header_t header;
+    const uint8_t* p;
+    const uint8_t* end;
+    uint64_t seen = 0;
+    uint64_t tag;
+    uint64_t varint;
+    uint64_t length;
+    uint32_t field;
+    uint32_t wire;
+    uint16_t fields = 0;
+
+    if (size < SS_EVENT_HEADER_SIZE) {
+        fprintf(stderr, "truncated header, %zu bytes\n", size);
+        return -1;
+    }
+    memcpy(&header, data, sizeof(header));
+    header.length = ntohs(header.length);
+    header.fields = ntohs(header.fields);
+    if (memcmp(header.magic, SS_EVENT_MAGIC, sizeof(header.magic))) {
+        fprintf(stderr, "bad magic %02x %02x\n", header.magic[0], header.magic[1]);
+        return -1;
+    }
+    if (header.version != SS_EVENT_VERSION) {
+        fprintf(stderr, "unsupported version %u\n", header.version);
+        return -1;
+    }
+    if (header.type == 0 || header.type >= SS_EVENT_MAX) {
+        fprintf(stderr, "unknown event type %u\n", header.type);
+        return -1;
+    }
+    if (header.length < SS_EVENT_HEADER_SIZE || header.length > size) {
+        fprintf(stderr, "event length %u, %zu bytes available\n", header.length, size);
+        return -1;
+    }
+
+    if (!quiet) printf("{ \"event\": \"%s\"", ss_event_type_dump((ss_event_type_t) header.type));
+    p   = data + SS_EVENT_HEADER_SIZE;
+    end = data + header.length;
+    while (p < end) {
+        if (ss_decode_varint(&p, end, &tag)) goto truncated;
+        field = (uint32_t) (tag >> SS_EVENT_TAG_SHIFT);
+        wire  = (uint32_t) (tag & ((1 << SS_EVENT_TAG_SHIFT) - 1));
+        varint = length = 0;
+        if      (wire == SS_EVENT_WIRE_VARINT) {
+            if (ss_decode_varint(&p, end, &varint)) goto truncated;
+        }
+        else if (wire == SS_EVENT_WIRE_BYTES) {
+            if (ss_decode_varint(&p, end, &length)) goto truncated;
+            if (length > (uint64_t) (end - p)) goto truncated;
+        }
+        else {
+            fprintf(stderr, "field %u has unknown wire type %u\n", field, wire);
+            goto invalid;
+        }
+        // tag is the one field written once per nm_tags entry
+        if (field < 64 && field != SS_FIELD_TAG && (seen & (1ULL << field))) {
+            fprintf(stderr, "field %s repeated\n", ss_event_field_name((ss_event_field_t) field));
+            goto invalid;
+        }
+        if (field < 64) seen |= 1ULL << field;
+        if (ss_decode_value(ss_event_field_info(field), wire, p, length, varint)) goto invalid;
+        p += length;
+        ++fields;
+    }
+    if (fields != header.fields) {
+        fprintf(stderr, "header says %u fields, found %u\n", header.fields, fields);
+        goto invalid;
+    }
+    if (!quiet) printf(" }\n");
+    return header.length;
+
+    truncated:
+    fprintf(stderr, "truncated field at offset %zu\n", (size_t) (p - data));
+    invalid:
+    if (!quiet) printf(" }\n");
+    return -1;
+}
+
+/* a JSON record is printed as it is, anything else must be an event */
+static int ss_decode_record(const uint8_t* data, size_t length) {
+    if (length > 0 && data[0] == '{') {
+        if (!quiet) printf("%.*s\n", (int) length, (const char*) data);
+        return 0;
+    }
+    return ss_decode_event(data, length) == (ssize_t) length ? 0 : -1;
+}
+
+static uint32_t ss_decode_be32(const uint8_t* data) {
+    return (uint32_t) data[0] << 24 | (uint32_t) data[1] << 16 | (uint32_t) data[2] << 8 | data[3];
+}
+
+static ssize_t ss_decode_records(const uint8_t* data, size_t size, size_t offset, uint16_t records);
+
+/* mirrors nn_batch_compressed_header_t: the records are one LZ4 or zstd frame */
+static ssize_t ss_decode_batch_compressed(const uint8_t* data, size_t size) {
+    ss_compress_conf_t* conf;
+    uint32_t raw_length;
+    uint32_t compressed_length;
+    uint32_t dict_id;
+    uint8_t type;
+
+    if (data[3] < SS_BATCH_COMPRESSED_HEADER_SIZE || data[3] > size) {
+        fprintf(stderr, "compressed batch header length %u, %zu bytes available\n", data[3], size);
+        return -1;
+    }
+    type              = data[6];
+    raw_length        = ss_decode_be32(data + 8);
+    compressed_length = ss_decode_be32(data + 12);
+    dict_id           = ss_decode_be32(data + 16);
+    if (compressed_length > size - data[3]) {
+        fprintf(stderr, "compressed batch of %u bytes, %zu available\n", compressed_length, size - data[3]);
+        return -1;
+    }
+    if (type == SS_COMPRESS_NONE || type >= SS_COMPRESS_MAX) {
+        fprintf(stderr, "unknown batch compression %u\n", type);
+        return -1;
+    }
+
+    conf = &compress_confs[type];
+    if (conf->type == SS_COMPRESS_NONE && ss_compress_conf_init(conf, (ss_compress_type_t) type, 0, dict_path)) return -1;
+    if (dict_id != conf->dict_id) {
+        fprintf(stderr, "batch needs dictionary %08x, -D gave %08x\n", dict_id, conf->dict_id);
+        return -1;
+    }
+    if (raw_length > inflated_size) {
+        free(inflated);
+        inflated_size = raw_length;
+        inflated      = malloc(inflated_size);
+        if (inflated == NULL) {
+            fprintf(stderr, "out of memory for a batch of %u bytes\n", raw_length);
+            inflated_size = 0;
+            return -1;
+        }
+    }
+    if (ss_decompress(conf, &compress_ctx, data + data[3], compressed_length, inflated, raw_length) != (ssize_t) raw_length) {
+        fprintf(stderr, "could not decompress %s batch of %u bytes\n", ss_compress_type_dump(conf->type), compressed_length);
+        return -1;
+    }
+    if (ss_decode_records(inflated, raw_length, 0, (uint16_t) (data[4] << 8 | data[5])) != (ssize_t) raw_length) {
+        fprintf(stderr, "compressed batch records do not fill its %u bytes\n", raw_length);
+        return -1;
+    }
+    return (ssize_t) (data[3] + compressed_length);
+}
+
+/* returns the batch length, or -1 when it is malformed */
+static ssize_t ss_decode_batch(const uint8_t* data, size_t size) {
+    if (size < SS_BATCH_HEADER_SIZE) {
+        fprintf(stderr, "truncated batch header, %zu bytes\n", size);
+        return -1;
+    }
+    if (data[2] == SS_BATCH_VERSION_COMPRESSED) return ss_decode_batch_compressed(data, size);
+    if (data[2] != SS_BATCH_VERSION) {
+        fprintf(stderr, "unsupported batch version %u\n", data[2]);
+        return -1;
+    }
+    if (data[3] < SS_BATCH_HEADER_SIZE || data[3] > size) {
+        fprintf(stderr, "batch header length %u, %zu bytes available\n", data[3], size);
+        return -1;
+    }
+    return ss_decode_records(data, size, data[3], (uint16_t) (data[4] << 8 | data[5]));
+}
+
+/* the records from offset on, returns where they end */
+static ssize_t ss_decode_records(const uint8_t* data, size_t size, size_t offset, uint16_t records) {
+    uint16_t length;
+
+    for (uint16_t i = 0; i < records; ++i) {
+        if (size - offset < sizeof(length)) {
+            fprintf(stderr, "batch record %u of %u truncated\n", i + 1, records);
+            return -1;
+        }
+        length  = (uint16_t) (data[offset] << 8 | data[offset + 1]);
+        offset += sizeof(length);
+        if (length > size - offset) {
+            fprintf(stderr, "batch record %u of %u has length %u, %zu bytes available\n", i + 1, records, length, size - offset);
+            return -1;
+        }
+        if (ss_decode_record(data + offset, length)) {
+            fprintf(stderr, "batch record %u of %u is invalid\n", i + 1, records);
+            return -1;
+        }
+        offset += length;
+    }
+    return (ssize_t) offset;
+}
+
+static int ss_decode_is_batch(const uint8_t* data, size_t size) {
+    return size >= 2 && !memcmp(data, SS_BATCH_MAGIC, 2);
+}
+
+static int ss_decode_file(FILE* file, const char* name) {
+    uint8_t* data = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+    size_t count;
+    size_t offset = 0;
+    ssize_t length;
+    int rv = 0;
+
+    // events are self-delimiting, so a capture is just their concatenation
+    do {
+        if (size == capacity) {
+            capacity = capacity ? capacity * 2 : 65536;
+            data = realloc(data, capacity);
+            if (data == NULL) {
+                fprintf(stderr, "%s: out of memory\n", name);
+                return -1;
+            }
+        }
+        count = fread(data + size, 1, capacity - size, file);
+        size += count;
+    } while (count);
+
+    while (offset < size) {
+        if (ss_decode_is_batch(data + offset, size - offset)) {
+            length = ss_decode_batch(data + offset, size - offset);
+        }
+        else {
+            length = ss_decode_event(data + offset, size - offset);
+        }
+        if (length < 0) {
+            fprintf(stderr, "%s: invalid event at offset %zu\n", name, offset);
+            rv = -1;
+            break;
+        }
+        offset += (size_t) length;
+    }
+    free(data);
+    return rv;
+}
+
+static int ss_decode_queue(const char* url) {
+    void* message;
+    int conn;
+    int length;
+
+    conn = nn_socket(AF_SP, NN_PULL);
+    if (conn < 0 || nn_bind(conn, url) < 0) {
+        fprintf(stderr, "could not bind nm queue %s: %s\n", url, nn_strerror(nn_errno()));
+        return -1;
+    }
+    for (;;) {
+        length = nn_recv(conn, &message, NN_MSG, 0);
+        if (length < 0) {
+            if (nn_errno() == EINTR) continue;
+            fprintf(stderr, "could not receive: %s\n", nn_strerror(nn_errno()));
+            break;
+        }
+        if (ss_decode_is_batch(message, (size_t) length)) {
+            if (ss_decode_batch(message, (size_t) length) != length) {
+                fprintf(stderr, "invalid batch, %d bytes\n", length);
+            }
+        }
+        else if (ss_decode_record(message, (size_t) length)) {
+            fprintf(stderr, "invalid event, %d bytes\n", length);
+        }
+        fflush(stdout);
+        nn_freemsg(message);
+    }
+    nn_close(conn);
+    return -1;
+}
+
+int main(int argc, char* argv[]) {
+    const char* url = NULL;
+    FILE* file;
+    int rv = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "qD:u:")) != -1) {
+        switch (c) {
+            case 'q': quiet = 1; break;
+            case 'D': dict_path = optarg; break;
+            case 'u': url = optarg; break;
+            default: {
+                fprintf(stderr, "usage: %s [-q] [-D dict] [-u url | file ...]\n", argv[0]);
+                return 2;
+            }
+        }
+    }
+
+    if (url) return ss_decode_queue(url) ? 1 : 0;
+    if (optind == argc) return ss_decode_file(stdin, "stdin") ? 1 : 0;
+
+    for (int i = optind; i < argc; ++i) {
+        file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            fprintf(stderr, "could not open %s: %s\n", argv[i], strerror(errno));
+            rv = 1;
+            continue;
+        }
+        if (ss_decode_file(file, argv[i])) rv = 1;
+        fclose(file);
+    }
+    return rv;
+}
@@ -0,0 +1,390 @@
+/*
+ * ss_flow_test: check the flow cache's keys and evictions.
+ *
+ * ss_flow_test [-n cases] [-s seed]
+ *
+ * Both directions of a v4 or v6 conversation, over TCP, UDP or neither,
+ * must build the same symmetric key, with the low address / port pair
+ * first and forward_lo telling the sides apart; non-first fragments
+ * build none. Then flows are created in a real rte_hash on one lcore:
+ * bucket-full adds are forced with the linker's --wrap, so evicting
+ * SS_FLOW_EVICT_ATTEMPTS victims, with and without room after them,
+ * must take exactly the LRU head flows and free their flat-array
+ * entries, and a full table must hand a victim's entry to the new flow.
+ * After every step each active entry must sit at its own hash position
+ * and on the LRU list. Exits 1 on any mismatch.
+ *
+ * The EAL runs on one core without hugepages or devices.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_eal.h>
+#include <rte_log.h>
+
+// white box: the shards and their flat arrays are static to flow.c
+#include "flow.c"
+
+#define SS_FT_KEY_CASES 10000
+#define SS_FT_FULL_ROUNDS  64
+
+static uint64_t seed = 0x9e3779b97f4a7c15ULL;
+static int errors;
+
+/* flow.c's only links to the rest of the sensor, never reached without packets */
+ss_conf_t* ss_conf = NULL;
+
+ss_ioc_entry_t* ss_ioc_metadata_match(ss_metadata_t* md) {
+    return NULL;
+}
+
+uint8_t* ss_metadata_prepare_flow(const char* source, nn_queue_t* nn_queue, ss_flow_t* flow, ss_flow_reason_t reason, size_t* length) {
+    return NULL;
+}
+
+int ss_nn_queue_send(nn_queue_t* nn_queue, uint8_t* message, uint16_t length) {
+    return -1;
+}
+
+int ss_nn_queue_wants(nn_queue_t* nn_queue, uint32_t events) {
+    return 0;
+}
+
+void* je_calloc(size_t count, size_t size) {
+    return calloc(count, size);
+}
+
+/* linked with --wrap=rte_hash_add_key, fails the next fail_adds adds as a full bucket */
+static int fail_adds;
+
+int32_t __real_rte_hash_add_key(const struct rte_hash* h, const void* key);
+
+int32_t __wrap_rte_hash_add_key(const struct rte_hash* h, const void* key) {
+    if (fail_adds) {
+        --fail_adds;
+        return -ENOSPC;
+    }
+    return __real_rte_hash_add_key(h, key);
+}
+
+static uint64_t ss_random(void) {
+    // xorshift64*, reproducible with -s
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return seed * 0x2545f4914f6cdd1dULL;
+}
+
+#define SS_FT_ERROR(...) do { fprintf(stderr, __VA_ARGS__); ++errors; } while (0)
+
+/* an Ethernet frame from sip:sport to dip:dport, in an mbuf with no pool */
+static void ss_ft_frame(rte_mbuf_t* mbuf, uint8_t* frame, uint16_t eth_type, uint8_t protocol,
+    const uint8_t* sip, const uint8_t* dip, uint16_t sport, uint16_t dport, uint16_t frag_off) {
+    eth_hdr_t* eth = (eth_hdr_t*) frame;
+    uint8_t* l4;
+    uint16_t length;
+
+    memset(frame, 0, 256);
+    eth->ether_type = rte_cpu_to_be_16(eth_type);
+    if (eth_type == ETHER_TYPE_IPV4) {
+        ip4_hdr_t* ip4 = (ip4_hdr_t*) (frame + sizeof(eth_hdr_t));
+        ip4->version  = 4;
+        ip4->ihl      = 5;
+        ip4->protocol = protocol;
+        ip4->frag_off = rte_cpu_to_be_16(frag_off);
+        memcpy(&ip4->saddr, sip, IPV4_ALEN);
+        memcpy(&ip4->daddr, dip, IPV4_ALEN);
+        l4 = (uint8_t*) ip4 + sizeof(ip4_hdr_t);
+    }
+    else {
+        ip6_hdr_t* ip6 = (ip6_hdr_t*) (frame + sizeof(eth_hdr_t));
+        ip6->ip6_vfc = 0x60;
+        ip6->ip6_nxt = protocol;
+        memcpy(&ip6->ip6_src, sip, IPV6_ALEN);
+        memcpy(&ip6->ip6_dst, dip, IPV6_ALEN);
+        l4 = (uint8_t*) ip6 + sizeof(ip6_hdr_t);
+    }
+    if (protocol == IPPROTO_TCP) {
+        tcp_hdr_t* tcp = (tcp_hdr_t*) l4;
+        tcp->source   = rte_cpu_to_be_16(sport);
+        tcp->dest     = rte_cpu_to_be_16(dport);
+        tcp->th_flags = TH_ACK;
+    }
+    else if (protocol == IPPROTO_UDP) {
+        udp_hdr_t* udp = (udp_hdr_t*) l4;
+        udp->uh_sport = rte_cpu_to_be_16(sport);
+        udp->uh_dport = rte_cpu_to_be_16(dport);
+    }
+    length = (uint16_t) (l4 + sizeof(tcp_hdr_t) - frame);
+
+    memset(mbuf, 0, sizeof(*mbuf));
+    mbuf->buf_addr = frame;
+    mbuf->data_off = 0;
+    mbuf->data_len = length;
+    mbuf->pkt_len  = length;
+}
+
+/* both directions of one conversation, against a key worked out here */
+static void ss_ft_check_key(uint16_t eth_type, uint8_t protocol, const uint8_t* a, const uint8_t* b, uint16_t aport, uint16_t bport) {
+    uint8_t frame[256];
+    rte_mbuf_t mbuf;
+    ss_flow_key_t keys[2];
+    ss_flow_key_t expected;
+    uint32_t alen = eth_type == ETHER_TYPE_IPV4 ? IPV4_ALEN : IPV6_ALEN;
+    int forward_lo[2];
+    uint8_t tcp_flags;
+    int a_lo;
+
+    if (protocol != IPPROTO_TCP && protocol != IPPROTO_UDP) aport = bport = 0;
+
+    ss_ft_frame(&mbuf, frame, eth_type, protocol, a, b, aport, bport, 0);
+    if (ss_flow_key_prepare(&mbuf, &keys[0], &forward_lo[0], &tcp_flags)) {
+        SS_FT_ERROR("0x%04x/%u: no key for a to b\n", eth_type, protocol);
+        return;
+    }
+    ss_ft_frame(&mbuf, frame, eth_type, protocol, b, a, bport, aport, 0);
+    if (ss_flow_key_prepare(&mbuf, &keys[1], &forward_lo[1], &tcp_flags)) {
+        SS_FT_ERROR("0x%04x/%u: no key for b to a\n", eth_type, protocol);
+        return;
+    }
+
+    a_lo = memcmp(a, b, alen) < 0 || (memcmp(a, b, alen) == 0 && aport <= bport);
+    memset(&expected, 0, sizeof(expected));
+    memcpy(expected.addr_lo, a_lo ? a : b, alen);
+    memcpy(expected.addr_hi, a_lo ? b : a, alen);
+    expected.port_lo  = rte_cpu_to_be_16(a_lo ? aport : bport);
+    expected.port_hi  = rte_cpu_to_be_16(a_lo ? bport : aport);
+    expected.eth_type = eth_type;
+    expected.protocol = protocol;
+
+    if (memcmp(&keys[0], &keys[1], sizeof(ss_flow_key_t))) {
+        SS_FT_ERROR("0x%04x/%u: the two directions build different keys\n", eth_type, protocol);
+    }
+    if (memcmp(&keys[0], &expected, sizeof(ss_flow_key_t))) {
+        SS_FT_ERROR("0x%04x/%u: key is not low pair first\n", eth_type, protocol);
+    }
+    // only a conversation with itself has both sides low
+    if (forward_lo[0] != a_lo || forward_lo[1] != (!a_lo || (memcmp(a, b, alen) == 0 && aport == bport))) {
+        SS_FT_ERROR("0x%04x/%u: forward_lo %d / %d with a %s\n",
+            eth_type, protocol, forward_lo[0], forward_lo[1], a_lo ? "low" : "high");
+    }
+}
+
+static void ss_ft_check_keys(size_t cases) {
+    static const uint8_t protocols[] = { IPPROTO_TCP, IPPROTO_UDP, IPPROTO_ICMP };
+    uint8_t a[IPV6_ALEN];
+    uint8_t b[IPV6_ALEN];
+    uint8_t frame[256];
+    rte_mbuf_t mbuf;
+    ss_flow_key_t key;
+    uint16_t eth_type;
+    uint16_t aport, bport;
+    int forward_lo;
+    uint8_t tcp_flags;
+
+    for (size_t i = 0; i < cases; ++i) {
+        eth_type = i % 2 ? ETHER_TYPE_IPV6 : ETHER_TYPE_IPV4;
+        for (size_t j = 0; j < sizeof(a); ++j) a[j] = (uint8_t) ss_random();
+        memcpy(b, a, sizeof(b));
+        // addresses equal, or differing in a low or a high byte, for the port tie-break
+        switch (i / 2 % 4) {
+            case 0:  break;
+            case 1:  b[0] ^= (uint8_t) (1 + ss_random() % 255); break;
+            default: b[eth_type == ETHER_TYPE_IPV4 ? 3 : 15] ^= (uint8_t) (1 + ss_random() % 255); break;
+        }
+        aport = (uint16_t) ss_random();
+        bport = ss_random() % 4 ? (uint16_t) ss_random() : aport;
+        ss_ft_check_key(eth_type, protocols[i % 3], a, b, aport, bport);
+    }
+
+    // ports of 256 and 1 are byte-swapped opposites, so compare in host order
+    memset(a, 10, sizeof(a));
+    ss_ft_check_key(ETHER_TYPE_IPV4, IPPROTO_TCP, a, a, 256, 1);
+    ss_ft_check_key(ETHER_TYPE_IPV6, IPPROTO_UDP, a, a, 1, 256);
+
+    memset(b, 11, sizeof(b));
+    ss_ft_frame(&mbuf, frame, ETHER_TYPE_IPV4, IPPROTO_UDP, a, b, 53, 1024, 185);
+    if (ss_flow_key_prepare(&mbuf, &key, &forward_lo, &tcp_flags) == 0) {
+        SS_FT_ERROR("a non-first fragment built a key\n");
+    }
+}
+
+/* every active entry at its own hash position and on the LRU list, and nothing else */
+static void ss_ft_check_table(ss_flow_shard_t* shard, uint32_t size, const char* when) {
+    ss_flow_stats_t* stats = &flow_stats[rte_lcore_id()];
+    ss_flow_t* flow;
+    uint64_t active = 0;
+    uint64_t listed = 0;
+    int32_t position;
+
+    for (uint32_t i = 0; i < size; ++i) {
+        if (!shard->flows[i].active) continue;
+        ++active;
+        position = rte_hash_lookup(shard->hash, &shard->flows[i].key);
+        if (position != (int32_t) i) SS_FT_ERROR("%s: flow %u is at hash position %d\n", when, i, position);
+    }
+    TAILQ_FOREACH(flow, &shard->lru, lru) {
+        ++listed;
+        if (!flow->active) SS_FT_ERROR("%s: inactive flow %td on the LRU list\n", when, flow - shard->flows);
+    }
+    if (active != listed || active != stats->flows_active) {
+        SS_FT_ERROR("%s: %lu active flows, %lu listed, %lu counted\n", when, active, listed, stats->flows_active);
+    }
+}
+
+static void ss_ft_key(ss_flow_key_t* key, uint32_t index) {
+    memset(key, 0, sizeof(*key));
+    key->addr_lo[0] = 10;
+    memcpy(&key->addr_lo[1], &index, sizeof(index));
+    key->addr_hi[0] = 192;
+    key->port_lo    = (uint16_t) ss_random();
+    key->port_hi    = rte_cpu_to_be_16(80);
+    key->eth_type   = ETHER_TYPE_IPV4;
+    key->protocol   = IPPROTO_TCP;
+}
+
+/*
+ * Create one flow with failures adds forced. The evicted flows must be
+ * the LRU head ones, gone from the hash, with their entries free or
+ * holding the new flow; on a full table the new flow can only have one
+ * of their entries.
+ */
+static ss_flow_t* ss_ft_create(ss_flow_shard_t* shard, uint32_t size, uint32_t index, int failures, const char* when) {
+    ss_flow_stats_t* stats = &flow_stats[rte_lcore_id()];
+    ss_flow_t* victims[SS_FLOW_EVICT_ATTEMPTS + 1];
+    ss_flow_key_t victim_keys[SS_FLOW_EVICT_ATTEMPTS + 1];
+    uint64_t evicted  = stats->flows_evicted;
+    uint64_t rejected = stats->flows_rejected;
+    int full          = stats->flows_active == size;
+    int count         = 0;
+    int reused        = 0;
+    ss_flow_key_t key;
+    ss_flow_t* flow;
+
+    TAILQ_FOREACH(flow, &shard->lru, lru) {
+        if (count == SS_FLOW_EVICT_ATTEMPTS + 1) break;
+        victims[count] = flow;
+        memcpy(&victim_keys[count], &flow->key, sizeof(ss_flow_key_t));
+        ++count;
+    }
+
+    ss_ft_key(&key, index);
+    fail_adds = failures;
+    flow = ss_flow_create(shard, &key, 1, 0, rte_rdtsc());
+    fail_adds = 0;
+    evicted = stats->flows_evicted - evicted;
+
+    if (evicted > (uint64_t) count) {
+        SS_FT_ERROR("%s: %lu evicted from %d flows\n", when, evicted, count);
+        return flow;
+    }
+    for (uint64_t i = 0; i < evicted; ++i) {
+        if (rte_hash_lookup(shard->hash, &victim_keys[i]) >= 0) {
+            SS_FT_ERROR("%s: victim %lu still in the hash\n", when, i);
+        }
+        if (victims[i] == flow) {
+            reused = 1;
+        }
+        else if (victims[i]->active) {
+            SS_FT_ERROR("%s: victim %lu left active at %td\n", when, i, victims[i] - shard->flows);
+        }
+    }
+    // the rest of the LRU order is untouched
+    if (evicted < (uint64_t) count && TAILQ_FIRST(&shard->lru) != victims[evicted]) {
+        SS_FT_ERROR("%s: flow %lu of the LRU list is not its head after %lu evictions\n", when, evicted, evicted);
+    }
+
+    if (flow == NULL) {
+        if (stats->flows_rejected != rejected + 1) SS_FT_ERROR("%s: rejected but not counted\n", when);
+        if (rte_hash_lookup(shard->hash, &key) >= 0) SS_FT_ERROR("%s: rejected flow in the hash\n", when);
+    }
+    else {
+        if (stats->flows_rejected != rejected) SS_FT_ERROR("%s: created but counted as rejected\n", when);
+        if (rte_hash_lookup(shard->hash, &key) != flow - shard->flows) {
+            SS_FT_ERROR("%s: new flow not at its hash position\n", when);
+        }
+        if (TAILQ_LAST(&shard->lru, ss_flow_list_s) != flow) SS_FT_ERROR("%s: new flow not at the LRU tail\n", when);
+        if (full && !reused) SS_FT_ERROR("%s: full table, new flow in no victim's entry\n", when);
+    }
+
+    ss_ft_check_table(shard, size, when);
+    return flow;
+}
+
+static void ss_ft_check_evictions(void) {
+    unsigned int lcore_id  = rte_lcore_id();
+    ss_flow_shard_t* shard = &flow_shards[lcore_id];
+    ss_flow_stats_t* stats = &flow_stats[lcore_id];
+    uint32_t size          = SS_MAX(ss_conf->flow_max / rte_lcore_count(), SS_FLOW_MIN);
+    uint32_t index         = 0;
+    uint64_t evicted;
+
+    for (int i = 0; i < 64; ++i) ss_ft_create(shard, size, index++, 0, "fill");
+
+    // every attempt fails but the last: 4 victims, then room
+    evicted = stats->flows_evicted;
+    if (ss_ft_create(shard, size, index++, SS_FLOW_EVICT_ATTEMPTS, "4 victims") == NULL) {
+        SS_FT_ERROR("4 victims: not created\n");
+    }
+    if (stats->flows_evicted - evicted != SS_FLOW_EVICT_ATTEMPTS) SS_FT_ERROR("4 victims: wrong count evicted\n");
+
+    // every attempt fails: 4 victims, then the new flow is rejected
+    evicted = stats->flows_evicted;
+    if (ss_ft_create(shard, size, index++, SS_FLOW_EVICT_ATTEMPTS + 1, "rejected") != NULL) {
+        SS_FT_ERROR("rejected: created anyway\n");
+    }
+    if (stats->flows_evicted - evicted != SS_FLOW_EVICT_ATTEMPTS) SS_FT_ERROR("rejected: wrong count evicted\n");
+
+    // fill until the table, or first some bucket, is full for real
+    evicted = stats->flows_evicted;
+    while (stats->flows_active < size && stats->flows_evicted == evicted && index < 16 * size) {
+        ss_ft_create(shard, size, index++, 0, "fill");
+    }
+    evicted = stats->flows_evicted;
+    for (int i = 0; i < SS_FT_FULL_ROUNDS; ++i) ss_ft_create(shard, size, index++, 0, "full");
+    if (stats->flows_evicted == evicted) SS_FT_ERROR("full: nothing evicted\n");
+}
+
+int main(int argc, char* argv[]) {
+    static ss_conf_t conf;
+    char* eal_args[] = { argv[0], "-c", "1", "-n", "1", "--no-huge", "-m", "64", "--no-pci", "--no-shconf" };
+    size_t cases = SS_FT_KEY_CASES;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:s:")) != -1) {
+        switch (c) {
+            case 'n': cases = strtoul(optarg, NULL, 0); break;
+            case 's': seed  = strtoull(optarg, NULL, 0) | 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-n cases] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    rte_set_log_level(RTE_LOG_ERR);
+    if (rte_eal_init(sizeof(eal_args) / sizeof(eal_args[0]), eal_args) < 0) {
+        fprintf(stderr, "could not initialize eal\n");
+        return 2;
+    }
+
+    // the smallest table, SS_FLOW_MIN
+    conf.flow_idle_timeout   = 60;
+    conf.flow_active_timeout = 300;
+    ss_conf = &conf;
+    if (ss_flow_init()) {
+        fprintf(stderr, "could not initialize flows\n");
+        return 2;
+    }
+
+    ss_ft_check_keys(cases);
+    ss_ft_check_evictions();
+
+    printf("%zu key cases and evictions, %d failed\n", cases, errors);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,463 @@
+/*
+ * ss_json_writer_test: check the sensor's JSON writer against json-c.
+ *
+ * ss_json_writer_test [-n cases] [-s seed] [-q]
+ *
+ * Builds the same objects through ss_json_writer and through json-c
+ * trees printed with JSON_C_TO_STRING_SPACED, which is what the metadata
+ * code used before the writer, and requires byte-identical output. The
+ * fixed cases cover every escape, every control and high byte, UTF-8 up
+ * to four bytes, empty and nested objects, int64 limits and appended
+ * nm_tags members; the random ones mix all of those. Each message is
+ * then written again into buffers too small for it, which must fail
+ * without a byte past the buffer. Then prints the time per message of
+ * both for a frame-shaped event; -q skips the timing. Exits 1 on any
+ * mismatch.
+ */
+
+#include <getopt.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <json-c/json.h>
+
+#include "json_writer.h"
+
+#define SS_JW_TEST_CASES        5000
+#define SS_JW_TEST_STRING_MAX    128
+#define SS_JW_TEST_FIELDS_MAX     24
+#define SS_JW_TEST_NEST_MAX        3 // below the writer's limit, which has a case of its own
+#define SS_JW_CANARY            0xa5
+#define SS_JW_CANARY_BYTES        16
+#define SS_JW_BENCH_MESSAGES  200000
+
+static uint64_t seed = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t ss_random(void) {
+    // xorshift64*, reproducible with -s
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return seed * 0x2545f4914f6cdd1dULL;
+}
+
+/* the writer and, when json is set, the json-c tree built alongside it */
+struct ss_jw_pair_s {
+    ss_json_writer_t writer;
+    int              json;
+    json_object*     objects[SS_JSON_WRITER_DEPTH];
+    int              depth;
+};
+
+typedef struct ss_jw_pair_s ss_jw_pair_t;
+
+static void ss_jw_start(ss_jw_pair_t* pair, uint8_t* data, size_t size, int json) {
+    memset(pair, 0, sizeof(*pair));
+    ss_json_writer_init(&pair->writer, data, size);
+    ss_json_writer_object_start(&pair->writer, NULL);
+    pair->json = json;
+    if (json) pair->objects[0] = json_object_new_object();
+}
+
+static void ss_jw_add(ss_jw_pair_t* pair, const char* key, json_object* value) {
+    if (pair->json) json_object_object_add(pair->objects[pair->depth], key, value);
+}
+
+static void ss_jw_string(ss_jw_pair_t* pair, const char* key, const char* value, size_t length) {
+    ss_json_writer_string_len(&pair->writer, key, value, length);
+    if (pair->json) ss_jw_add(pair, key, json_object_new_string_len(value, (int) length));
+}
+
+static void ss_jw_int64(ss_jw_pair_t* pair, const char* key, int64_t value) {
+    ss_json_writer_int64(&pair->writer, key, value);
+    if (pair->json) ss_jw_add(pair, key, json_object_new_int64(value));
+}
+
+static void ss_jw_int(ss_jw_pair_t* pair, const char* key, int32_t value) {
+    ss_json_writer_int(&pair->writer, key, value);
+    if (pair->json) ss_jw_add(pair, key, json_object_new_int(value));
+}
+
+static void ss_jw_object_start(ss_jw_pair_t* pair, const char* key) {
+    json_object* child;
+
+    ss_json_writer_object_start(&pair->writer, key);
+    if (!pair->json) return;
+    child = json_object_new_object();
+    ss_jw_add(pair, key, child);
+    pair->objects[++pair->depth] = child;
+}
+
+static void ss_jw_object_end(ss_jw_pair_t* pair) {
+    ss_json_writer_object_end(&pair->writer);
+    if (pair->json && pair->depth > 0) --pair->depth;
+}
+
+/* random text of one kind: printable, any byte, control heavy, JSON specials, or UTF-8 */
+static size_t ss_jw_random_string(char* value, size_t size, int nul) {
+    static const char specials[] = "\"\\/\b\f\n\r\t";
+    size_t length = ss_random() % size;
+    size_t i = 0;
+    uint32_t code;
+    int kind = (int) (ss_random() % 5);
+
+    while (i < length) {
+        switch (kind) {
+            case 0: value[i++] = (char) (0x20 + ss_random() % 0x5f); break;
+            case 1: value[i++] = (char) ss_random(); break;
+            case 2: value[i++] = (char) (ss_random() % 2 ? ss_random() % 0x20 : 0x7f); break;
+            case 3: value[i++] = specials[ss_random() % (sizeof(specials) - 1)]; break;
+            default:
+                code = (uint32_t) (ss_random() % 4 == 0 ? ss_random() % 0x110000 : ss_random() % 0x800);
+                if (code >= 0xd800 && code < 0xe000) code = 0xfffd;
+                if (code < 0x80) {
+                    value[i++] = (char) code;
+                }
+                else if (code < 0x800 && i + 2 <= length) {
+                    value[i++] = (char) (0xc0 | code >> 6);
+                    value[i++] = (char) (0x80 | (code & 0x3f));
+                }
+                else if (code < 0x10000 && i + 3 <= length) {
+                    value[i++] = (char) (0xe0 | code >> 12);
+                    value[i++] = (char) (0x80 | (code >> 6 & 0x3f));
+                    value[i++] = (char) (0x80 | (code & 0x3f));
+                }
+                else if (i + 4 <= length) {
+                    value[i++] = (char) (0xf0 | code >> 18);
+                    value[i++] = (char) (0x80 | (code >> 12 & 0x3f));
+                    value[i++] = (char) (0x80 | (code >> 6 & 0x3f));
+                    value[i++] = (char) (0x80 | (code & 0x3f));
+                }
+                else {
+                    value[i++] = 'x';
+                }
+                break;
+        }
+        // keys and C strings stop at the first NUL
+        if (!nul && value[i - 1] == '\0') value[i - 1] = '0';
+    }
+    value[length] = '\0';
+    return length;
+}
+
+/* a unique prefix, so json-c never replaces a member, then random bytes */
+static void ss_jw_random_key(char* key, size_t size, unsigned int index) {
+    int prefix = snprintf(key, size, "%u:", index);
+    ss_jw_random_string(key + prefix, size - (size_t) prefix, 0);
+}
+
+static int64_t ss_jw_random_int64(void) {
+    static const int64_t edges[] = { 0, 1, -1, 9, 10, -10, INT32_MAX, INT32_MIN, INT64_MAX, INT64_MIN };
+
+    switch (ss_random() % 3) {
+        case 0:  return edges[ss_random() % (sizeof(edges) / sizeof(edges[0]))];
+        case 1:  return (int64_t) (ss_random() % 100000) - 50000;
+        default: return (int64_t) ss_random();
+    }
+}
+
+static void ss_jw_random_members(ss_jw_pair_t* pair, int nest) {
+    char key[64];
+    char value[SS_JW_TEST_STRING_MAX + 1];
+    size_t length;
+    // fewer fields further down, so a message stays well inside the writer's buffer
+    unsigned int fields = (unsigned int) (ss_random() % ((SS_JW_TEST_FIELDS_MAX >> 2 * nest) + 1));
+
+    for (unsigned int i = 0; i < fields; ++i) {
+        ss_jw_random_key(key, sizeof(key), i);
+        switch (ss_random() % 8) {
+            case 0:
+                ss_jw_int(pair, key, (int32_t) ss_jw_random_int64());
+                break;
+            case 1:
+            case 2:
+                ss_jw_int64(pair, key, ss_jw_random_int64());
+                break;
+            case 3:
+                if (nest < SS_JW_TEST_NEST_MAX) {
+                    ss_jw_object_start(pair, key);
+                    ss_jw_random_members(pair, nest + 1);
+                    ss_jw_object_end(pair);
+                    break;
+                }
+                // fall through
+            default:
+                length = ss_jw_random_string(value, sizeof(value), ss_random() % 2);
+                ss_jw_string(pair, key, value, length);
+                break;
+        }
+    }
+}
+
+/*
+ * nm_tags: rendered once by a writer of their own, then appended as raw
+ * members by every message, and added field by field to the json-c tree.
+ */
+struct ss_jw_tags_s {
+    uint8_t data[1024];
+    size_t  length;
+    char    keys[4][32];
+    char    values[4][32];
+    size_t  count;
+};
+
+typedef struct ss_jw_tags_s ss_jw_tags_t;
+
+static void ss_jw_random_tags(ss_jw_tags_t* tags) {
+    ss_json_writer_t writer;
+    int length;
+
+    memset(tags, 0, sizeof(*tags));
+    tags->count = ss_random() % 4;
+    ss_json_writer_init(&writer, tags->data, sizeof(tags->data));
+    ss_json_writer_object_start(&writer, NULL);
+    for (size_t i = 0; i < tags->count; ++i) {
+        // after the message fields, which start with 0 to 23
+        snprintf(tags->keys[i], sizeof(tags->keys[i]), "tag%zu", i);
+        ss_jw_random_string(tags->values[i], sizeof(tags->values[i]), 0);
+        ss_json_writer_string(&writer, tags->keys[i], tags->values[i]);
+    }
+    ss_json_writer_object_end(&writer);
+    length = ss_json_writer_finish(&writer);
+    // between the "{ " and the " }"
+    tags->length = tags->count ? (size_t) length - 4 : 0;
+    memmove(tags->data, tags->data + 2, tags->length);
+}
+
+static void ss_jw_tags_add(ss_jw_pair_t* pair, ss_jw_tags_t* tags) {
+    ss_json_writer_members(&pair->writer, tags->data, tags->length);
+    for (size_t i = 0; pair->json && i < tags->count; ++i) {
+        ss_jw_add(pair, tags->keys[i], json_object_new_string(tags->values[i]));
+    }
+}
+
+/* the fixed cases, by number, then random ones from a seed of their own */
+typedef void (*ss_jw_build_t)(ss_jw_pair_t* pair, uint64_t arg);
+
+static void ss_jw_build_fixed(ss_jw_pair_t* pair, uint64_t arg) {
+    char bytes[256];
+
+    switch (arg) {
+        case 0:
+            break;
+        case 1:
+            ss_jw_string(pair, "escapes", "\"\\/\b\f\n\r\t", 8);
+            ss_jw_string(pair, "a/b\"c\\d", "key escapes", 11);
+            break;
+        case 2:
+            for (int i = 0; i < 256; ++i) bytes[i] = (char) i;
+            ss_jw_string(pair, "every byte", bytes, sizeof(bytes));
+            break;
+        case 3:
+            ss_jw_string(pair, "controls", "\x01\x07\x0b\x0e\x1b\x1f\x7f", 7);
+            ss_jw_string(pair, "nul", "a\0b", 3);
+            break;
+        case 4:
+            ss_jw_string(pair, "latin", "caf\xc3\xa9", 5);
+            ss_jw_string(pair, "kelvin", "\xe2\x84\xaa", 3);
+            ss_jw_string(pair, "emoji", "\xf0\x9f\x98\x80", 4);
+            ss_jw_string(pair, "invalid", "\xff\xfe\xc3", 3);
+            ss_jw_string(pair, "\xe6\x97\xa5\xe6\x9c\xac", "key in UTF-8", 12);
+            break;
+        case 5:
+            ss_jw_int64(pair, "min", INT64_MIN);
+            ss_jw_int64(pair, "max", INT64_MAX);
+            ss_jw_int(pair, "int min", INT32_MIN);
+            ss_jw_int(pair, "zero", 0);
+            break;
+        case 6:
+            ss_jw_object_start(pair, "empty");
+            ss_jw_object_end(pair);
+            ss_jw_object_start(pair, "outer");
+            ss_jw_object_start(pair, "inner");
+            ss_jw_string(pair, "leaf", "x", 1);
+            ss_jw_object_end(pair);
+            ss_jw_int(pair, "after", 1);
+            ss_jw_object_end(pair);
+            break;
+        case 7:
+            ss_jw_string(pair, "long", "", 0);
+            for (int i = 0; i < 16; ++i) ss_jw_int(pair, (char[]) { (char) ('a' + i), '\0' }, i);
+            break;
+    }
+}
+
+#define SS_JW_FIXED_CASES 8
+
+static void ss_jw_build_random(ss_jw_pair_t* pair, uint64_t arg) {
+    ss_jw_tags_t tags;
+    uint64_t saved = seed;
+
+    seed = arg;
+    ss_jw_random_tags(&tags);
+    ss_jw_random_members(pair, 0);
+    ss_jw_tags_add(pair, &tags);
+    seed = saved;
+}
+
+static int ss_jw_check(const char* name, uint64_t arg, ss_jw_build_t build) {
+    static uint8_t data[SS_JSON_WRITER_SIZE];
+    ss_jw_pair_t pair;
+    const char* expected;
+    uint8_t* small;
+    int length, rv;
+    int errors = 0;
+
+    ss_jw_start(&pair, data, sizeof(data), 1);
+    build(&pair, arg);
+    ss_jw_object_end(&pair);
+    length   = ss_json_writer_finish(&pair.writer);
+    expected = json_object_to_json_string_ext(pair.objects[0], JSON_C_TO_STRING_SPACED);
+    if (length < 0 || strlen(expected) != (size_t) length || memcmp(expected, data, (size_t) length)) {
+        fprintf(stderr, "%s %lu mismatch:\n  writer: %.*s\n  json-c: %s\n",
+            name, arg, length < 0 ? 0 : length, data, expected);
+        ++errors;
+    }
+    json_object_put(pair.objects[0]);
+    if (errors) return errors;
+
+    // one byte short of the NUL must fail, as must every size below it
+    small = malloc((size_t) length + 1 + SS_JW_CANARY_BYTES);
+    if (small == NULL) {
+        fprintf(stderr, "could not allocate overflow buffer\n");
+        exit(2);
+    }
+    for (size_t i = 0; i < 16 + 8; ++i) {
+        // 16 sizes at random, then the last 8, longer than any one escape
+        size_t size = i < 16 ? ss_random() % ((size_t) length + 1) : (size_t) length + 1 - (i - 16);
+        if (size > (size_t) length + 1) continue;
+        memset(small, SS_JW_CANARY, (size_t) length + 1 + SS_JW_CANARY_BYTES);
+        ss_jw_start(&pair, small, size, 0);
+        build(&pair, arg);
+        ss_jw_object_end(&pair);
+        rv = ss_json_writer_finish(&pair.writer);
+        if (size <= (size_t) length ? rv != -1 : rv != length || memcmp(small, data, (size_t) length + 1)) {
+            fprintf(stderr, "%s %lu: size %zu of %d returned %d\n", name, arg, size, length, rv);
+            ++errors;
+        }
+        for (size_t i = size; i < (size_t) length + 1 + SS_JW_CANARY_BYTES; ++i) {
+            if (small[i] == SS_JW_CANARY) continue;
+            fprintf(stderr, "%s %lu: size %zu wrote past the buffer at %zu\n", name, arg, size, i);
+            ++errors;
+            break;
+        }
+    }
+    free(small);
+    return errors;
+}
+
+/* past SS_JSON_WRITER_DEPTH the writer gives up instead of losing track */
+static int ss_jw_check_depth(void) {
+    static uint8_t data[SS_JSON_WRITER_SIZE];
+    ss_json_writer_t writer;
+    int errors = 0;
+
+    for (int depth = SS_JSON_WRITER_DEPTH - 2; depth <= SS_JSON_WRITER_DEPTH; ++depth) {
+        ss_json_writer_init(&writer, data, sizeof(data));
+        ss_json_writer_object_start(&writer, NULL);
+        for (int i = 0; i < depth; ++i) ss_json_writer_object_start(&writer, "n");
+        for (int i = 0; i <= depth; ++i) ss_json_writer_object_end(&writer);
+        if ((ss_json_writer_finish(&writer) < 0) != (depth + 1 >= SS_JSON_WRITER_DEPTH)) {
+            fprintf(stderr, "nesting %d objects deep: wrong result\n", depth + 1);
+            ++errors;
+        }
+    }
+    return errors;
+}
+
+/* the fields of a frame_ioc event, with tags */
+static void ss_jw_build_frame(ss_jw_pair_t* pair, uint64_t arg) {
+    static const char* strings[][2] = {
+        { "source", "frame_ioc" }, { "rule", "bad_actors" }, { "direction", "RX" },
+        { "smac", "00:1b:21:3a:4f:5c" }, { "dmac", "f8:bc:12:9e:00:01" },
+        { "sip", "192.168.1.10" }, { "dip", "203.0.113.77" },
+        { "dns_name", "update.example.com" }, { "ioc_type", "IP" },
+        { "ioc_value", "203.0.113.77" }, { "ioc_dns", "" }, { "ioc_threat_type", "c2" },
+        { "sensor", "dc1/edge" },
+    };
+    static const char* ints[] = {
+        "port_id", "self", "length", "eth_type", "ip_protocol", "ttl", "l4_length",
+        "tcp_flags", "sport", "dport", "ioc_id", "ioc_file_id", "icmp_type", "icmp_code",
+    };
+
+    for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); ++i) {
+        ss_jw_string(pair, strings[i][0], strings[i][1], strlen(strings[i][1]));
+    }
+    for (size_t i = 0; i < sizeof(ints) / sizeof(ints[0]); ++i) {
+        ss_jw_int(pair, ints[i], (int32_t) (arg + i * 1021));
+    }
+}
+
+static double ss_jw_now(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec * 1e9 + (double) now.tv_nsec;
+}
+
+static void ss_jw_bench(void) {
+    static uint8_t data[SS_JSON_WRITER_SIZE];
+    volatile size_t sink = 0;
+    ss_jw_pair_t pair;
+    char* copy;
+    double start, writer_ns, json_ns;
+
+    start = ss_jw_now();
+    for (uint64_t i = 0; i < SS_JW_BENCH_MESSAGES; ++i) {
+        ss_jw_start(&pair, data, sizeof(data), 0);
+        ss_jw_build_frame(&pair, i);
+        ss_jw_object_end(&pair);
+        sink += (size_t) ss_json_writer_finish(&pair.writer);
+    }
+    writer_ns = (ss_jw_now() - start) / SS_JW_BENCH_MESSAGES;
+
+    // what the metadata code did before: tree, print, strdup, free
+    start = ss_jw_now();
+    for (uint64_t i = 0; i < SS_JW_BENCH_MESSAGES; ++i) {
+        memset(&pair, 0, sizeof(pair));
+        pair.json       = 1;
+        pair.objects[0] = json_object_new_object();
+        ss_jw_build_frame(&pair, i);
+        copy = strdup(json_object_to_json_string_ext(pair.objects[0], JSON_C_TO_STRING_SPACED));
+        sink += strlen(copy);
+        free(copy);
+        json_object_put(pair.objects[0]);
+    }
+    json_ns = (ss_jw_now() - start) / SS_JW_BENCH_MESSAGES;
+
+    printf("%-8s %14s %14s\n", "message", "writer ns", "json-c ns");
+    printf("%-8s %14.1f %14.1f\n", "frame", writer_ns, json_ns);
+}
+
+int main(int argc, char* argv[]) {
+    size_t cases = SS_JW_TEST_CASES;
+    int quiet = 0;
+    int errors = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:s:q")) != -1) {
+        switch (c) {
+            case 'n': cases = strtoul(optarg, NULL, 0); break;
+            case 's': seed  = strtoull(optarg, NULL, 0) | 1; break;
+            case 'q': quiet = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-n cases] [-s seed] [-q]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    for (uint64_t i = 0; i < SS_JW_FIXED_CASES; ++i) errors += ss_jw_check("fixed case", i, ss_jw_build_fixed);
+    errors += ss_jw_check("frame", 7, ss_jw_build_frame);
+    errors += ss_jw_check_depth();
+    for (size_t i = 0; i < cases; ++i) errors += ss_jw_check("random seed", ss_random() | 1, ss_jw_build_random);
+
+    printf("%d fixed and %zu random cases, %d failed\n", SS_JW_FIXED_CASES, cases, errors);
+    if (errors || quiet) return errors ? 1 : 0;
+
+    ss_jw_bench();
+    return 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * ss_re_literal_test: check the re prefilter's required-literal extraction.
+ *
+ * ss_re_literal_test [-v]
+ *
+ * Runs ss_re_literal_extract over a table of patterns and compares the
+ * literal it picks with the expected one. The literal must occur in
+ * every match of the pattern, so escapes whose operands are not plain
+ * bytes (\x.., octal, \cX, \p{..}, backreferences) must never end up in
+ * it. -v prints every case. Exits 1 when any case differs.
+ */
+
+#include <getopt.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "re_literal.h"
+
+struct ss_re_literal_case_s {
+    const char* re;
+    int         flags;
+    const char* literal;
+};
+
+typedef struct ss_re_literal_case_s ss_re_literal_case_t;
+
+static const ss_re_literal_case_t cases[] = {
+    // plain runs, classes, groups and quantifiers
+    { "Failed password",              0, "Failed password" },
+    { "Failed Password",              1, "failed password" },
+    { "ab[cd]efgh",                   0, "efgh"            },
+    { "abc(def)+ghij",                0, "ghij"            },
+    { "abcd?ef",                      0, "abc"             },
+    { "abcde*f",                      0, "abcd"            },
+    { "abc+defg",                     0, "defg"            },
+    { "abc{0,2}de",                   0, "ab"              },
+    { "abc{2}defg",                   0, "defg"            },
+    { "x\\.y\\.zz",                   0, "x.y.zz"          },
+    { "^sshd\\[\\d+\\]: Accepted",    0, "]: Accepted"     },
+    { "user \\w+ from \\d{1,3}",      0, " from "          },
+
+    // no literal required, or none usable
+    { "foo|barbaz",                   0, ""                },
+    { "(?i)FooBar",                   0, ""                },
+    { "\\Qabc\\E",                    0, ""                },
+    { "[abc]+",                       0, ""                },
+
+    // hex, octal and control escapes: none of the operand is literal
+    { "\\x41BCDx",                    0, "BCDx"            },
+    { "ab\\x{263a}cdef",              0, "cdef"            },
+    { "\\x4qrst",                     0, "qrst"            },
+    { "\\0123abc",                    0, "abc"             },
+    { "ab\\012345xyz",                0, "xyz"             },
+    { "\\o{101}pqrs",                 0, "pqrs"            },
+    { "\\cAbcdef",                    0, "bcdef"           },
+    { "\\c[zzzz",                     0, "zzzz"            },
+
+    // unicode properties and named characters
+    { "\\pLabcd",                     0, "abcd"            },
+    { "\\PLabcd",                     0, "abcd"            },
+    { "\\p{Greek}wxyz",               0, "wxyz"            },
+    { "\\N{U+0041}tail",              0, "tail"            },
+
+    // backreferences, numbered and named
+    { "(a)\\1234bc",                  0, "bc"              },
+    { "(?<n>x)\\k<n>tail",            0, "tail"            },
+    { "(?<n>x)\\k{n}tail",            0, "tail"            },
+    { "(?<n>x)\\k'n'tail",            0, "tail"            },
+    { "(x)\\g{-1}tail",               0, "tail"            },
+    { "(x)\\g-1tail",                 0, "tail"            },
+    { "(x)\\g12tail",                 0, "tail"            },
+
+    // escapes with no operand keep what follows
+    { "\\bword\\b",                   0, "word"            },
+    { "\\d\\d:\\d\\d login",          0, " login"          },
+
+    // an alternation hidden behind an escape operand is still seen
+    { "\\x{7c}abc|defg",              0, ""                },
+    { "\\c(abc|de)fgh",               0, ""                },
+
+    // UTF-8 caseless K and S also match U+212A and U+017F, so they end runs
+    { "Failed password",              SS_RE_LITERAL_NOCASE | SS_RE_LITERAL_UTF8, "failed pa" },
+    { "Failed password",              SS_RE_LITERAL_UTF8,   "Failed password" },
+    { "Kelvin",                       SS_RE_LITERAL_NOCASE | SS_RE_LITERAL_UTF8, "elvin" },
+    { "kSsK",                         SS_RE_LITERAL_NOCASE | SS_RE_LITERAL_UTF8, "" },
+    { "ab\\\xc3\\\xa9" "cd",            SS_RE_LITERAL_NOCASE | SS_RE_LITERAL_UTF8, "ab" },
+
+    // runs stop at SS_RE_LITERAL_MAX
+    { "0123456789abcdef0123456789abcdefXYZ", 0, "0123456789abcdef0123456789abcdef" },
+};
+
+int main(int argc, char* argv[]) {
+    uint8_t literal[SS_RE_LITERAL_MAX];
+    size_t literal_length;
+    size_t expected_length;
+    size_t i;
+    int verbose = 0;
+    int failed = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "v")) != -1) {
+        switch (c) {
+            case 'v': verbose = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        const ss_re_literal_case_t* tc = &cases[i];
+        literal_length  = ss_re_literal_extract(tc->re, tc->flags, literal, sizeof(literal));
+        expected_length = strlen(tc->literal);
+        int ok = literal_length == expected_length && !memcmp(literal, tc->literal, expected_length);
+        if (!ok) ++failed;
+        if (!ok || verbose) {
+            printf("%s re [%s] flags %d literal [%.*s] expected [%s]\n",
+                ok ? "ok  " : "FAIL", tc->re, tc->flags,
+                (int) literal_length, (char*) literal, tc->literal);
+        }
+    }
+
+    printf("%zu cases, %d failed\n", sizeof(cases) / sizeof(cases[0]), failed);
+    return failed ? 1 : 0;
+}
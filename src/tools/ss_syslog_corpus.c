@@ -0,0 +1,157 @@
+/*
+ * ss_syslog_corpus: run the sensor's syslog parser over a message corpus.
+ *
+ * ss_syslog_corpus [-q] file ...
+ *
+ * Each file holds one raw message, as it would arrive in a UDP or TCP
+ * payload. The message is parsed as a whole and then cut short at every
+ * length, as a truncated packet would be; every parse must keep its
+ * fields inside the bytes it was given, and the RFC 5424 SD-PARAM lookups
+ * must too. The fields of each whole message are printed one line per
+ * file, so the output can be compared with corpus/syslog.expected; -q
+ * only checks. Exits 1 when any parse breaks an invariant.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "syslog.h"
+
+#define SS_CORPUS_MESSAGE_MAX 65536
+
+/* looked up in every message, present or not */
+static const char* sd_params[][2] = {
+    { NULL,                "a"       },
+    { NULL,                "iut"     },
+    { "two",               "a"       },
+    { "exampleSDID@32473", "eventID" },
+};
+
+static int ss_corpus_slice_check(const char* path, size_t length, const char* what, const uint8_t* data, const ss_slice_t* slice) {
+    if (slice->data == NULL) {
+        if (slice->length == 0) return 0;
+    }
+    else if (slice->data >= data && slice->length <= length
+        && (size_t) (slice->data - data) <= length - slice->length) {
+        return 0;
+    }
+    fprintf(stderr, "%s: length %zu: %s slice outside the message\n", path, length, what);
+    return 1;
+}
+
+/* parse data[0, length) and check every slice stays inside it */
+static int ss_corpus_check(const char* path, const uint8_t* data, size_t length, ss_syslog_t* syslog) {
+    ss_slice_t value;
+    int rv, errors = 0;
+
+    rv = ss_syslog_parse(syslog, data, length);
+
+    for (int field = SS_SYSLOG_FIELD_MESSAGE; field < SS_SYSLOG_FIELD_MAX; ++field) {
+        errors += ss_corpus_slice_check(path, length, ss_syslog_field_dump((ss_syslog_field_t) field), data, &syslog->fields[field]);
+    }
+    if (syslog->fields[SS_SYSLOG_FIELD_SD_PARAM].data) {
+        fprintf(stderr, "%s: length %zu: sd_param set by the parser\n", path, length);
+        ++errors;
+    }
+    if ((rv == -1) != (syslog->pri == -1) || syslog->pri > SS_SYSLOG_PRI_MAX) {
+        fprintf(stderr, "%s: length %zu: return %d with pri %d\n", path, length, rv, syslog->pri);
+        ++errors;
+    }
+    if (syslog->pri >= 0 && (syslog->facility != syslog->pri >> 3 || syslog->severity != (syslog->pri & 0x07))) {
+        fprintf(stderr, "%s: length %zu: facility or severity disagree with pri %d\n", path, length, syslog->pri);
+        ++errors;
+    }
+    for (size_t i = 0; i < sizeof(sd_params) / sizeof(sd_params[0]); ++i) {
+        memset(&value, 0, sizeof(value));
+        if (ss_syslog_sd_param_get(syslog, sd_params[i][0], sd_params[i][1], &value)) {
+            errors += ss_corpus_slice_check(path, length, "sd_param", data, &value);
+        }
+    }
+
+    return errors;
+}
+
+static void ss_corpus_slice_print(const char* name, const ss_slice_t* slice) {
+    printf(" %s=\"", name);
+    for (size_t i = 0; i < slice->length; ++i) {
+        uint8_t c = slice->data[i];
+        if (c == '"' || c == '\\')     printf("\\%c", c);
+        else if (c >= 0x20 && c < 0x7f) putchar(c);
+        else                            printf("\\x%02x", c);
+    }
+    putchar('"');
+}
+
+static void ss_corpus_print(const char* path, ss_syslog_t* syslog) {
+    const char* name = strrchr(path, '/');
+    ss_slice_t value;
+    char label[128];
+
+    printf("%s format=%s pri=%d", name ? name + 1 : path, ss_syslog_format_dump(syslog->format), syslog->pri);
+    for (int field = SS_SYSLOG_FIELD_MESSAGE; field < SS_SYSLOG_FIELD_MAX; ++field) {
+        if (field == SS_SYSLOG_FIELD_MESSAGE || !syslog->fields[field].data) continue;
+        ss_corpus_slice_print(ss_syslog_field_dump((ss_syslog_field_t) field), &syslog->fields[field]);
+    }
+    for (size_t i = 0; i < sizeof(sd_params) / sizeof(sd_params[0]); ++i) {
+        if (!ss_syslog_sd_param_get(syslog, sd_params[i][0], sd_params[i][1], &value)) continue;
+        snprintf(label, sizeof(label), "sd_param[%s%s%s]",
+            sd_params[i][0] ? sd_params[i][0] : "", sd_params[i][0] ? "/" : "", sd_params[i][1]);
+        ss_corpus_slice_print(label, &value);
+    }
+    putchar('\n');
+}
+
+int main(int argc, char* argv[]) {
+    static uint8_t message[SS_CORPUS_MESSAGE_MAX];
+    ss_syslog_t syslog;
+    FILE* file;
+    uint8_t* copy;
+    size_t length;
+    int quiet = 0;
+    int errors = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "q")) != -1) {
+        switch (c) {
+            case 'q': quiet = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-q] file ...\n", argv[0]);
+                return 2;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-q] file ...\n", argv[0]);
+        return 2;
+    }
+
+    for (int i = optind; i < argc; ++i) {
+        file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            fprintf(stderr, "could not open %s: %s\n", argv[i], strerror(errno));
+            return 2;
+        }
+        length = fread(message, 1, sizeof(message), file);
+        fclose(file);
+
+        // every prefix in a buffer of its own size, so overreads are caught
+        for (size_t prefix = 0; prefix <= length; ++prefix) {
+            copy = malloc(prefix ? prefix : 1);
+            if (copy == NULL) {
+                fprintf(stderr, "could not allocate message copy\n");
+                return 2;
+            }
+            memcpy(copy, message, prefix);
+            errors += ss_corpus_check(argv[i], copy, prefix, &syslog);
+            if (prefix == length && !quiet) ss_corpus_print(argv[i], &syslog);
+            free(copy);
+        }
+    }
+
+    if (errors) fprintf(stderr, "%d invariant failures\n", errors);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,282 @@
+/*
+ * ss_timer_wheel_test: check the sensor's timer wheel against a model.
+ *
+ * ss_timer_wheel_test [-n rounds] [-s seed]
+ *
+ * Every armed entry must fire exactly once, on the first tick at or
+ * after its deadline, and never once cancelled. The fixed cases put
+ * deadlines on both sides of the 256 and 65536 tick level boundaries and
+ * past the 2^24 tick span, from several starting points, cancel entries
+ * on each level while they are pending, and re-arm, cancel and arm other
+ * entries from inside callbacks. The random rounds mix all of those.
+ * Exits 1 on any mismatch.
+ */
+
+#include <getopt.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timer_wheel.h"
+
+#define SS_TW_TEST_ROUNDS      20
+#define SS_TW_TEST_ENTRIES    512
+#define SS_TW_TEST_TICK         7 // cycles per tick, so deadlines round up
+#define SS_TW_NONE     UINT64_MAX
+
+static uint64_t seed = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t ss_random(void) {
+    // xorshift64*, reproducible with -s
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return seed * 0x2545f4914f6cdd1dULL;
+}
+
+/* an entry and what the model expects of it */
+struct ss_tw_timer_s {
+    ss_timer_wheel_entry_t entry;
+    uint64_t due;      // tick it must fire on, SS_TW_NONE when not armed
+    uint64_t fired;
+    uint64_t rearms;   // re-arm this many more times from the callback
+    uint64_t period;   // ticks to re-arm by
+    struct ss_tw_timer_s* cancel; // cancel this one from the callback
+    struct ss_tw_timer_s* arm;    // arm this one, one tick on, from the callback
+};
+
+typedef struct ss_tw_timer_s ss_tw_timer_t;
+
+struct ss_tw_test_s {
+    ss_timer_wheel_t wheel;
+    ss_tw_timer_t    timers[SS_TW_TEST_ENTRIES];
+    uint64_t         armed;
+    int              errors;
+    const char*      name;
+};
+
+typedef struct ss_tw_test_s ss_tw_test_t;
+
+static ss_tw_test_t test;
+
+static void ss_tw_start(const char* name, uint64_t now) {
+    memset(&test, 0, sizeof(test));
+    test.name = name;
+    ss_timer_wheel_init(&test.wheel, SS_TW_TEST_TICK, now * SS_TW_TEST_TICK);
+    for (int i = 0; i < SS_TW_TEST_ENTRIES; ++i) test.timers[i].due = SS_TW_NONE;
+}
+
+static void ss_tw_error(ss_tw_timer_t* timer, const char* problem) {
+    fprintf(stderr, "%s: timer %td %s at tick %lu, due %lu\n",
+        test.name, timer - test.timers, problem, test.wheel.now, timer->due);
+    ++test.errors;
+}
+
+/* arm a timer delta ticks from now, with a deadline somewhere inside its tick */
+static void ss_tw_arm(ss_tw_timer_t* timer, uint64_t delta) {
+    uint64_t deadline = test.wheel.now + delta;
+    uint64_t cycles   = deadline ? deadline * SS_TW_TEST_TICK - ss_random() % SS_TW_TEST_TICK : 0;
+
+    if (timer->due == SS_TW_NONE) ++test.armed;
+    // deadlines not after now still wait for the next tick
+    timer->due = delta ? deadline : test.wheel.now + 1;
+    ss_timer_wheel_add(&test.wheel, &timer->entry, cycles);
+}
+
+static void ss_tw_cancel(ss_tw_timer_t* timer) {
+    if (timer->due != SS_TW_NONE) --test.armed;
+    timer->due = SS_TW_NONE;
+    ss_timer_wheel_remove(&test.wheel, &timer->entry);
+}
+
+static void ss_tw_fire(ss_timer_wheel_entry_t* entry, void* arg) {
+    ss_tw_timer_t* timer = (ss_tw_timer_t*) entry;
+    (void) arg;
+
+    if (timer->due != test.wheel.now) ss_tw_error(timer, timer->due == SS_TW_NONE ? "fired unarmed" : "fired");
+    if (entry->list != NULL) ss_tw_error(timer, "still armed in callback");
+    if (timer->due != SS_TW_NONE) --test.armed;
+    timer->due = SS_TW_NONE;
+    ++timer->fired;
+
+    if (timer->rearms) {
+        --timer->rearms;
+        ss_tw_arm(timer, timer->period);
+    }
+    if (timer->cancel) {
+        ss_tw_cancel(timer->cancel);
+        timer->cancel = NULL;
+    }
+    if (timer->arm) {
+        ss_tw_arm(timer->arm, 1);
+        timer->arm = NULL;
+    }
+}
+
+/* advance to the tick, in one call or one tick at a time, then check the count */
+static void ss_tw_advance(uint64_t target, int stepped) {
+    uint64_t now = test.wheel.now;
+
+    if (stepped) {
+        while (now < target) ss_timer_wheel_advance(&test.wheel, ++now * SS_TW_TEST_TICK, ss_tw_fire, NULL);
+    }
+    else {
+        ss_timer_wheel_advance(&test.wheel, target * SS_TW_TEST_TICK + SS_TW_TEST_TICK - 1, ss_tw_fire, NULL);
+    }
+    if (test.wheel.count != test.armed) {
+        fprintf(stderr, "%s: wheel counts %lu armed, expected %lu\n", test.name, test.wheel.count, test.armed);
+        ++test.errors;
+        test.armed = test.wheel.count;
+    }
+}
+
+/* nothing may be left pending once every deadline has passed */
+static int ss_tw_finish(uint64_t target, int stepped) {
+    ss_tw_advance(target, stepped);
+    for (int i = 0; i < SS_TW_TEST_ENTRIES; ++i) {
+        if (test.timers[i].due != SS_TW_NONE) ss_tw_error(&test.timers[i], "never fired");
+    }
+    return test.errors;
+}
+
+/* deadlines either side of each level boundary and of the span */
+static int ss_tw_check_boundaries(void) {
+    static const uint64_t starts[] = { 0, 1, 200, 255, 256, 65000, 65535, 65536, (1ULL << 24) - 3 };
+    static const uint64_t deltas[] = {
+        0, 1, 2, 254, 255, 256, 257, 511, 512, 65535, 65536, 65537, 65791,
+        131072, (1ULL << 24) - 1, 1ULL << 24, (1ULL << 24) + 1, (1ULL << 25) + 300,
+    };
+    size_t count = sizeof(deltas) / sizeof(deltas[0]);
+    int errors = 0;
+
+    for (size_t i = 0; i < sizeof(starts) / sizeof(starts[0]); ++i) {
+        ss_tw_start("boundaries", starts[i]);
+        for (size_t j = 0; j < count; ++j) ss_tw_arm(&test.timers[j], deltas[j]);
+        errors += ss_tw_finish(starts[i] + deltas[count - 1], i % 2);
+    }
+    return errors;
+}
+
+/* cancel entries on every level, before and after they cascade down */
+static int ss_tw_check_cancel(void) {
+    static const uint64_t deltas[] = { 5, 300, 70000, (1ULL << 24) + 9 };
+    size_t count = sizeof(deltas) / sizeof(deltas[0]);
+
+    ss_tw_start("cancel", 100);
+    for (size_t i = 0; i < count; ++i) {
+        ss_tw_arm(&test.timers[i], deltas[i]);
+        ss_tw_arm(&test.timers[count + i], deltas[i]);
+        ss_tw_arm(&test.timers[2 * count + i], deltas[i]);
+    }
+    // right away, then each one a tick before it is due
+    for (size_t i = 0; i < count; ++i) ss_tw_cancel(&test.timers[i]);
+    for (size_t i = 0; i < count; ++i) {
+        ss_tw_advance(100 + deltas[i] - 1, 0);
+        ss_tw_cancel(&test.timers[count + i]);
+        // twice is harmless
+        ss_tw_cancel(&test.timers[count + i]);
+    }
+    ss_tw_finish(100 + deltas[count - 1] + 1, 0);
+    for (size_t i = 0; i < 2 * count; ++i) {
+        if (test.timers[i].fired) ss_tw_error(&test.timers[i], "fired after cancel");
+    }
+    for (size_t i = 2 * count; i < 3 * count; ++i) {
+        if (test.timers[i].fired != 1) ss_tw_error(&test.timers[i], "did not fire once");
+    }
+    return test.errors;
+}
+
+/* callbacks re-arm themselves, arm others and cancel others */
+static int ss_tw_check_rearm(void) {
+    static const uint64_t periods[] = { 0, 1, 255, 256, 65536 };
+    ss_tw_timer_t* timer;
+    size_t count = sizeof(periods) / sizeof(periods[0]);
+
+    ss_tw_start("re-arm", 250);
+    for (size_t i = 0; i < count; ++i) {
+        timer         = &test.timers[i];
+        timer->rearms = 3;
+        timer->period = periods[i];
+        ss_tw_arm(timer, 1 + i);
+    }
+    // one fires a tick before another in the same slot list and cancels it
+    ss_tw_arm(&test.timers[10], 40);
+    ss_tw_arm(&test.timers[11], 41);
+    test.timers[10].cancel = &test.timers[11];
+    // one due the same tick cancels a later one in its own slot
+    ss_tw_arm(&test.timers[12], 60);
+    ss_tw_arm(&test.timers[13], 60);
+    test.timers[12].cancel = &test.timers[13];
+    // one arms an idle entry for the next tick
+    ss_tw_arm(&test.timers[14], 70);
+    test.timers[14].arm = &test.timers[15];
+
+    ss_tw_finish(250 + 4 * 65536 + 10, 1);
+    for (size_t i = 0; i < count; ++i) {
+        if (test.timers[i].fired != 4) ss_tw_error(&test.timers[i], "did not fire 4 times");
+    }
+    if (test.timers[11].fired || test.timers[13].fired) ss_tw_error(&test.timers[11], "fired after cancel");
+    if (test.timers[15].fired != 1) ss_tw_error(&test.timers[15], "was not armed by a callback");
+    return test.errors;
+}
+
+static uint64_t ss_tw_random_delta(void) {
+    switch (ss_random() % 8) {
+        case 0:  return ss_random() % 4;
+        case 1:  return 256 + ss_random() % 5 - 2;
+        case 2:  return 65536 + ss_random() % 5 - 2;
+        case 3:  return ss_random() % (1ULL << 17);
+        case 4:  return ss_random() % 2 ? (1ULL << 24) - 1 + ss_random() % 3 : ss_random() % (1ULL << 24);
+        default: return ss_random() % 1024;
+    }
+}
+
+static int ss_tw_check_random(void) {
+    ss_tw_timer_t* timer;
+    uint64_t end;
+
+    ss_tw_start("random", ss_random() % (1ULL << 20));
+    end = test.wheel.now + (1ULL << 18);
+    while (test.wheel.now < end) {
+        for (int i = 0; i < 32; ++i) {
+            timer = &test.timers[ss_random() % SS_TW_TEST_ENTRIES];
+            switch (ss_random() % 6) {
+                case 0:  ss_tw_cancel(timer); break;
+                case 1:
+                    timer->rearms = ss_random() % 3;
+                    timer->period = ss_tw_random_delta();
+                    // fall through
+                default: ss_tw_arm(timer, ss_tw_random_delta()); break;
+            }
+        }
+        ss_tw_advance(test.wheel.now + ss_random() % 600, ss_random() % 2);
+    }
+    // re-arms stop after 2, each at most 2^24 + 1 on
+    return ss_tw_finish(end + 4 * (1ULL << 24), 0);
+}
+
+int main(int argc, char* argv[]) {
+    size_t rounds = SS_TW_TEST_ROUNDS;
+    int errors = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:s:")) != -1) {
+        switch (c) {
+            case 'n': rounds = strtoul(optarg, NULL, 0); break;
+            case 's': seed   = strtoull(optarg, NULL, 0) | 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-n rounds] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    errors += ss_tw_check_boundaries();
+    errors += ss_tw_check_cancel();
+    errors += ss_tw_check_rearm();
+    for (size_t i = 0; i < rounds; ++i) errors += ss_tw_check_random();
+
+    printf("3 fixed and %zu random cases, %d failed\n", rounds, errors);
+    return errors ? 1 : 0;
+}
@@ -16,6 +16,7 @@
 #include "common.h"
 #include "extractor.h"
 #include "l4_utils.h"
+#include "log.h"
 #include "netflow.h"
 #include "re_utils.h"
 #include "sflow_cb.h"
@@ -27,23 +28,23 @@ int ss_frame_handle_udp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
     rx_buf->data.sport = rte_bswap16(rx_buf->udp->uh_sport);
     rx_buf->data.dport = rte_bswap16(rx_buf->udp->uh_dport);
     
-    RTE_LOG(DEBUG, L3L4, "rx udp packet: sport: %hu dport: %hu length: %hu\n",
+    SS_LOG(DEBUG, L3L4, "rx udp packet: sport: %hu dport: %hu length: %hu\n",
         rx_buf->data.sport, rx_buf->data.dport, rx_buf->data.l4_length);
     
     switch (rx_buf->data.dport) {
         case L4_PORT_DNS: {
-            RTE_LOG(DEBUG, L3L4, "rx udp dns packet\n");
+            SS_LOG(DEBUG, L3L4, "rx udp dns packet\n");
             ss_extract_dns(rx_buf);
             break;
         }
         case L4_PORT_SYSLOG: {
-            RTE_LOG(DEBUG, L3L4, "rx udp syslog packet\n");
+            SS_LOG(DEBUG, L3L4, "rx udp syslog packet\n");
             SS_CHECK_SELF(rx_buf, 0);
             ss_udp_extract_syslog(rx_buf);
             break;
         }
         case L4_PORT_SFLOW: {
-            RTE_LOG(DEBUG, L3L4, "rx udp sFlow packet\n");
+            SS_LOG(DEBUG, L3L4, "rx udp sFlow packet\n");
             SS_CHECK_SELF(rx_buf, 0);
 
             rte_hexdump(stderr, "sflow_bytes", rte_pktmbuf_mtod(rx_buf->mbuf, uint8_t*), rte_pktmbuf_pkt_len(rx_buf->mbuf));
@@ -53,7 +54,7 @@ int ss_frame_handle_udp(ss_frame_t* rx_buf, ss_frame_t* tx_buf) {
         case L4_PORT_NETFLOW_1:
         case L4_PORT_NETFLOW_2:
         case L4_PORT_NETFLOW_3: {
-            RTE_LOG(DEBUG, L3L4, "rx udp NetFlow packet\n");
+            SS_LOG(DEBUG, L3L4, "rx udp NetFlow packet\n");
             SS_CHECK_SELF(rx_buf, 0);
             netflow_frame_handle(rx_buf);
             break;
@@ -76,7 +77,7 @@ int ss_udp_extract_syslog(ss_frame_t* fbuf) {
     // place a zero byte at the end of the log message to form a C string
     match_string = (uint8_t*) rte_pktmbuf_append(fbuf->mbuf, 1);
     if (match_string == NULL) {
-        RTE_LOG(ERR, EXTRACTOR, "could not append zero byte to syslog message\n");
+        SS_LOG(ERR, EXTRACTOR, "could not append zero byte to syslog message\n");
         return -1;
     }
     *match_string = 0;